@@ -67,6 +67,18 @@ int MetadataBackend::Remove(const TINumber dir_id,
 
 // Returns "0" if MDB get the file stat successfully,
 // otherwise "-ENOENT" when no file is found.
+static void StatToInfo(const struct stat &stbuf, int state, StatInfo *info) {
+  info->mode = stbuf.st_mode;
+  info->uid = stbuf.st_uid;
+  info->gid = stbuf.st_gid;
+  info->size = stbuf.st_size;
+  info->mtime = stbuf.st_mtime;
+  info->ctime = stbuf.st_ctime;
+  info->id = stbuf.st_ino;
+  info->zeroth_server = stbuf.st_dev;
+  info->is_embedded = (state == RPC_LEVELDB_FILE_IN_DB);
+}
+
 int MetadataBackend::Getattr(const TINumber dir_id,
                              const int partition_id,
                              const std::string &objname,
@@ -76,15 +88,34 @@ int MetadataBackend::Getattr(const TINumber dir_id,
   int ret = metadb_lookup(&mdb, dir_id, partition_id, objname.c_str(),
                           &stbuf, &state);
   if (ret == 0) {
-    info->mode = stbuf.st_mode;
-    info->uid = stbuf.st_uid;
-    info->gid = stbuf.st_gid;
-    info->size = stbuf.st_size;
-    info->mtime = stbuf.st_mtime;
-    info->ctime = stbuf.st_ctime;
-    info->id = stbuf.st_ino;
-    info->zeroth_server = stbuf.st_dev;
-    info->is_embedded = (state == RPC_LEVELDB_FILE_IN_DB);
+    StatToInfo(stbuf, state, info);
+  }
+  return ret;
+}
+
+int MetadataBackend::GetattrBatch(const TINumber dir_id,
+                                  const int partition_id,
+                                  const std::vector<std::string> &objnames,
+                                  std::vector<StatInfo> *infos,
+                                  std::vector<int> *rets) {
+  const int num = objnames.size();
+  infos->resize(num);
+  rets->resize(num);
+  if (num == 0) {
+    return 0;
+  }
+  std::vector<const char*> names(num);
+  for (int i = 0; i < num; i++) {
+    names[i] = objnames[i].c_str();
+  }
+  std::vector<struct stat> stbufs(num);
+  std::vector<int> states(num);
+  int ret = metadb_lookup_batch(&mdb, dir_id, partition_id, num, &names[0],
+                                &stbufs[0], &states[0], &(*rets)[0]);
+  for (int i = 0; i < num; i++) {
+    if ((*rets)[i] == 0) {
+      StatToInfo(stbufs[i], states[i], &(*infos)[i]);
+    }
   }
   return ret;
 }
@@ -116,7 +147,9 @@ int MetadataBackend::Readdir(const TINumber dir_id,
     entries->push_back(std::string(buf_ptr+sizeof(rec_len), rec_len));
     buf_ptr += sizeof(rec_len) + rec_len;
   }
-  end_key->insert(0, end_key_cstr, HASH_LEN);
+  if (*more_entries_flag) {
+    end_key->insert(0, end_key_cstr, HASH_LEN);
+  }
 
   return 0;
 }
@@ -158,7 +191,9 @@ int MetadataBackend::ReaddirPlus(const TINumber dir_id,
     free(buf_entries[i]);
     entries->push_back(info);
   }
-  end_key->insert(0, end_key_cstr, HASH_LEN);
+  if (*more_entries_flag) {
+    end_key->insert(0, end_key_cstr, HASH_LEN);
+  }
 
   return 0;
 }
@@ -266,6 +301,21 @@ int MetadataBackend::WriteLink(const TINumber dir_id, const int partition_id,
 }
 
 
+bool MetadataBackend::GetProperty(const std::string &property,
+                                  std::string *value) {
+  char* prop = metadb_get_property(&mdb, property.c_str());
+  if (prop == NULL) {
+    return false;
+  }
+  value->assign(prop);
+  free(prop);
+  return true;
+}
+
+void MetadataBackend::GetBlockCacheStats(uint64_t *lookups, uint64_t *hits) {
+  metadb_get_block_cache_stats(&mdb, lookups, hits);
+}
+
 TINumber MetadataBackend::NewInodeNumber() {
   return metadb_get_next_inode_count(&mdb);
 }
@@ -59,6 +59,15 @@ public:
               const std::string &objname,
               StatInfo *info);
 
+  // Getattr for several objects of one partition in a single batch.
+  // Sets (*rets)[i] to what Getattr would return for objnames[i].
+  // Returns "0" on success, otherwise "-1" if the batch hit an error.
+  int GetattrBatch(const TINumber dir_id,
+                   const int partition_id,
+                   const std::vector<std::string> &objnames,
+                   std::vector<StatInfo> *infos,
+                   std::vector<int> *rets);
+
   // Returns "0" if MDB get directory entries successfully,
   // otherwise "-ENOENT" when no file is found.
   int Readdir(const TINumber dir_id,
@@ -135,6 +144,12 @@ public:
   int WriteLink(const TINumber dir_id, const int partition_id,
                 const std::string &objname, const std::string &link);
 
+  // Returns true and sets *value to the LevelDB property "property",
+  // otherwise returns false if there is no such property.
+  bool GetProperty(const std::string &property, std::string *value);
+
+  void GetBlockCacheStats(uint64_t *lookups, uint64_t *hits);
+
   void Close() { metadb_close(&mdb); }
 
   TINumber NewInodeNumber();
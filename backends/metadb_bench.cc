@@ -0,0 +1,319 @@
+// Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Single-box micro benchmark for the metadb layer.  Drives metadb_*
+// calls from several threads against a private database and reports
+// aggregated throughput, bypassing RPC and the metadata server.
+//
+// Usage: metadb_bench <db_dir> [benchmarks] [num_threads] [ops_per_thread]
+//
+// where benchmarks is a comma-separated list of:
+//
+//   creates   each thread creates files in its own directory
+//   lookups   each thread stats the files made by "creates"
+//   batchlookups
+//             same as "lookups", but 64 files per metadb_lookup_batch()
+//   misses    each thread stats names that do not exist, which is the
+//             existence probe every create pays; it is answered by the
+//             bloom filters of every level
+//   hotscan   half of the threads stat the first tenth of the files in
+//             their directory at random, while the other half keep
+//             listing their own directories; reports the block cache
+//             hit rate of the stats, which the scan-resistant cache
+//             keeps up (tables are mmapped, and never cached, only when
+//             built with -DDEFAULT_MMAP_TABLES=1)
+//   chmods    each thread changes the mode of the files made by "creates"
+//   readdirs  each thread lists the directory made by "creates" once;
+//             ops are directory entries
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <string>
+
+extern "C" {
+#include "common/debugging.h"
+#include "operations.h"
+}
+
+namespace {
+
+// State shared by the threads of one benchmark run.
+struct SharedState {
+  pthread_mutex_t mu;
+  int num_threads;
+  int num_lookup_threads;   // "hotscan" lookup threads still running
+};
+
+struct BenchState {
+  struct MetaDB* mdb;
+  SharedState* shared;
+  int thread_id;
+  int num_ops;
+  int num_errors;
+};
+
+typedef void* (*BenchFunc)(void*);
+
+uint64_t NowMicros() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+// User plus system CPU time consumed by the whole process, including
+// background compaction threads.
+uint64_t CpuMicros() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return static_cast<uint64_t>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)
+      * 1000000 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+void* DoCreates(void* arg) {
+  BenchState* state = reinterpret_cast<BenchState*>(arg);
+  char name[64];
+  for (int i = 0; i < state->num_ops; i++) {
+    snprintf(name, sizeof(name), "f%d", i);
+    if (metadb_create(state->mdb, state->thread_id + 1, 0, name, "") != 0) {
+      state->num_errors++;
+    }
+  }
+  return NULL;
+}
+
+void* DoLookups(void* arg) {
+  BenchState* state = reinterpret_cast<BenchState*>(arg);
+  char name[64];
+  struct stat statbuf;
+  int obj_state;
+  for (int i = 0; i < state->num_ops; i++) {
+    snprintf(name, sizeof(name), "f%d", i);
+    if (metadb_lookup(state->mdb, state->thread_id + 1, 0, name,
+                      &statbuf, &obj_state) != 0) {
+      state->num_errors++;
+    }
+  }
+  return NULL;
+}
+
+void* DoBatchLookups(void* arg) {
+  static const int kBatchSize = 64;
+  BenchState* state = reinterpret_cast<BenchState*>(arg);
+  char names[kBatchSize][64];
+  const char* name_ptrs[kBatchSize];
+  struct stat statbufs[kBatchSize];
+  int obj_states[kBatchSize];
+  int rets[kBatchSize];
+  for (int i = 0; i < state->num_ops; i += kBatchSize) {
+    int n = state->num_ops - i < kBatchSize ? state->num_ops - i : kBatchSize;
+    for (int j = 0; j < n; j++) {
+      snprintf(names[j], sizeof(names[j]), "f%d", i + j);
+      name_ptrs[j] = names[j];
+    }
+    if (metadb_lookup_batch(state->mdb, state->thread_id + 1, 0, n,
+                            name_ptrs, statbufs, obj_states, rets) != 0) {
+      state->num_errors += n;
+      continue;
+    }
+    for (int j = 0; j < n; j++) {
+      if (rets[j] != 0) {
+        state->num_errors++;
+      }
+    }
+  }
+  return NULL;
+}
+
+void* DoChmods(void* arg) {
+  BenchState* state = reinterpret_cast<BenchState*>(arg);
+  char name[64];
+  for (int i = 0; i < state->num_ops; i++) {
+    snprintf(name, sizeof(name), "f%d", i);
+    if (metadb_chmod(state->mdb, state->thread_id + 1, 0, name,
+                     (i & 1) ? 0644 : 0600) != 0) {
+      state->num_errors++;
+    }
+  }
+  return NULL;
+}
+
+void* DoMisses(void* arg) {
+  BenchState* state = reinterpret_cast<BenchState*>(arg);
+  char name[64];
+  struct stat statbuf;
+  int obj_state;
+  for (int i = 0; i < state->num_ops; i++) {
+    snprintf(name, sizeof(name), "m%d", i);
+    if (metadb_lookup(state->mdb, state->thread_id + 1, 0, name,
+                      &statbuf, &obj_state) == 0) {
+      state->num_errors++;
+    }
+  }
+  return NULL;
+}
+
+// List directory "dir_id" from start to end; returns the entry count.
+int ListDirectory(struct MetaDB* mdb, metadb_inode_t dir_id) {
+  static const size_t kBufferSize = 64 << 10;
+  char* buf = new char[kBufferSize];
+  char end_key[HASH_LEN];
+  int partition_id = -1;
+  unsigned char more_entries = 1;
+  int total = 0;
+  const char* start_key = NULL;
+  while (more_entries) {
+    int num_entries = 0;
+    if (metadb_readdir(mdb, dir_id, &partition_id, start_key, buf,
+                       kBufferSize, &num_entries, end_key,
+                       &more_entries) != 0) {
+      break;
+    }
+    total += num_entries;
+    start_key = end_key;
+  }
+  delete [] buf;
+  return total;
+}
+
+void* DoReaddirs(void* arg) {
+  BenchState* state = reinterpret_cast<BenchState*>(arg);
+  int n = ListDirectory(state->mdb, state->thread_id + 1);
+  state->num_errors += n > state->num_ops ? n - state->num_ops
+                                          : state->num_ops - n;
+  return NULL;
+}
+
+void* DoHotScan(void* arg) {
+  BenchState* state = reinterpret_cast<BenchState*>(arg);
+  SharedState* shared = state->shared;
+  const int half = shared->num_threads / 2;
+  if (state->thread_id < half) {
+    // Scanner: keep listing its own directory until all the lookup
+    // threads are done
+    while (true) {
+      pthread_mutex_lock(&shared->mu);
+      bool done = shared->num_lookup_threads == 0;
+      pthread_mutex_unlock(&shared->mu);
+      if (done) break;
+      ListDirectory(state->mdb, state->thread_id + 1);
+    }
+  } else {
+    char name[64];
+    struct stat statbuf;
+    int obj_state;
+    unsigned int seed = state->thread_id;
+    int hot = state->num_ops / 10 > 0 ? state->num_ops / 10 : 1;
+    for (int i = 0; i < state->num_ops; i++) {
+      snprintf(name, sizeof(name), "f%d", rand_r(&seed) % hot);
+      if (metadb_lookup(state->mdb, state->thread_id + 1, 0, name,
+                        &statbuf, &obj_state) != 0) {
+        state->num_errors++;
+      }
+    }
+    pthread_mutex_lock(&shared->mu);
+    shared->num_lookup_threads--;
+    pthread_mutex_unlock(&shared->mu);
+  }
+  return NULL;
+}
+
+void RunBenchmark(struct MetaDB* mdb, const char* name, BenchFunc func,
+                  int num_threads, int num_ops) {
+  pthread_t* threads = new pthread_t[num_threads];
+  BenchState* states = new BenchState[num_threads];
+  SharedState shared;
+  pthread_mutex_init(&shared.mu, NULL);
+  shared.num_threads = num_threads;
+  shared.num_lookup_threads = num_threads - num_threads / 2;
+  uint64_t lookups_start, hits_start;
+  leveldb_cache_get_lookup_stats(mdb->cache, &lookups_start, &hits_start);
+  uint64_t start = NowMicros();
+  uint64_t cpu_start = CpuMicros();
+  for (int i = 0; i < num_threads; i++) {
+    states[i].mdb = mdb;
+    states[i].shared = &shared;
+    states[i].thread_id = i;
+    states[i].num_ops = num_ops;
+    states[i].num_errors = 0;
+    pthread_create(&threads[i], NULL, func, &states[i]);
+  }
+  int num_errors = 0;
+  for (int i = 0; i < num_threads; i++) {
+    pthread_join(threads[i], NULL);
+    num_errors += states[i].num_errors;
+  }
+  double seconds = (NowMicros() - start) / 1000000.0;
+  double cpu_micros = static_cast<double>(CpuMicros() - cpu_start);
+  double total_ops = static_cast<double>(num_threads) * num_ops;
+  fprintf(stdout, "%-12s : %d threads, %.0f ops, %.3f s, %.0f ops/s,"
+          " %.2f cpu us/op, %d errors\n", name, num_threads, total_ops,
+          seconds, total_ops / seconds, cpu_micros / total_ops, num_errors);
+  uint64_t lookups, hits;
+  leveldb_cache_get_lookup_stats(mdb->cache, &lookups, &hits);
+  if (lookups > lookups_start) {
+    fprintf(stdout, "%-12s : block cache hit rate %.2f%% (%llu lookups)\n",
+            name, 100.0 * (hits - hits_start) / (lookups - lookups_start),
+            static_cast<unsigned long long>(lookups - lookups_start));
+  }
+  pthread_mutex_destroy(&shared.mu);
+  delete [] states;
+  delete [] threads;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <db_dir> [benchmarks] [num_threads]"
+            " [ops_per_thread]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  std::string benchmarks = argc > 2 ? argv[2] : "creates";
+  int num_threads = argc > 3 ? atoi(argv[3]) : 16;
+  int num_ops = argc > 4 ? atoi(argv[4]) : 100000;
+
+  giga_logopen(LOG_ERR);
+  struct MetaDB mdb;
+  if (metadb_init(&mdb, argv[1], NULL, 0, 0) < 0) {
+    fprintf(stderr, "cannot open metadb at %s\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+  size_t start = 0;
+  while (start <= benchmarks.size()) {
+    size_t end = benchmarks.find(',', start);
+    if (end == std::string::npos) {
+      end = benchmarks.size();
+    }
+    std::string name = benchmarks.substr(start, end - start);
+    start = end + 1;
+
+    BenchFunc func = NULL;
+    if (name == "creates") {
+      func = DoCreates;
+    } else if (name == "lookups") {
+      func = DoLookups;
+    } else if (name == "batchlookups") {
+      func = DoBatchLookups;
+    } else if (name == "misses") {
+      func = DoMisses;
+    } else if (name == "hotscan") {
+      func = DoHotScan;
+    } else if (name == "chmods") {
+      func = DoChmods;
+    } else if (name == "readdirs") {
+      func = DoReaddirs;
+    }
+    if (func != NULL) {
+      RunBenchmark(&mdb, name.c_str(), func, num_threads, num_ops);
+    } else if (!name.empty()) {
+      fprintf(stderr, "unknown benchmark: %s\n", name.c_str());
+    }
+  }
+  metadb_close(&mdb);
+  return 0;
+}
@@ -2,6 +2,7 @@
 #include "common/debugging.h"
 #include "common/options.h"
 #include "operations.h"
+#include "util/trace_c.h"
 
 #include <time.h>
 #include <errno.h>
@@ -15,7 +16,9 @@
 
 #define DEFAULT_ZERO_FACTOR        10.0
 #define DEFAULT_LEVEL_FACTOR       10.0
+#ifndef DEFAULT_LEVELDB_CACHE_SIZE
 #define DEFAULT_LEVELDB_CACHE_SIZE (512 << 20)
+#endif
 #define DEFAULT_WRITE_BUFFER_SIZE  (32 << 20)
 #define DEFAULT_MAX_OPEN_FILES     1024
 #define DEFAULT_MAX_BATCH_SIZE     1024
@@ -24,9 +27,36 @@
 #define DEFAULT_PVFS_BUFFER_SIZE   4096
 #define DEFAULT_METRIC_SAMPLING_INTERVAL 1
 #define DEFAULT_SYNC_INTERVAL      5
+#ifndef DEFAULT_USE_COLUMNDB
 #define DEFAULT_USE_COLUMNDB       0
+#endif
+#ifndef DEFAULT_USE_IO_URING
+#define DEFAULT_USE_IO_URING       0 // Falls back if the kernel lacks it
+#endif
+#define DEFAULT_VALUE_GC_INTERVAL  60 // Seconds; only used by ColumnDB
+#define DEFAULT_BLOOM_LEVELS       7
+#define DEFAULT_READAHEAD_BLOCKS   16 // For readdir and extract scans
+#ifndef DEFAULT_PREFETCH_VALUES
+#define DEFAULT_PREFETCH_VALUES    0 // ColumnDB value prefetch in scans
+#endif
+#ifndef DEFAULT_MMAP_TABLES
+#define DEFAULT_MMAP_TABLES        0 // Mapped blocks bypass the block cache
+#endif
 #define DEFAULT_METADB_LOG_FILE "/tmp/metadb.log" // Default metadb log file location
 #define MAX_FILENAME_LEN 1024
+
+/* Wait and hold times of mtx_leveldb, in LOCK_PROFILING builds */
+#ifdef LOCK_PROFILING
+#define LOCK_PROFILE_NOW() leveldb_lock_profile_now_nanos()
+#define LOCK_PROFILE_RECORD(lock_class, start, acquired)          \
+  leveldb_lock_profile_record(lock_class, 0, (acquired) - (start), \
+                              leveldb_lock_profile_now_nanos() - (acquired))
+#else
+#define LOCK_PROFILE_NOW() 0
+#define LOCK_PROFILE_RECORD(lock_class, start, acquired) \
+  ((void) (start), (void) (acquired))
+#endif
+
 #define METADB_KEY_LEN (sizeof(metadb_key_t))
 #define METADB_INTERNAL_KEY_LEN (sizeof(metadb_key_t)+8)
 
@@ -38,6 +68,24 @@
 
 static struct stat INIT_STATBUF;
 
+/* Bloom filter bits per key for each LSM level.  Most negative lookups,
+ * such as the existence check done by every create, fall through to the
+ * deepest levels, so those get the most bits. */
+static const int bloom_bits_per_level[DEFAULT_BLOOM_LEVELS] = {
+    10, 10, 12, 12, 14, 16, 16
+};
+
+/* Env for a metadb kept on the local file system. */
+static
+leveldb_env_t* metadb_create_local_env()
+{
+#if DEFAULT_USE_IO_URING
+    return leveldb_create_io_uring_env();
+#else
+    return leveldb_create_default_env();
+#endif
+}
+
 static
 void init_meta_obj_key(metadb_key_t *mkey,
                        metadb_inode_t dir_id,
@@ -200,6 +248,100 @@ void free_metadb_val(metadb_val_t* mobj_val) {
     }
 }
 
+/*
+ * Point lookups hand one of the visitors below to
+ * leveldb_get_with_visitor(), which calls it with the stored value still
+ * in the memtable or block cache.  Values there need not be aligned, so
+ * the header is copied out before its fields are read.  Visitors return
+ * -1 if the value is too short for what its header announces.
+ */
+static
+int copy_val_header(const char* value, size_t vallen,
+                    metadb_val_header_t* mobj)
+{
+    if (vallen < sizeof(metadb_val_header_t)) {
+        memset(mobj, 0, sizeof(metadb_val_header_t));
+        return -1;
+    }
+    memcpy(mobj, value, sizeof(metadb_val_header_t));
+    /* Both names are followed by a NUL */
+    size_t rest = vallen - sizeof(metadb_val_header_t);
+    if (mobj->objname_len >= rest ||
+        mobj->realpath_len >= rest - mobj->objname_len - 1) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Size of the header and names of a value whose header is "mobj" */
+static
+size_t val_header_size(const metadb_val_header_t* mobj)
+{
+    return sizeof(metadb_val_header_t) +
+           mobj->objname_len + mobj->realpath_len + 2;
+}
+
+/* Copy the whole value into a malloc()ed metadb_val_t */
+static
+void copy_val_visitor(void* arg, const char* value, size_t vallen)
+{
+    metadb_val_t* mobj_val = (metadb_val_t*) arg;
+    mobj_val->value = (char*) malloc(vallen);
+    memcpy(mobj_val->value, value, vallen);
+    mobj_val->size = vallen;
+}
+
+typedef int (*metadb_visitor_t)(void* arg, const char* value, size_t vallen);
+
+typedef struct {
+    metadb_visitor_t visitor;
+    void* arg;
+    int ret;
+} metadb_visit_t;
+
+static
+void visit_value(void* arg, const char* value, size_t vallen)
+{
+    metadb_visit_t* visit = (metadb_visit_t*) arg;
+    visit->ret = visit->visitor(visit->arg, value, vallen);
+}
+
+static
+int metadb_visit(struct MetaDB *mdb,
+                 const metadb_inode_t dir_id,
+                 const int partition_id,
+                 const char *path,
+                 metadb_visitor_t visitor,
+                 void* arg)
+{
+    metadb_key_t mobj_key;
+    metadb_visit_t visit;
+    char* err = NULL;
+
+    init_meta_obj_key(&mobj_key, dir_id, partition_id, path);
+    visit.visitor = visitor;
+    visit.arg = arg;
+    visit.ret = 0;
+    unsigned char found =
+        leveldb_get_with_visitor(mdb->db, mdb->lookup_options,
+                                 (const char*) &mobj_key, METADB_KEY_LEN,
+                                 visit_value, &visit, &err);
+    if (err != NULL) {
+        logMessage(METADB_LOG, __func__,
+               "visit(%s) in (partition=%d,dirid=%ld) failed: (%s)",
+               path, partition_id, dir_id, err);
+        free(err);
+        return -1;
+    }
+    if (found && visit.ret != 0) {
+        logMessage(LOG_ERR, __func__,
+               "visit(%s) in (partition=%d,dirid=%ld): malformed value",
+               path, partition_id, dir_id);
+        return -1;
+    }
+    return found ? 0 : ENOENT;
+}
+
 static void CmpDestroy(void* arg) { if (arg != NULL) {} }
 
 static int CmpCompare(void* arg, const char* a, size_t alen,
@@ -224,6 +366,61 @@ static const char* CmpName(void* arg) {
     return "foo";
 }
 
+/*
+ * chmod, setattr, bitmap updates and writes of embedded data are blind
+ * writes: instead of reading the object, changing it and writing it
+ * back, they store a merge operand naming the change.  leveldb applies
+ * the operands to the object on reads and folds them into it during
+ * compaction.  An operand is one byte of metadb_merge_op_t followed by
+ * the argument of the update.
+ */
+typedef enum {
+    METADB_MERGE_CHMOD = 1,    /* mode_t */
+    METADB_MERGE_SETATTR = 2,  /* struct stat */
+    METADB_MERGE_BITMAP = 3,   /* struct giga_mapping_t */
+    METADB_MERGE_WRITE = 4     /* int offset, int length, data */
+} metadb_merge_op_t;
+
+static int apply_merge_operand(metadb_val_t* mobj_val,
+                               const char* operand, size_t operand_len);
+
+static void MergeDestroy(void* arg) { if (arg != NULL) {} }
+
+static const char* MergeName(void* arg) {
+    if (arg != NULL) {
+      return "wrong";
+    }
+    return "metadb.UpdateMerge";
+}
+
+static char* MergeFull(void* arg, const char* key, size_t key_len,
+                       const char* existing_value, size_t existing_len,
+                       const char* const* operands,
+                       const size_t* operands_len, int num_operands,
+                       unsigned char* success, size_t* new_len) {
+    metadb_val_t mobj_val;
+    int i;
+
+    *success = 0;
+    if (existing_value == NULL ||
+        existing_len < sizeof(metadb_val_header_t)) {
+        /* Operands without a value are dropped before they get here */
+        return NULL;
+    }
+    mobj_val.size = existing_len;
+    mobj_val.value = (char*) malloc(existing_len);
+    memcpy(mobj_val.value, existing_value, existing_len);
+    for (i = 0; i < num_operands; i++) {
+        if (apply_merge_operand(&mobj_val, operands[i], operands_len[i]) < 0) {
+            free_metadb_val(&mobj_val);
+            return NULL;
+        }
+    }
+    *success = 1;
+    *new_len = mobj_val.size;
+    return mobj_val.value;
+}
+
 int metric_thread_errors;
 
 void* metric_thread(void *unused) {
@@ -312,12 +509,6 @@ void metadb_log_destroy() {
     metric_thread_errors = 100;
 }
 
-volatile int stop_sync_thread;
-volatile int flag_sync_thread_finish;
-static pthread_mutex_t  mtx_sync;
-static pthread_cond_t   cv_sync;
-
-
 void* sync_thread(void *v) {
     struct MetaDB* mdb = (struct MetaDB*) v;
 
@@ -326,32 +517,32 @@ void* sync_thread(void *v) {
     struct timeval now;
     char* err;
 
-    pthread_mutex_lock(&(mtx_sync));
-    while (stop_sync_thread == 0) {
+    pthread_mutex_lock(&(mdb->mtx_sync));
+    while (mdb->stop_sync_thread == 0) {
         gettimeofday(&now, NULL);
         wait.tv_sec = now.tv_sec + DEFAULT_SYNC_INTERVAL;
-        int ret = pthread_cond_timedwait(&(cv_sync), &(mtx_sync), &wait);
+        int ret = pthread_cond_timedwait(&(mdb->cv_sync), &(mdb->mtx_sync), &wait);
         if (ret == ETIMEDOUT) {
           metadb_save_inode_count(mdb, &err);
         } else {
-          if (stop_sync_thread == 0) {
+          if (mdb->stop_sync_thread == 0) {
             fprintf(stderr, "Unexpected interrupt for sync thread\n");
-            stop_sync_thread = 1;
+            mdb->stop_sync_thread = 1;
           }
         }
     }
-    flag_sync_thread_finish = 1;
-    pthread_cond_broadcast(&(cv_sync));
-    pthread_mutex_unlock(&(mtx_sync));
+    mdb->flag_sync_thread_finish = 1;
+    pthread_cond_broadcast(&(mdb->cv_sync));
+    pthread_mutex_unlock(&(mdb->mtx_sync));
 
     return NULL;
 }
 
 void metadb_sync_init(struct MetaDB *mdb) {
-    stop_sync_thread = 0;
-    flag_sync_thread_finish = 0;
-    pthread_mutex_init(&(mtx_sync), NULL);
-    pthread_cond_init(&(cv_sync), NULL);
+    mdb->stop_sync_thread = 0;
+    mdb->flag_sync_thread_finish = 0;
+    pthread_mutex_init(&(mdb->mtx_sync), NULL);
+    pthread_cond_init(&(mdb->cv_sync), NULL);
 
     int ret;
     pthread_t tid;
@@ -367,23 +558,32 @@ void metadb_sync_init(struct MetaDB *mdb) {
     }
 }
 
-void metadb_sync_destroy() {
-  pthread_mutex_lock(&(mtx_sync));
-  stop_sync_thread = 1;
-  pthread_cond_signal(&(cv_sync));
-  while (flag_sync_thread_finish == 0) {
-    pthread_cond_wait(&(cv_sync), &(mtx_sync));
+void metadb_sync_destroy(struct MetaDB *mdb) {
+  pthread_mutex_lock(&(mdb->mtx_sync));
+  mdb->stop_sync_thread = 1;
+  pthread_cond_signal(&(mdb->cv_sync));
+  while (mdb->flag_sync_thread_finish == 0) {
+    pthread_cond_wait(&(mdb->cv_sync), &(mdb->mtx_sync));
   }
-  pthread_mutex_unlock(&(mtx_sync));
+  pthread_mutex_unlock(&(mdb->mtx_sync));
 
-  pthread_mutex_destroy(&(mtx_sync));
-  pthread_cond_destroy(&(cv_sync));
+  pthread_mutex_destroy(&(mdb->mtx_sync));
+  pthread_cond_destroy(&(mdb->cv_sync));
 }
 
 char* metadb_get_metric(struct MetaDB *mdb) {
   return leveldb_property_value(mdb->db, "leveldb.stats");
 }
 
+char* metadb_get_property(struct MetaDB *mdb, const char* property) {
+  return leveldb_property_value(mdb->db, property);
+}
+
+void metadb_get_block_cache_stats(struct MetaDB *mdb,
+                                  uint64_t *lookups, uint64_t *hits) {
+  leveldb_cache_get_lookup_stats(mdb->cache, lookups, hits);
+}
+
 // Returns "0" if a new LDB is created successfully, "1" if an existing LDB is
 // opened successfully, and "-1" on error.
 int metadb_init(struct MetaDB *mdb, const char *mdb_name,
@@ -400,7 +600,7 @@ int metadb_init(struct MetaDB *mdb, const char *mdb_name,
       leveldb_options_set_use_rename(mdb->options, 1);
       mdb->use_hdfs = 1;
 #else
-      mdb->env = leveldb_create_default_env();
+      mdb->env = metadb_create_local_env();
       leveldb_options_set_use_rename(mdb->options, 0);
       mdb->use_hdfs = 0;
 #endif
@@ -410,22 +610,30 @@ int metadb_init(struct MetaDB *mdb, const char *mdb_name,
       leveldb_options_set_use_rename(mdb->options, 1);
       mdb->use_hdfs = 1;
 #else
-      mdb->env = leveldb_create_default_env();
+      mdb->env = metadb_create_local_env();
       leveldb_options_set_use_rename(mdb->options, 0);
       mdb->use_hdfs = 0;
 #endif
     }
 #else
-    mdb->env = leveldb_create_default_env();
+    mdb->env = metadb_create_local_env();
     leveldb_options_set_use_rename(mdb->options, 0);
     mdb->use_hdfs = 0;
 #endif
     mdb->server_id = server_id;
+    /* Tables are read with pread() rather than mapped, unless
+     * DEFAULT_MMAP_TABLES is set, so that their blocks enter this cache
+     * and its scan resistance keeps hot blocks under long listings. */
     mdb->cache = leveldb_cache_create_lru(DEFAULT_LEVELDB_CACHE_SIZE);
     mdb->cmp = leveldb_comparator_create(NULL, CmpDestroy, CmpCompare, CmpName);
+    mdb->merge_op = leveldb_mergeoperator_create(NULL, MergeDestroy,
+                                                 MergeFull, MergeName);
+    leveldb_mergeoperator_set_drop_operands_without_value(mdb->merge_op, 1);
 
     leveldb_options_set_comparator(mdb->options, mdb->cmp);
+    leveldb_options_set_merge_operator(mdb->options, mdb->merge_op);
     leveldb_options_set_cache(mdb->options, mdb->cache);
+    leveldb_options_set_allow_mmap_reads(mdb->options, DEFAULT_MMAP_TABLES);
     leveldb_options_set_env(mdb->options, mdb->env);
     leveldb_options_set_create_if_missing(mdb->options, 0);
     leveldb_options_set_info_log(mdb->options, NULL);
@@ -436,18 +644,29 @@ int metadb_init(struct MetaDB *mdb, const char *mdb_name,
     leveldb_options_set_level_zero_factor(mdb->options, DEFAULT_ZERO_FACTOR);
     leveldb_options_set_level_factor(mdb->options, DEFAULT_LEVEL_FACTOR);
     leveldb_options_set_block_size(mdb->options, DEFAULT_BLOCK_SIZE);
+    leveldb_options_set_block_format(mdb->options,
+                                     leveldb_fixed_key_delta_block);
     //leveldb_options_disable_compaction(mdb->options);
     leveldb_options_set_compression(mdb->options, leveldb_no_compression);
     leveldb_options_set_server_id(mdb->options, server_id);
+    leveldb_options_set_allow_concurrent_memtable_write(mdb->options, 1);
+    leveldb_options_set_value_gc_interval(mdb->options,
+                                          DEFAULT_VALUE_GC_INTERVAL);
 
     leveldb_options_set_filter_policy(mdb->options,
-                        leveldb_filterpolicy_create_bloom(14));
+        leveldb_filterpolicy_create_blocked_bloom_per_level(
+            bloom_bits_per_level, DEFAULT_BLOOM_LEVELS));
 
     mdb->lookup_options = leveldb_readoptions_create();
     leveldb_readoptions_set_fill_cache(mdb->lookup_options, 1);
 
     mdb->scan_options = leveldb_readoptions_create();
     leveldb_readoptions_set_fill_cache(mdb->scan_options, 1);
+    leveldb_readoptions_set_scan_hint(mdb->scan_options, 1);
+    leveldb_readoptions_set_readahead_blocks(mdb->scan_options,
+                                             DEFAULT_READAHEAD_BLOCKS);
+    leveldb_readoptions_set_prefetch_values(mdb->scan_options,
+                                            DEFAULT_PREFETCH_VALUES);
 
     mdb->insert_options = leveldb_writeoptions_create();
     leveldb_writeoptions_set_sync(mdb->insert_options, 0);
@@ -527,7 +746,7 @@ int metadb_readonly_init(struct MetaDB *mdb, const char *mdb_name,
       mdb->env = leveldb_create_hdfs_env(hdfsServerIP, hdfsServerPort);
       mdb->use_hdfs = 1;
 #else
-      mdb->env = leveldb_create_default_env();
+      mdb->env = metadb_create_local_env();
       mdb->use_hdfs = 0;
 #endif
 
@@ -537,21 +756,25 @@ int metadb_readonly_init(struct MetaDB *mdb, const char *mdb_name,
       leveldb_options_set_use_rename(mdb->options, 1);
       mdb->use_hdfs = 1;
 #else
-      mdb->env = leveldb_create_default_env();
+      mdb->env = metadb_create_local_env();
       mdb->use_hdfs = 0;
 #endif
     }
 #else
-    mdb->env = leveldb_create_default_env();
+    mdb->env = metadb_create_local_env();
     mdb->use_hdfs = 0;
 #endif
   mdb->server_id = -1; // use-less
 
   mdb->cache = leveldb_cache_create_lru(0); // NO LRU Cache
   mdb->cmp = leveldb_comparator_create(NULL, CmpDestroy, CmpCompare, CmpName);
+  mdb->merge_op = leveldb_mergeoperator_create(NULL, MergeDestroy,
+                                               MergeFull, MergeName);
+  leveldb_mergeoperator_set_drop_operands_without_value(mdb->merge_op, 1);
 
   mdb->options = leveldb_options_create();
   leveldb_options_set_comparator(mdb->options, mdb->cmp);
+  leveldb_options_set_merge_operator(mdb->options, mdb->merge_op);
   leveldb_options_set_cache(mdb->options, mdb->cache);
   leveldb_options_set_env(mdb->options, mdb->env);
   leveldb_options_set_create_if_missing(mdb->options, 0); // NO
@@ -568,6 +791,10 @@ int metadb_readonly_init(struct MetaDB *mdb, const char *mdb_name,
 
   mdb->scan_options = leveldb_readoptions_create();
   leveldb_readoptions_set_fill_cache(mdb->scan_options, 0); // NO
+  leveldb_readoptions_set_readahead_blocks(mdb->scan_options,
+                                           DEFAULT_READAHEAD_BLOCKS);
+  leveldb_readoptions_set_prefetch_values(mdb->scan_options,
+                                          DEFAULT_PREFETCH_VALUES);
 
   mdb->insert_options = leveldb_writeoptions_create();
   leveldb_writeoptions_set_sync(mdb->insert_options, 0);
@@ -606,21 +833,26 @@ int metadb_cliside_init(struct MetaDB *mdb, const char *mdb_name,
       mdb->env = leveldb_create_hdfs_env(hdfsServerIP, hdfsServerPort);
       mdb->use_hdfs = 1;
     } else {
-      mdb->env = leveldb_create_default_env();
+      mdb->env = metadb_create_local_env();
       mdb->use_hdfs = 0;
     }
 #else
-    mdb->env = leveldb_create_default_env();
+    mdb->env = metadb_create_local_env();
     mdb->use_hdfs = 0;
 #endif
     mdb->server_id = -1; // undefined for client-slide meta DB.
 
     mdb->cache = leveldb_cache_create_lru(DEFAULT_LEVELDB_CACHE_SIZE);
     mdb->cmp = leveldb_comparator_create(NULL, CmpDestroy, CmpCompare, CmpName);
+    mdb->merge_op = leveldb_mergeoperator_create(NULL, MergeDestroy,
+                                                 MergeFull, MergeName);
+    leveldb_mergeoperator_set_drop_operands_without_value(mdb->merge_op, 1);
 
     mdb->options = leveldb_options_create();
     leveldb_options_set_comparator(mdb->options, mdb->cmp);
+    leveldb_options_set_merge_operator(mdb->options, mdb->merge_op);
     leveldb_options_set_cache(mdb->options, mdb->cache);
+    leveldb_options_set_allow_mmap_reads(mdb->options, DEFAULT_MMAP_TABLES);
     leveldb_options_set_env(mdb->options, mdb->env);
     leveldb_options_set_create_if_missing(mdb->options, 1); // YES
     leveldb_options_set_error_if_exists(mdb->options, 1); // YES
@@ -629,6 +861,8 @@ int metadb_cliside_init(struct MetaDB *mdb, const char *mdb_name,
                                           DEFAULT_WRITE_BUFFER_SIZE);
     leveldb_options_set_max_open_files(mdb->options, DEFAULT_MAX_OPEN_FILES);
     leveldb_options_set_block_size(mdb->options, DEFAULT_BLOCK_SIZE);
+    leveldb_options_set_block_format(mdb->options,
+                                     leveldb_fixed_key_delta_block);
     leveldb_options_set_compression(mdb->options, leveldb_no_compression);
 
     mdb->lookup_options = leveldb_readoptions_create();
@@ -636,6 +870,10 @@ int metadb_cliside_init(struct MetaDB *mdb, const char *mdb_name,
 
     mdb->scan_options = leveldb_readoptions_create();
     leveldb_readoptions_set_fill_cache(mdb->scan_options, 1);
+    leveldb_readoptions_set_readahead_blocks(mdb->scan_options,
+                                             DEFAULT_READAHEAD_BLOCKS);
+    leveldb_readoptions_set_prefetch_values(mdb->scan_options,
+                                            DEFAULT_PREFETCH_VALUES);
 
     mdb->insert_options = leveldb_writeoptions_create();
     leveldb_writeoptions_set_sync(mdb->insert_options, 0);
@@ -664,10 +902,12 @@ int metadb_cliside_init(struct MetaDB *mdb, const char *mdb_name,
 
 int metadb_close(struct MetaDB *mdb) {
 //    metadb_log_destroy();
-    metadb_sync_destroy();
+    metadb_sync_destroy(mdb);
 
     leveldb_close(mdb->db);
     mdb->db = NULL;
+    leveldb_mergeoperator_destroy(mdb->merge_op);
+    mdb->merge_op = NULL;
     leveldb_options_destroy(mdb->options);
     leveldb_cache_destroy(mdb->cache);
     leveldb_env_destroy(mdb->env);
@@ -689,6 +929,8 @@ int metadb_close(struct MetaDB *mdb) {
 int metadb_readonly_close(struct MetaDB *mdb) {
     leveldb_close(mdb->db);
     mdb->db = NULL;
+    leveldb_mergeoperator_destroy(mdb->merge_op);
+    mdb->merge_op = NULL;
 
     leveldb_options_destroy(mdb->options);
     leveldb_cache_destroy(mdb->cache);
@@ -713,6 +955,8 @@ int metadb_readonly_close(struct MetaDB *mdb) {
 int metadb_cliside_close(struct MetaDB *mdb) {
     leveldb_close(mdb->db);
     mdb->db = NULL;
+    leveldb_mergeoperator_destroy(mdb->merge_op);
+    mdb->merge_op = NULL;
 
     leveldb_options_destroy(mdb->options);
     leveldb_cache_destroy(mdb->cache);
@@ -747,17 +991,21 @@ int metadb_create(struct MetaDB *mdb,
 
     //ACQUIRE_RWLOCK_READ(&(mdb->rwlock_extract), "metadb_create(%s)", path);
 
+    uint64_t span_start = trace_start();
     int exists = leveldb_exists(mdb->db, mdb->lookup_options,
                                  (const char*) &mobj_key, METADB_KEY_LEN, &err);
+    trace_record("leveldb_exists", span_start);
 
     if (!exists) {
         mobj_val = init_meta_val(NULL,
                                  strlen(path), path,
                                  strlen(realpath), realpath,
                                  0, NULL);
+        span_start = trace_start();
         leveldb_put(mdb->db, mdb->insert_options,
                 (const char*) &mobj_key, METADB_KEY_LEN,
                 mobj_val.value, mobj_val.size, &err);
+        trace_record("leveldb_put", span_start);
     }
 
     //RELEASE_RWLOCK(&(mdb->rwlock_extract), "metadb_create(%s)", path);
@@ -787,8 +1035,10 @@ int metadb_create_dir(struct MetaDB *mdb,
                "create_dir(%s) in (partition=%d,dirid=%d): (%d, %08x)",
                path, partition_id, dir_id, mobj_val.size, mobj_val.value);
 
+    uint64_t span_start = trace_start();
     int exists = leveldb_exists(mdb->db, mdb->lookup_options,
                                  (const char*) &mobj_key, METADB_KEY_LEN, &err);
+    trace_record("leveldb_exists", span_start);
 
     if (!exists) {
         if (path != NULL) {
@@ -798,9 +1048,11 @@ int metadb_create_dir(struct MetaDB *mdb,
             mobj_val = init_dir_val(inode_id, 0, NULL, server_id, dir_mapping);
         }
 
+        span_start = trace_start();
         leveldb_put(mdb->db, mdb->insert_options,
                 (const char*) &mobj_key, METADB_KEY_LEN,
                 mobj_val.value, mobj_val.size, &err);
+        trace_record("leveldb_put", span_start);
     }
 
     free_metadb_val(&mobj_val);
@@ -828,8 +1080,10 @@ int metadb_create_entry(struct MetaDB *mdb,
                "create_dir(%s) in (partition=%d,dirid=%d): (%d, %08x)",
                path, partition_id, dir_id, mobj_val.size, mobj_val.value);
 
+    uint64_t span_start = trace_start();
     int exists = leveldb_exists(mdb->db, mdb->lookup_options,
                                  (const char*) &mobj_key, METADB_KEY_LEN, &err);
+    trace_record("leveldb_exists", span_start);
     if (!exists) {
         mobj_val = init_meta_val(statbuf,
                                  strlen(path), path,
@@ -859,8 +1113,10 @@ int metadb_insert_inode(struct MetaDB *mdb,
 
     init_meta_obj_key(&mobj_key, dir_id, partition_id, path);
 
+    uint64_t span_start = trace_start();
     int exists = leveldb_exists(mdb->db, mdb->lookup_options,
                                  (const char*) &mobj_key, METADB_KEY_LEN, &err);
+    trace_record("leveldb_exists", span_start);
 
     if (!exists) {
         leveldb_put(mdb->db, mdb->insert_options,
@@ -890,9 +1146,11 @@ metadb_val_t metadb_lookup_internal(struct MetaDB *mdb,
 
     init_meta_obj_key(&mobj_key, dir_id, partition_id, path);
 
-    mobj_val.value = leveldb_get(mdb->db, mdb->lookup_options,
-                                 (const char*) &mobj_key, METADB_KEY_LEN,
-                                 &mobj_val.size, &err);
+    mobj_val.value = NULL;
+    mobj_val.size = 0;
+    leveldb_get_with_visitor(mdb->db, mdb->lookup_options,
+                             (const char*) &mobj_key, METADB_KEY_LEN,
+                             copy_val_visitor, &mobj_val, &err);
 
     if (err != NULL || mobj_val.value == NULL) {
         logMessage(METADB_LOG, __func__,
@@ -929,9 +1187,11 @@ int metadb_update_internal(struct MetaDB *mdb,
 
     init_meta_obj_key(&mobj_key, dir_id, partition_id, path);
 
-    mobj_val.value = leveldb_get(mdb->db, mdb->lookup_options,
-                                (const char*) &mobj_key, METADB_KEY_LEN,
-                                &mobj_val.size, &err);
+    mobj_val.value = NULL;
+    mobj_val.size = 0;
+    leveldb_get_with_visitor(mdb->db, mdb->lookup_options,
+                             (const char*) &mobj_key, METADB_KEY_LEN,
+                             copy_val_visitor, &mobj_val, &err);
 
     if ((err == NULL) && (mobj_val.size != 0)) {
         reconstruct_mobj_value(&mobj_val);
@@ -945,9 +1205,10 @@ int metadb_update_internal(struct MetaDB *mdb,
                            "update_internal (%s) failed (%s).", path, err);
                 ret = -1;
             }
-            free_metadb_val(&mobj_val);
         }
+        free_metadb_val(&mobj_val);
     } else {
+        free_metadb_val(&mobj_val);
         mobj_val.value = NULL;
         mobj_val.size = 0;
         ret = ENOENT;
@@ -959,26 +1220,114 @@ int metadb_update_internal(struct MetaDB *mdb,
     return ret;
 }
 
+typedef struct {
+    struct stat *statbuf;
+    int *state;
+} metadb_lookup_t;
+
+static
+int lookup_visitor(void* arg, const char* value, size_t vallen) {
+    metadb_lookup_t* lookup = (metadb_lookup_t *) arg;
+    metadb_val_header_t mobj;
+    if (copy_val_header(value, vallen, &mobj) < 0) {
+        return -1;
+    }
+    *lookup->statbuf = mobj.statbuf;
+    *lookup->state = mobj.state;
+    return 0;
+}
+
 int metadb_lookup(struct MetaDB *mdb,
                   const metadb_inode_t dir_id, const int partition_id,
                   const char *path, struct stat *statbuf, int* state)
 {
-    int ret = 0;
-    metadb_val_t mobj_val;
-
-    mobj_val = metadb_lookup_internal(mdb, dir_id, partition_id, path);
-
-    if (mobj_val.size != 0) {
-        metadb_val_header_t* mobj = (metadb_val_header_t *) mobj_val.value;
-        *statbuf = mobj->statbuf;
-        *state = mobj->state;
+    metadb_lookup_t lookup;
+    lookup.statbuf = statbuf;
+    lookup.state = state;
+    uint64_t span_start = trace_start();
+    int ret = metadb_visit(mdb, dir_id, partition_id, path,
+                           lookup_visitor, &lookup);
+    trace_record("leveldb_get", span_start);
+
+    if (ret == 0) {
         logMessage(METADB_LOG, __func__, "lookup found entry(%s).", path);
     } else {
         logMessage(METADB_LOG, __func__, "entry(%s) not found.", path);
         ret = ENOENT;
     }
+    return ret;
+}
 
-    free_metadb_val(&mobj_val);
+typedef struct {
+    struct stat *statbufs;
+    int *states;
+    int *rets;
+} metadb_lookup_batch_t;
+
+static
+void lookup_batch_visitor(void* arg, int index,
+                          const char* value, size_t vallen) {
+    metadb_lookup_batch_t* batch = (metadb_lookup_batch_t *) arg;
+    metadb_val_header_t mobj;
+    if (copy_val_header(value, vallen, &mobj) < 0) {
+        batch->rets[index] = -1;
+        return;
+    }
+    batch->statbufs[index] = mobj.statbuf;
+    batch->states[index] = mobj.state;
+}
+
+int metadb_lookup_batch(struct MetaDB *mdb,
+                        const metadb_inode_t dir_id, const int partition_id,
+                        int num_entries, const char* const* paths,
+                        struct stat *statbufs, int* states, int* rets)
+{
+    int i;
+    int ret = 0;
+    char* err = NULL;
+    metadb_lookup_batch_t batch;
+
+    if (num_entries <= 0) {
+        return 0;
+    }
+    metadb_key_t* mobj_keys =
+        (metadb_key_t *) malloc(num_entries * sizeof(metadb_key_t));
+    const char** keys = (const char **) malloc(num_entries * sizeof(char*));
+    size_t* key_lens = (size_t *) malloc(num_entries * sizeof(size_t));
+    unsigned char* found = (unsigned char *) malloc(num_entries);
+    for (i = 0; i < num_entries; i++) {
+        init_meta_obj_key(&mobj_keys[i], dir_id, partition_id, paths[i]);
+        keys[i] = (const char*) &mobj_keys[i];
+        key_lens[i] = METADB_KEY_LEN;
+    }
+
+    batch.statbufs = statbufs;
+    batch.states = states;
+    batch.rets = rets;
+    for (i = 0; i < num_entries; i++) {
+        rets[i] = 0;
+    }
+    leveldb_multi_get_with_visitor(mdb->db, mdb->lookup_options,
+                                   num_entries, keys, key_lens,
+                                   lookup_batch_visitor, &batch,
+                                   found, &err);
+    if (err != NULL) {
+        logMessage(METADB_LOG, __func__,
+               "lookup_batch of %d entries in (partition=%d,dirid=%ld)"
+               " failed: (%s)", num_entries, partition_id, dir_id, err);
+        free(err);
+        ret = -1;
+    }
+    for (i = 0; i < num_entries; i++) {
+        if (!found[i]) {
+            rets[i] = ENOENT;
+        }
+    }
+
+    free(found);
+    free(key_lens);
+    free(keys);
+    free(mobj_keys);
     return ret;
 }
 
@@ -1006,68 +1355,145 @@ int metadb_get_val(struct MetaDB *mdb,
 }
 
 
+typedef struct {
+    int *state;
+    char *buf;
+    int *buf_len;
+} metadb_get_file_t;
+
+static
+int get_file_visitor(void* arg, const char* value, size_t vallen) {
+    metadb_get_file_t* file = (metadb_get_file_t *) arg;
+    metadb_val_header_t mobj;
+    if (copy_val_header(value, vallen, &mobj) < 0) {
+        return -1;
+    }
+    const char* realpath = value + sizeof(metadb_val_header_t)
+                         + mobj.objname_len + 1;
+
+    //Check if this thingy is a symlink or not
+    if (mobj.state == RPC_LEVELDB_FILE_IN_FS) {
+        *file->state = RPC_LEVELDB_FILE_IN_FS;
+        *file->buf_len = mobj.realpath_len;
+        memcpy(file->buf, realpath, mobj.realpath_len);
+        file->buf[mobj.realpath_len] = '\0';
+    } else {
+        if (mobj.statbuf.st_size < 0 ||
+            (size_t) mobj.statbuf.st_size > vallen - val_header_size(&mobj)) {
+            return -1;
+        }
+        *file->state = RPC_LEVELDB_FILE_IN_DB;
+        *file->buf_len = mobj.statbuf.st_size;
+        memcpy(file->buf, realpath + mobj.realpath_len + 1,
+               mobj.statbuf.st_size);
+    }
+    return 0;
+}
+
 int metadb_get_file(struct MetaDB *mdb,
                     const metadb_inode_t dir_id, const int partition_id,
                     const char *path, int *state, char* buf, int *buf_len)
 {
-    int ret = 0;
-    metadb_val_t mobj_val;
-    mobj_val = metadb_lookup_internal(mdb, dir_id, partition_id, path);
-
-    if (mobj_val.size != 0) {
+    metadb_get_file_t file;
+    file.state = state;
+    file.buf = buf;
+    file.buf_len = buf_len;
+    int ret = metadb_visit(mdb, dir_id, partition_id, path,
+                           get_file_visitor, &file);
+
+    if (ret == 0) {
         logMessage(METADB_LOG, __func__, "lookup found entry(%s).", path);
-
-        //Check if this thingy is a symlink or not
-        metadb_val_header_t* mobj = (metadb_val_header_t *) mobj_val.value;
-        if (mobj->state == RPC_LEVELDB_FILE_IN_FS) {
-            *state = RPC_LEVELDB_FILE_IN_FS;
-            *buf_len = mobj->realpath_len;
-            memcpy(buf, mobj->realpath, *buf_len);
-            buf[mobj->realpath_len] = '\0';
-        } else {
-            *state = RPC_LEVELDB_FILE_IN_DB;
-            *buf_len = mobj->statbuf.st_size;
-            char* mobj_data = (char*) mobj + sizeof(metadb_val_header_t)
-                            + mobj->objname_len + mobj->realpath_len + 2;
-            memcpy(buf, mobj_data, *buf_len);
-        }
     } else {
         logMessage(METADB_LOG, __func__, "readpath: entry(%s) not found.", path);
         ret = ENOENT;
     }
-
-    free_metadb_val(&mobj_val);
     return ret;
 }
 
+static
+int get_state_visitor(void* arg, const char* value, size_t vallen) {
+    metadb_get_file_t* file = (metadb_get_file_t *) arg;
+    metadb_val_header_t mobj;
+    if (copy_val_header(value, vallen, &mobj) < 0) {
+        return -1;
+    }
+
+    //Check if this thingy is a symlink or not
+    *file->state = mobj.state;
+    if (mobj.state == RPC_LEVELDB_FILE_IN_FS) {
+        *file->buf_len = mobj.realpath_len;
+        memcpy(file->buf, value + sizeof(metadb_val_header_t)
+                          + mobj.objname_len + 1, mobj.realpath_len);
+        file->buf[mobj.realpath_len] = '\0';
+    }
+    return 0;
+}
+
 int metadb_get_state(struct MetaDB *mdb,
                      const metadb_inode_t dir_id, const int partition_id,
                      const char *path, int *state, char* link, int *link_len)
 {
-    int ret = 0;
-    metadb_val_t mobj_val;
-    mobj_val = metadb_lookup_internal(mdb, dir_id, partition_id, path);
-
-    if (mobj_val.size != 0) {
+    metadb_get_file_t file;
+    file.state = state;
+    file.buf = link;
+    file.buf_len = link_len;
+    int ret = metadb_visit(mdb, dir_id, partition_id, path,
+                           get_state_visitor, &file);
+
+    if (ret == 0) {
         logMessage(METADB_LOG, __func__, "lookup found entry(%s).", path);
-
-        //Check if this thingy is a symlink or not
-        metadb_val_header_t* mobj = (metadb_val_header_t *) mobj_val.value;
-        *state = mobj->state;
-        if ((*state) == RPC_LEVELDB_FILE_IN_FS) {
-            *link_len = mobj->realpath_len;
-            memcpy(link, mobj->realpath, *link_len);
-            link[mobj->realpath_len] = '\0';
-        }
     } else {
         logMessage(METADB_LOG, __func__, "readpath: entry(%s) not found.", path);
         ret = ENOENT;
     }
-
-    free_metadb_val(&mobj_val);
     return ret;
 }
 
+/*
+ * Store a merge operand for the object: "op" followed by "arg" and
+ * "data".  The caller has checked that the object exists; should it be
+ * removed before the operand is applied, the operand is dropped.  Returns
+ * ENOENT if the object is already known to be gone, as with ColumnDB.
+ */
+static
+int metadb_merge_update(struct MetaDB *mdb,
+                        const metadb_inode_t dir_id,
+                        const int partition_id,
+                        const char *path,
+                        metadb_merge_op_t op,
+                        const void* arg, size_t arg_len,
+                        const char* data, size_t data_len)
+{
+    metadb_key_t mobj_key;
+    char* err = NULL;
+    char stack_buf[256];
+    size_t operand_len = 1 + arg_len + data_len;
+    char* operand = operand_len <= sizeof(stack_buf) ?
+                    stack_buf : (char*) malloc(operand_len);
+
+    operand[0] = (char) op;
+    memcpy(operand + 1, arg, arg_len);
+    if (data_len > 0) {
+        memcpy(operand + 1 + arg_len, data, data_len);
+    }
+
+    init_meta_obj_key(&mobj_key, dir_id, partition_id, path);
+    leveldb_merge(mdb->db, mdb->insert_options,
+                  (const char*) &mobj_key, METADB_KEY_LEN,
+                  operand, operand_len, &err);
+    if (operand != stack_buf) {
+        free(operand);
+    }
+    if (err != NULL) {
+        int ret = strncmp(err, "NotFound: ", 10) == 0 ? ENOENT : -1;
+        logMessage(METADB_LOG, __func__,
+                   "merge_update(%s) op %d failed (%s).", path, op, err);
+        free(err);
+        return ret;
+    }
+    return 0;
+}
+
 typedef struct {
     const char* buf;
     int buf_len;
@@ -1104,13 +1530,15 @@ int metadb_write_file(struct MetaDB *mdb,
                       const int partition_id,
                       const char* objname,
                       const char* buf, int buf_len, int offset) {
-    metadb_write_data_t data;
-    data.buf = buf;
-    data.buf_len = buf_len;
-    data.offset = offset;
-    return metadb_update_internal(mdb, dir_id, partition_id, objname,
-                                  metadb_write_file_handler,
-                                  (void *) &data);
+    int range[2];
+    range[0] = offset;
+    range[1] = buf_len;
+    if (metadb_merge_update(mdb, dir_id, partition_id, objname,
+                            METADB_MERGE_WRITE, range, sizeof(range),
+                            buf, buf_len) != 0) {
+        return -1;
+    }
+    return buf_len;
 }
 
 int metadb_write_link_handler(metadb_val_t* mobj_val, void* arg1) {
@@ -1152,42 +1580,50 @@ int metadb_setattr(struct MetaDB *mdb,
                    const int partition_id,
                    const char* objname,
                    const struct stat* statbuf) {
-    return metadb_update_internal(mdb, dir_id, partition_id, objname,
-                                  metadb_setattr_handler,
-                                  (void *) statbuf);
+    return metadb_merge_update(mdb, dir_id, partition_id, objname,
+                               METADB_MERGE_SETATTR,
+                               statbuf, sizeof(struct stat), NULL, 0);
 }
 
 
+static
+int read_bitmap_visitor(void* arg, const char* value, size_t vallen) {
+    metadb_val_header_t mobj;
+    if (copy_val_header(value, vallen, &mobj) < 0 ||
+        vallen - val_header_size(&mobj) < sizeof(struct giga_mapping_t)) {
+        return -1;
+    }
+    memcpy(arg, value + val_header_size(&mobj),
+           sizeof(struct giga_mapping_t));
+    return 0;
+}
+
 int metadb_read_bitmap(struct MetaDB *mdb,
                        const metadb_inode_t dir_id,
                        const int partition_id,
                        const char* path,
                        struct giga_mapping_t* mapping) {
-    int ret = 0;
-    metadb_val_t mobj_val;
+    int ret = metadb_visit(mdb, dir_id, partition_id, path,
+                           read_bitmap_visitor, mapping);
 
-    mobj_val = metadb_lookup_internal(mdb, dir_id, partition_id, path);
-
-    if (mobj_val.size != 0) {
-        struct giga_mapping_t* mobj_mapping =
-            (struct giga_mapping_t*) (mobj_val.value
-                                    + metadb_header_size(&mobj_val));
-        *mapping = *mobj_mapping;
+    if (ret == 0) {
         logMessage(METADB_LOG, __func__, "read_bitmap found entry(%s).", path);
     } else {
         logMessage(METADB_LOG, __func__, "entry(%s) not found.", path);
         ret = -1;
     }
-
-    free_metadb_val(&mobj_val);
     return ret;
 }
 
 int metadb_write_bitmap_handler(metadb_val_t* mobj_val, void* arg1) {
-    struct giga_mapping_t* mobj_mapping =
-        (struct giga_mapping_t*) ( mobj_val->value
-                                 + metadb_header_size(mobj_val));
-    *mobj_mapping = *((struct giga_mapping_t *) arg1);
+    size_t header_size = metadb_header_size(mobj_val);
+    if (mobj_val->size < header_size + sizeof(struct giga_mapping_t)) {
+        /* Directory created without a mapping */
+        mobj_val->size = header_size + sizeof(struct giga_mapping_t);
+        mobj_val->value = (char*) realloc(mobj_val->value, mobj_val->size);
+    }
+    memcpy(mobj_val->value + header_size, arg1,
+           sizeof(struct giga_mapping_t));
     return 0;
 }
 
@@ -1196,9 +1632,9 @@ int metadb_write_bitmap(struct MetaDB *mdb,
                         const int partition_id,
                         const char* path,
                         const struct giga_mapping_t* mapping) {
-    metadb_update_internal(mdb, dir_id, partition_id, path,
-                                  metadb_write_bitmap_handler,
-                                  (void *) mapping);
+    metadb_merge_update(mdb, dir_id, partition_id, path,
+                        METADB_MERGE_BITMAP,
+                        mapping, sizeof(struct giga_mapping_t), NULL, 0);
     return 0;
 }
 
@@ -1221,9 +1657,59 @@ int metadb_chmod(struct MetaDB *mdb,
                  mode_t new_mode) {
     chmod_update_t update;
     update.new_mode = new_mode;
-    return metadb_update_internal(mdb, dir_id, partition_id, path,
-                                  metadb_chmod_handler,
-                                  (void *) &update);
+    return metadb_merge_update(mdb, dir_id, partition_id, path,
+                               METADB_MERGE_CHMOD,
+                               &update, sizeof(update), NULL, 0);
+}
+
+/*
+ * Apply one merge operand to the object in mobj_val, which is malloc()ed
+ * and so aligned.  The arguments inside the operand may not be.
+ */
+static
+int apply_merge_operand(metadb_val_t* mobj_val,
+                        const char* operand, size_t operand_len)
+{
+    if (operand_len < 1) {
+        return -1;
+    }
+    const char* arg = operand + 1;
+    size_t arg_len = operand_len - 1;
+    switch ((metadb_merge_op_t) operand[0]) {
+    case METADB_MERGE_CHMOD: {
+        chmod_update_t update;
+        if (arg_len != sizeof(update)) break;
+        memcpy(&update, arg, sizeof(update));
+        return metadb_chmod_handler(mobj_val, &update);
+    }
+    case METADB_MERGE_SETATTR: {
+        struct stat statbuf;
+        if (arg_len != sizeof(statbuf)) break;
+        memcpy(&statbuf, arg, sizeof(statbuf));
+        return metadb_setattr_handler(mobj_val, &statbuf);
+    }
+    case METADB_MERGE_BITMAP: {
+        struct giga_mapping_t mapping;
+        if (arg_len != sizeof(mapping)) break;
+        memcpy(&mapping, arg, sizeof(mapping));
+        return metadb_write_bitmap_handler(mobj_val, &mapping);
+    }
+    case METADB_MERGE_WRITE: {
+        int range[2];
+        metadb_write_data_t data;
+        if (arg_len < sizeof(range)) break;
+        memcpy(range, arg, sizeof(range));
+        if (range[0] < 0 || range[1] < 0 ||
+            arg_len - sizeof(range) != (size_t) range[1]) break;
+        data.offset = range[0];
+        data.buf_len = range[1];
+        data.buf = arg + sizeof(range);
+        return metadb_write_file_handler(mobj_val, &data) < 0 ? -1 : 0;
+    }
+    }
+    logMessage(METADB_LOG, __func__, "bad merge operand (op %d, %d bytes)",
+               operand[0], (int) operand_len);
+    return -1;
 }
 
 int metadb_valid(struct MetaDB *mdb) {
@@ -1379,6 +1865,9 @@ int metadb_readdir(struct MetaDB *mdb,
         init_meta_obj_seek_key(&mobj_key, dir_id, *partition_id, start_key);
     }
 
+    // A scan of one partition stops at its end, even if later
+    // partitions of the directory are stored on this server too
+    const int scan_partition_id = *partition_id;
     leveldb_iterator_t* iter =
         leveldb_create_iterator(mdb->db, mdb->scan_options);
     leveldb_iter_seek(iter, (char *) &mobj_key, METADB_KEY_LEN);
@@ -1388,7 +1877,9 @@ int metadb_readdir(struct MetaDB *mdb,
             metadb_val_t  iter_val;
             size_t klen;
             iter_key = (metadb_key_t*) leveldb_iter_key(iter, &klen);
-            if (iter_key->parent_id == dir_id) {
+            if (iter_key->parent_id == dir_id &&
+                (scan_partition_id < 0 ||
+                 iter_key->partition_id == scan_partition_id)) {
                 if (iter_key->partition_id >= 0) {
                     iter_val.value =
                         (char *) leveldb_iter_value(iter, &iter_val.size);
@@ -1457,6 +1948,9 @@ int metadb_readdirplus(struct MetaDB *mdb,
         init_meta_obj_seek_key(&mobj_key, dir_id, *partition_id, start_key);
     }
 
+    // A scan of one partition stops at its end, even if later
+    // partitions of the directory are stored on this server too
+    const int scan_partition_id = *partition_id;
     leveldb_iterator_t* iter =
         leveldb_create_iterator(mdb->db, mdb->scan_options);
     leveldb_iter_seek(iter, (char *) &mobj_key, METADB_KEY_LEN);
@@ -1466,7 +1960,9 @@ int metadb_readdirplus(struct MetaDB *mdb,
             metadb_val_t  iter_val;
             size_t klen;
             iter_key = (metadb_key_t*) leveldb_iter_key(iter, &klen);
-            if (iter_key->parent_id == dir_id) {
+            if (iter_key->parent_id == dir_id &&
+                (scan_partition_id < 0 ||
+                 iter_key->partition_id == scan_partition_id)) {
                 if (iter_key->partition_id >= 0) {
                     iter_val.value =
                         (char *) leveldb_iter_value(iter, &iter_val.size);
@@ -1546,8 +2042,10 @@ int metadb_extract_do(struct MetaDB *mdb,
     struct timeval start_time;
     gettimeofday(&start_time, NULL);
 
+    uint64_t lock_start = LOCK_PROFILE_NOW();
     ACQUIRE_MUTEX(&(mdb->mtx_leveldb), "metadb_extract(p%d->p%d)",
                     old_partition_id, new_partition_id);
+    uint64_t lock_acquired = LOCK_PROFILE_NOW();
 
     /*
     ACQUIRE_MUTEX(&(mdb->mtx_extload), "metadb_extract(p%d->p%d)",
@@ -1578,6 +2076,7 @@ int metadb_extract_do(struct MetaDB *mdb,
 
         RELEASE_MUTEX(&(mdb->mtx_leveldb), "metadb_extract(p%d->p%d)",
                   old_partition_id, new_partition_id);
+        LOCK_PROFILE_RECORD("mtx_leveldb", lock_start, lock_acquired);
 
         return ret;
     }
@@ -1598,8 +2097,31 @@ int metadb_extract_do(struct MetaDB *mdb,
           mdb->options, sstable_filename, mdb->env, &err);
     metadb_error("create new builder", err);
 
+    // Scan a snapshot so that the entries moved, their sequence numbers
+    // and (with ColumnDB) the data files they point into stay fixed
+    // while creates go on in the partition.
+    const leveldb_snapshot_t* snapshot = leveldb_create_snapshot(mdb->db);
+    leveldb_readoptions_t* extract_options = leveldb_readoptions_create();
+    leveldb_readoptions_set_fill_cache(extract_options, 0);
+    leveldb_readoptions_set_scan_hint(extract_options, 1);
+    leveldb_readoptions_set_readahead_blocks(extract_options,
+                                             DEFAULT_READAHEAD_BLOCKS);
+    leveldb_readoptions_set_prefetch_values(extract_options,
+                                            DEFAULT_PREFETCH_VALUES);
+    leveldb_readoptions_set_snapshot(extract_options, snapshot);
+
+    // With ColumnDB, the entries moved point into our data files, which
+    // the garbage collector must leave alone from now on
+    metadb_key_t mobj_end_key;
+    init_meta_obj_seek_key(&mobj_end_key, dir_id, old_partition_id, NULL);
+    memset(mobj_end_key.name_hash, 0xff, sizeof(mobj_end_key.name_hash));
+    leveldb_pin_values(mdb->db, extract_options,
+                       (char *) &mobj_key, METADB_KEY_LEN,
+                       (char *) &mobj_end_key, METADB_KEY_LEN, &err);
+    metadb_error("pin values", err);
+
     leveldb_iterator_t* iter =
-      leveldb_create_iterator(mdb->db, mdb->scan_options);
+      leveldb_create_iterator(mdb->db, extract_options);
     leveldb_writebatch_t* batch = leveldb_writebatch_create();
 
     if (!leveldb_iter_valid(iter)) {
@@ -1676,7 +2198,9 @@ int metadb_extract_do(struct MetaDB *mdb,
             }
             leveldb_iter_next(iter);
         }
-        if (leveldb_tablebuilder_size(builder) > 0) {
+        // The builder reports no size until its first block is flushed,
+        // so test for moved entries rather than for table contents
+        if (num_migrated_entries > 0) {
             leveldb_write(mdb->db, mdb->insert_options, batch, &err);
             metadb_error("delete moved entreis", err);
         }
@@ -1691,9 +2215,12 @@ int metadb_extract_do(struct MetaDB *mdb,
     leveldb_writebatch_destroy(batch);
     leveldb_tablebuilder_destroy(builder);
     leveldb_iter_destroy(iter);
+    leveldb_readoptions_destroy(extract_options);
+    leveldb_release_snapshot(mdb->db, snapshot);
 
     RELEASE_MUTEX(&(mdb->mtx_leveldb), "metadb_extract(p%d->p%d)",
                   old_partition_id, new_partition_id);
+    LOCK_PROFILE_RECORD("mtx_leveldb", lock_start, lock_acquired);
 
     struct timeval finish_time;
     gettimeofday(&finish_time, NULL);
@@ -1898,8 +2425,10 @@ int metadb_bulkinsert(struct MetaDB *mdb,
 
     //ACQUIRE_RWLOCK_WRITE(&(mdb->rwlock_extract), "metadb_bulkinsert(%s)", dir_with_new_partition);
 
+    uint64_t lock_start = LOCK_PROFILE_NOW();
     ACQUIRE_MUTEX(&(mdb->mtx_leveldb), "metadb_bulkinsert(%s)",
                     dir_with_new_partition);
+    uint64_t lock_acquired = LOCK_PROFILE_NOW();
 
     leveldb_bulkinsert(mdb->db, mdb->insert_options,
                        dir_with_new_partition,
@@ -1912,6 +2441,7 @@ int metadb_bulkinsert(struct MetaDB *mdb,
 
     RELEASE_MUTEX(&(mdb->mtx_leveldb), "metadb_bulkinsert(%s)",
                     dir_with_new_partition);
+    LOCK_PROFILE_RECORD("mtx_leveldb", lock_start, lock_acquired);
 
     return ret;
 }
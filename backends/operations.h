@@ -105,6 +105,8 @@ struct MetaDB {
     leveldb_t* db;              // DB instance
     leveldb_comparator_t* cmp;  // Compartor object that allows user-defined
                                 // object comparions functions.
+    leveldb_mergeoperator_t* merge_op;  // Applies attribute updates that
+                                        // were written as merge operands.
     leveldb_cache_t* cache;     // Cache object: If set, individual blocks 
                                 // (of levelDB files) are cached using LRU.
     leveldb_env_t* env;
@@ -122,6 +124,12 @@ struct MetaDB {
     pthread_mutex_t     mtx_extract;
     pthread_mutex_t     mtx_leveldb;
 
+    // Background thread periodically saving inode_count
+    pthread_mutex_t     mtx_sync;
+    pthread_cond_t      cv_sync;
+    int stop_sync_thread;
+    int flag_sync_thread_finish;
+
     FILE* logfile;
     int use_hdfs;
     int server_id;
@@ -144,6 +152,15 @@ const struct stat* metadb_readdir_iter_get_stat(metadb_readdir_iterator_t *iter)
 
 char* metadb_get_metric(struct MetaDB *mdb);
 
+// Returns the value of LevelDB property "property" in a malloc()ed
+// string, or NULL if there is no such property.
+char* metadb_get_property(struct MetaDB *mdb, const char* property);
+
+// Stores the lookups made so far in the LevelDB block cache and how many
+// of them hit.
+void metadb_get_block_cache_stats(struct MetaDB *mdb,
+                                  uint64_t *lookups, uint64_t *hits);
+
 int metadb_get_next_inode_count(struct MetaDB *mdb);
 int metadb_get_next_inode_batch(struct MetaDB *mdb, int bulk_size);
 
@@ -215,6 +232,19 @@ int metadb_lookup(struct MetaDB *mdb,
                   struct stat *stbuf,
                   int* state);
 
+// Looks up objnames[0..num_entries-1] of one partition in a single
+// batch, filling in stbufs[i] and states[i] and setting rets[i] to "0"
+// or "ENOENT" as metadb_lookup() would.
+// Returns "0" on success, otherwise "-1" if the batch hit an error.
+int metadb_lookup_batch(struct MetaDB *mdb,
+                        const metadb_inode_t dir_id,
+                        const int partition_id,
+                        int num_entries,
+                        const char* const* objnames,
+                        struct stat *stbufs,
+                        int* states,
+                        int* rets);
+
 // Returns "0" if MDB get directory entries successfully,
 // otherwise "-ENOENT" when no file is found.
 int metadb_readdir(struct MetaDB *mdb,
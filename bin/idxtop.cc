@@ -0,0 +1,252 @@
+// Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Cluster-wide "top" for IndexFS.  Polls GetStats() of every server in
+// the server list every few seconds and prints one row per server and
+// one row per operation type summed over the cluster, followed by the
+// hottest directories.  Rates are the difference between two polls;
+// latencies are the servers' own window.
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "client/libclient_helper.h"
+#include "communication/rpc.h"
+
+namespace indexfs {
+
+// Other tools get this from the C client library, which idxtop does not use
+DEFINE_string(logfn, "idxtop", "Set the IndexFS log file name");
+
+DEFINE_int32(interval, 2, "Seconds between two polls");
+DEFINE_int32(iterations, 0, "Number of polls to print, or 0 to never stop");
+DEFINE_int32(hot, 5, "Number of hot directories to print");
+
+namespace {
+
+// Stats of each server, and whether they were fetched on the last poll
+struct Poll {
+  std::vector<ServerStats> stats;
+  std::vector<bool> ok;
+};
+
+int64_t TotalOps(const ServerStats& stats) {
+  // The last operation type is the total of the others
+  return stats.ops.empty() ? 0 : stats.ops.back().count;
+}
+
+double Rate(int64_t now, int64_t before, double seconds) {
+  return seconds > 0 && now >= before ? (now - before) / seconds : 0;
+}
+
+double HitRatio(const ServerStats& stats, const char* name) {
+  for (size_t i = 0; i < stats.caches.size(); ++i) {
+    const CacheStats& cache = stats.caches[i];
+    if (cache.name == name) {
+      return cache.lookups > 0 ? 100.0 * cache.hits / cache.lookups : 0;
+    }
+  }
+  return 0;
+}
+
+void FetchStats(RPC* rpc, int num_servers, Poll* poll) {
+  poll->stats.assign(num_servers, ServerStats());
+  poll->ok.assign(num_servers, false);
+  for (int i = 0; i < num_servers; ++i) {
+    MetadataServiceIf* srv;
+    if (!rpc->GetMetadataService(i, &srv).ok()) {
+      continue;
+    }
+    try {
+      srv->GetStats(poll->stats[i]);
+      poll->ok[i] = true;
+    } catch (apache::thrift::TException &tx) {
+      fprintf(stderr, "server %d: %s\n", i, tx.what());
+    }
+  }
+}
+
+void PrintServers(const Poll& last, const Poll& current) {
+  printf("%4s %10s %8s %8s %8s %8s %6s %6s %6s %5s %9s %9s %7s %6s %8s\n",
+         "srv", "ops/s", "p50 us", "p90 us", "p99 us", "p99.9 us",
+         "dent%", "dir%", "blk%",
+         "L0", "cmp-r MB", "cmp-w MB", "stalls", "splitq", "leases");
+  for (size_t i = 0; i < current.stats.size(); ++i) {
+    if (!current.ok[i]) {
+      printf("%4d %10s\n", static_cast<int>(i), "down");
+      continue;
+    }
+    const ServerStats& now = current.stats[i];
+    double rate = 0;
+    if (last.ok.size() > i && last.ok[i]) {
+      const ServerStats& before = last.stats[i];
+      rate = Rate(TotalOps(now), TotalOps(before),
+                  (now.timestamp - before.timestamp) / 1000000.0);
+    }
+    const OpStats* total = now.ops.empty() ? NULL : &now.ops.back();
+    printf("%4d %10.0f %8.0f %8.0f %8.0f %8.0f %6.1f %6.1f %6.1f %5d %9.1f"
+           " %9.1f %7lld %6d %8lld\n",
+           now.server_id, rate,
+           total != NULL ? total->p50_lat : 0,
+           total != NULL ? total->p90_lat : 0,
+           total != NULL ? total->p99_lat : 0,
+           total != NULL ? total->p999_lat : 0,
+           HitRatio(now, "dent"), HitRatio(now, "dir"),
+           HitRatio(now, "block"),
+           now.levels.empty() ? 0 : now.levels[0].num_files,
+           now.compaction_bytes_read / 1048576.0,
+           now.compaction_bytes_written / 1048576.0,
+           static_cast<long long>(now.write_stalls),
+           now.split_queue_depth,
+           static_cast<long long>(now.active_leases));
+  }
+}
+
+struct OpRow {
+  double rate;
+  double p50_lat;
+  double p90_lat;
+  double p99_lat;
+  double p999_lat;
+  double max_lat;
+  OpRow() : rate(0), p50_lat(0), p90_lat(0), p99_lat(0), p999_lat(0),
+            max_lat(0) {}
+};
+
+// Sums the rates of each operation type over the servers, and takes
+// the worst latencies of any server.
+void PrintOps(const Poll& last, const Poll& current) {
+  std::vector<std::string> names;
+  std::map<std::string, OpRow> rows;
+  for (size_t i = 0; i < current.stats.size(); ++i) {
+    if (!current.ok[i] || last.ok.size() <= i || !last.ok[i]) {
+      continue;
+    }
+    const ServerStats& now = current.stats[i];
+    const ServerStats& before = last.stats[i];
+    double seconds = (now.timestamp - before.timestamp) / 1000000.0;
+    for (size_t j = 0; j < now.ops.size(); ++j) {
+      const OpStats& op = now.ops[j];
+      if (rows.find(op.name) == rows.end()) {
+        names.push_back(op.name);
+      }
+      OpRow& row = rows[op.name];
+      if (j < before.ops.size() && before.ops[j].name == op.name) {
+        row.rate += Rate(op.count, before.ops[j].count, seconds);
+      }
+      row.p50_lat = std::max(row.p50_lat, op.p50_lat);
+      row.p90_lat = std::max(row.p90_lat, op.p90_lat);
+      row.p99_lat = std::max(row.p99_lat, op.p99_lat);
+      row.p999_lat = std::max(row.p999_lat, op.p999_lat);
+      row.max_lat = std::max(row.max_lat, op.max_lat);
+    }
+  }
+  printf("%-12s %10s %8s %8s %8s %8s %10s\n",
+         "op", "ops/s", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+  for (size_t i = 0; i < names.size(); ++i) {
+    const OpRow& row = rows[names[i]];
+    if (row.rate > 0) {
+      printf("%-12s %10.0f %8.0f %8.0f %8.0f %8.0f %10.0f\n",
+             names[i].c_str(), row.rate, row.p50_lat, row.p90_lat,
+             row.p99_lat, row.p999_lat, row.max_lat);
+    }
+  }
+}
+
+struct HotDir {
+  double rate;
+  double hottest_rate;
+  std::string hottest_op;
+  int server_id;
+  HotDir() : rate(0), hottest_rate(0), server_id(-1) {}
+};
+
+struct HotterDir {
+  bool operator()(const std::pair<int64_t, HotDir>& a,
+                  const std::pair<int64_t, HotDir>& b) const {
+    return a.second.rate > b.second.rate;
+  }
+};
+
+// Sums the decayed rates the servers report for each directory over
+// operation types and servers; a directory split over several servers
+// is shown with the server busiest with a single operation type on it.
+void PrintHotDirs(const Poll& current) {
+  std::map<int64_t, HotDir> dirs;
+  for (size_t i = 0; i < current.stats.size(); ++i) {
+    if (!current.ok[i]) {
+      continue;
+    }
+    const ServerStats& now = current.stats[i];
+    for (size_t j = 0; j < now.hot_keys.size(); ++j) {
+      const HotKeyStats& op = now.hot_keys[j];
+      for (size_t k = 0; k < op.dirs.size(); ++k) {
+        HotDir& dir = dirs[op.dirs[k].dir_id];
+        dir.rate += op.dirs[k].rate;
+        if (op.dirs[k].rate > dir.hottest_rate) {
+          dir.hottest_rate = op.dirs[k].rate;
+          dir.hottest_op = op.op;
+          dir.server_id = now.server_id;
+        }
+      }
+    }
+  }
+  std::vector<std::pair<int64_t, HotDir> > sorted(dirs.begin(), dirs.end());
+  std::sort(sorted.begin(), sorted.end(), HotterDir());
+  printf("%-12s %10s %-12s %4s\n", "hot dir", "ops/s", "top op", "srv");
+  for (size_t i = 0; i < sorted.size() &&
+       static_cast<int>(i) < FLAGS_hot; ++i) {
+    const HotDir& dir = sorted[i].second;
+    printf("%-12lld %10.0f %-12s %4d\n",
+           static_cast<long long>(sorted[i].first), dir.rate,
+           dir.hottest_op.c_str(), dir.server_id);
+  }
+}
+
+} // namespace
+
+} // namespace indexfs
+
+using namespace indexfs;
+
+int main(int argc, char* argv[]) {
+  SetUsageMessage("IndexFS Client Toolkit - idxtop");
+  ParseCommandLineFlags(&argc, &argv, true);
+  Config* config = LoadClientConfig();
+  RPC* rpc = RPC::CreateRPC(config);
+  int num_servers = config->GetSrvNum();
+
+  Poll last, current;
+  for (int i = 0; FLAGS_iterations <= 0 || i <= FLAGS_iterations; ++i) {
+    FetchStats(rpc, num_servers, &current);
+    // The first poll only sets the base of the rates
+    if (i > 0) {
+      time_t now = time(NULL);
+      printf("== %s", ctime(&now));
+      PrintServers(last, current);
+      printf("\n");
+      PrintOps(last, current);
+      printf("\n");
+      if (FLAGS_hot > 0) {
+        PrintHotDirs(current);
+        printf("\n");
+      }
+      fflush(stdout);
+    }
+    last = current;
+    if (FLAGS_iterations <= 0 || i < FLAGS_iterations) {
+      sleep(FLAGS_interval);
+    }
+  }
+
+  rpc->Shutdown();
+  delete rpc;
+  delete config;
+  return 0;
+}
@@ -0,0 +1,125 @@
+// Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "capture_client.h"
+
+namespace indexfs {
+
+// Path recorded for ops on file descriptors
+static const std::string kNoPath;
+
+CaptureClient::~CaptureClient() {
+  delete client_;
+  TraceCapture::Flush();
+}
+
+Status CaptureClient::Dispose() {
+  Status s = client_->Dispose();
+  TraceCapture::Flush();
+  return s;
+}
+
+Status CaptureClient::Getattr(Path &path, StatInfo* info) {
+  uint64_t start = TraceCapture::NowMicros();
+  Status s = client_->Getattr(path, info);
+  TraceCapture::Record(kCaptureGetattr, path, NULL, 0, s, start);
+  return s;
+}
+
+Status CaptureClient::Mknod(Path &path, int16_t permission) {
+  uint64_t start = TraceCapture::NowMicros();
+  Status s = client_->Mknod(path, permission);
+  TraceCapture::Record(kCaptureMknod, path, NULL, permission, s, start);
+  return s;
+}
+
+Status CaptureClient::Mkdir(Path &path, int16_t permission) {
+  uint64_t start = TraceCapture::NowMicros();
+  Status s = client_->Mkdir(path, permission);
+  TraceCapture::Record(kCaptureMkdir, path, NULL, permission, s, start);
+  return s;
+}
+
+Status CaptureClient::Chmod(Path &path, int16_t permission) {
+  uint64_t start = TraceCapture::NowMicros();
+  Status s = client_->Chmod(path, permission);
+  TraceCapture::Record(kCaptureChmod, path, NULL, permission, s, start);
+  return s;
+}
+
+Status CaptureClient::Remove(Path &path) {
+  uint64_t start = TraceCapture::NowMicros();
+  Status s = client_->Remove(path);
+  TraceCapture::Record(kCaptureRemove, path, NULL, 0, s, start);
+  return s;
+}
+
+Status CaptureClient::Rename(Path &source, Path &target) {
+  uint64_t start = TraceCapture::NowMicros();
+  Status s = client_->Rename(source, target);
+  TraceCapture::Record(kCaptureRename, source, &target, 0, s, start);
+  return s;
+}
+
+Status CaptureClient::Readdir(Path &path, std::vector<std::string>* result) {
+  uint64_t start = TraceCapture::NowMicros();
+  Status s = client_->Readdir(path, result);
+  TraceCapture::Record(kCaptureReaddir, path, NULL, 0, s, start);
+  return s;
+}
+
+Status CaptureClient::ReaddirPlus(Path &path,
+                                  std::vector<std::string>* names,
+                                  std::vector<StatInfo>* entries) {
+  uint64_t start = TraceCapture::NowMicros();
+  Status s = client_->ReaddirPlus(path, names, entries);
+  TraceCapture::Record(kCaptureReaddirPlus, path, NULL, 0, s, start);
+  return s;
+}
+
+Status CaptureClient::Fsyncdir(Path &path) {
+  uint64_t start = TraceCapture::NowMicros();
+  Status s = client_->Fsyncdir(path);
+  TraceCapture::Record(kCaptureFsyncdir, path, NULL, 0, s, start);
+  return s;
+}
+
+Status CaptureClient::AccessDir(Path &path) {
+  uint64_t start = TraceCapture::NowMicros();
+  Status s = client_->AccessDir(path);
+  TraceCapture::Record(kCaptureAccessDir, path, NULL, 0, s, start);
+  return s;
+}
+
+Status CaptureClient::Read(int fd, size_t offset, size_t size, char *buf,
+                           int *ret_size) {
+  uint64_t start = TraceCapture::NowMicros();
+  Status s = client_->Read(fd, offset, size, buf, ret_size);
+  TraceCapture::Record(kCaptureRead, kNoPath, NULL, fd, s, start);
+  return s;
+}
+
+Status CaptureClient::Write(int fd, size_t offset, size_t size,
+                            const char* buf) {
+  uint64_t start = TraceCapture::NowMicros();
+  Status s = client_->Write(fd, offset, size, buf);
+  TraceCapture::Record(kCaptureWrite, kNoPath, NULL, fd, s, start);
+  return s;
+}
+
+Status CaptureClient::Close(int fd) {
+  uint64_t start = TraceCapture::NowMicros();
+  Status s = client_->Close(fd);
+  TraceCapture::Record(kCaptureClose, kNoPath, NULL, fd, s, start);
+  return s;
+}
+
+Status CaptureClient::Open(Path &path, int16_t mode, int *fd) {
+  uint64_t start = TraceCapture::NowMicros();
+  Status s = client_->Open(path, mode, fd);
+  TraceCapture::Record(kCaptureOpen, path, NULL, mode, s, start);
+  return s;
+}
+
+} /* namespace indexfs */
@@ -0,0 +1,76 @@
+// Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef _INDEXFS_CAPTURE_CLIENT_H_
+#define _INDEXFS_CAPTURE_CLIENT_H_
+
+#include "client.h"
+#include "trace_capture.h"
+
+namespace indexfs {
+
+// Passes every call on to another client, recording it with
+// TraceCapture.  Made by the default client factory when capture is
+// enabled.
+//
+class CaptureClient : public Client {
+ public:
+
+  // Takes ownership of "client"
+  explicit CaptureClient(Client* client) : client_(client) { }
+
+  virtual ~CaptureClient();
+
+  virtual Status Init() { return client_->Init(); }
+
+  virtual Status Dispose();
+
+  virtual Status Getattr(Path &path, StatInfo* info);
+
+  virtual Status Mknod(Path &path, int16_t permission);
+
+  virtual Status Mkdir(Path &path, int16_t permission);
+
+  virtual Status Chmod(Path &path, int16_t permission);
+
+  virtual Status Remove(Path &path);
+
+  virtual Status Rename(Path &source, Path &target);
+
+  virtual Status Readdir(Path &path, std::vector<std::string>* result);
+
+  virtual Status ReaddirPlus(Path &path,
+                             std::vector<std::string>* names,
+                             std::vector<StatInfo>* entries);
+
+  virtual Status Fsyncdir(Path &path);
+
+  virtual Status AccessDir(Path &path);
+
+  virtual Status Read(int fd, size_t offset, size_t size, char *buf,
+                      int *ret_size);
+
+  virtual Status Write(int fd, size_t offset, size_t size, const char* buf);
+
+  virtual Status Close(int fd);
+
+  virtual Status Open(Path &path, int16_t mode, int *fd);
+
+  virtual void Noop() { client_->Noop(); }
+
+  virtual void PrintMeasurements(FILE* output) {
+    client_->PrintMeasurements(output);
+  }
+
+ private:
+  Client* client_;
+
+  // No copy allowed
+  CaptureClient(const CaptureClient&);
+  CaptureClient& operator=(const CaptureClient&);
+};
+
+} /* namespace indexfs */
+
+#endif /* _INDEXFS_CAPTURE_CLIENT_H_ */
@@ -3,6 +3,7 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "client.h"
+#include "capture_client.h"
 #include "metadata_client.h"
 
 namespace indexfs {
@@ -10,7 +11,21 @@ namespace indexfs {
 class DefaultClientFactory: public ClientFactory {
  public:
   virtual ~DefaultClientFactory() { }
-  virtual Client* GetClient(Config* config) { return new MetadataClient(config); }
+  virtual Client* GetClient(Config* config) {
+    Client* client = new MetadataClient(config);
+    std::string capture_file = config->GetCaptureFile();
+    if (!capture_file.empty()) {
+      Status s = TraceCapture::Start(capture_file,
+                                     config->IsCaptureHashed(),
+                                     config->GetCaptureHashSeed());
+      if (s.ok()) {
+        client = new CaptureClient(client);
+      } else {
+        LOG(WARNING) << "Cannot capture client ops: " << s.ToString();
+      }
+    }
+    return client;
+  }
 
 };
 
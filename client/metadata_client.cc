@@ -57,8 +57,6 @@ MetadataClient::MetadataClient(Config* conf)
   , dent_cache_(new DirEntryCache<DirEntryValue>(conf->GetDirEntryCacheSize()))
   , dmap_cache_(new DirMappingCache(conf->GetDirMappingCacheSize()))
   , rpc_(RPC::CreateRPC(conf)), fd_count_(0) {
-  DirHandle::dmap_cache_ = dmap_cache_;
-  DirHandle::dir_cache_ = dir_cache_;
 #if defined(OS_LINUX) && defined(HDFS)
   int hdfs_port = cfg_->GetHDFSPort();
   const char* hdfs_ip = cfg_->GetHDFSIP();
@@ -72,6 +70,8 @@ MetadataClient::MetadataClient(Config* conf)
   for (int i = 0; i < kNumInstrumentPoints; ++i)
     points.push_back(std::string(kMetadataClientOpsName[i]));
   measure_ = new Measurement(points, 0, 0);
+  Tracer::Configure(cfg_->GetTraceSampleRate(),
+                    cfg_->GetTraceSlowMicros(), stderr);
 }
 
 MetadataClient::~MetadataClient() {
@@ -81,9 +81,6 @@ MetadataClient::~MetadataClient() {
   SanityClean(dent_cache_);
   SanityClean(dmap_cache_);
   SanityClean(dir_cache_);
-
-  DirHandle::dmap_cache_ = NULL;
-  DirHandle::dir_cache_ = NULL;
 }
 
 void MetadataClient::PrintMeasurements(FILE* output) {
@@ -102,6 +99,17 @@ bool MetadataClient::IsEntryExpired
   return env_->NowMicros() > value.expire_time;
 }
 
+// Returns the service of server "srv_id" for the next RPC.  Operations
+// being traced first tell the server which trace the RPC belongs to.
+//
+MetadataServiceIf* MetadataClient::GetService(int srv_id) {
+  MetadataServiceIf* service = rpc_->GetClient(srv_id);
+  if (Tracer::Current() != 0) {
+    service->SetTrace(Tracer::Current());
+  }
+  return service;
+}
+
 int MetadataClient::SelectServer
   (DirHandle &handle, Path &entry) {
   index_t index =
@@ -163,7 +171,8 @@ DirHandle MetadataClient::FetchDir
     if (handle == NULL) {
       try {
         GigaBitmap mapping;
-        rpc_->GetClient(zeroth_server)->ReadBitmap(mapping, dir_id);
+        TraceSpan span("rpc_readbitmap");
+        GetService(zeroth_server)->ReadBitmap(mapping, dir_id);
         handle = dmap_cache_->Put(dir_id, ToLegacyMapping(mapping));
       }
       catch (FileNotFoundException &tx) {
@@ -173,7 +182,7 @@ DirHandle MetadataClient::FetchDir
       }
     }
   } /* end double-checking */
-  return DirHandle(dir, handle);
+  return DirHandle(dmap_cache_, dir_cache_, dir, handle);
 }
 
 Status MetadataClient::ResolvePath(Path &path, TINumber* parent,
@@ -202,6 +211,7 @@ Status MetadataClient::ResolvePath(Path &path, TINumber* parent,
 
 Status MetadataClient::Internal_ResolvePath(Path &path, TINumber* parent,
                  int* zeroth_server, std::string* entry, int* path_depth) {
+  TraceSpan span("resolve_path");
   int depth = 0;
   int pdir_id = 0;
   int pzeroth_server = 0;
@@ -251,7 +261,8 @@ Status MetadataClient::Lookup(int zeroth_server, TINumber parent,
     int server = SelectServer(handle, entry);
     ++num_retries;
     try {
-      rpc_->GetClient(server)->Access((*info), parent, entry, lease_time);
+      TraceSpan span("rpc_access");
+      GetService(server)->Access((*info), parent, entry, lease_time);
     } catch (ServerRedirectionException &sx) {
       UpdateBitmap(handle, sx.redirect);
       continue; // Retry again!
@@ -267,6 +278,7 @@ Status MetadataClient::Lookup(int zeroth_server, TINumber parent,
 
 Status MetadataClient::Getattr
   (Path &path, StatInfo *info) {
+  TraceScope trace("getattr");
   if (path == "/") {
     info->uid = info->gid = 0;
     info->mtime = info->ctime = 0;
@@ -318,7 +330,8 @@ Status MetadataClient::RPC_Getattr(TINumber parent, Path &entry, StatInfo* info,
     int server = SelectServer(handle, entry);
     srvs.push_back(server);
     try {
-      rpc_->GetClient(server)->Getattr((*info), parent, entry, lease_time);
+      TraceSpan span("rpc_getattr");
+      GetService(server)->Getattr((*info), parent, entry, lease_time);
     } catch (ServerRedirectionException &sx) {
       UpdateBitmap(handle, sx.redirect);
       continue; // Retry again!
@@ -332,6 +345,7 @@ Status MetadataClient::RPC_Getattr(TINumber parent, Path &entry, StatInfo* info,
 
 Status MetadataClient::Mknod
   (Path &path, int16_t permission) {
+  TraceScope trace("mknod");
   TINumber parent;
   int zeroth_server;
 
@@ -360,7 +374,8 @@ Status MetadataClient::RPC_Mknod
     int server = SelectServer(handle, entry);
     srvs.push_back(server);
     try {
-      rpc_->GetClient(server)->Mknod(parent, entry, permission);
+      TraceSpan span("rpc_mknod");
+      GetService(server)->Mknod(parent, entry, permission);
     } catch (ServerRedirectionException &sx) {
       UpdateBitmap(handle, sx.redirect);
       continue; // Retry again!
@@ -376,6 +391,7 @@ Status MetadataClient::RPC_Mknod
 
 Status MetadataClient::Mkdir
   (Path &path, int16_t permission) {
+  TraceScope trace("mkdir");
   TINumber parent;
   int zeroth_server;
 
@@ -402,7 +418,8 @@ Status MetadataClient::RPC_Mkdir
     int server = SelectServer(handle, entry);
     srvs.push_back(server);
     try {
-      rpc_->GetClient(server)->Mkdir(parent, entry, permission, hint_server);
+      TraceSpan span("rpc_mkdir");
+      GetService(server)->Mkdir(parent, entry, permission, hint_server);
     } catch (ServerRedirectionException &sx) {
       UpdateBitmap(handle, sx.redirect);
       continue; //Retry again!
@@ -420,6 +437,7 @@ Status MetadataClient::RPC_Mkdir
 
 Status MetadataClient::Chmod
   (Path &path, int16_t permission) {
+  TraceScope trace("chmod");
   TINumber parent;
   int zeroth_server;
 
@@ -441,7 +459,7 @@ Status MetadataClient::RPC_Chmod
   int server;
   server = SelectServer(handle, entry);
   try {
-    rpc_->GetClient(server)->Chmod(parent, entry, permission);
+    GetService(server)->Chmod(parent, entry, permission);
   } catch (ServerRedirectionException &sx) {
     UpdateBitmap(handle, sx.redirect);
     return RPC_Chmod(parent, entry, permission, handle);
@@ -453,6 +471,7 @@ Status MetadataClient::RPC_Chmod
 
 Status MetadataClient::Remove
   (Path &path) {
+  TraceScope trace("remove");
   TINumber parent;
   int zeroth_server;
 
@@ -475,7 +494,7 @@ Status MetadataClient::RPC_Remove
   int server;
   server = SelectServer(handle, entry);
   try {
-    rpc_->GetClient(server)->Remove(parent, entry);
+    GetService(server)->Remove(parent, entry);
   } catch (ServerRedirectionException &sx) {
     UpdateBitmap(handle, sx.redirect);
     return RPC_Remove(parent, entry, handle);
@@ -492,7 +511,7 @@ Status MetadataClient::RPC_Create(TINumber parent, Path &entry, int server,
 
   while (true) {
     try {
-      rpc_->GetClient(server)->CreateEntry(parent, entry, info, link, data);
+      GetService(server)->CreateEntry(parent, entry, info, link, data);
     } catch (ServerRedirectionException &sx) {
       UpdateBitmap(handle, sx.redirect);
       server = SelectServer(handle, entry);
@@ -508,6 +527,7 @@ Status MetadataClient::RPC_Create(TINumber parent, Path &entry, int server,
 }
 
 Status MetadataClient::Rename(Path &src, Path &dst) {
+  TraceScope trace("rename");
   //Not fault tolerant rename
   TINumber src_parent;
   int src_server;
@@ -535,11 +555,13 @@ Status MetadataClient::Rename(Path &src, Path &dst) {
   return RPC_Remove(src_parent, src_entry, src_handle);
 }
 
+// Reverse the lowest n bits of b
 static uint8_t reverse_bits(unsigned int b, unsigned int n) {
-  return ((b * 0x80200802ULL) & 0x0884422110ULL) * 0x0101010101ULL >> (32+sizeof(uint8_t)-n);
+  return ((b * 0x80200802ULL) & 0x0884422110ULL) * 0x0101010101ULL >> (32+8*sizeof(uint8_t)-n);
 }
 
 Status MetadataClient::Readdir(Path &path, std::vector<std::string>* result) {
+  TraceScope trace("readdir");
   TINumber dir_id;
   int server;
   int depth;
@@ -555,15 +577,17 @@ Status MetadataClient::Readdir(Path &path, std::vector<std::string>* result) {
   uint8_t curr_idx = 0;
   unsigned int curr_radix = handle.mapping->curr_radix;
   std::string start_key;
-  start_key.clear();
   while (curr_idx < (1 << curr_radix)) {
     uint8_t curr_partition = reverse_bits(curr_idx, curr_radix);
     if (get_bit_status(handle.mapping->bitmap, curr_partition) > 0) {
       server = giga_get_server_for_index(handle.mapping, curr_partition);
+      // Each partition is scanned from its start; the end key of the
+      // last scan of the previous partition is not set by the server
+      start_key.clear();
       ScanResult scan_result;
       do {
         try {
-          rpc_->GetClient(server)->Readdir(scan_result, dir_id,
+          GetService(server)->Readdir(scan_result, dir_id,
                                            curr_partition,
                                            start_key, kMaxNumScanEntries);
         } catch (ServerRedirectionException &sx) {
@@ -589,6 +613,7 @@ Status MetadataClient::Readdir(Path &path, std::vector<std::string>* result) {
 Status MetadataClient::ReaddirPlus(Path &path,
                                    std::vector<std::string>* names,
                                    std::vector<StatInfo>* entries) {
+  TraceScope trace("readdirplus");
   TINumber dir_id;
   int server;
   int depth;
@@ -604,15 +629,17 @@ Status MetadataClient::ReaddirPlus(Path &path,
   uint8_t curr_idx = 0;
   unsigned int curr_radix = handle.mapping->curr_radix;
   std::string start_key;
-  start_key.clear();
   while (curr_idx < (1 << curr_radix)) {
     uint8_t curr_partition = reverse_bits(curr_idx, curr_radix);
     if (get_bit_status(handle.mapping->bitmap, curr_partition) > 0) {
       server = giga_get_server_for_index(handle.mapping, curr_partition);
+      // Each partition is scanned from its start; the end key of the
+      // last scan of the previous partition is not set by the server
+      start_key.clear();
       ScanPlusResult scan_result;
       do {
         try {
-          rpc_->GetClient(server)->ReaddirPlus(scan_result, dir_id,
+          GetService(server)->ReaddirPlus(scan_result, dir_id,
                                                curr_partition, start_key,
                                                kMaxNumScanEntries);
         } catch (ServerRedirectionException &sx) {
@@ -646,7 +673,7 @@ Status MetadataClient::RPC_Open(int parent, Path &entry,
   int server = SelectServer(handle, entry);
   while (true) {
     try {
-      rpc_->GetClient(server)->OpenFile(ret, parent, entry, mode, 0);
+      GetService(server)->OpenFile(ret, parent, entry, mode, 0);
     } catch (ServerRedirectionException &sx) {
       UpdateBitmap(handle, sx.redirect);
       server = SelectServer(handle, entry);
@@ -670,6 +697,7 @@ int MetadataClient::AllocateFD() {
 }
 
 Status MetadataClient::Open(Path &path, int16_t mode, int *fd) {
+  TraceScope trace("open");
   TINumber parent;
   int zth_server;
   std::string entry;
@@ -696,6 +724,7 @@ Status MetadataClient::Open(Path &path, int16_t mode, int *fd) {
 
 Status MetadataClient::Read(int fd, size_t offset, size_t size, char *buf,
                             int *ret_size) {
+  TraceScope trace("read");
   if (fd_[fd] == 0) return Status::IOError("No such file descriptor");
   if (fd_[fd]->rf == 0) {
     MeasurementHelper helper(oRead, measure_);
@@ -706,7 +735,7 @@ Status MetadataClient::Read(int fd, size_t offset, size_t size, char *buf,
     ReadResult ret;
     while (true) {
       try {
-        rpc_->GetClient(server)->Read(ret, fd_[fd]->parent_dir_id,
+        GetService(server)->Read(ret, fd_[fd]->parent_dir_id,
                                       fd_[fd]->objname, offset, size);
       } catch (ServerRedirectionException &sx) {
         UpdateBitmap(handle, sx.redirect);
@@ -735,6 +764,7 @@ Status MetadataClient::Read(int fd, size_t offset, size_t size, char *buf,
 
 Status MetadataClient::Write(int fd, size_t offset, size_t size,
                              const char *buf) {
+  TraceScope trace("write");
   if (fd_[fd] == 0) return Status::IOError("No such file descriptor");
   if (fd_[fd]->wf == 0) {
     MeasurementHelper helper(oWrite, measure_);
@@ -745,7 +775,7 @@ Status MetadataClient::Write(int fd, size_t offset, size_t size,
     WriteResult ret;
     while (true) {
       try {
-        rpc_->GetClient(server)->Write(ret, fd_[fd]->parent_dir_id,
+        GetService(server)->Write(ret, fd_[fd]->parent_dir_id,
                       fd_[fd]->objname, std::string(buf, size), offset);
       } catch (ServerRedirectionException &sx) {
         UpdateBitmap(handle, sx.redirect);
@@ -769,6 +799,7 @@ Status MetadataClient::Write(int fd, size_t offset, size_t size,
 }
 
 Status MetadataClient::Close(int fd) {
+  TraceScope trace("close");
   if (fd_[fd] == 0) return Status::IOError("No such file descriptor");
   if (fd_[fd]->wf != 0) {
     fd_[fd]->wf->Close();
@@ -784,7 +815,7 @@ Status MetadataClient::Close(int fd) {
   int server = SelectServer(handle, fd_[fd]->objname);
   while (true) {
     try {
-      rpc_->GetClient(server)->CloseFile(fd_[fd]->parent_dir_id,
+      GetService(server)->CloseFile(fd_[fd]->parent_dir_id,
                                          fd_[fd]->objname, fd_[fd]->mode);
     } catch (ServerRedirectionException &sx) {
       UpdateBitmap(handle, sx.redirect);
@@ -16,6 +16,7 @@
 #include "client.h"
 #include "communication/rpc.h"
 #include "util/measurement.h"
+#include "util/trace.h"
 
 namespace indexfs {
 
@@ -70,6 +71,8 @@ class MetadataClient : public Client {
 
  protected:
 
+  MetadataServiceIf* GetService(int srv_id);
+
   int SelectServer(DirHandle &handle, Path &entry);
 
   void UpdateBitmap(DirHandle &handle, GigaBitmap &bitmap);
@@ -0,0 +1,412 @@
+// Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "trace_capture.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <sstream>
+
+#include "common/murmurhash3.h"
+
+namespace indexfs {
+
+const char* kCaptureOpNames[kNumCaptureOps] = {
+  "getattr", "mknod", "mkdir", "chmod", "remove", "rename", "readdir",
+  "readdirplus", "fsyncdir", "accessdir", "open", "read", "write", "close"
+};
+
+namespace {
+
+static const char kCaptureMagic[8] = { 'I', 'D', 'X', 'F', 'S', 'C', 'P', '1' };
+static const uint32_t kCaptureVersion = 1;
+
+// Chunk sizes bound the longest record, so longer paths are truncated
+static const size_t kChunkSize = 64 << 10;
+static const size_t kMaxCapturePath = 4096;
+// Full chunks waiting to be written, past which records are dropped
+static const int kMaxFullChunks = 1024;
+static const int kFlushIntervalMicros = 1000000;
+
+struct Chunk {
+  Chunk* next;
+  volatile size_t size;    // Bytes appended, published after the bytes
+  size_t flushed;          // Bytes written out, for the flusher only
+  char data[kChunkSize];
+};
+
+struct ThreadBuffer {
+  uint32_t thread;
+  Chunk* active;
+  std::string hashed;
+  std::string hashed2;
+  ThreadBuffer* prev;
+  ThreadBuffer* next;
+};
+
+FILE* capture_file = NULL;
+bool hash_paths = false;
+uint32_t hash_seed = 0;
+uint32_t next_thread = 0;
+int num_full_chunks = 0;
+uint64_t num_dropped = 0;
+Chunk* volatile full_chunks = NULL;   // Most recently filled first
+
+pthread_mutex_t start_mu = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t flush_mu = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t wakeup_mu = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t wakeup_cv = PTHREAD_COND_INITIALIZER;
+pthread_mutex_t threads_mu = PTHREAD_MUTEX_INITIALIZER;
+ThreadBuffer* threads = NULL;         // Threads that may hold chunks
+
+pthread_once_t key_once = PTHREAD_ONCE_INIT;
+pthread_key_t buffer_key;
+
+// Hand a chunk over to the flusher, and wake it up.  Wake-ups may be
+// missed, as the flusher does not hold wakeup_mu while flushing, but the
+// flusher wakes up every kFlushIntervalMicros anyway.
+void PushFullChunk(Chunk* chunk) {
+  Chunk* head;
+  do {
+    head = full_chunks;
+    chunk->next = head;
+  } while (!__sync_bool_compare_and_swap(&full_chunks, head, chunk));
+  __sync_add_and_fetch(&num_full_chunks, 1);
+  pthread_cond_signal(&wakeup_cv);
+}
+
+// Threads that exit hand their chunk over to the flusher
+void FreeThreadBuffer(void* arg) {
+  ThreadBuffer* buffer = reinterpret_cast<ThreadBuffer*>(arg);
+  pthread_mutex_lock(&threads_mu);
+  if (buffer->prev != NULL) buffer->prev->next = buffer->next;
+  if (buffer->next != NULL) buffer->next->prev = buffer->prev;
+  if (threads == buffer) threads = buffer->next;
+  pthread_mutex_unlock(&threads_mu);
+  if (buffer->active != NULL) {
+    PushFullChunk(buffer->active);
+  }
+  delete buffer;
+}
+
+void InitBufferKey() {
+  pthread_key_create(&buffer_key, &FreeThreadBuffer);
+}
+
+ThreadBuffer* GetThreadBuffer() {
+  static __thread ThreadBuffer* buffer = NULL;
+  if (buffer == NULL) {
+    pthread_once(&key_once, &InitBufferKey);
+    buffer = new ThreadBuffer;
+    buffer->thread = __sync_add_and_fetch(&next_thread, 1);
+    buffer->active = NULL;
+    buffer->prev = NULL;
+    pthread_mutex_lock(&threads_mu);
+    buffer->next = threads;
+    if (threads != NULL) threads->prev = buffer;
+    threads = buffer;
+    pthread_mutex_unlock(&threads_mu);
+    pthread_setspecific(buffer_key, buffer);
+  }
+  return buffer;
+}
+
+Chunk* NewChunk() {
+  Chunk* chunk = static_cast<Chunk*>(malloc(sizeof(Chunk)));
+  chunk->next = NULL;
+  chunk->size = 0;
+  chunk->flushed = 0;
+  return chunk;
+}
+
+// Write the bytes of a chunk appended since it was last written
+void WriteChunk(Chunk* chunk) {
+  size_t size = chunk->size;
+  __sync_synchronize();
+  if (size > chunk->flushed) {
+    fwrite(chunk->data + chunk->flushed, 1, size - chunk->flushed,
+           capture_file);
+    chunk->flushed = size;
+  }
+}
+
+// Replace each component of "path" by the hex of its keyed hash
+Path& HashPath(Path &path, std::string* result) {
+  result->clear();
+  size_t start = 0;
+  while (start < path.size()) {
+    size_t end = path.find('/', start);
+    if (end == std::string::npos) {
+      end = path.size();
+    }
+    if (end > start) {
+      uint32_t hash;
+      MurmurHash3_x86_32(path.data() + start, static_cast<int>(end - start),
+                         hash_seed, &hash);
+      char hex[8];
+      for (int i = 7; i >= 0; i--, hash >>= 4) {
+        hex[i] = "0123456789abcdef"[hash & 15];
+      }
+      result->append(hex, 8);
+    }
+    if (end < path.size()) {
+      result->push_back('/');
+    }
+    start = end + 1;
+  }
+  return *result;
+}
+
+uint8_t GetCaptureResult(const Status &s) {
+  if (s.ok()) return kCaptureOk;
+  if (s.IsNotFound()) return kCaptureNotFound;
+  if (s.IsCorruption()) return kCaptureCorruption;
+  if (s.IsIOError()) return kCaptureIOError;
+  return kCaptureOtherError;
+}
+
+void* FlushThread(void* arg) {
+  while (true) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    uint64_t deadline = static_cast<uint64_t>(now.tv_sec) * 1000000 +
+                        now.tv_usec + kFlushIntervalMicros;
+    struct timespec abstime;
+    abstime.tv_sec = deadline / 1000000;
+    abstime.tv_nsec = (deadline % 1000000) * 1000;
+    pthread_mutex_lock(&wakeup_mu);
+    if (full_chunks == NULL) {
+      pthread_cond_timedwait(&wakeup_cv, &wakeup_mu, &abstime);
+    }
+    pthread_mutex_unlock(&wakeup_mu);
+    TraceCapture::Flush();
+  }
+  return NULL;
+}
+
+void FlushAtExit() {
+  TraceCapture::Flush();
+}
+
+} // namespace
+
+volatile bool TraceCapture::enabled_ = false;
+
+uint64_t TraceCapture::NowMicros() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+Status TraceCapture::Start(const std::string &fname_prefix, bool hash,
+                           uint32_t seed) {
+  pthread_mutex_lock(&start_mu);
+  if (capture_file != NULL) {
+    pthread_mutex_unlock(&start_mu);
+    return Status::OK();
+  }
+  std::stringstream ss;
+  ss << fname_prefix << "." << getpid();
+  std::string fname = ss.str();
+  FILE* file = fopen(fname.c_str(), "wb");
+  if (file == NULL) {
+    int err = errno;
+    pthread_mutex_unlock(&start_mu);
+    return Status::IOError(fname, strerror(err));
+  }
+
+  CaptureHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kCaptureMagic, sizeof(header.magic));
+  header.version = kCaptureVersion;
+  header.flags = hash ? kCaptureHashedPaths : 0;
+  header.start_micros = NowMicros();
+  header.pid = getpid();
+  if (fwrite(&header, sizeof(header), 1, file) != 1) {
+    int err = errno;
+    fclose(file);
+    pthread_mutex_unlock(&start_mu);
+    return Status::IOError(fname, strerror(err));
+  }
+
+  pthread_t thread;
+  int ret = pthread_create(&thread, NULL, &FlushThread, NULL);
+  if (ret != 0) {
+    fclose(file);
+    pthread_mutex_unlock(&start_mu);
+    return Status::IOError("cannot create capture thread", strerror(ret));
+  }
+  pthread_detach(thread);
+  hash_paths = hash;
+  hash_seed = seed;
+  capture_file = file;
+  atexit(&FlushAtExit);
+  __sync_synchronize();
+  enabled_ = true;
+  pthread_mutex_unlock(&start_mu);
+  return Status::OK();
+}
+
+void TraceCapture::Record(int op, Path &path, Path* path2, int32_t arg,
+                          const Status &s, uint64_t start) {
+  if (!enabled_) {
+    return;
+  }
+  uint64_t end = NowMicros();
+  ThreadBuffer* buffer = GetThreadBuffer();
+  Path* p = &path;
+  Path* p2 = path2;
+  if (hash_paths) {
+    p = &HashPath(path, &buffer->hashed);
+    if (p2 != NULL) {
+      p2 = &HashPath(*path2, &buffer->hashed2);
+    }
+  }
+  size_t path_size = std::min(p->size(), kMaxCapturePath);
+  size_t path2_size = p2 != NULL ? std::min(p2->size(), kMaxCapturePath) : 0;
+  size_t size = sizeof(CaptureRecord) + path_size + path2_size;
+  size = (size + 7) & ~size_t(7);
+
+  // The flusher reads buffer->active, so a chunk is only made active
+  // once initialized, and stops being active before it can be freed
+  Chunk* chunk = buffer->active;
+  if (chunk != NULL && chunk->size + size > kChunkSize) {
+    buffer->active = NULL;
+    PushFullChunk(chunk);
+    chunk = NULL;
+  }
+  if (chunk == NULL) {
+    if (num_full_chunks >= kMaxFullChunks) {
+      __sync_add_and_fetch(&num_dropped, 1);
+      return;
+    }
+    chunk = NewChunk();
+    __sync_synchronize();
+    buffer->active = chunk;
+  }
+
+  char* dst = chunk->data + chunk->size;
+  CaptureRecord* rec = reinterpret_cast<CaptureRecord*>(dst);
+  memset(rec, 0, sizeof(CaptureRecord));
+  rec->start_micros = start;
+  uint64_t latency = end > start ? end - start : 0;
+  rec->latency_micros = latency > 0xffffffffu ? 0xffffffffu
+                                              : static_cast<uint32_t>(latency);
+  rec->thread = buffer->thread;
+  rec->arg = arg;
+  rec->op = static_cast<uint8_t>(op);
+  rec->result = GetCaptureResult(s);
+  rec->path_size = static_cast<uint16_t>(path_size);
+  rec->path2_size = static_cast<uint16_t>(path2_size);
+  dst += sizeof(CaptureRecord);
+  memcpy(dst, p->data(), path_size);
+  dst += path_size;
+  if (path2_size > 0) {
+    memcpy(dst, p2->data(), path2_size);
+    dst += path2_size;
+  }
+  memset(dst, 0, chunk->data + chunk->size + size - dst);
+  // Publish the record to the flusher
+  __sync_synchronize();
+  chunk->size += size;
+}
+
+void TraceCapture::Flush() {
+  if (!enabled_) {
+    return;
+  }
+  pthread_mutex_lock(&flush_mu);
+  Chunk* list = __sync_lock_test_and_set(&full_chunks, NULL);
+  Chunk* ordered = NULL;
+  while (list != NULL) {
+    Chunk* next = list->next;
+    list->next = ordered;
+    ordered = list;
+    list = next;
+  }
+  while (ordered != NULL) {
+    Chunk* next = ordered->next;
+    WriteChunk(ordered);
+    free(ordered);
+    __sync_sub_and_fetch(&num_full_chunks, 1);
+    ordered = next;
+  }
+  // Chunks still being filled are only read up to what has been
+  // published; they are freed by the flusher once full
+  pthread_mutex_lock(&threads_mu);
+  for (ThreadBuffer* buffer = threads; buffer != NULL;
+       buffer = buffer->next) {
+    Chunk* chunk = buffer->active;
+    if (chunk != NULL) {
+      WriteChunk(chunk);
+    }
+  }
+  pthread_mutex_unlock(&threads_mu);
+  fflush(capture_file);
+
+  uint64_t dropped = __sync_lock_test_and_set(&num_dropped, 0);
+  if (dropped > 0) {
+    fprintf(stderr, "trace capture: dropped %llu records\n",
+            static_cast<unsigned long long>(dropped));
+  }
+  pthread_mutex_unlock(&flush_mu);
+}
+
+CaptureReader::CaptureReader()
+  : file_(NULL) {
+  memset(&header_, 0, sizeof(header_));
+}
+
+CaptureReader::~CaptureReader() {
+  if (file_ != NULL) {
+    fclose(file_);
+  }
+}
+
+Status CaptureReader::Open(const std::string &fname) {
+  fname_ = fname;
+  file_ = fopen(fname.c_str(), "rb");
+  if (file_ == NULL) {
+    return Status::IOError(fname, strerror(errno));
+  }
+  if (fread(&header_, sizeof(header_), 1, file_) != 1 ||
+      memcmp(header_.magic, kCaptureMagic, sizeof(kCaptureMagic)) != 0 ||
+      header_.version != kCaptureVersion) {
+    return Status::Corruption(fname, "not a capture file");
+  }
+  return Status::OK();
+}
+
+bool CaptureReader::Next(CaptureRecord* rec, std::string* path,
+                         std::string* path2) {
+  if (!status_.ok()) {
+    return false;
+  }
+  size_t n = fread(rec, 1, sizeof(CaptureRecord), file_);
+  if (n == 0 && feof(file_)) {
+    return false;
+  }
+  if (n != sizeof(CaptureRecord)) {
+    status_ = Status::Corruption(fname_, "truncated record");
+    return false;
+  }
+  size_t size = rec->path_size + rec->path2_size;
+  size_t padded = ((sizeof(CaptureRecord) + size + 7) & ~size_t(7))
+                  - sizeof(CaptureRecord);
+  buffer_.resize(padded);
+  if (padded > 0 && fread(&buffer_[0], 1, padded, file_) != padded) {
+    status_ = Status::Corruption(fname_, "truncated record");
+    return false;
+  }
+  path->assign(buffer_.data(), rec->path_size);
+  path2->assign(buffer_.data() + rec->path_size, rec->path2_size);
+  return true;
+}
+
+} /* namespace indexfs */
@@ -0,0 +1,134 @@
+// Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Capture of the operations applications perform through the client, so
+// that production workloads can be replayed against other setups.
+//
+// When FS_CAPTURE_FILE is set, clients made by the default factory record
+// every call: op, path, argument, result, start time and latency.  Each
+// thread appends records to a chunk of its own without locking; full
+// chunks go on a lock-free list, and a background thread writes them, and
+// whatever the threads have appended since, to <FS_CAPTURE_FILE>.<pid>
+// as chunks fill up and at least every second, on client disposal and at
+// exit.  If the disk cannot keep up, records are dropped rather than
+// stalling the application.
+//
+// Path components may be replaced by seeded 32-bit MurmurHash3 hashes,
+// which keeps the shape of the namespace and makes captures harder to
+// read, but does not anonymize them: the hash is not cryptographic, the
+// seed can be found by search from one known name, and common names can
+// then be recognized.  trace_convert turns capture files into binary
+// traces for replay_test.
+//
+// A capture file is a CaptureHeader followed by records, each made of a
+// CaptureRecord, path bytes and path2 bytes, padded to 8 bytes.  Records
+// of different threads interleave, and are not strictly ordered by time.
+
+#ifndef _INDEXFS_CLIENT_TRACE_CAPTURE_H_
+#define _INDEXFS_CLIENT_TRACE_CAPTURE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+#include "common/common.h"
+
+namespace indexfs {
+
+enum CaptureOp {
+  kCaptureGetattr, kCaptureMknod, kCaptureMkdir, kCaptureChmod,
+  kCaptureRemove, kCaptureRename, kCaptureReaddir, kCaptureReaddirPlus,
+  kCaptureFsyncdir, kCaptureAccessDir, kCaptureOpen, kCaptureRead,
+  kCaptureWrite, kCaptureClose, kNumCaptureOps
+};
+
+extern const char* kCaptureOpNames[kNumCaptureOps];
+
+enum CaptureResult {
+  kCaptureOk, kCaptureNotFound, kCaptureCorruption, kCaptureIOError,
+  kCaptureOtherError
+};
+
+enum CaptureFlags {
+  kCaptureHashedPaths = 1
+};
+
+struct CaptureHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint64_t start_micros;   // When the capture started
+  uint64_t pid;
+};
+
+struct CaptureRecord {
+  uint64_t start_micros;
+  uint32_t latency_micros;
+  uint32_t thread;         // Numbered from 1 in order of first capture
+  int32_t arg;             // Permission, mode or file descriptor
+  uint8_t op;
+  uint8_t result;
+  uint16_t path_size;
+  uint16_t path2_size;
+  uint16_t reserved;
+  uint32_t reserved2;
+};
+
+class TraceCapture {
+ public:
+  // Start capturing into <fname_prefix>.<pid>, hashing path components
+  // with "hash_seed" if "hash_paths" is set.  Does nothing if already
+  // capturing; once started, capture goes on until the process exits.
+  static Status Start(const std::string &fname_prefix, bool hash_paths,
+                      uint32_t hash_seed);
+
+  static bool Enabled() { return enabled_; }
+
+  // Record an op that started at "start" and has just finished;
+  // path2 is NULL for single-path ops.
+  static void Record(int op, Path &path, Path* path2, int32_t arg,
+                     const Status &s, uint64_t start);
+
+  // Write out all records captured so far
+  static void Flush();
+
+  static uint64_t NowMicros();
+
+ private:
+  static volatile bool enabled_;
+
+  TraceCapture();
+};
+
+// Reads capture files, record by record
+class CaptureReader {
+ public:
+  CaptureReader();
+  ~CaptureReader();
+
+  Status Open(const std::string &fname);
+
+  const CaptureHeader& header() const { return header_; }
+
+  // Read the next record, returning false at the end of the file or on
+  // error, in which case status() tells which.
+  bool Next(CaptureRecord* rec, std::string* path, std::string* path2);
+
+  Status status() const { return status_; }
+
+ private:
+  FILE* file_;
+  std::string fname_;
+  CaptureHeader header_;
+  Status status_;
+  std::string buffer_;
+
+  // No copying allowed
+  CaptureReader(const CaptureReader&);
+  CaptureReader& operator=(const CaptureReader&);
+};
+
+} /* namespace indexfs */
+
+#endif /* _INDEXFS_CLIENT_TRACE_CAPTURE_H_ */
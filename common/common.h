@@ -12,6 +12,7 @@
 #include "leveldb/util/mutexlock.h"
 
 #include "port/port.h"
+#include "port/lock_profile.h"
 #include "thrift/indexfs_types.h"
 
 namespace indexfs {
@@ -23,6 +24,7 @@ using leveldb::Cache;
 using leveldb::MutexLock;
 using leveldb::port::CondVar;
 using leveldb::port::Mutex;
+using leveldb::port::LockClass;
 using leveldb::Options;
 using leveldb::WritableFile;
 using leveldb::RandomAccessFile;
@@ -119,6 +119,18 @@ Status Config::SetServers(const std::vector<std::pair<std::string, int> > &serve
   return Status::OK();
 }
 
+// Directly set the storage directories, in place of loading them from
+// a configuration file. Used to run several servers within one process.
+//
+Status Config::SetStorageDirs(const std::string &file_dir,
+                              const std::string &split_dir,
+                              const std::string &leveldb_dir) {
+  file_dir_ = file_dir;
+  split_dir_ = split_dir;
+  leveldb_dir_ = leveldb_dir;
+  return Status::OK();
+}
+
 // Retrieve a fixed set of member servers by loading their IP addresses and port numbers
 // from a user-specified server list file. If we already have a set of member servers, then
 // the provided server list will be ignored and no server will be loaded.
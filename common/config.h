@@ -176,9 +176,70 @@ class Config {
     return result > 0 ? result : DEFAULT_DENT_CACHE_SIZE;
   }
 
+  // Returns N if one in every N operations is to be traced, or 0 if
+  // tracing is disabled.
+  //
+  int GetTraceSampleRate() {
+    const char* env = getenv("FS_TRACE_SAMPLE");
+    int result = ( env != NULL ? atoi(env) : 0 );
+    return result > 0 ? result : 0;
+  }
+
+  // Returns the latency in micros over which traced operations are
+  // printed to the slow op log.
+  //
+  int GetTraceSlowMicros() {
+    const char* env = getenv("FS_TRACE_SLOW_MICROS");
+    int result = ( env != NULL ? atoi(env) : DEFAULT_TRACE_SLOW_MICROS );
+    return result >= 0 ? result : DEFAULT_TRACE_SLOW_MICROS;
+  }
+
+  // Returns the number of hot directories and entries tracked per
+  // operation type, or 0 if they are not tracked.
+  //
+  int GetHotKeysCapacity() {
+    const char* env = getenv("FS_HOT_KEYS");
+    int result = ( env != NULL ? atoi(env) : DEFAULT_HOT_KEYS );
+    return result >= 0 ? result : DEFAULT_HOT_KEYS;
+  }
+
+  // Returns the half life of the hot directory and entry counts in
+  // seconds.
+  //
+  int GetHotKeysHalfLife() {
+    const char* env = getenv("FS_HOT_KEYS_HALF_LIFE");
+    int result = ( env != NULL ? atoi(env) : DEFAULT_HOT_KEYS_HALF_LIFE );
+    return result > 0 ? result : DEFAULT_HOT_KEYS_HALF_LIFE;
+  }
+
+  // Returns the prefix of the files into which clients capture the
+  // operations they perform, or an empty string if they do not.
+  //
+  std::string GetCaptureFile() {
+    const char* env = getenv("FS_CAPTURE_FILE");
+    return env != NULL ? env : "";
+  }
+
+  // Returns true if captured path components are hashed, which they are
+  // whenever FS_CAPTURE_HASH_SEED is set, even to 0.
+  //
+  bool IsCaptureHashed() {
+    return getenv("FS_CAPTURE_HASH_SEED") != NULL;
+  }
+
+  // Returns the seed with which captured path components are hashed.
+  //
+  uint32_t GetCaptureHashSeed() {
+    const char* env = getenv("FS_CAPTURE_HASH_SEED");
+    return env != NULL ? static_cast<uint32_t>(strtoul(env, NULL, 10)) : 0;
+  }
+
   Status SetServerID(int srv_id);
   Status SetServers(const std::vector<std::string> &servers);
   Status SetServers(const std::vector<std::pair<std::string, int> > &servers);
+  Status SetStorageDirs(const std::string &file_dir,
+                        const std::string &split_dir,
+                        const std::string &leveldb_dir);
 
   Status LoadNetworkInfo();
   Status LoadServerList(const std::string &file_name);
@@ -5,6 +5,7 @@
 #ifndef _INDEXFS_COUNTER_H_
 #define _INDEXFS_COUNTER_H_
 
+#include <algorithm>
 #include "common.h"
 
 namespace indexfs {
@@ -63,6 +64,60 @@ struct ClientCounter {
   }
 };
 
+// Number of leases granted and not yet expired.  Leases are counted in
+// the slot of the 100ms period they expire in; slots cover the next
+// kNumSlots periods, and longer leases count as expiring in the last one.
+class LeaseCounter {
+ public:
+  enum { kNumSlots = 128 };
+  static const uint64_t kSlotMicros = 100000;
+
+  LeaseCounter() {
+    for (int i = 0; i < kNumSlots; ++i) {
+      period_[i] = 0;
+      count_[i] = 0;
+    }
+  }
+
+  // A lease that expired at old_expire, or none if it is in the past,
+  // now expires at new_expire.
+  void Extend(uint64_t old_expire, uint64_t new_expire, uint64_t now) {
+    uint64_t horizon = now / kSlotMicros + kNumSlots - 1;
+    uint64_t old_period = std::min(old_expire / kSlotMicros, horizon);
+    uint64_t new_period = std::min(new_expire / kSlotMicros, horizon);
+    MutexLock l(&mu_);
+    if (old_expire > now) {
+      int slot = old_period % kNumSlots;
+      if (period_[slot] == old_period && count_[slot] > 0)
+        count_[slot]--;
+    }
+    if (new_expire > now) {
+      int slot = new_period % kNumSlots;
+      if (period_[slot] != new_period) {
+        period_[slot] = new_period;
+        count_[slot] = 0;
+      }
+      count_[slot]++;
+    }
+  }
+
+  uint64_t Active(uint64_t now) {
+    uint64_t current = now / kSlotMicros;
+    uint64_t active = 0;
+    MutexLock l(&mu_);
+    for (int i = 0; i < kNumSlots; ++i) {
+      if (period_[i] >= current)
+        active += count_[i];
+    }
+    return active;
+  }
+
+ private:
+  Mutex mu_;
+  uint64_t period_[kNumSlots];
+  uint64_t count_[kNumSlots];
+};
+
 } // indexfs namespace
 
 #endif /* COUNTER_H_ */
@@ -119,6 +119,10 @@ class DirEntryCache {
     return cache_->Insert(key, value, 1, &DeleteEntry<TEntry>);
   }
 
+  void GetLookupStats(uint64_t* lookups, uint64_t* hits) {
+    cache_->GetLookupStats(lookups, hits);
+  }
+
   void Evict(const TINumber dir_id, const std::string &objname) {
     Status s;
     std::string key = objname;
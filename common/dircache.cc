@@ -12,6 +12,8 @@ DirCache::DirCache(int entries)
   : capacity_(entries) {
     mutexs_ = new Mutex[kNumShards];
     dirs_ = new std::map<TINumber, Directory*>[kNumShards];
+    lookups_ = new uint64_t[kNumShards]();
+    hits_ = new uint64_t[kNumShards]();
     (void) capacity_;
 }
 
@@ -23,6 +25,8 @@ DirCache::~DirCache() {
   }
   delete [] dirs_;
   delete [] mutexs_;
+  delete [] lookups_;
+  delete [] hits_;
 }
 
 void DirCache::Get(const TINumber dir_id,
@@ -32,10 +36,14 @@ void DirCache::Get(const TINumber dir_id,
   std::map<TINumber, Directory*>::iterator it;
   it = dirs_[shard].find(dir_id);
 
+  lookups_[shard]++;
   if (it != dirs_[shard].end()) {
     *directory = it->second;
+    hits_[shard]++;
   } else {
     *directory = new Directory();
+    (*directory)->partition_mtx.SetLockClass(
+        LockClass::Get("partition_mtx"), dir_id);
     dirs_[shard].insert(
         std::pair<TINumber, Directory*>(dir_id, *directory));
   }
@@ -64,4 +72,14 @@ void DirCache::Evict(const TINumber dir_id) {
   }
 }
 
+void DirCache::GetLookupStats(uint64_t* lookups, uint64_t* hits) {
+  *lookups = 0;
+  *hits = 0;
+  for (int i = 0; i < kNumShards; ++i) {
+    MutexLock l(&mutexs_[i]);
+    *lookups += lookups_[i];
+    *hits += hits_[i];
+  }
+}
+
 } // namespace indexfs
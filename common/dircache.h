@@ -14,11 +14,17 @@ struct Directory {
   int partition_size;
   short refcount;
   short split_flag;
+  // Partition a running split moves entries to while it works without
+  // partition_mtx, or -1.  Operations on those entries wait for it.
+  int split_index;
+  // Writers asleep on a lease with partition_mtx released.
+  short lease_sleepers;
 
   Mutex partition_mtx;
   CondVar partition_cv;
 
   Directory() : partition_size(0), refcount(1), split_flag(0),
+                split_index(-1), lease_sleepers(0),
                 partition_cv(&partition_mtx) {
   }
 };
@@ -38,10 +44,16 @@ class DirCache {
 
   void Evict(const TINumber dir_id);
 
+  // Store the number of Get() calls made so far and how many of them
+  // found the directory already open.
+  void GetLookupStats(uint64_t* lookups, uint64_t* hits);
+
  private:
 
   Mutex *mutexs_;
   std::map<TINumber, Directory*> *dirs_;
+  uint64_t *lookups_;  // Per shard, guarded by the shard mutex
+  uint64_t *hits_;
   int capacity_;
 };
 
@@ -10,13 +10,19 @@
 
 namespace indexfs {
 
+// A referenced directory and its mapping, released back to the caches
+// they came from when the handle goes out of scope.  Handles carry their
+// caches, so that servers and clients sharing a process keep apart.
 class DirHandle {
  public:
-  DirHandle() : mapping(NULL), dir(NULL), handle_(NULL) {
+  DirHandle() : mapping(NULL), dir(NULL), handle_(NULL),
+    dmap_cache_(NULL), dir_cache_(NULL) {
   }
 
-  DirHandle(Directory* newdir, Cache::Handle* newhandle)
-    : dir(newdir), handle_(newhandle) {
+  DirHandle(DirMappingCache* dmap_cache, DirCache* dir_cache,
+            Directory* newdir, Cache::Handle* newhandle)
+    : dir(newdir), handle_(newhandle),
+      dmap_cache_(dmap_cache), dir_cache_(dir_cache) {
     mapping = (handle_ != NULL) ? dmap_cache_->Value(handle_) : NULL;
   }
 
@@ -28,24 +34,13 @@ class DirHandle {
     }
   }
 
-  void Setup(Directory* newdir, Cache::Handle* newhandle) {
-    if (newdir != NULL && newhandle != NULL) {
-      dir = newdir;
-      handle_ = newhandle;
-      mapping = dmap_cache_->Value(handle_);
-    } else {
-      dir = NULL;
-      handle_ = NULL;
-      mapping = NULL;
-    }
-  }
-
   giga_mapping_t* mapping;
   Directory* dir;
   Cache::Handle* handle_;
 
-  static DirMappingCache* dmap_cache_;
-  static DirCache* dir_cache_;
+ private:
+  DirMappingCache* dmap_cache_;
+  DirCache* dir_cache_;
 };
 
 } // namespace indexfs
@@ -58,4 +58,8 @@ void DirMappingCache::Evict(const TINumber dir_id) {
   cache_->Erase(key);
 }
 
+void DirMappingCache::GetLookupStats(uint64_t* lookups, uint64_t* hits) {
+  cache_->GetLookupStats(lookups, hits);
+}
+
 } // indexfs
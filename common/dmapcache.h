@@ -34,6 +34,8 @@ class DirMappingCache {
 
   void Evict(const TINumber dir_id);
 
+  void GetLookupStats(uint64_t* lookups, uint64_t* hits);
+
  private:
   Cache* cache_;
 };
@@ -36,5 +36,11 @@
 #define DEFAULT_DENT_CACHE_SIZE  (1<<16)
 // Default size of the directory mapping cache
 #define DEFAULT_DMAP_CACHE_SIZE  (1<<15)
+// Default latency over which traced operations are logged, in micros
+#define DEFAULT_TRACE_SLOW_MICROS 100000
+// Default number of hot directories and entries tracked per operation
+#define DEFAULT_HOT_KEYS         32
+// Default half life of the hot directory and entry counts, in seconds
+#define DEFAULT_HOT_KEYS_HALF_LIFE 60
 
 #endif /* _INDEXFS_LEGACY_OPTIONS_H_ */
@@ -2,8 +2,11 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
+#include <string.h>
+
 #include "rpc.h"
 #include "rpc_helper.h"
+#include "util/trace.h"
 
 namespace indexfs {
 
@@ -163,6 +166,23 @@ MetadataServiceIf* RPC::GetClient(int srv_id) {
   return _return;
 }
 
+namespace {
+
+// A SetTrace() call leaves its trace ID pending for the call that follows
+// it on the connection.  Once that call is over, drop the ID even if the
+// call failed, or had no TraceScope, so that the next call on this thread
+// does not join a stale trace.
+class PendingTraceCleaner : public TProcessorEventHandler {
+ public:
+  virtual void freeContext(void* ctx, const char* fn_name) {
+    if (strcmp(fn_name, "MetadataService.SetTrace") != 0) {
+      Tracer::ClearPending();
+    }
+  }
+};
+
+} // namespace
+
 struct RPC_Server::RPC_Internal_Server {
   
   virtual ~RPC_Internal_Server() {
@@ -177,6 +197,8 @@ struct RPC_Server::RPC_Internal_Server {
     , socket_(new TServerSocket(port))
     , protocol_factory_(new TBinaryProtocolFactory())
     , transport_factory_(new TBufferedTransportFactory()) {
+    processor_->setEventHandler(
+      shared_ptr<TProcessorEventHandler>(new PendingTraceCleaner()));
     server_ = new TThreadedServer(
       processor_, socket_, transport_factory_, protocol_factory_);
     CHECK(server_ != NULL) << "Fail to establish a new RPC server";
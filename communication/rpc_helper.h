@@ -13,6 +13,7 @@ using boost::shared_ptr;
 #include <thrift/TProcessor.h>
 
 using apache::thrift::TProcessor;
+using apache::thrift::TProcessorEventHandler;
 
 #include <thrift/protocol/TProtocol.h>
 #include <thrift/protocol/TBinaryProtocol.h>
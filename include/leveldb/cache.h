@@ -26,7 +26,9 @@ namespace leveldb {
 class Cache;
 
 // Create a new cache with a fixed size capacity.  This implementation
-// of Cache uses a least-recently-used eviction policy.
+// of Cache uses a segmented least-recently-used eviction policy: entries
+// that have been looked up (other than by LookupForScan()) since they
+// were inserted are protected from eviction by entries that have not.
 extern Cache* NewLRUCache(size_t capacity);
 
 class Cache {
@@ -59,6 +61,13 @@ class Cache {
   // longer needed.
   virtual Handle* Lookup(const Slice& key) = 0;
 
+  // Like Lookup(), but on behalf of a long scan that touches each entry
+  // once.  A hit does not count as reuse of the entry, so a scan can not
+  // promote entries above those used by other clients.
+  //
+  // The default implementation simply calls Lookup().
+  virtual Handle* LookupForScan(const Slice& key);
+
   // Release a mapping returned by a previous Lookup().
   // REQUIRES: handle must not have been released yet.
   // REQUIRES: handle must have been returned by a method on *this.
@@ -81,6 +90,12 @@ class Cache {
   // its cache keys.
   virtual uint64_t NewId() = 0;
 
+  // Store in *lookups the number of Lookup() calls made so far and in
+  // *hits how many of them found an entry.  LookupForScan() calls are
+  // not counted.  The default implementation
+  // reports zero for both.
+  virtual void GetLookupStats(uint64_t* lookups, uint64_t* hits);
+
  private:
   void LRU_Remove(Handle* e);
   void LRU_Append(Handle* e);
@@ -68,6 +68,15 @@ class DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Record "value" as a merge operand for "key" without reading the
+  // current entry.  Reads combine the operands with the value beneath
+  // them through options.merge_operator.  Returns NotSupported if no
+  // merge operator was configured when the database was opened.
+  // Note: consider setting options.sync = true.
+  virtual Status Merge(const WriteOptions& options,
+                       const Slice& key,
+                       const Slice& value);
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
@@ -83,11 +92,33 @@ class DB {
   virtual Status Get(const ReadOptions& options,
                      const Slice& key, std::string* value) = 0;
 
+  // If the database contains an entry for "key" call
+  // (*visitor)(arg, value) with the corresponding value and return OK.
+  // The value points into the memtable or into a block pinned in the
+  // block cache and is only valid during the call, so nothing is copied
+  // or allocated for it.
+  //
+  // If there is no entry for "key" return a status for which
+  // Status::IsNotFound() returns true without calling "visitor".
+  typedef void (*ValueVisitor)(void* arg, const Slice& value);
+  virtual Status Get(const ReadOptions& options, const Slice& key,
+                     ValueVisitor visitor, void* arg);
+
+  // Return OK if the database contains an entry for "key".
   virtual Status Exists(const ReadOptions& options,
-                        const Slice& key) {
-    std::string tmp;
-    return Get(options, key, &tmp);
-  }
+                        const Slice& key);
+
+  // Look up keys[0,n-1] in one batch.  For each keys[i] that is found,
+  // call (*visitor)(arg, i, value) as Get() would; store the status of
+  // each lookup in statuses[i].  Keys need not be sorted or distinct.
+  //
+  // The batch shares one view of the database and visits the tables in
+  // key order, so each table and data block it needs is fetched once.
+  typedef void (*MultiValueVisitor)(void* arg, int index, const Slice& value);
+  virtual void MultiGet(const ReadOptions& options,
+                        int n, const Slice* keys,
+                        MultiValueVisitor visitor, void* arg,
+                        Status* statuses);
 
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
@@ -117,6 +148,11 @@ class DB {
   //
   //  "leveldb.num-files-at-level<N>" - return the number of files at level <N>,
   //     where <N> is an ASCII representation of a level number (e.g. "0").
+  //  "leveldb.bytes-at-level<N>" - return the total size of the files at
+  //     level <N>.
+  //  "leveldb.counters" - returns "name value" lines of running totals:
+  //     compactions, bytes they read and wrote, and writes delayed
+  //     waiting for room in the memtable and the time they waited.
   //  "leveldb.stats" - returns a multi-line string that describes statistics
   //     about the internal operation of the DB.
   //  "leveldb.sstables" - returns a multi-line string that describes all
@@ -162,6 +198,15 @@ class DB {
                             uint64_t min_sequence_number,
                             uint64_t max_sequence_number) = 0;
 
+  // Keep the values of the keys in [*begin, *end], as seen by "options",
+  // readable for good, even once they are overwritten or deleted.  Call
+  // before copying the raw index entries of the keys out of the
+  // database (e.g. Iterator::internalvalue() of a ColumnDB) to split
+  // them off elsewhere.  The default implementation does nothing, as
+  // the index entries of a plain DB hold the values themselves.
+  virtual Status PinValues(const ReadOptions& options,
+                           const Slice* begin, const Slice* end);
+
  private:
   // No copying allowed
   DB(const DB&);
@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 namespace leveldb {
 
@@ -14,6 +15,7 @@ class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class MergeOperator;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -27,6 +29,27 @@ enum CompressionType {
   kSnappyCompression = 0x1
 };
 
+// The following enum describes how the keys of a block are laid out.
+enum BlockFormat {
+  // Keys are prefix-compressed against their predecessor and found by
+  // binary searching sparse restart points.  Works for any keys.
+  kPrefixCompressedBlock = 0x0,
+
+  // Keys are stored whole in a fixed-stride array, followed by the
+  // values and an array of value offsets, so any entry can be reached
+  // without decoding its neighbours.  Only used for blocks whose keys
+  // all have the same length; other blocks fall back to
+  // kPrefixCompressedBlock.  Costs space unless keys share few bytes.
+  kFixedKeyBlock = 0x1,
+
+  // Like kFixedKeyBlock, but each value is stored as a patch against the
+  // first value of the block: only the 8-byte groups that differ from it
+  // are kept, down to the differing bytes.  Suits blocks of records with
+  // the same layout and mostly equal fields (e.g. stat records of one
+  // directory) at a small decoding cost per value read.
+  kFixedKeyDeltaBlock = 0x2
+};
+
 // Options to control the behavior of a database (passed to DB::Open)
 struct Options {
   // -------------------
@@ -97,6 +120,14 @@ struct Options {
   // Default: NULL
   Cache* block_cache;
 
+  // If true, table files are opened with Env::NewRandomAccessFile(),
+  // which may memory map them.  Blocks of mapped tables that need no
+  // decompression are read in place and never enter block_cache.  If
+  // false, tables are opened with Env::NewUnmappedRandomAccessFile(),
+  // so that every block read can be cached.
+  // Default: true
+  bool allow_mmap_reads;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -112,6 +143,13 @@ struct Options {
   // Default: 16
   int block_restart_interval;
 
+  // Layout to use for blocks whose keys all have the same length.
+  // Readers accept either layout regardless of this setting.  This
+  // parameter can be changed dynamically.
+  //
+  // Default: kPrefixCompressedBlock
+  BlockFormat block_format;
+
   // Compress blocks using the specified compression algorithm.  This
   // parameter can be changed dynamically.
   //
@@ -135,6 +173,15 @@ struct Options {
   // Default: NULL
   const FilterPolicy* filter_policy;
 
+  // If non-NULL, DB::Merge() is available and uses this operator to
+  // combine the operands it records with the values they apply to.
+  //
+  // REQUIRES: the operator must have the same name as the one given to
+  // previous open calls on the same DB if there may be operands left.
+  //
+  // Default: NULL
+  const MergeOperator* merge_operator;
+
   // If false, no write ahead log will be written.
   // With no write ahead log, the system is vulnerable to system crash, resulting
   // in data loss.
@@ -162,6 +209,35 @@ struct Options {
 
   bool disable_compaction;
 
+  // If true, the leader of a write group lets every writer in the group
+  // insert its own batch into the memtable in parallel instead of
+  // inserting the whole group by itself.  Helps when many threads issue
+  // small writes at the same time.
+  //
+  // Default: false
+  bool allow_concurrent_memtable_write;
+
+  // ColumnDB only: seconds between rounds of value log garbage
+  // collection, which copies the live records out of mostly dead data
+  // files and deletes those files.  0 disables the background
+  // collector.
+  //
+  // Default: 0
+  int value_gc_interval;
+
+  // ColumnDB only: a data file is collected once at least this
+  // percentage of its bytes is estimated to be garbage.
+  //
+  // Default: 50
+  int value_gc_garbage_percent;
+
+  // ColumnDB only: upper bound on the bytes per second the collector
+  // reads from data files, so that it does not starve foreground work.
+  // 0 means no limit.
+  //
+  // Default: 16MB
+  uint64_t value_gc_bytes_per_second;
+
   // Create an Options object with default values for all fields.
   Options();
 };
@@ -178,6 +254,27 @@ struct ReadOptions {
   // Default: true
   bool fill_cache;
 
+  // Set for large scans.  Cached blocks read for this iteration are
+  // not treated as reused (see Cache::LookupForScan()), so the blocks
+  // the scan brings in are evicted before the working set of other
+  // reads.
+  // Default: false
+  bool scan_hint;
+
+  // If positive, iterators moving forward ask the Env to fetch this
+  // many data blocks ahead of their position in each table.  Meant for
+  // long scans of data that may not be cached.
+  // Default: 0
+  int readahead_blocks;
+
+  // If true and readahead_blocks is positive, a ColumnDB iterator whose
+  // values are out of write order also prefetches the records of that
+  // many values ahead.  Each prefetch reads whole chunks of the data
+  // files, which is wasted when the values are already cached or the
+  // scan stops early.
+  // Default: false
+  bool prefetch_values;
+
   // If "snapshot" is non-NULL, read as of the supplied snapshot
   // (which must belong to the DB that is being read and which must
   // not have been released).  If "snapshot" is NULL, use an impliicit
@@ -188,6 +285,9 @@ struct ReadOptions {
   ReadOptions()
       : verify_checksums(false),
         fill_cache(true),
+        scan_hint(false),
+        readahead_blocks(0),
+        prefetch_values(false),
         snapshot(NULL) {
   }
 };
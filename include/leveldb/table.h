@@ -61,15 +61,25 @@ class Table {
 
   explicit Table(Rep* rep) { rep_ = rep; }
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
+  static void Readahead(void*, const ReadOptions&, const Slice&, uint64_t*);
 
   // Calls (*handle_result)(arg, ...) with the entry found after a call
-  // to Seek(key).  May not make such a call if filter policy says
-  // that key is not present.
+  // to Seek(key), and with the entries after it for as long as
+  // handle_result returns true.  May not make such a call if filter
+  // policy says that key is not present.
   friend class TableCache;
   Status InternalGet(
       const ReadOptions&, const Slice& key,
       void* arg,
-      void (*handle_result)(void* arg, const Slice& k, const Slice& v));
+      bool (*handle_result)(void* arg, const Slice& k, const Slice& v));
+
+  // InternalGet() for each of the n sorted keys, with args[i] passed to
+  // handle_result for keys[i].  Consecutive keys that fall in the same
+  // data block share one read of the block.
+  Status InternalMultiGet(
+      const ReadOptions&, int n, const Slice* keys,
+      void* const* args,
+      bool (*handle_result)(void* arg, const Slice& k, const Slice& v));
 
 
   void ReadMeta(const Footer& footer);
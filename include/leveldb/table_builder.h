@@ -27,8 +27,10 @@ class TableBuilder {
  public:
   // Create a builder that will store the contents of the table it is
   // building in *file.  Does not close the file.  It is up to the
-  // caller to close the file after calling Finish().
-  TableBuilder(const Options& options, WritableFile* file, bool lastLayer);
+  // caller to close the file after calling Finish().  "level" is the
+  // level the table will be installed at, or -1 if it is not known; it
+  // is passed on to the filter policy.
+  TableBuilder(const Options& options, WritableFile* file, int level);
 
   // REQUIRES: Either Finish() or Abandon() has been called.
   ~TableBuilder();
@@ -4,12 +4,13 @@
 
 #include "util/arena.h"
 #include <assert.h>
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
 static const int kBlockSize = 4096;
 
-Arena::Arena() {
+Arena::Arena() : shared_block_(NULL) {
   blocks_memory_ = 0;
   alloc_ptr_ = NULL;  // First allocation will allocate a block
   alloc_bytes_remaining_ = 0;
@@ -19,6 +20,9 @@ Arena::~Arena() {
   for (size_t i = 0; i < blocks_.size(); i++) {
     delete[] blocks_[i];
   }
+  for (size_t i = 0; i < shared_blocks_.size(); i++) {
+    delete shared_blocks_[i];
+  }
 }
 
 char* Arena::AllocateFallback(size_t bytes) {
@@ -58,6 +62,38 @@ char* Arena::AllocateAligned(size_t bytes) {
   return result;
 }
 
+char* Arena::AllocateAlignedConcurrently(size_t bytes) {
+  assert(bytes > 0);
+  const size_t align = sizeof(void*);
+  const size_t needed = (bytes + align - 1) & ~(align - 1);
+  if (needed > kBlockSize / 4) {
+    // Blocks come from new[], so they are suitably aligned
+    MutexLock l(&mu_);
+    return AllocateNewBlock(bytes);
+  }
+  while (true) {
+    SharedBlock* block =
+        reinterpret_cast<SharedBlock*>(shared_block_.Acquire_Load());
+    if (block != NULL) {
+      size_t offset = __sync_fetch_and_add(&block->used, needed);
+      if (offset + needed <= block->size) {
+        return block->base + offset;
+      }
+    }
+    // The block is full; the first thread in installs a new one, and
+    // the rest retry against it.  The tail of the old block is wasted.
+    MutexLock l(&mu_);
+    if (shared_block_.NoBarrier_Load() == block) {
+      SharedBlock* next = new SharedBlock;
+      next->base = AllocateNewBlock(kBlockSize);
+      next->size = kBlockSize;
+      next->used = 0;
+      shared_blocks_.push_back(next);
+      shared_block_.Release_Store(next);
+    }
+  }
+}
+
 char* Arena::AllocateNewBlock(size_t block_bytes) {
   char* result = new char[block_bytes];
   blocks_memory_ += block_bytes;
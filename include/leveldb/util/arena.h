@@ -9,6 +9,7 @@
 #include <vector>
 #include <assert.h>
 #include <stdint.h>
+#include "port/port.h"
 
 namespace leveldb {
 
@@ -23,6 +24,14 @@ class Arena {
   // Allocate memory with the normal alignment guarantees provided by malloc
   char* AllocateAligned(size_t bytes);
 
+  // Thread-safe variants of Allocate() and AllocateAligned().  These may
+  // be called by several threads at once, but not at the same time as
+  // the unsynchronized variants above.  Both return aligned memory.
+  char* AllocateConcurrently(size_t bytes) {
+    return AllocateAlignedConcurrently(bytes);
+  }
+  char* AllocateAlignedConcurrently(size_t bytes);
+
   // Returns an estimate of the total memory usage of data allocated
   // by the arena (including space allocated but not yet used for user
   // allocations).
@@ -44,6 +53,20 @@ class Arena {
   // Bytes of memory in blocks allocated so far
   size_t blocks_memory_;
 
+  // Block the *Concurrently() paths carve allocations from.  Threads
+  // claim space by atomically advancing "used"; a thread that runs past
+  // "size" installs a new block.
+  struct SharedBlock {
+    char* base;
+    size_t size;
+    size_t used;
+  };
+  port::AtomicPointer shared_block_;
+  std::vector<SharedBlock*> shared_blocks_;
+
+  // Held to install shared blocks and for large concurrent allocations
+  port::Mutex mu_;
+
   // No copying allowed
   Arena(const Arena&);
   void operator=(const Arena&);
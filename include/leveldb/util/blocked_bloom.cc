@@ -0,0 +1,166 @@
+// Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A bloom filter that confines all the probes for a key to one 64-byte
+// block, so a lookup touches a single cache line instead of up to k
+// random ones.  The block is selected from the key hash and the k bit
+// positions inside it are derived by double-hashing.  Probing builds a
+// 512-bit mask and tests it against the block in one pass (with SSE2
+// when it is available) rather than branching on every bit.
+//
+// Filter layout:
+//    block[0] ... block[num_blocks-1]   (64 bytes each)
+//    k                                  (1 byte)
+
+#include "leveldb/filter_policy.h"
+
+#include <string.h>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "leveldb/slice.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+namespace {
+static const size_t kBlockBytes = 64;
+static const size_t kBlockBits = kBlockBytes * 8;
+
+static uint32_t BloomHash(const Slice& key) {
+  return Hash(key.data(), key.size(), 0xbc9f1d34);
+}
+
+// Map h uniformly onto [0, n) without a division.
+static inline uint32_t FastRange(uint32_t h, uint32_t n) {
+  return static_cast<uint32_t>((static_cast<uint64_t>(h) * n) >> 32);
+}
+
+// Set the k bits for hash "h" in the 64-byte "block".
+static inline void SetBits(uint32_t h, size_t k, char* block) {
+  // Derive in-block positions from a remixed hash so that they are
+  // independent of the high bits that chose the block.
+  uint32_t g = h * 0x9e3779b1u;
+  const uint32_t delta = (g >> 17) | (g << 15);  // Rotate right 17 bits
+  for (size_t j = 0; j < k; j++) {
+    const uint32_t bitpos = g >> 23;             // Top 9 bits: [0, 512)
+    block[bitpos / 8] |= static_cast<char>(1 << (bitpos % 8));
+    g += delta;
+  }
+}
+
+// Return true iff every bit set in "mask" is also set in "block".
+static inline bool BlockContains(const char* block, const char* mask) {
+#if defined(__SSE2__)
+  __m128i missing = _mm_setzero_si128();
+  for (size_t i = 0; i < kBlockBytes; i += 16) {
+    const __m128i b = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(block + i));
+    const __m128i m = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(mask + i));
+    missing = _mm_or_si128(missing, _mm_andnot_si128(b, m));
+  }
+  return _mm_movemask_epi8(
+      _mm_cmpeq_epi8(missing, _mm_setzero_si128())) == 0xFFFF;
+#else
+  uint64_t missing = 0;
+  for (size_t i = 0; i < kBlockBytes; i += 8) {
+    uint64_t b, m;
+    memcpy(&b, block + i, 8);
+    memcpy(&m, mask + i, 8);
+    missing |= m & ~b;
+  }
+  return missing == 0;
+#endif
+}
+
+class BlockedBloomFilterPolicy : public FilterPolicy {
+ private:
+  // bits_per_key_[i] is used for tables at level i.  Levels beyond the
+  // end of the vector, and tables of unknown level, use the last entry.
+  std::vector<size_t> bits_per_key_;
+  std::vector<size_t> k_;
+
+ public:
+  BlockedBloomFilterPolicy(const int* bits_per_level, int num_levels) {
+    for (int i = 0; i < num_levels; i++) {
+      size_t bits = bits_per_level[i] > 0 ? bits_per_level[i] : 1;
+      // We intentionally round down to reduce probing cost a little bit
+      size_t k = static_cast<size_t>(bits * 0.69);  // 0.69 =~ ln(2)
+      if (k < 1) k = 1;
+      if (k > 30) k = 30;
+      bits_per_key_.push_back(bits);
+      k_.push_back(k);
+    }
+  }
+
+  virtual const char* Name() const {
+    return "leveldb.BuiltinBlockedBloomFilter";
+  }
+
+  virtual void CreateFilter(const Slice* keys, int n, std::string* dst,
+                            int level) const {
+    size_t idx = bits_per_key_.size() - 1;
+    if (level >= 0 && static_cast<size_t>(level) < idx) idx = level;
+    const size_t k = k_[idx];
+
+    // Round the filter up to a whole number of blocks; this also gives
+    // small filters a sane minimum length.
+    const size_t bits = n * bits_per_key_[idx];
+    uint32_t num_blocks = (bits + kBlockBits - 1) / kBlockBits;
+    if (num_blocks < 1) num_blocks = 1;
+
+    const size_t init_size = dst->size();
+    dst->resize(init_size + num_blocks * kBlockBytes, 0);
+    dst->push_back(static_cast<char>(k));  // Remember # of probes in filter
+    char* array = &(*dst)[init_size];
+    for (int i = 0; i < n; i++) {
+      const uint32_t h = BloomHash(keys[i]);
+      SetBits(h, k, array + FastRange(h, num_blocks) * kBlockBytes);
+    }
+  }
+
+  virtual bool KeyMayMatch(const Slice& key, const Slice& bloom_filter) const {
+    const size_t len = bloom_filter.size();
+    if (len < kBlockBytes + 1) return false;
+    if ((len - 1) % kBlockBytes != 0) {
+      // Not a filter we know how to read.  Consider it a match.
+      return true;
+    }
+
+    const char* array = bloom_filter.data();
+    const uint32_t num_blocks = (len - 1) / kBlockBytes;
+
+    // Use the encoded k so that we can read filters generated with
+    // different bits per key.
+    const size_t k = array[len-1];
+    if (k > 30) {
+      // Reserved for potentially new encodings.  Consider it a match.
+      return true;
+    }
+
+    const uint32_t h = BloomHash(key);
+    char mask[kBlockBytes];
+    memset(mask, 0, sizeof(mask));
+    SetBits(h, k, mask);
+    return BlockContains(array + FastRange(h, num_blocks) * kBlockBytes, mask);
+  }
+};
+}
+
+const FilterPolicy* NewBlockedBloomFilterPolicy(int bits_per_key) {
+  return new BlockedBloomFilterPolicy(&bits_per_key, 1);
+}
+
+const FilterPolicy* NewBlockedBloomFilterPolicy(const int* bits_per_level,
+                                                int num_levels) {
+  if (num_levels < 1) {
+    return NewBlockedBloomFilterPolicy(10);
+  }
+  return new BlockedBloomFilterPolicy(bits_per_level, num_levels);
+}
+
+}  // namespace leveldb
@@ -16,6 +16,14 @@ namespace crc32c {
 // crc32c of a stream of data.
 extern uint32_t Extend(uint32_t init_crc, const char* data, size_t n);
 
+// Return true if Extend() runs on the SSE4.2 crc32 instruction rather
+// than on the portable table-driven code.
+extern bool IsHardwareAccelerated();
+
+// Extend() on the portable table-driven code, whatever the CPU.  For
+// checking the accelerated code against.
+extern uint32_t ExtendPortable(uint32_t init_crc, const char* data, size_t n);
+
 // Return the crc32c of data[0,n-1]
 inline uint32_t Value(const char* data, size_t n) {
   return Extend(0, data, n);
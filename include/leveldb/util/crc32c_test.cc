@@ -0,0 +1,132 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Checks Extend() against known crcs, and against the portable code over
+// unaligned heads and lengths around every stream size of the SSE4.2
+// code.  Exits non-zero on the first mismatch.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#include "util/crc32c.h"
+
+namespace leveldb {
+namespace crc32c {
+
+static void Check(bool ok, const char* what, size_t offset, size_t n) {
+  if (!ok) {
+    fprintf(stderr, "crc32c_test: %s (offset %d, length %d)\n", what,
+            static_cast<int>(offset), static_cast<int>(n));
+    exit(EXIT_FAILURE);
+  }
+}
+
+// From rfc3720 section B.4.
+static void TestStandardResults() {
+  char buf[32];
+
+  memset(buf, 0, sizeof(buf));
+  Check(Value(buf, sizeof(buf)) == 0x8a9136aa, "zeros", 0, sizeof(buf));
+
+  memset(buf, 0xff, sizeof(buf));
+  Check(Value(buf, sizeof(buf)) == 0x62a8ab43, "ones", 0, sizeof(buf));
+
+  for (int i = 0; i < 32; i++) {
+    buf[i] = i;
+  }
+  Check(Value(buf, sizeof(buf)) == 0x46dd794e, "ascending", 0, sizeof(buf));
+
+  for (int i = 0; i < 32; i++) {
+    buf[i] = 31 - i;
+  }
+  Check(Value(buf, sizeof(buf)) == 0x113fdb5c, "descending", 0, sizeof(buf));
+
+  unsigned char data[48] = {
+    0x01, 0xc0, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00,
+    0x14, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x04, 0x00,
+    0x00, 0x00, 0x00, 0x14,
+    0x00, 0x00, 0x00, 0x18,
+    0x28, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00,
+    0x02, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00,
+  };
+  Check(Value(reinterpret_cast<char*>(data), sizeof(data)) == 0xd9963a56,
+        "iscsi read", 0, sizeof(data));
+}
+
+static void TestExtendAndMask() {
+  Check(Value("a", 1) != Value("foo", 3), "values differ", 0, 1);
+  Check(Value("hello world", 11) == Extend(Value("hello ", 6), "world", 5),
+        "extend", 6, 5);
+  const uint32_t crc = Value("foo", 3);
+  Check(crc != Mask(crc) && crc != Mask(Mask(crc)), "mask", 0, 3);
+  Check(crc == Unmask(Mask(crc)) && crc == Unmask(Unmask(Mask(Mask(crc)))),
+        "unmask", 0, 3);
+}
+
+// The SSE4.2 code takes 8-byte aligned runs in three streams of 8192,
+// then 256, bytes, and the head and tail a byte at a time.
+static void TestMatchesPortable() {
+#if defined(__GNUC__) && defined(__x86_64__)
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2) != 0) {
+    // Extend() falls back to the portable code if the two disagree
+    Check(IsHardwareAccelerated(), "SSE4.2 code not in use", 0, 0);
+  }
+#endif
+  if (!IsHardwareAccelerated()) {
+    fprintf(stderr, "crc32c_test: portable code only\n");
+  }
+
+  std::vector<size_t> lengths;
+  for (size_t n = 0; n <= 3 * 256 + 64; n++) {
+    lengths.push_back(n);
+  }
+  static const size_t kLongs[] = {
+    3 * 8192 - 1, 3 * 8192, 3 * 8192 + 1, 3 * 8192 + 3 * 256 + 7,
+    6 * 8192 + 3 * 256 - 1, 9 * 8192 + 6 * 256 + 15
+  };
+  for (size_t i = 0; i < sizeof(kLongs) / sizeof(kLongs[0]); i++) {
+    lengths.push_back(kLongs[i]);
+  }
+
+  const size_t kMaxOffset = 16;
+  std::vector<char> buf(lengths.back() + kMaxOffset);
+  uint32_t seed = 301;
+  for (size_t i = 0; i < buf.size(); i++) {
+    seed = seed * 1103515245u + 12345u;
+    buf[i] = static_cast<char>(seed >> 16);
+  }
+  for (size_t offset = 0; offset < kMaxOffset; offset++) {
+    for (size_t i = 0; i < lengths.size(); i++) {
+      const char* data = &buf[offset];
+      const size_t n = lengths[i];
+      Check(Extend(0, data, n) == ExtendPortable(0, data, n),
+            "mismatch", offset, n);
+      Check(Extend(0xdeadbeef, data, n) == ExtendPortable(0xdeadbeef, data, n),
+            "mismatch with initial crc", offset, n);
+    }
+  }
+}
+
+}  // namespace crc32c
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  leveldb::crc32c::TestStandardResults();
+  leveldb::crc32c::TestExtendAndMask();
+  leveldb::crc32c::TestMatchesPortable();
+  fprintf(stderr, "crc32c_test: PASS\n");
+  return 0;
+}
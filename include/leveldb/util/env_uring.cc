@@ -0,0 +1,569 @@
+// Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// An Env that moves the I/O of table files onto a Linux io_uring and
+// forwards everything else to Env::Default():
+//
+//  - Random access files are read with pread() rather than mmap(), so
+//    a cold read fetches one block instead of faulting in the pages
+//    around it.  Prefetch() queues one read-ahead per range and submits
+//    the whole batch with a single system call.
+//  - Table files are written behind: Append() fills a buffer and hands
+//    it to the kernel once full, and the writes are only waited for by
+//    Sync() and Close().  Nothing reads a table before it is closed.
+//    Log, MANIFEST and ColumnDB data files may be read while they are
+//    still being written, so they keep the synchronous default files.
+//
+// io_uring support is probed once, at the first call of IOUringEnv().
+
+#include "leveldb/env.h"
+
+#if defined(OS_LINUX) && defined(IO_URING)
+
+#include <algorithm>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "leveldb/slice.h"
+#include "port/port.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+static const unsigned kRingEntries = 64;
+static const size_t kWriteBufferSize = 256 << 10;
+static const int kNumWriteBuffers = 4;
+
+static Status IOError(const std::string& context, int err_number) {
+  return Status::IOError(context, strerror(err_number));
+}
+
+// Completion of one submitted operation.
+struct RingRequest {
+  int result;   // Bytes transferred, or -errno
+  bool done;
+};
+
+// A submission/completion ring shared by all the files of the Env.
+// Any thread may submit.  Threads waiting for their requests take turns
+// blocking in the kernel, and whichever one wakes up hands out all the
+// completions that have arrived.
+class Ring {
+ public:
+  // Returns NULL if the kernel does not let us set up a ring.
+  static Ring* Open(unsigned entries);
+
+  bool supports_fadvise() const { return supports_fadvise_; }
+
+  // Submit the "n" operations in "sqes".  If "reqs" is not NULL,
+  // reqs[i] is completed with the result of sqes[i]; otherwise the
+  // results are dropped.
+  void Submit(const struct io_uring_sqe* sqes, RingRequest* const* reqs,
+              int n);
+
+  // Wait until "req" is done.  Once the ring has failed, requests still
+  // pending are completed with the error of the ring.
+  void Wait(RingRequest* req);
+
+ private:
+  Ring() : cv_(&mu_), inflight_(0), polling_(false), error_(0) { }
+
+  int fd_;
+  unsigned entries_;
+  bool supports_fadvise_;
+  struct io_uring_sqe* sqes_;
+  volatile unsigned* sq_tail_;
+  unsigned sq_mask_;
+  unsigned* sq_array_;
+  volatile unsigned* cq_head_;
+  volatile unsigned* cq_tail_;
+  unsigned cq_mask_;
+  struct io_uring_cqe* cqes_;
+
+  port::Mutex mu_;
+  port::CondVar cv_;
+  unsigned inflight_;         // Submitted but not yet reaped
+  bool polling_;              // Some thread is blocked in the kernel
+  int error_;                 // errno of a failed io_uring_enter(), or 0
+
+  int Enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return syscall(__NR_io_uring_enter, fd_, to_submit, min_complete,
+                   flags, NULL, 0);
+  }
+
+  int ReapLocked();
+  void AwaitLocked();
+  void FailLocked(int err);
+
+  // No copying allowed
+  Ring(const Ring&);
+  void operator=(const Ring&);
+};
+
+Ring* Ring::Open(unsigned entries) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  int fd = syscall(__NR_io_uring_setup, entries, &p);
+  if (fd < 0) {
+    return NULL;
+  }
+  size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    sq_size = cq_size = std::max(sq_size, cq_size);
+  }
+  void* sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  void* cq = sq;
+  if (sq != MAP_FAILED && !(p.features & IORING_FEAT_SINGLE_MMAP)) {
+    cq = mmap(NULL, cq_size, PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+  }
+  void* sqes = MAP_FAILED;
+  if (sq != MAP_FAILED && cq != MAP_FAILED) {
+    sqes = mmap(NULL, p.sq_entries * sizeof(io_uring_sqe),
+                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                fd, IORING_OFF_SQES);
+  }
+  if (sqes == MAP_FAILED) {
+    if (cq != MAP_FAILED && cq != sq) munmap(cq, cq_size);
+    if (sq != MAP_FAILED) munmap(sq, sq_size);
+    close(fd);
+    return NULL;
+  }
+
+  Ring* ring = new Ring;
+  ring->fd_ = fd;
+  ring->entries_ = p.sq_entries;
+  ring->sqes_ = reinterpret_cast<io_uring_sqe*>(sqes);
+  char* sq_base = reinterpret_cast<char*>(sq);
+  ring->sq_tail_ = reinterpret_cast<unsigned*>(sq_base + p.sq_off.tail);
+  ring->sq_mask_ = *reinterpret_cast<unsigned*>(sq_base + p.sq_off.ring_mask);
+  ring->sq_array_ = reinterpret_cast<unsigned*>(sq_base + p.sq_off.array);
+  char* cq_base = reinterpret_cast<char*>(cq);
+  ring->cq_head_ = reinterpret_cast<unsigned*>(cq_base + p.cq_off.head);
+  ring->cq_tail_ = reinterpret_cast<unsigned*>(cq_base + p.cq_off.tail);
+  ring->cq_mask_ = *reinterpret_cast<unsigned*>(cq_base + p.cq_off.ring_mask);
+  ring->cqes_ = reinterpret_cast<io_uring_cqe*>(cq_base + p.cq_off.cqes);
+
+  // IORING_OP_FADVISE needs Linux 5.6; older kernels also lack the
+  // probe and we fall back to posix_fadvise()
+  ring->supports_fadvise_ = false;
+  const size_t probe_size = sizeof(io_uring_probe) +
+                            256 * sizeof(io_uring_probe_op);
+  io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(
+      calloc(1, probe_size));
+  if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE,
+              probe, 256) == 0 &&
+      probe->last_op >= IORING_OP_FADVISE &&
+      (probe->ops[IORING_OP_FADVISE].flags & IO_URING_OP_SUPPORTED)) {
+    ring->supports_fadvise_ = true;
+  }
+  free(probe);
+  return ring;
+}
+
+void Ring::Submit(const struct io_uring_sqe* sqes, RingRequest* const* reqs,
+                  int n) {
+  while (n > 0) {
+    unsigned batch;
+    {
+      MutexLock l(&mu_);
+      // Prefetches have no waiter; whoever submits next reaps them
+      ReapLocked();
+      while (error_ == 0 && inflight_ == entries_) {
+        AwaitLocked();
+      }
+      if (error_ != 0) {
+        for (int i = 0; reqs != NULL && i < n; i++) {
+          reqs[i]->result = -error_;
+          reqs[i]->done = true;
+        }
+        return;
+      }
+      batch = std::min<unsigned>(n, entries_ - inflight_);
+      unsigned tail = *sq_tail_;
+      for (unsigned i = 0; i < batch; i++) {
+        const unsigned index = tail & sq_mask_;
+        sqes_[index] = sqes[i];
+        if (reqs != NULL) {
+          reqs[i]->done = false;
+          sqes_[index].user_data = reinterpret_cast<uintptr_t>(reqs[i]);
+        } else {
+          sqes_[index].user_data = 0;
+        }
+        sq_array_[index] = index;
+        tail++;
+      }
+      port::MemoryBarrier();
+      *sq_tail_ = tail;
+      inflight_ += batch;
+    }
+    // Entering without the lock may also submit entries published by
+    // other threads; they then find theirs already consumed, which is
+    // fine since every call asks for at most what has been published.
+    while (Enter(batch, 0, 0) < 0) {
+      const int err = errno;
+      MutexLock l(&mu_);
+      if (err != EINTR && err != EAGAIN && err != EBUSY) {
+        FailLocked(err);
+        break;
+      }
+      ReapLocked();
+    }
+    sqes += batch;
+    if (reqs != NULL) reqs += batch;
+    n -= batch;
+  }
+}
+
+void Ring::Wait(RingRequest* req) {
+  MutexLock l(&mu_);
+  while (!req->done) {
+    if (error_ != 0) {
+      req->result = -error_;
+      req->done = true;
+      break;
+    }
+    AwaitLocked();
+  }
+}
+
+// Hand out the completions that have arrived.  Returns their number.
+int Ring::ReapLocked() {
+  mu_.AssertHeld();
+  unsigned head = *cq_head_;
+  const unsigned tail = *cq_tail_;
+  port::MemoryBarrier();
+  int reaped = 0;
+  for (; head != tail; head++) {
+    const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+    RingRequest* req = reinterpret_cast<RingRequest*>(
+        static_cast<uintptr_t>(cqe.user_data));
+    // After a failure the waiter may have been failed and gone away
+    if (req != NULL && error_ == 0) {
+      req->result = cqe.res;
+      req->done = true;
+    }
+    reaped++;
+  }
+  if (reaped > 0) {
+    port::MemoryBarrier();
+    *cq_head_ = head;
+    inflight_ -= reaped;
+    cv_.SignalAll();
+  }
+  return reaped;
+}
+
+// Wait for at least one completion.  REQUIRES: inflight_ > 0.
+void Ring::AwaitLocked() {
+  mu_.AssertHeld();
+  if (ReapLocked() > 0) {
+    return;
+  }
+  if (polling_) {
+    cv_.Wait();
+    return;
+  }
+  polling_ = true;
+  mu_.Unlock();
+  const int err = Enter(0, 1, IORING_ENTER_GETEVENTS) < 0 ? errno : 0;
+  mu_.Lock();
+  polling_ = false;
+  if (err != 0 && err != EINTR && err != EAGAIN && err != EBUSY) {
+    FailLocked(err);
+  }
+  ReapLocked();
+  // Let the next waiter take over the polling
+  cv_.SignalAll();
+}
+
+// The kernel refused the ring, so the requests submitted to it may never
+// complete.  Stop using it: pending requests fail when waited for, and
+// later ones right away.
+void Ring::FailLocked(int err) {
+  mu_.AssertHeld();
+  if (error_ == 0) {
+    error_ = err;
+    cv_.SignalAll();
+  }
+}
+
+// pread() based random-access with batched read-ahead
+class UringRandomAccessFile: public RandomAccessFile {
+ private:
+  std::string filename_;
+  int fd_;
+  Ring* ring_;
+
+ public:
+  UringRandomAccessFile(const std::string& fname, int fd, Ring* ring)
+      : filename_(fname), fd_(fd), ring_(ring) { }
+  virtual ~UringRandomAccessFile() { close(fd_); }
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const {
+    Status s;
+    ssize_t r = pread(fd_, scratch, n, static_cast<off_t>(offset));
+    *result = Slice(scratch, (r < 0) ? 0 : r);
+    if (r < 0) {
+      // An error: return a non-ok status
+      s = IOError(filename_, errno);
+    }
+    return s;
+  }
+
+  virtual void Prefetch(int n, const uint64_t* offsets,
+                        const size_t* sizes) const {
+    if (!ring_->supports_fadvise()) {
+      for (int i = 0; i < n; i++) {
+        posix_fadvise(fd_, static_cast<off_t>(offsets[i]),
+                      static_cast<off_t>(sizes[i]), POSIX_FADV_WILLNEED);
+      }
+      return;
+    }
+    std::vector<io_uring_sqe> sqes(n);
+    memset(&sqes[0], 0, n * sizeof(io_uring_sqe));
+    for (int i = 0; i < n; i++) {
+      sqes[i].opcode = IORING_OP_FADVISE;
+      sqes[i].fd = fd_;
+      sqes[i].off = offsets[i];
+      sqes[i].len = sizes[i];
+      sqes[i].fadvise_advice = POSIX_FADV_WILLNEED;
+    }
+    // Only a hint: nobody waits for these
+    ring_->Submit(&sqes[0], NULL, n);
+  }
+};
+
+// Appends go into kNumWriteBuffers buffers of kWriteBufferSize bytes.
+// A full buffer is written out in the background while the next one is
+// being filled.  Flush() is a no-op: tables are not read before Close().
+class UringWritableFile : public WritableFile {
+ private:
+  struct Buffer {
+    char* data;
+    size_t used;
+    uint64_t offset;          // File offset of data[0] once submitted
+    struct iovec iov;
+    RingRequest req;
+    bool in_flight;
+  };
+
+  std::string filename_;
+  int fd_;
+  Ring* ring_;
+  uint64_t file_offset_;      // File offset of the current buffer
+  Buffer buffers_[kNumWriteBuffers];
+  int current_;
+  Status status_;             // First error of a background write
+
+  // Submit the current buffer and move on to the next one
+  void WriteCurrent() {
+    Buffer* b = &buffers_[current_];
+    b->offset = file_offset_;
+    b->iov.iov_base = b->data;
+    b->iov.iov_len = b->used;
+    io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_WRITEV;
+    sqe.fd = fd_;
+    sqe.off = b->offset;
+    sqe.addr = reinterpret_cast<uintptr_t>(&b->iov);
+    sqe.len = 1;
+    RingRequest* req = &b->req;
+    ring_->Submit(&sqe, &req, 1);
+    b->in_flight = true;
+    file_offset_ += b->used;
+    current_ = (current_ + 1) % kNumWriteBuffers;
+    Reclaim(&buffers_[current_]);
+  }
+
+  // Wait for the write of "b", if any, and make it empty again
+  void Reclaim(Buffer* b) {
+    if (b->in_flight) {
+      ring_->Wait(&b->req);
+      b->in_flight = false;
+      if (b->req.result < 0) {
+        if (status_.ok()) status_ = IOError(filename_, -b->req.result);
+      } else {
+        // Finish a short write synchronously
+        size_t done = b->req.result;
+        while (done < b->used && status_.ok()) {
+          ssize_t r = pwrite(fd_, b->data + done, b->used - done,
+                             static_cast<off_t>(b->offset + done));
+          if (r < 0) {
+            if (errno != EINTR) status_ = IOError(filename_, errno);
+          } else {
+            done += r;
+          }
+        }
+      }
+    }
+    b->used = 0;
+  }
+
+  // Write out what has been appended so far and wait for it
+  void Drain() {
+    if (buffers_[current_].used > 0) {
+      WriteCurrent();
+    }
+    for (int i = 0; i < kNumWriteBuffers; i++) {
+      Reclaim(&buffers_[i]);
+    }
+  }
+
+ public:
+  UringWritableFile(const std::string& fname, int fd, Ring* ring)
+      : filename_(fname), fd_(fd), ring_(ring), file_offset_(0),
+        current_(0) {
+    for (int i = 0; i < kNumWriteBuffers; i++) {
+      buffers_[i].data = new char[kWriteBufferSize];
+      buffers_[i].used = 0;
+      buffers_[i].in_flight = false;
+    }
+  }
+
+  ~UringWritableFile() {
+    if (fd_ >= 0) {
+      UringWritableFile::Close();
+    }
+    for (int i = 0; i < kNumWriteBuffers; i++) {
+      delete [] buffers_[i].data;
+    }
+  }
+
+  virtual Status Append(const Slice& data) {
+    const char* src = data.data();
+    size_t left = data.size();
+    while (left > 0) {
+      Buffer* b = &buffers_[current_];
+      size_t n = std::min(left, kWriteBufferSize - b->used);
+      memcpy(b->data + b->used, src, n);
+      b->used += n;
+      src += n;
+      left -= n;
+      if (b->used == kWriteBufferSize) {
+        WriteCurrent();
+      }
+    }
+    return status_;
+  }
+
+  virtual Status Close() {
+    Drain();
+    Status s = status_;
+    if (close(fd_) < 0) {
+      if (s.ok()) {
+        s = IOError(filename_, errno);
+      }
+    }
+    fd_ = -1;
+    return s;
+  }
+
+  virtual Status Flush() {
+    return status_;
+  }
+
+  virtual Status Sync() {
+    Drain();
+    Status s = status_;
+    if (s.ok() && fdatasync(fd_) < 0) {
+      s = IOError(filename_, errno);
+    }
+    return s;
+  }
+};
+
+static bool IsTableFile(const std::string& fname) {
+  static const char kSuffix[] = ".sst";
+  const size_t n = sizeof(kSuffix) - 1;
+  return fname.size() >= n &&
+         fname.compare(fname.size() - n, n, kSuffix) == 0;
+}
+
+class UringEnv : public EnvWrapper {
+ public:
+  UringEnv(Env* base, Ring* ring) : EnvWrapper(base), ring_(ring) { }
+  virtual ~UringEnv() { }
+
+  virtual Status NewRandomAccessFile(const std::string& fname,
+                                     RandomAccessFile** result) {
+    *result = NULL;
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return IOError(fname, errno);
+    }
+    *result = new UringRandomAccessFile(fname, fd, ring_);
+    return Status::OK();
+  }
+
+  // Files of this Env are never mapped
+  virtual Status NewUnmappedRandomAccessFile(const std::string& fname,
+                                             RandomAccessFile** result) {
+    return NewRandomAccessFile(fname, result);
+  }
+
+  virtual Status NewWritableFile(const std::string& fname,
+                                 WritableFile** result) {
+    if (!IsTableFile(fname)) {
+      return target()->NewWritableFile(fname, result);
+    }
+    const int fd = open(fname.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0) {
+      *result = NULL;
+      return IOError(fname, errno);
+    }
+    *result = new UringWritableFile(fname, fd, ring_);
+    return Status::OK();
+  }
+
+ private:
+  Ring* ring_;
+};
+
+}  // namespace
+
+static pthread_once_t uring_once = PTHREAD_ONCE_INIT;
+static Env* uring_env;
+static void InitIOUringEnv() {
+  Ring* ring = Ring::Open(kRingEntries);
+  if (ring != NULL) {
+    uring_env = new UringEnv(Env::Default(), ring);
+  } else {
+    uring_env = Env::Default();
+  }
+}
+
+Env* Env::IOUringEnv() {
+  pthread_once(&uring_once, InitIOUringEnv);
+  return uring_env;
+}
+
+}  // namespace leveldb
+
+#else
+
+namespace leveldb {
+
+Env* Env::IOUringEnv() {
+  return Env::Default();
+}
+
+}  // namespace leveldb
+
+#endif
@@ -2,11 +2,14 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
-#include "common/dirhandle.h"
+#include "leveldb/merge_operator.h"
 
-namespace indexfs {
+namespace leveldb {
 
-DirMappingCache* DirHandle::dmap_cache_ = NULL;
-DirCache* DirHandle::dir_cache_ = NULL;
+MergeOperator::~MergeOperator() { }
 
-} // namespace indexfs
+bool MergeOperator::DropsOperandsWithoutValue() const {
+  return false;
+}
+
+}  // namespace leveldb
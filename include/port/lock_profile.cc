@@ -0,0 +1,150 @@
+// Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "port/lock_profile.h"
+
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+
+namespace leveldb {
+namespace port {
+
+namespace {
+
+pthread_mutex_t classes_mu = PTHREAD_MUTEX_INITIALIZER;
+LockClass* classes = NULL;
+
+int BucketIndex(uint64_t nanos) {
+  if (nanos == 0) {
+    return 0;
+  }
+  int index = 64 - __builtin_clzll(nanos);
+  return std::min(index, static_cast<int>(LockClass::kNumBuckets) - 1);
+}
+
+}  // namespace
+
+LockClass::LockClass(const char* name)
+    : name_(name),
+      next_(NULL),
+      acquisitions_(0),
+      contended_(0),
+      wait_nanos_(0),
+      hold_nanos_(0),
+      num_tags_(0) {
+  memset(wait_buckets_, 0, sizeof(wait_buckets_));
+  memset(hold_buckets_, 0, sizeof(hold_buckets_));
+  pthread_mutex_init(&tags_mu_, NULL);
+}
+
+LockClass* LockClass::Get(const char* name) {
+  pthread_mutex_lock(&classes_mu);
+  LockClass* c = classes;
+  while (c != NULL && c->name_ != name) {
+    c = c->next_;
+  }
+  if (c == NULL) {
+    c = new LockClass(name);
+    c->next_ = classes;
+    classes = c;
+  }
+  pthread_mutex_unlock(&classes_mu);
+  return c;
+}
+
+void LockClass::GetAll(std::vector<LockClass*>* result) {
+  result->clear();
+  pthread_mutex_lock(&classes_mu);
+  for (LockClass* c = classes; c != NULL; c = c->next_) {
+    result->push_back(c);
+  }
+  pthread_mutex_unlock(&classes_mu);
+}
+
+uint64_t LockClass::NowNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void LockClass::Record(uint64_t tag, uint64_t wait_nanos,
+                       uint64_t hold_nanos) {
+  __sync_fetch_and_add(&acquisitions_, 1);
+  __sync_fetch_and_add(&hold_nanos_, hold_nanos);
+  __sync_fetch_and_add(&hold_buckets_[BucketIndex(hold_nanos)], 1);
+  __sync_fetch_and_add(&wait_buckets_[BucketIndex(wait_nanos)], 1);
+  if (wait_nanos == 0) {
+    return;
+  }
+  __sync_fetch_and_add(&contended_, 1);
+  __sync_fetch_and_add(&wait_nanos_, wait_nanos);
+
+  pthread_mutex_lock(&tags_mu_);
+  int min = 0;
+  int i = 0;
+  for (; i < num_tags_; i++) {
+    if (tags_[i] == tag) {
+      break;
+    }
+    if (tag_waits_[i] < tag_waits_[min]) {
+      min = i;
+    }
+  }
+  if (i < num_tags_) {
+    tag_waits_[i] += wait_nanos;
+  } else if (num_tags_ < kNumTopTags * 4) {
+    tags_[num_tags_] = tag;
+    tag_waits_[num_tags_] = wait_nanos;
+    num_tags_++;
+  } else {
+    // Take over the counter of the least waited for tag
+    tags_[min] = tag;
+    tag_waits_[min] += wait_nanos;
+  }
+  pthread_mutex_unlock(&tags_mu_);
+}
+
+void LockClass::GetStats(Stats* stats) {
+  // Counters are read whole, though not all at the same instant
+  stats->acquisitions = acquisitions_;
+  stats->contended = contended_;
+  stats->wait_nanos = wait_nanos_;
+  stats->hold_nanos = hold_nanos_;
+  memcpy(stats->wait_buckets, wait_buckets_, sizeof(wait_buckets_));
+  memcpy(stats->hold_buckets, hold_buckets_, sizeof(hold_buckets_));
+
+  stats->top_tags.clear();
+  pthread_mutex_lock(&tags_mu_);
+  for (int i = 0; i < num_tags_; i++) {
+    stats->top_tags.push_back(std::make_pair(tag_waits_[i], tags_[i]));
+  }
+  pthread_mutex_unlock(&tags_mu_);
+  std::sort(stats->top_tags.rbegin(), stats->top_tags.rend());
+  if (stats->top_tags.size() > kNumTopTags) {
+    stats->top_tags.resize(kNumTopTags);
+  }
+}
+
+uint64_t LockClass::Stats::Percentile(const uint64_t* buckets, double p) {
+  uint64_t total = 0;
+  for (int i = 0; i < kNumBuckets; i++) {
+    total += buckets[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+  const double threshold = total * p;
+  uint64_t sum = 0;
+  for (int i = 0; i < kNumBuckets; i++) {
+    sum += buckets[i];
+    if (sum >= threshold) {
+      return i == 0 ? 0 : (1ull << i) - 1;
+    }
+  }
+  return (1ull << (kNumBuckets - 1)) - 1;
+}
+
+}  // namespace port
+}  // namespace leveldb
@@ -8,6 +8,9 @@
 #include <stdio.h>
 #include <string.h>
 #include "util/logging.h"
+#ifdef LOCK_PROFILING
+#include "port/lock_profile.h"
+#endif
 
 namespace leveldb {
 namespace port {
@@ -19,13 +22,58 @@ static void PthreadCall(const char* label, int result) {
   }
 }
 
+#ifndef LOCK_PROFILING
 Mutex::Mutex() { PthreadCall("init mutex", pthread_mutex_init(&mu_, NULL)); }
+#else
+Mutex::Mutex() : lock_class_(NULL), tag_(0), acquired_(0), wait_(0) {
+  PthreadCall("init mutex", pthread_mutex_init(&mu_, NULL));
+}
+#endif
 
 Mutex::~Mutex() { PthreadCall("destroy mutex", pthread_mutex_destroy(&mu_)); }
 
+#ifndef LOCK_PROFILING
 void Mutex::Lock() { PthreadCall("lock", pthread_mutex_lock(&mu_)); }
 
 void Mutex::Unlock() { PthreadCall("unlock", pthread_mutex_unlock(&mu_)); }
+#else
+void Mutex::Lock() {
+  if (lock_class_ == NULL) {
+    PthreadCall("lock", pthread_mutex_lock(&mu_));
+  } else if (pthread_mutex_trylock(&mu_) == 0) {
+    Acquired(0);
+  } else {
+    const uint64_t start = LockClass::NowNanos();
+    PthreadCall("lock", pthread_mutex_lock(&mu_));
+    Acquired(LockClass::NowNanos() - start);
+  }
+}
+
+void Mutex::Unlock() {
+  if (lock_class_ == NULL) {
+    PthreadCall("unlock", pthread_mutex_unlock(&mu_));
+    return;
+  }
+  // Record once the mutex is released, so as not to make the hold
+  // longer; the mutex itself may be gone by then
+  LockClass* lock_class = lock_class_;
+  const uint64_t tag = tag_;
+  const uint64_t wait = wait_;
+  const uint64_t hold = LockClass::NowNanos() - acquired_;
+  PthreadCall("unlock", pthread_mutex_unlock(&mu_));
+  lock_class->Record(tag, wait, hold);
+}
+
+void Mutex::Acquired(uint64_t wait) {
+  acquired_ = LockClass::NowNanos();
+  wait_ = wait;
+}
+
+// Waiting on a condition variable releases the mutex without Unlock()
+void Mutex::Releasing() {
+  lock_class_->Record(tag_, wait_, LockClass::NowNanos() - acquired_);
+}
+#endif
 
 CondVar::CondVar(Mutex* mu)
     : mu_(mu) {
@@ -35,6 +83,16 @@ CondVar::CondVar(Mutex* mu)
 CondVar::~CondVar() { PthreadCall("destroy cv", pthread_cond_destroy(&cv_)); }
 
 void CondVar::Wait() {
+#ifdef LOCK_PROFILING
+  if (mu_->lock_class_ != NULL) {
+    mu_->Releasing();
+    PthreadCall("wait", pthread_cond_wait(&cv_, &mu_->mu_));
+    // Time spent getting the mutex back is not told apart from the
+    // time waiting for the signal
+    mu_->Acquired(0);
+    return;
+  }
+#endif
   PthreadCall("wait", pthread_cond_wait(&cv_, &mu_->mu_));
 }
 
@@ -42,6 +100,14 @@ void CondVar::TimedWait(uint64_t sec, uint64_t nano) {
   struct timespec wait;
   wait.tv_sec = sec;
   wait.tv_nsec = nano;
+#ifdef LOCK_PROFILING
+  if (mu_->lock_class_ != NULL) {
+    mu_->Releasing();
+    pthread_cond_timedwait(&cv_, &mu_->mu_, &wait);
+    mu_->Acquired(0);
+    return;
+  }
+#endif
   int result = pthread_cond_timedwait(&cv_, &mu_->mu_, &wait);
 }
 
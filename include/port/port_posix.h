@@ -57,6 +57,7 @@ namespace port {
 static const bool kLittleEndian = IS_LITTLE_ENDIAN;
 
 class CondVar;
+class LockClass;
 
 class Mutex {
  public:
@@ -67,9 +68,30 @@ class Mutex {
   void Unlock();
   void AssertHeld() { }
 
+  // Count the wait and hold times of this mutex towards "lock_class",
+  // under "tag"; see port/lock_profile.h.  Does nothing unless built
+  // with LOCK_PROFILING.
+#ifdef LOCK_PROFILING
+  void SetLockClass(LockClass* lock_class, uint64_t tag = 0) {
+    lock_class_ = lock_class;
+    tag_ = tag;
+  }
+#else
+  void SetLockClass(LockClass* lock_class, uint64_t tag = 0) { }
+#endif
+
  private:
   friend class CondVar;
   pthread_mutex_t mu_;
+#ifdef LOCK_PROFILING
+  LockClass* lock_class_;
+  uint64_t tag_;
+  uint64_t acquired_;    // When the current holder got the mutex
+  uint64_t wait_;        // How long the current holder waited for it
+
+  void Acquired(uint64_t wait);
+  void Releasing();
+#endif
 
   // No copying
   Mutex(const Mutex&);
@@ -2,7 +2,6 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
-#include <mpi.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include "io_task.h"
@@ -100,14 +99,14 @@ class CacheTest: public IOTask {
   }
 
   virtual void Run() {
-    double start = MPI_Wtime();
+    double start = WallTime();
     do {
       int wait = rand() % (2 * FLAGS_req_wait) + 1;
       usleep(wait);
       int rw = rand() % 100; // [0, 100)
       rw < FLAGS_rw_ratio ?
         MetadataRead(IO_, listener_) : MetadataWrite(IO_, listener_);
-    } while (MPI_Wtime() - start < FLAGS_test_length);
+    } while (WallTime() - start < FLAGS_test_length);
   }
 
   virtual void Clean() {
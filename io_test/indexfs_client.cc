@@ -5,6 +5,7 @@
 #include "io_client.h"
 #include "client/client.h"
 
+#include <pthread.h>
 #include <sys/stat.h>
 #include "common/config.h"
 #include "common/logging.h"
@@ -37,8 +38,9 @@ DEFINE_bool(bulk_insert,
 namespace {
 
 // An IO Client implementation that uses IndexFS as its backend file system.
-// Here we assume that such client will only be initialized once. Use --bulk_insert
-// to enable the bulk_insert feature of IndexFS.
+// Several clients may live in one process, one per driver thread; they share
+// the process-wide log, opened by the first one and closed by the last one.
+// Use --bulk_insert to enable the bulk_insert feature of IndexFS.
 //
 class IndexFSClient: public IOClient {
  public:
@@ -84,11 +86,21 @@ class IndexFSClient: public IOClient {
 
  protected:
   Client* cli_;
+  static pthread_mutex_t env_mu_;
+  static int env_refs_;
   static void InitIndexFSEnv() {
-    OpenClientLog(GetLogFileName());
+    pthread_mutex_lock(&env_mu_);
+    if (env_refs_++ == 0) {
+      OpenClientLog(GetLogFileName());
+    }
+    pthread_mutex_unlock(&env_mu_);
   }
   static void DisposeIndexFSEnv() {
-    CloseFSLog();
+    pthread_mutex_lock(&env_mu_);
+    if (--env_refs_ == 0) {
+      CloseFSLog();
+    }
+    pthread_mutex_unlock(&env_mu_);
   }
 
  private:
@@ -97,6 +109,9 @@ class IndexFSClient: public IOClient {
   IndexFSClient& operator=(const IndexFSClient&);
 };
 
+pthread_mutex_t IndexFSClient::env_mu_ = PTHREAD_MUTEX_INITIALIZER;
+int IndexFSClient::env_refs_ = 0;
+
 Status IndexFSClient::NewFile
   (Path &path) {
   if (FLAGS_print_ops) {
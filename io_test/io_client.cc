@@ -2,12 +2,12 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
-#include <mpi.h>
 #include <time.h>
 #include <sstream>
 #include <gflags/gflags.h>
 
 #include "io_client.h"
+#include "io_task.h"
 #include "leveldb/util/socket.h"
 #include "leveldb/util/histogram.h"
 
@@ -91,7 +91,7 @@ class MetaClient: public IOClient {
     delete cli_;
   }
   explicit MetaClient(IOClient* cli, int rank, const std::string &id)
-    : IOClient(), rank_(rank), id_(id), cli_(cli) {
+    : IOClient(), rank_(rank), id_(id), cli_(cli), listener_(NULL) {
     mon_ = true;
     last_sent_ = 0;
     res_sum_ = ops_ = err_ops_ = 0;
@@ -123,9 +123,9 @@ class MetaClient: public IOClient {
   virtual Status op(arg_type arg) {                                  \
     if (mon_) {                                                      \
       double start, finish, dura;                                    \
-      start = MPI_Wtime();                                           \
+      start = WallTime();                                           \
       Status s = cli_->op(arg);                                      \
-      finish = MPI_Wtime();                                          \
+      finish = WallTime();                                          \
       dura = (finish - start) * 1000 * 1000;                         \
       if (!s.ok()) {                                                 \
         err_ops_++;                                                  \
@@ -134,6 +134,8 @@ class MetaClient: public IOClient {
         res_sum_ += dura;                                            \
         counters_[k##op]++;                                          \
         latencies_[kOpCategoryIndex[k##op]].Add(dura);               \
+        if (listener_ != NULL)                                       \
+          listener_->IOLatency(kOpNames[k##op], dura);               \
       }                                                              \
       if (FLAGS_per_sec) {                                           \
         if (finish - last_sent_ >= FLAGS_perf_num_secs) {            \
@@ -155,9 +157,9 @@ class MetaClient: public IOClient {
   virtual Status op(arg_type1 arg1, arg_type2 arg2) {                \
     if (mon_) {                                                      \
       double start, finish, dura;                                    \
-      start = MPI_Wtime();                                           \
+      start = WallTime();                                           \
       Status s = cli_->op(arg1, arg2);                               \
-      finish = MPI_Wtime();                                          \
+      finish = WallTime();                                          \
       dura = (finish - start) * 1000 * 1000;                         \
       if (!s.ok()) {                                                 \
         err_ops_++;                                                  \
@@ -166,6 +168,8 @@ class MetaClient: public IOClient {
         res_sum_ += dura;                                            \
         counters_[k##op]++;                                          \
         latencies_[kOpCategoryIndex[k##op]].Add(dura);               \
+        if (listener_ != NULL)                                       \
+          listener_->IOLatency(kOpNames[k##op], dura);               \
       }                                                              \
       if (FLAGS_per_sec) {                                           \
         if (finish - last_sent_ >= FLAGS_perf_num_secs) {            \
@@ -199,6 +203,7 @@ class MetaClient: public IOClient {
   // IO MEASUREMENT INTERFACE //
 
   void EnableMonitoring(bool enable);
+  void SetListener(IOListener* listener) { listener_ = listener; }
   void Reset();
   void __PrintMeasurements__(FILE* output); // max, min, avg and latency histogram
 
@@ -229,6 +234,7 @@ class MetaClient: public IOClient {
   Histogram latencies_[kNumCategories];
   int counters_[kNumOps];
   IOClient* cli_; // The real IO client being composited
+  IOListener* listener_; // Receives op latencies, if not NULL
 
   // No copying allowed
   MetaClient(const MetaClient&);
@@ -267,7 +273,7 @@ void MetaClient::Reset() {
   for (int i = 0; i < kNumCategories; i++) {
     latencies_[i].Clear();
   }
-  last_sent_ = MPI_Wtime();
+  last_sent_ = WallTime();
   res_sum_ = ops_ = err_ops_ = 0;
   last_res_sum_ = last_ops_ = last_err_ops_ = 0;
 }
@@ -331,6 +337,11 @@ void IOMeasurements::PrintMeasurements(IOClient* cli, FILE* output) {
   meta_cli->__PrintMeasurements__(output);
 }
 
+void IOMeasurements::SetListener(IOClient* cli, IOListener* listener) {
+  MetaClient* meta_cli = reinterpret_cast<MetaClient*>(cli);
+  meta_cli->SetListener(listener);
+}
+
 //////////////////////////////////////////////////////////////////////////////////
 // IO-CLIENT FACTORY
 //
@@ -14,6 +14,8 @@ namespace indexfs { namespace mpi {
 
 // Abstract FS Interface
 class IOClient;
+// Receives the outcome of each IO operation; see io_task.h
+struct IOListener;
 
 DECLARE_bool(bulk_insert); // Is bulk_insert enabled? -- for IndexFS only
 DECLARE_bool(print_ops); // Print op trace to stdout? -- useful for debugging
@@ -89,8 +91,16 @@ struct IOMeasurements {
   static void EnableMonitoring(IOClient* cli, bool enable);
   static void Reset(IOClient* cli);
   static void PrintMeasurements(IOClient* cli, FILE* output);
+  // Report the latency of every monitored op to "listener"
+  static void SetListener(IOClient* cli, IOListener* listener);
 };
 
+// Wall clock time in seconds.  Stands in for MPI_Wtime() so that clients
+// and tasks can also run without MPI.
+inline double WallTime() {
+  return Env::Default()->NowMicros() / 1000000.0;
+}
+
 } /* namespace mpi */ } /* namespace indexfs */
 
 #endif /* _INDEXFS_MPI_IO_CLIENT_H_ */
@@ -17,7 +17,7 @@ using ::indexfs::mpi::IOTaskFactory;
 
 // Use TreeTest by default
 DEFINE_string(task,
-    "tree", "Set the benchmark suite [tree|cache|replay|rpc]");
+    "tree", "Set the benchmark suite [tree|cache|replay|rpc|load]");
 
 DEFINE_int32(rank,
     -1, "Set the rank of a particular driver instance");
@@ -43,6 +43,10 @@ IOTask* FetchTask(int my_rank, int comm_sz) {
     my_rank == 0 ? printf("== Run RPCTest ==\n") : 0;
     return IOTaskFactory::GetRPCTestTask(my_rank, comm_sz);
   }
+  if (FLAGS_task == "load") {
+    my_rank == 0 ? printf("== Run LoadTest ==\n") : 0;
+    return IOTaskFactory::GetLoadTestTask(my_rank, comm_sz);
+  }
   my_rank == 0 ?
     fprintf(stderr, "No matching task found: %s\n", FLAGS_task.c_str()) : 0;
   return NULL; // No matching benchmark task found
@@ -120,6 +124,10 @@ class IOTestDriver: public IOListener {
     MPI_Finalize();
   }
 
+  virtual void IOBarrier() {
+    MPI_Barrier(MPI_COMM_WORLD);
+  }
+
   IOTestDriver(int* argc, char*** argv) : ops_(0), err_(0) {
     int my_rank;
     int comm_sz;
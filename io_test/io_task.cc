@@ -70,7 +70,7 @@ IOTask::~IOTask() {
 }
 
 IOTask::IOTask(int my_rank, int comm_sz)
-  : my_rank_(my_rank), comm_sz_(comm_sz) {
+  : my_rank_(my_rank), comm_sz_(comm_sz), listener_(NULL) {
   srand(GetRandomSeed());
   LOG_ = OpenLogFile(my_rank);
   IO_ = CreateIOClient(my_rank);
@@ -78,6 +78,9 @@ IOTask::IOTask(int my_rank, int comm_sz)
 
 void IOTask::SetListener(IOListener* listener) {
   listener_ = listener;
+  if (IO_ != NULL) {
+    IOMeasurements::SetListener(IO_, listener);
+  }
 }
 
 } /* namespace mpi */ } /* namespace indexfs */
@@ -14,6 +14,10 @@ namespace indexfs { namespace mpi {
 struct IOListener {
   virtual void IOPerformed(const char* op) = 0;
   virtual void IOFailed(const char* op) = 0;
+  // Latency of a successful op, for ops timed by the IO client
+  virtual void IOLatency(const char* op, double micros) {}
+  // Wait until all ranks get here; each must call it as often as the rest
+  virtual void IOBarrier() {}
 };
 
 struct IOError {
@@ -81,6 +85,8 @@ struct IOTaskFactory {
   static IOTask* GetReplayTestTask(int my_rank, int comm_sz);
   // FS client-side cache effectiveness
   static IOTask* GetCacheTestTask(int my_rank, int comm_sz);
+  // FS latency under an offered load on a schedule
+  static IOTask* GetLoadTestTask(int my_rank, int comm_sz);
 };
 
 } /* namespace mpi */ } /* namespace indexfs */
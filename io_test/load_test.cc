@@ -0,0 +1,402 @@
+// Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Load generator with target rates.  Unlike tree_test and replay_test,
+// which issue each op as soon as the previous one returns, every client
+// here schedules ops at a constant rate or with Poisson arrivals.  A
+// client has a single connection and so one op outstanding at a time:
+// this is a closed loop corrected for its schedule, not a truly open one.
+// An op that falls due while another is in flight is sent as soon as that
+// one returns, and its latency is measured from the time it was scheduled
+// to start, so the time it spends waiting behind the slow op is counted
+// instead of being left out (coordinated omission).  Load a client cannot
+// keep up with shows up as growing latency and missed ops rather than as
+// more ops in flight; run more clients for more concurrency.
+//
+// The test sweeps a list of per-client rates, running a getattr, mknod,
+// mkdir and readdir mix at each, and writes one CSV row per rate and op
+// to the log file: offered and achieved throughput, and latency
+// percentiles, from which throughput/latency curves can be drawn.
+
+#include <stdlib.h>
+#include <math.h>
+
+#include <sstream>
+#include <vector>
+#include "io_task.h"
+#include "leveldb/util/random.h"
+#include <gflags/gflags.h>
+
+namespace indexfs { namespace mpi {
+
+DEFINE_string(load_rates,
+    "100,200,500,1000,2000", "Comma-separated list of per-client target rates, in ops per second, to sweep");
+DEFINE_string(load_mix,
+    "getattr:70,mknod:20,mkdir:5,readdir:5", "Op mix as op:weight pairs, with ops among getattr, mknod, mkdir and readdir");
+DEFINE_string(load_arrival,
+    "poisson", "Set the op arrival process, options including \"poisson\" and \"constant\"");
+DEFINE_int32(load_secs,
+    10, "Number of seconds to run at each target rate");
+DEFINE_int32(load_files,
+    1000, "Number of files each client creates beforehand for getattr and readdir");
+
+namespace {
+
+using ::leveldb::Histogram;
+using ::leveldb::Random;
+
+enum LoadOp { kGetattr, kMknod, kMkdir, kReaddir, kNumLoadOps };
+
+const char* kLoadOpNames[kNumLoadOps] = {
+  "getattr", "mknod", "mkdir", "readdir"
+};
+
+const char* kPrefix = "load";
+
+// Parse a comma-separated list of positive rates
+bool ParseRates(const std::string &str, std::vector<double>* rates) {
+  std::stringstream ss(str);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    double rate = atof(item.c_str());
+    if (rate <= 0) {
+      return false;
+    }
+    rates->push_back(rate);
+  }
+  return !rates->empty();
+}
+
+// Parse a comma-separated list of op:weight pairs
+bool ParseMix(const std::string &str, int* weights) {
+  for (int i = 0; i < kNumLoadOps; i++) {
+    weights[i] = 0;
+  }
+  std::stringstream ss(str);
+  std::string item;
+  int total = 0;
+  while (std::getline(ss, item, ',')) {
+    size_t colon = item.find(':');
+    if (colon == std::string::npos) {
+      return false;
+    }
+    std::string op = item.substr(0, colon);
+    int weight = atoi(item.c_str() + colon + 1);
+    int i = 0;
+    while (i < kNumLoadOps && op != kLoadOpNames[i]) {
+      i++;
+    }
+    if (i == kNumLoadOps || weight < 0) {
+      return false;
+    }
+    weights[i] += weight;
+    total += weight;
+  }
+  return total > 0;
+}
+
+class LoadTest: public IOTask {
+
+  // Results of one op type at one target rate
+  struct OpResult {
+    int ops;
+    int errors;
+    int missed;         // Never issued; counted in latency, not in ops
+    Histogram latency;  // From the scheduled start, in micros
+    Histogram service;  // From the actual start, in micros
+    void Clear() {
+      ops = errors = missed = 0;
+      latency.Clear();
+      service.Clear();
+    }
+  };
+
+  std::string DirPath(int dno) {
+    std::stringstream ss;
+    ss << "/d_" << kPrefix << dno;
+    return ss.str();
+  }
+
+  Status Issue(int op) {
+    switch (op) {
+      case kGetattr:
+        return IO_->GetAttr(my_rank_, rnd_.Uniform(FLAGS_load_files),
+                            kPrefix);
+      case kMknod:
+        return IO_->NewFile(comm_sz_ + my_rank_, next_file_++, kPrefix);
+      case kMkdir:
+        next_dir_ += comm_sz_;
+        return IO_->MakeDirectory(next_dir_, kPrefix);
+      case kReaddir:
+        return IO_->ListDirectory(DirPath(my_rank_));
+    }
+    return Status::InvalidArgument("unknown op");
+  }
+
+  // Report the outcome of an op, throwing on errors unless ignored
+  void Check(const Status &s, int op) {
+    const char* name = kLoadOpNames[op];
+    if (!s.ok()) {
+      if (listener_ != NULL) {
+        listener_->IOFailed(name);
+      }
+      if (!FLAGS_ignore_errors) {
+        throw IOError(name, s.ToString());
+      }
+    } else if (listener_ != NULL) {
+      listener_->IOPerformed(name);
+    }
+  }
+
+  int PickOp() {
+    int n = rnd_.Uniform(total_weight_);
+    int op = 0;
+    while (n >= weights_[op]) {
+      n -= weights_[op];
+      op++;
+    }
+    return op;
+  }
+
+  // Seconds until the next op is scheduled
+  double NextInterval(double rate) {
+    if (FLAGS_load_arrival == "constant") {
+      return 1.0 / rate;
+    }
+    // Exponentially distributed, from a uniform sample in (0, 1]
+    double u = (rnd_.Next() + 1.0) / 2147483648.0;
+    return -log(u) / rate;
+  }
+
+  // Percentile of the latencies in h, which holds n of them
+  static double Percentile(const Histogram &h, int n, double p) {
+    return n > 0 ? h.Percentile(p) : 0;
+  }
+
+  void PrintRow(double rate, const char* op, const OpResult &result,
+                double secs) {
+    int n = result.ops - result.errors;
+    int late = n + result.missed;
+    fprintf(LOG_, "%g,%d,%s,%s,%d,%d,%d,%.1f,"
+            "%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+            rate, comm_sz_, FLAGS_load_arrival.c_str(), op,
+            result.ops, result.errors, result.missed,
+            secs > 0 ? result.ops / secs : 0.0,
+            result.latency.Average(),
+            Percentile(result.latency, late, 50),
+            Percentile(result.latency, late, 90),
+            Percentile(result.latency, late, 99),
+            Percentile(result.latency, late, 99.9),
+            result.latency.Max(),
+            result.service.Average(),
+            Percentile(result.service, n, 99));
+  }
+
+  // Issue ops at "rate" per second for FLAGS_load_secs seconds.  Once
+  // behind schedule, ops are issued back to back until caught up.  Ops
+  // still not issued after twice the run time are counted as missed, and
+  // enter the latency histograms with the time they had waited so far, a
+  // lower bound, so that an overloaded run cannot report good latencies
+  // by leaving its worst ops out.
+  void RunAtRate(double rate) {
+    OpResult results[kNumLoadOps];
+    for (int i = 0; i < kNumLoadOps; i++) {
+      results[i].Clear();
+    }
+    double start = WallTime();
+    double end = start + FLAGS_load_secs;
+    double deadline = end + FLAGS_load_secs;
+    double scheduled = start + NextInterval(rate);
+    while (scheduled < end) {
+      int op = PickOp();
+      double now = WallTime();
+      if (now > deadline) {
+        results[op].missed++;
+        results[op].latency.Add((now - scheduled) * 1000000);
+        scheduled += NextInterval(rate);
+        continue;
+      }
+      if (scheduled > now) {
+        Env::Default()->SleepForMicroseconds(
+            static_cast<int>((scheduled - now) * 1000000));
+      }
+      double issued = WallTime();
+      Status s = Issue(op);
+      double finish = WallTime();
+      OpResult* result = &results[op];
+      result->ops++;
+      if (!s.ok()) {
+        result->errors++;
+      } else {
+        result->latency.Add((finish - scheduled) * 1000000);
+        result->service.Add((finish - issued) * 1000000);
+      }
+      Check(s, op);
+      scheduled += NextInterval(rate);
+    }
+    double secs = WallTime() - start;
+
+    OpResult all;
+    all.Clear();
+    for (int i = 0; i < kNumLoadOps; i++) {
+      if (weights_[i] > 0) {
+        PrintRow(rate, kLoadOpNames[i], results[i], secs);
+      }
+      all.ops += results[i].ops;
+      all.errors += results[i].errors;
+      all.missed += results[i].missed;
+      all.latency.Merge(results[i].latency);
+      all.service.Merge(results[i].service);
+    }
+    PrintRow(rate, "all", all, secs);
+    fflush(LOG_);
+    if (my_rank_ == 0) {
+      printf("rate %g/s x %d clients: %.1f ops/s achieved, "
+             "p50 %.1f us, p99 %.1f us, %d missed\n",
+             rate, comm_sz_, secs > 0 ? all.ops / secs : 0.0,
+             Percentile(all.latency, all.ops - all.errors + all.missed, 50),
+             Percentile(all.latency, all.ops - all.errors + all.missed, 99),
+             all.missed);
+    }
+  }
+
+  int PrintSettings() {
+    return printf("Test Settings:\n"
+      "  target rates per process -> %s\n"
+      "  op mix -> %s\n"
+      "  arrival -> %s\n"
+      "  seconds per rate -> %d\n"
+      "  files per process -> %d\n"
+      "  total processes -> %d\n"
+      "  backend_fs -> %s\n"
+      "  ignore_errors -> %s\n"
+      "  log_file -> %s\n"
+      "  run_id -> %s\n",
+      FLAGS_load_rates.c_str(),
+      FLAGS_load_mix.c_str(),
+      FLAGS_load_arrival.c_str(),
+      FLAGS_load_secs,
+      FLAGS_load_files,
+      comm_sz_,
+      FLAGS_fs.c_str(),
+      GetBoolString(FLAGS_ignore_errors),
+      FLAGS_log_file.c_str(),
+      FLAGS_run_id.c_str());
+  }
+
+  Random rnd_;
+  std::vector<double> rates_;
+  int weights_[kNumLoadOps];
+  int total_weight_;
+  int next_file_; // Next file to create in the mknod directory
+  int next_dir_; // Last directory created by mkdir
+
+ public:
+
+  LoadTest(int my_rank, int comm_sz)
+    : IOTask(my_rank, comm_sz)
+    , rnd_(1 + (static_cast<unsigned>(rand()) + my_rank) % 2147483646u)
+    , total_weight_(0)
+    , next_file_(0), next_dir_(comm_sz + my_rank) {
+  }
+
+  virtual void Prepare() {
+    Status s = IO_->Init();
+    if (!s.ok()) {
+      throw IOError("init", s.ToString());
+    }
+    IOMeasurements::EnableMonitoring(IO_, false);
+    // One directory to read from, and one to create files in
+    Check(IO_->MakeDirectory(my_rank_, kPrefix), kMkdir);
+    Check(IO_->MakeDirectory(comm_sz_ + my_rank_, kPrefix), kMkdir);
+    for (int i = 0; i < FLAGS_load_files; i++) {
+      Check(IO_->NewFile(my_rank_, i, kPrefix), kMknod);
+    }
+    IOMeasurements::EnableMonitoring(IO_, true);
+  }
+
+  virtual void Run() {
+    IOMeasurements::Reset(IO_);
+    fprintf(LOG_, "rate_per_client,clients,arrival,op,ops,errors,missed,"
+            "achieved_ops_per_sec,lat_avg_us,lat_p50_us,lat_p90_us,"
+            "lat_p99_us,lat_p999_us,lat_max_us,svc_avg_us,svc_p99_us\n");
+    // Start every client at each rate together, so that a client still
+    // busy with the last rate does not overlap the next one.  A client
+    // that fails keeps meeting the others at each rate until the end.
+    bool failed = false;
+    IOError error("load", "");
+    for (size_t i = 0; i < rates_.size(); i++) {
+      if (listener_ != NULL) {
+        listener_->IOBarrier();
+      }
+      if (!failed) {
+        try {
+          RunAtRate(rates_[i]);
+        } catch (IOError &err) {
+          failed = true;
+          error = err;
+        }
+      }
+    }
+    if (failed) {
+      throw error;
+    }
+    fprintf(LOG_, "\n== Main Phase Performance Data ==\n\n");
+    IOMeasurements::PrintMeasurements(IO_, LOG_);
+  }
+
+  virtual void Clean() {
+    // Leave the namespace in place for inspection
+  }
+
+  virtual bool CheckPrecondition() {
+    if (IO_ == NULL || LOG_ == NULL) {
+      return false; // err has already been printed elsewhere
+    }
+    if (!ParseRates(FLAGS_load_rates, &rates_)) {
+      my_rank_ == 0 ? fprintf(stderr, "%s! (%s)\n",
+        "fail to parse the target rates",
+        "use --load_rates=100,200,... to specify") : 0;
+      return false;
+    }
+    if (!ParseMix(FLAGS_load_mix, weights_)) {
+      my_rank_ == 0 ? fprintf(stderr, "%s! (%s)\n",
+        "fail to parse the op mix",
+        "use --load_mix=getattr:70,mknod:30,... to specify") : 0;
+      return false;
+    }
+    for (int i = 0; i < kNumLoadOps; i++) {
+      total_weight_ += weights_[i];
+    }
+    if (FLAGS_load_arrival != "poisson" && FLAGS_load_arrival != "constant") {
+      my_rank_ == 0 ? fprintf(stderr, "%s! (%s)\n",
+        "unknown arrival process",
+        "use --load_arrival=poisson or --load_arrival=constant") : 0;
+      return false;
+    }
+    if (FLAGS_load_secs <= 0) {
+      my_rank_ == 0 ? fprintf(stderr, "%s! (%s)\n",
+        "fail to specify the time to run at each rate",
+        "use --load_secs=xx to specify") : 0;
+      return false;
+    }
+    if (FLAGS_load_files <= 0 && weights_[kGetattr] > 0) {
+      my_rank_ == 0 ? fprintf(stderr, "%s! (%s)\n",
+        "getattr needs files to read",
+        "use --load_files=xx to specify") : 0;
+      return false;
+    }
+    my_rank_ == 0 ? PrintSettings() : 0;
+    // All will check, yet only the zeroth process will do the printing
+    return true;
+  }
+};
+
+} /* anonymous namespace */
+
+IOTask* IOTaskFactory::GetLoadTestTask(int my_rank, int comm_sz) {
+  return new LoadTest(my_rank, comm_sz);
+}
+
+} /* namespace mpi */ } /* namespace indexfs */
@@ -0,0 +1,462 @@
+// Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Runs the same IO tasks as io_driver without MPI, for a single box.
+// Ranks are --procs forked processes of --threads threads each.  They
+// meet at a barrier before and after every phase, and sum their op
+// counts and latencies into a region of shared memory, which stands in
+// for MPI_Barrier() and MPI_Reduce().  Results go to stdout, as with
+// io_driver, and to a JSON file so that runs can be compared over time.
+
+#include "io_task.h"
+#include "common/config.h"
+#include "common/logging.h"
+#include "util/measurement.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+#include <gflags/gflags.h>
+
+using ::indexfs::LatencySummary;
+using ::indexfs::Measurement;
+using ::indexfs::mpi::IOTask;
+using ::indexfs::mpi::IOError;
+using ::indexfs::mpi::IOListener;
+using ::indexfs::mpi::IOTaskFactory;
+using ::indexfs::mpi::WallTime;
+using ::indexfs::mpi::FLAGS_fs;
+using ::indexfs::mpi::FLAGS_run_id;
+
+// Use TreeTest by default
+DEFINE_string(task,
+    "tree", "Set the benchmark suite [tree|cache|replay|rpc|load]");
+
+DEFINE_int32(procs,
+    1, "Set the number of processes to fork");
+
+DEFINE_int32(threads,
+    1, "Set the number of threads per process");
+
+DEFINE_string(json,
+    "/tmp/io_results.json", "Write the results as JSON to this file, or - for stdout");
+
+DEFINE_int32(verbose,
+    0, "Set a larger number to get more detailed per-client runtime status");
+
+namespace {
+
+enum { kPrepare, kMain, kClean, kNumPhases };
+
+const char* kPhaseNames[kNumPhases] = { "prepare", "main", "clean" };
+
+enum { kMaxOps = 16 }; // More than any task performs
+enum { kMaxOpName = 32 };
+
+struct OpResult {
+  char name[kMaxOpName];
+  uint64_t sum;
+  uint64_t buckets[Measurement::kNumBuckets];
+};
+
+struct PhaseResult {
+  int ops;
+  int err;
+  double dura; // Of the slowest rank
+  int num_ops;
+  OpResult op_results[kMaxOps];
+};
+
+// Lives in memory shared by all ranks of all processes
+struct SharedState {
+  pthread_barrier_t barrier;
+  pthread_mutex_t mu;
+  int failed;
+  PhaseResult phases[kNumPhases];
+};
+
+SharedState* shared = NULL;
+int comm_sz = 0;
+
+IOTask* FetchTask(int my_rank) {
+  if (FLAGS_task == "tree") {
+    my_rank == 0 ? printf("== Run TreeTest ==\n") : 0;
+    return IOTaskFactory::GetTreeTestTask(my_rank, comm_sz);
+  }
+  if (FLAGS_task == "replay") {
+    my_rank == 0 ? printf("== Run ReplayTest ==\n") : 0;
+    return IOTaskFactory::GetReplayTestTask(my_rank, comm_sz);
+  }
+  if (FLAGS_task == "cache") {
+    my_rank == 0 ? printf("== Run CacheTest ==\n") : 0;
+    return IOTaskFactory::GetCacheTestTask(my_rank, comm_sz);
+  }
+  if (FLAGS_task == "rpc") {
+    my_rank == 0 ? printf("== Run RPCTest ==\n") : 0;
+    return IOTaskFactory::GetRPCTestTask(my_rank, comm_sz);
+  }
+  if (FLAGS_task == "load") {
+    my_rank == 0 ? printf("== Run LoadTest ==\n") : 0;
+    return IOTaskFactory::GetLoadTestTask(my_rank, comm_sz);
+  }
+  my_rank == 0 ?
+    fprintf(stderr, "No matching task found: %s\n", FLAGS_task.c_str()) : 0;
+  return NULL; // No matching benchmark task found
+}
+
+void PrintError(const IOError &err) {
+  if (err.dir_>= 0) {
+    if (err.file_ >= 0) {
+       fprintf(stderr, "error performing %s at dir %d file %d: %s\n",
+         err.op_.c_str(), err.dir_, err.file_, err.cause_.c_str());
+    } else {
+      fprintf(stderr, "error performing %s at dir %d: %s\n",
+         err.op_.c_str(), err.dir_, err.cause_.c_str());
+    }
+  } else if (err.path_.length() > 0) {
+    fprintf(stderr, "error performing %s at %s: %s\n",
+        err.op_.c_str(), err.path_.c_str(), err.cause_.c_str());
+  } else {
+    fprintf(stderr, "error performing %s: %s\n", err.op_.c_str(), err.cause_.c_str());
+  }
+}
+
+// Counts the ops of one rank during one phase, without any locking;
+// merged into the shared state at the end of the phase.
+class RankListener: public IOListener {
+ public:
+
+  RankListener() : ops_(0), err_(0) {
+  }
+
+  virtual void IOPerformed(const char* op) {
+    ops_++;
+  }
+  virtual void IOFailed(const char* op) {
+    err_++;
+  }
+  virtual void IOLatency(const char* op, double micros) {
+    OpLatency* latency = GetOp(op);
+    uint64_t us = micros > 0 ? static_cast<uint64_t>(micros) : 0;
+    latency->buckets[Measurement::BucketIndex(us)]++;
+    latency->sum += us;
+  }
+  virtual void IOBarrier() {
+    pthread_barrier_wait(&shared->barrier);
+  }
+
+  void Reset() {
+    ops_ = err_ = 0;
+    latencies_.clear();
+  }
+
+  void MergeInto(PhaseResult* result, double dura) {
+    pthread_mutex_lock(&shared->mu);
+    result->ops += ops_;
+    result->err += err_;
+    if (dura > result->dura)
+      result->dura = dura;
+    for (size_t i = 0; i < latencies_.size(); i++) {
+      const OpLatency& latency = latencies_[i];
+      OpResult* op = NULL;
+      for (int j = 0; j < result->num_ops; j++) {
+        if (strcmp(result->op_results[j].name, latency.name) == 0)
+          op = &result->op_results[j];
+      }
+      if (op == NULL) {
+        if (result->num_ops >= kMaxOps)
+          continue;
+        op = &result->op_results[result->num_ops++];
+        strncpy(op->name, latency.name, kMaxOpName - 1);
+      }
+      op->sum += latency.sum;
+      for (int j = 0; j < Measurement::kNumBuckets; j++)
+        op->buckets[j] += latency.buckets[j];
+    }
+    pthread_mutex_unlock(&shared->mu);
+  }
+
+  int ops() const { return ops_; }
+
+ private:
+
+  struct OpLatency {
+    const char* name;
+    uint64_t sum;
+    std::vector<uint64_t> buckets;
+  };
+
+  OpLatency* GetOp(const char* op) {
+    for (size_t i = 0; i < latencies_.size(); i++) {
+      if (latencies_[i].name == op || strcmp(latencies_[i].name, op) == 0)
+        return &latencies_[i];
+    }
+    OpLatency latency;
+    latency.name = op;
+    latency.sum = 0;
+    latency.buckets.assign(Measurement::kNumBuckets, 0);
+    latencies_.push_back(latency);
+    return &latencies_.back();
+  }
+
+  int ops_;
+  int err_;
+  std::vector<OpLatency> latencies_;
+};
+
+void Barrier() {
+  pthread_barrier_wait(&shared->barrier);
+}
+
+void SetFailed() {
+  pthread_mutex_lock(&shared->mu);
+  shared->failed = 1;
+  pthread_mutex_unlock(&shared->mu);
+}
+
+void RunPhase(IOTask* task, int phase) {
+  switch (phase) {
+    case kPrepare: task->Prepare(); break;
+    case kMain: task->Run(); break;
+    case kClean: task->Clean(); break;
+  }
+}
+
+void RunRank(int my_rank) {
+  IOTask* task = FetchTask(my_rank);
+  if (task == NULL || !task->CheckPrecondition())
+    SetFailed();
+  Barrier();
+  if (shared->failed) {
+    delete task;
+    return;
+  }
+
+  RankListener listener;
+  task->SetListener(&listener);
+  my_rank == 0 ? printf("== IO Test Begin ==\n") : 0;
+  for (int phase = 0; phase < kNumPhases; phase++) {
+    listener.Reset();
+    if (my_rank == 0) {
+      printf("%c%s Phase ...\n", toupper(kPhaseNames[phase][0]),
+          kPhaseNames[phase] + 1);
+      fflush(stdout);
+    }
+    Barrier();
+    double start = WallTime();
+    try {
+      RunPhase(task, phase);
+    } catch (IOError &err) {
+      PrintError(err);
+      SetFailed();
+    }
+    double dura = WallTime() - start;
+    listener.MergeInto(&shared->phases[phase], dura);
+    if (FLAGS_verbose >= 1 && listener.ops() > 0 && dura > 0) {
+      printf("# Rank #%d completed with %.3f ops/s in avg\n",
+        my_rank, listener.ops() / dura);
+    }
+    Barrier();
+    if (shared->failed)
+      break;
+    if (my_rank == 0) {
+      const PhaseResult& result = shared->phases[phase];
+      printf("-- Performed %d ops in %.3f seconds: %d succ, %d fail\n",
+        result.ops + result.err, result.dura, result.ops, result.err);
+      fflush(stdout);
+    }
+  }
+  my_rank == 0 && !shared->failed ? printf("== IO Test Completed ==\n") : 0;
+  task->SetListener(NULL);
+  delete task;
+}
+
+void* RankThread(void* arg) {
+  RunRank(static_cast<int>(reinterpret_cast<intptr_t>(arg)));
+  return NULL;
+}
+
+void RunProcess(int proc) {
+  std::vector<pthread_t> threads(FLAGS_threads);
+  for (int i = 0; i < FLAGS_threads; i++) {
+    intptr_t rank = proc * FLAGS_threads + i;
+    if (pthread_create(&threads[i], NULL, RankThread,
+                       reinterpret_cast<void*>(rank)) != 0) {
+      perror("cannot create thread");
+      abort(); // Peers would wait at the barrier forever
+    }
+  }
+  for (int i = 0; i < FLAGS_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  fflush(stdout);
+  fflush(stderr);
+}
+
+// Run all processes, returning false if any of them died
+bool RunAll() {
+  if (FLAGS_procs == 1) {
+    RunProcess(0);
+    return true;
+  }
+  fflush(stdout);
+  fflush(stderr);
+  std::vector<pid_t> children;
+  for (int i = 0; i < FLAGS_procs; i++) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      RunProcess(i);
+      _exit(0);
+    }
+    if (pid < 0) {
+      perror("cannot fork");
+      for (size_t j = 0; j < children.size(); j++)
+        kill(children[j], SIGKILL);
+      return false;
+    }
+    children.push_back(pid);
+  }
+  bool ok = true;
+  for (size_t remaining = children.size(); remaining > 0; remaining--) {
+    int status;
+    pid_t pid = wait(&status);
+    if (pid < 0)
+      break;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      if (ok) {
+        fprintf(stderr, "process %d died -- stopping the others\n",
+            static_cast<int>(pid));
+        // The others would wait for it at the next barrier forever
+        for (size_t j = 0; j < children.size(); j++)
+          kill(children[j], SIGKILL);
+      }
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+std::string JsonString(const std::string &s) {
+  std::string result = "\"";
+  for (size_t i = 0; i < s.size(); i++) {
+    char c = s[i];
+    if (c == '"' || c == '\\') {
+      result += '\\';
+      result += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      result += buf;
+    } else {
+      result += c;
+    }
+  }
+  return result + "\"";
+}
+
+void WriteJson(FILE* output, bool ok) {
+  fprintf(output, "{\n");
+  fprintf(output, "  \"task\": %s,\n", JsonString(FLAGS_task).c_str());
+  fprintf(output, "  \"fs\": %s,\n", JsonString(FLAGS_fs).c_str());
+  fprintf(output, "  \"run_id\": %s,\n", JsonString(FLAGS_run_id).c_str());
+  fprintf(output, "  \"timestamp\": %ld,\n", static_cast<long>(time(NULL)));
+  fprintf(output, "  \"procs\": %d,\n", FLAGS_procs);
+  fprintf(output, "  \"threads\": %d,\n", FLAGS_threads);
+  fprintf(output, "  \"ok\": %s,\n", ok ? "true" : "false");
+  fprintf(output, "  \"phases\": [");
+  for (int phase = 0; phase < kNumPhases; phase++) {
+    const PhaseResult& result = shared->phases[phase];
+    fprintf(output, "%s\n    {\n", phase > 0 ? "," : "");
+    fprintf(output, "      \"name\": \"%s\",\n", kPhaseNames[phase]);
+    fprintf(output, "      \"ops\": %d,\n", result.ops);
+    fprintf(output, "      \"errors\": %d,\n", result.err);
+    fprintf(output, "      \"seconds\": %.6f,\n", result.dura);
+    fprintf(output, "      \"ops_per_sec\": %.3f,\n",
+        result.dura > 0 ? result.ops / result.dura : 0);
+    fprintf(output, "      \"latency_us\": {");
+    for (int i = 0; i < result.num_ops; i++) {
+      const OpResult& op = result.op_results[i];
+      LatencySummary summary;
+      summary.Add(op.buckets, op.sum);
+      fprintf(output, "%s\n        %s: {\"count\": %llu, \"avg\": %.1f,"
+          " \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"p999\": %.1f,"
+          " \"max\": %.0f}", i > 0 ? "," : "",
+          JsonString(op.name).c_str(),
+          static_cast<unsigned long long>(summary.Count()),
+          summary.Average(), summary.Percentile(0.5),
+          summary.Percentile(0.9), summary.Percentile(0.99),
+          summary.Percentile(0.999), summary.Max());
+    }
+    fprintf(output, "%s}\n    }", result.num_ops > 0 ? "\n      " : "");
+  }
+  fprintf(output, "\n  ]\n}\n");
+}
+
+bool InitSharedState() {
+  void* mem = mmap(NULL, sizeof(SharedState), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    perror("cannot map shared memory");
+    return false;
+  }
+  shared = static_cast<SharedState*>(mem); // Zero-filled
+  pthread_barrierattr_t battr;
+  pthread_barrierattr_init(&battr);
+  pthread_barrierattr_setpshared(&battr, PTHREAD_PROCESS_SHARED);
+  pthread_barrier_init(&shared->barrier, &battr, comm_sz);
+  pthread_barrierattr_destroy(&battr);
+  pthread_mutexattr_t mattr;
+  pthread_mutexattr_init(&mattr);
+  pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+  pthread_mutex_init(&shared->mu, &mattr);
+  pthread_mutexattr_destroy(&mattr);
+  return true;
+}
+
+} /* anonymous namespace */
+
+using ::indexfs::GetDefaultLogDir;
+
+using ::google::SetUsageMessage;
+using ::google::ParseCommandLineFlags;
+using ::google::InstallFailureSignalHandler;
+
+int main(int argc, char** argv) {
+  FLAGS_log_dir = GetDefaultLogDir();
+  SetUsageMessage("IndexFS's IO Benchmark, without MPI");
+  ParseCommandLineFlags(&argc, &argv, true);
+  InstallFailureSignalHandler(); // To obtain stack trace, hopefully
+
+  if (FLAGS_procs <= 0 || FLAGS_threads <= 0) {
+    fprintf(stderr, "--procs and --threads must be positive\n");
+    return 1;
+  }
+  comm_sz = FLAGS_procs * FLAGS_threads;
+  if (!InitSharedState())
+    return 1;
+
+  bool ok = RunAll() && !shared->failed;
+
+  if (!FLAGS_json.empty()) {
+    FILE* output = FLAGS_json == "-" ? stdout : fopen(FLAGS_json.c_str(), "w");
+    if (output == NULL) {
+      fprintf(stderr, "cannot open %s: %s\n", FLAGS_json.c_str(), strerror(errno));
+      return 1;
+    }
+    WriteJson(output, ok);
+    if (output != stdout)
+      fclose(output);
+  }
+  return ok ? 0 : 1;
+}
@@ -9,6 +9,7 @@
 #include <vector>
 #include "io_task.h"
 #include "gzstream.h"
+#include "trace_format.h"
 #include <gflags/gflags.h>
 
 namespace indexfs { namespace mpi {
@@ -27,6 +28,11 @@ DEFINE_bool(check,
     false, "Check pre-conditions before performing each IO operation");
 DEFINE_bool(read_only,
     false, "Do not update metadata -- issue read operation instead");
+DEFINE_string(binary_log,
+    "", "Binary trace made by trace_convert, replayed instead of replay_log");
+DEFINE_double(replay_speed,
+    0, "Replay timed binary traces at this multiple of the original pace,"
+       " or as fast as possible if 0");
 
 // For merging multiple logs into one replay list
 //
@@ -60,6 +66,17 @@ struct IOAdaptor {
   Status IO_setPermission   (Path &path, Path &path2);
   Status IO_setReplication  (Path &path, Path &path2);
 
+  // Client calls, such as those captured with FS_CAPTURE_FILE
+  //
+  Status IO_NewFile         (Path &path, Path &path2);
+  Status IO_MakeDirectory   (Path &path, Path &path2);
+  Status IO_SyncDirectory   (Path &path, Path &path2);
+  Status IO_ResetMode       (Path &path, Path &path2);
+  Status IO_GetAttr         (Path &path, Path &path2);
+  Status IO_ListDirectory   (Path &path, Path &path2);
+  Status IO_Remove          (Path &path, Path &path2);
+  Status IO_Rename          (Path &path, Path &path2);
+
 };
 
 class Op {
@@ -287,8 +304,89 @@ REGISTER_OP(setReplication) {
   return IO_->GetAttr(path);
 }
 
+// Client calls are replayed as they were made, rather than adapted like
+// the HDFS ops above.  With --read_only, updates become a getattr.
+
+REGISTER_OP(NewFile) {
+  if (FLAGS_read_only) {
+    return IO_->GetAttr(path);
+  }
+  return IO_->NewFile(path);
+}
+
+REGISTER_OP(MakeDirectory) {
+  if (FLAGS_read_only) {
+    return IO_->GetAttr(path);
+  }
+  return IO_->MakeDirectory(path);
+}
+
+REGISTER_OP(SyncDirectory) {
+  return IO_->SyncDirectory(path);
+}
+
+REGISTER_OP(ResetMode) {
+  if (FLAGS_read_only) {
+    return IO_->GetAttr(path);
+  }
+  return IO_->ResetMode(path);
+}
+
+REGISTER_OP(GetAttr) {
+  return IO_->GetAttr(path);
+}
+
+REGISTER_OP(ListDirectory) {
+  return IO_->ListDirectory(path);
+}
+
+REGISTER_OP(Remove) {
+  if (FLAGS_read_only) {
+    return IO_->GetAttr(path);
+  }
+  return IO_->Remove(path);
+}
+
+REGISTER_OP(Rename) {
+  if (FLAGS_read_only) {
+    return IO_->GetAttr(path);
+  }
+  return IO_->Rename(path, path2);
+}
+
 #undef REGISTER_OP
 
+typedef Status (IOAdaptor::*IOMethod)(Path &path, Path &path2);
+
+// Binary trace ops, indexed by TraceOpCode
+static const IOMethod kTraceMethods[kNumTraceOps] = {
+  &IOAdaptor::IO_open,
+  &IOAdaptor::IO_create,
+  &IOAdaptor::IO_delete,
+  &IOAdaptor::IO_rename,
+  &IOAdaptor::IO_mkdir,
+  &IOAdaptor::IO_mkdirs,
+  &IOAdaptor::IO_listStatus,
+  &IOAdaptor::IO_setOwner,
+  &IOAdaptor::IO_setPermission,
+  &IOAdaptor::IO_setReplication,
+  &IOAdaptor::IO_NewFile,
+  &IOAdaptor::IO_MakeDirectory,
+  &IOAdaptor::IO_SyncDirectory,
+  &IOAdaptor::IO_ResetMode,
+  &IOAdaptor::IO_GetAttr,
+  &IOAdaptor::IO_ListDirectory,
+  &IOAdaptor::IO_Remove,
+  &IOAdaptor::IO_Rename
+};
+
+// Position within one partition of a binary trace
+struct TraceCursor {
+  const TraceOp* next;
+  const TraceOp* end;
+  uint64_t micros; // Trace time of the next op
+};
+
 //////////////////////////////////////////////////////////////////////////////////
 // REPLAY TEST IMPLEMENTATION
 //
@@ -391,13 +489,15 @@ class ReplayTest: public IOTask {
           line.append("\t"); // Using a tailing sentinel element
           size_t op_pos = line.find('\t');
           size_t path_pos = line.find('\t', op_pos + 1);
+          size_t path2_pos = path_pos == std::string::npos ?
+            std::string::npos : line.find('\t', path_pos + 1);
           op = line.substr(0, op_pos);
           path.resize(root_size);
-          path.append(line.substr(op_pos + 1, path_pos - op_pos - 1));
+          path.append(line, op_pos + 1, path_pos - op_pos - 1);
           path2.resize(root_size);
-          path2.append(line.substr(path_pos + 1));
-          if (path2.size() > root_size) {
-            path2.erase(path2.length() - 1);
+          if (path2_pos != std::string::npos) {
+            // The op time that may follow is only used by binary traces
+            path2.append(line, path_pos + 1, path2_pos - path_pos - 1);
           }
           OpFactory f = GetOpFactory(op);
           if (f == NULL) {
@@ -415,6 +515,99 @@ class ReplayTest: public IOTask {
     printf("# Proc %d loaded %lu ops\n", my_rank_, replay_list_.size());
   }
 
+  // Perform a binary trace op, reusing the path buffers.  Errors are handled
+  // like those of the ops built from text traces.
+  void ExecTraceOp(IOAdaptor &ada, const TraceOp &op,
+                   std::string &path, std::string &path2) {
+    if (op.op >= kNumTraceOps) {
+      throw IOError("replay", "corrupted binary trace");
+    }
+    Slice p = trace_.GetPath(op.path);
+    path.assign(FLAGS_root_dir).append(p.data(), p.size());
+    path2.clear();
+    if (op.path2 != kNoTracePath) {
+      Slice p2 = trace_.GetPath(op.path2);
+      path2.assign(FLAGS_root_dir).append(p2.data(), p2.size());
+    }
+    const char* name = kTraceOpNames[op.op];
+    Status s = (ada.*kTraceMethods[op.op])(path, path2);
+    if (!s.ok()) {
+      if (listener_ != NULL) listener_->IOFailed(name);
+      if (!FLAGS_ignore_errors) {
+        throw IOError(path, name, s.ToString());
+      }
+    } else if (listener_ != NULL) {
+      listener_->IOPerformed(name);
+    }
+  }
+
+  // Replay this rank's partitions of the binary trace straight from the
+  // mapping.  Timed traces are merged in trace order, and paced against
+  // the earliest op of the whole trace so that all ranks stay aligned;
+  // others are interleaved in windows as with text traces.
+  void ReplayBinaryTrace() {
+    std::vector<TraceCursor> cursors;
+    uint64_t origin = ~uint64_t(0);
+    for (int i = 0; i < trace_.NumPartitions(); i++) {
+      TraceCursor c;
+      trace_.GetPartition(i, &c.next, &c.end);
+      c.micros = trace_.PartitionStartMicros(i);
+      if (c.next != c.end && c.micros < origin) {
+        origin = c.micros;
+      }
+      if (i % comm_sz_ == my_rank_ && c.next != c.end) {
+        cursors.push_back(c);
+      }
+    }
+
+    IOAdaptor ada(IO_);
+    std::string path, path2;
+    path.reserve(256);
+    path2.reserve(256);
+    if (!trace_.HasTimes()) {
+      size_t remaining = cursors.size();
+      while (remaining > 0) {
+        for (size_t idx = 0; idx < cursors.size(); idx++) {
+          TraceCursor &c = cursors[idx];
+          for (int i = 0; i < FLAGS_win_size && c.next != c.end; i++) {
+            ExecTraceOp(ada, *c.next++, path, path2);
+            if (c.next == c.end) {
+              remaining--;
+            }
+          }
+        }
+      }
+      return;
+    }
+
+    double start = WallTime();
+    while (!cursors.empty()) {
+      size_t idx = 0;
+      for (size_t i = 1; i < cursors.size(); i++) {
+        if (cursors[i].micros < cursors[idx].micros) {
+          idx = i;
+        }
+      }
+      TraceCursor &c = cursors[idx];
+      if (FLAGS_replay_speed > 0) {
+        double due = start +
+          (c.micros - origin) / (FLAGS_replay_speed * 1000000.0);
+        double now = WallTime();
+        if (due > now) {
+          Env::Default()->SleepForMicroseconds(
+            static_cast<int>((due - now) * 1000000));
+        }
+      }
+      ExecTraceOp(ada, *c.next++, path, path2);
+      if (c.next == c.end) {
+        cursors[idx] = cursors.back();
+        cursors.pop_back();
+      } else {
+        c.micros += c.next->delta_micros;
+      }
+    }
+  }
+
   int PrintSettings() {
     return printf("Test Settings:\n"
       "  total processes -> %d\n"
@@ -425,6 +618,8 @@ class ReplayTest: public IOTask {
       "  prepare_log -> %s\n"
       "  verify_log -> %s\n"
       "  replay_log -> %s\n"
+      "  binary_log -> %s\n"
+      "  replay_speed -> %.2f\n"
       "  num_parts -> %d\n"
       "  win_size -> %d\n"
       "  root_dir -> %s\n"
@@ -437,6 +632,8 @@ class ReplayTest: public IOTask {
       FLAGS_prepare_log.c_str(),
       FLAGS_verify_log.c_str(),
       FLAGS_replay_log.c_str(),
+      FLAGS_binary_log.c_str(),
+      FLAGS_replay_speed,
       FLAGS_num_parts,
       FLAGS_win_size,
       FLAGS_root_dir.c_str(),
@@ -459,6 +656,10 @@ class ReplayTest: public IOTask {
   std::vector<igzstream*> replay_logs_;
   std::vector<Op*> replay_list_;
 
+  bool binary_;
+  Status trace_status_;
+  TraceReader trace_;
+
  public:
 
   virtual ~ReplayTest() {
@@ -481,7 +682,8 @@ class ReplayTest: public IOTask {
   }
 
   ReplayTest(int my_rank, int comm_sz) : IOTask(my_rank, comm_sz),
-    init_(false), prepare_(false), verify_(false), replay_(false) {
+    init_(false), prepare_(false), verify_(false), replay_(false),
+    binary_(false) {
     if (FLAGS_num_parts == 0) {
       FLAGS_num_parts = comm_sz;
     }
@@ -501,6 +703,14 @@ class ReplayTest: public IOTask {
       replay_ = true;
       OpenTraces(replay_logs_, FLAGS_replay_log, my_rank, comm_sz);
     }
+    if (!FLAGS_binary_log.empty()) {
+      binary_ = true;
+      trace_status_ = trace_.Open(FLAGS_binary_log);
+      if (!trace_status_.ok()) {
+        fprintf(stderr, "cannot open binary trace: %s\n",
+          trace_status_.ToString().c_str());
+      }
+    }
   }
 
   virtual void Prepare() {
@@ -551,6 +761,9 @@ class ReplayTest: public IOTask {
         }
       }
     }
+    if (binary_) {
+      ReplayBinaryTrace();
+    }
     fprintf(LOG_, "== Main Phase Performance Data ==\n\n");
     IOMeasurements::PrintMeasurements(IO_, LOG_);
   }
@@ -578,7 +791,10 @@ class ReplayTest: public IOTask {
     if (replay_ && !OpenedAllReplayLogs(replay_logs_)) {
       return false; // err has already been printed elsewhere
     }
-    if (!init_ && !prepare_ && !verify_ && !replay_) {
+    if (binary_ && !trace_status_.ok()) {
+      return false; // err has already been printed elsewhere
+    }
+    if (!init_ && !prepare_ && !verify_ && !replay_ && !binary_) {
       my_rank_ == 0
         ? fprintf(stderr, "No trace file of any category is specified\n")
         : 0;
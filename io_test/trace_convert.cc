@@ -0,0 +1,300 @@
+// Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Converts the gzipped text traces read by replay_test into one binary
+// trace, which replay_test can then replay with --binary_log.  Parts
+// <input>.0.gz to <input>.<num_parts - 1>.gz become the partitions of the
+// binary trace.  Each line of a part is
+//
+//   op <TAB> path [<TAB> path2 [<TAB> micros]]
+//
+// where micros, if present, is the time of the op in microseconds; with
+// times, the binary trace can be replayed at its original pace.
+//
+// Alternatively, --capture lists files captured by clients with
+// FS_CAPTURE_FILE set.  Each thread of each file becomes a partition, so
+// that its ops replay in the order it made them.  Client ops become the
+// client calls they were made with, or the nearest ones; ops on file
+// descriptors, and ops that failed when captured, are left out.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <gflags/gflags.h>
+
+#include "gzstream.h"
+#include "trace_format.h"
+#include "client/trace_capture.h"
+
+using ::indexfs::Status;
+using ::indexfs::CaptureReader;
+using ::indexfs::CaptureRecord;
+using ::indexfs::kCaptureOk;
+using ::indexfs::kNumCaptureOps;
+using namespace ::indexfs::mpi;
+
+DEFINE_string(input,
+    "", "Prefix of the text trace parts to convert");
+
+DEFINE_int32(num_parts,
+    1, "Number of text trace parts");
+
+DEFINE_string(capture,
+    "", "Comma-separated client capture files to convert instead");
+
+DEFINE_string(output,
+    "", "Binary trace file to write");
+
+namespace {
+
+// Split "line" at the next tab after *pos, advancing *pos past it
+std::string NextField(const std::string &line, size_t* pos) {
+  if (*pos > line.size()) {
+    return std::string();
+  }
+  size_t end = line.find('\t', *pos);
+  if (end == std::string::npos) {
+    end = line.size();
+  }
+  std::string field = line.substr(*pos, end - *pos);
+  *pos = end + 1;
+  return field;
+}
+
+bool ConvertPart(TraceWriter* writer, int part, uint64_t* num_ops) {
+  std::stringstream ss;
+  ss << FLAGS_input << "." << part << ".gz";
+  std::string fname = ss.str();
+  igzstream in(fname.c_str());
+  if (!in.good()) {
+    fprintf(stderr, "cannot open trace log: %s\n", fname.c_str());
+    return false;
+  }
+  std::string line;
+  line.reserve(256);
+  int64_t lineno = 0;
+  while (std::getline(in, line)) {
+    lineno++;
+    if (line.empty()) {
+      continue;
+    }
+    size_t pos = 0;
+    std::string op = NextField(line, &pos);
+    std::string path = NextField(line, &pos);
+    std::string path2 = NextField(line, &pos);
+    std::string micros = NextField(line, &pos);
+    int code = GetTraceOpCode(op);
+    if (code < 0) {
+      fprintf(stderr, "warning: %s:%lld: unknown IO op: %s\n",
+          fname.c_str(), static_cast<long long>(lineno), op.c_str());
+      continue;
+    }
+    Status s = writer->Append(part, code, path, path2,
+        micros.empty() ? 0 : strtoull(micros.c_str(), NULL, 10));
+    if (!s.ok()) {
+      fprintf(stderr, "cannot write trace: %s\n", s.ToString().c_str());
+      return false;
+    }
+    (*num_ops)++;
+  }
+  return true;
+}
+
+// Replay op for each captured op, or -1 for those not replayed
+const int kCaptureToTraceOp[kNumCaptureOps] = {
+  kTraceIOGetAttr,       // getattr
+  kTraceIONewFile,       // mknod
+  kTraceIOMakeDirectory, // mkdir
+  kTraceIOResetMode,     // chmod
+  kTraceIORemove,        // remove
+  kTraceIORename,        // rename
+  kTraceIOListDirectory, // readdir
+  kTraceIOListDirectory, // readdirplus
+  kTraceIOSyncDirectory, // fsyncdir
+  kTraceIOGetAttr,       // accessdir
+  kTraceIOGetAttr,       // open
+  -1,                    // read
+  -1,                    // write
+  -1                     // close
+};
+
+// Failed ops are left out, as they would mostly fail again on replay
+// and stop it, short of --ignore_errors.
+bool IsReplayed(const CaptureRecord &rec) {
+  return rec.op < kNumCaptureOps && kCaptureToTraceOp[rec.op] >= 0 &&
+         rec.result == kCaptureOk;
+}
+
+// Partition of each thread with ops to replay in a capture file
+typedef std::map<uint32_t, int> ThreadParts;
+
+// Give each thread of "fname" the next partition, in thread order
+bool ListCaptureThreads(const std::string &fname, int* num_parts,
+                        ThreadParts* parts) {
+  CaptureReader reader;
+  Status s = reader.Open(fname);
+  if (!s.ok()) {
+    fprintf(stderr, "cannot open capture: %s\n", s.ToString().c_str());
+    return false;
+  }
+  CaptureRecord rec;
+  std::string path, path2;
+  while (reader.Next(&rec, &path, &path2)) {
+    if (IsReplayed(rec)) {
+      (*parts)[rec.thread] = 0;
+    }
+  }
+  for (ThreadParts::iterator it = parts->begin(); it != parts->end(); ++it) {
+    it->second = (*num_parts)++;
+  }
+  return true;
+}
+
+struct CapturedOp {
+  int part;
+  uint64_t micros;
+  int op;
+  std::string path;
+  std::string path2;
+};
+
+struct CapturedOpOrder {
+  bool operator()(const CapturedOp* a, const CapturedOp* b) const {
+    return a->part != b->part ? a->part < b->part : a->micros < b->micros;
+  }
+};
+
+// Threads append captured ops in chunks, and each chunk is written once
+// full, so the ops of a thread are only roughly in time order; sort them
+// before writing.
+bool ConvertCapture(TraceWriter* writer, const std::string &fname,
+                    const ThreadParts &parts, uint64_t* num_ops,
+                    uint64_t* num_failed) {
+  CaptureReader reader;
+  Status s = reader.Open(fname);
+  if (!s.ok()) {
+    fprintf(stderr, "cannot open capture: %s\n", s.ToString().c_str());
+    return false;
+  }
+  std::vector<CapturedOp> ops;
+  CaptureRecord rec;
+  std::string path, path2;
+  while (reader.Next(&rec, &path, &path2)) {
+    if (!IsReplayed(rec)) {
+      if (rec.result != kCaptureOk) {
+        (*num_failed)++;
+      }
+      continue;
+    }
+    ThreadParts::const_iterator it = parts.find(rec.thread);
+    if (it == parts.end()) {
+      continue; // Appended since the file was listed
+    }
+    ops.push_back(CapturedOp());
+    ops.back().part = it->second;
+    ops.back().micros = rec.start_micros;
+    ops.back().op = kCaptureToTraceOp[rec.op];
+    ops.back().path.swap(path);
+    ops.back().path2.swap(path2);
+  }
+  if (!reader.status().ok()) {
+    // A process killed while capturing leaves a partial record behind
+    fprintf(stderr, "warning: %s\n", reader.status().ToString().c_str());
+  }
+
+  std::vector<const CapturedOp*> order(ops.size());
+  for (size_t i = 0; i < ops.size(); i++) {
+    order[i] = &ops[i];
+  }
+  std::stable_sort(order.begin(), order.end(), CapturedOpOrder());
+  for (size_t i = 0; i < order.size(); i++) {
+    s = writer->Append(order[i]->part, order[i]->op, order[i]->path,
+                       order[i]->path2, order[i]->micros);
+    if (!s.ok()) {
+      fprintf(stderr, "cannot write trace: %s\n", s.ToString().c_str());
+      return false;
+    }
+  }
+  *num_ops += ops.size();
+  return true;
+}
+
+} // anonymous namespace
+
+using ::google::SetUsageMessage;
+using ::google::ParseCommandLineFlags;
+
+int main(int argc, char** argv) {
+  SetUsageMessage(
+      "Convert replay traces or client captures into a binary trace");
+  ParseCommandLineFlags(&argc, &argv, true);
+  std::vector<std::string> captures;
+  std::stringstream list(FLAGS_capture);
+  std::string capture;
+  while (std::getline(list, capture, ',')) {
+    if (!capture.empty()) {
+      captures.push_back(capture);
+    }
+  }
+  std::vector<ThreadParts> capture_parts(captures.size());
+  if (!captures.empty()) {
+    FLAGS_num_parts = 0;
+    for (size_t i = 0; i < captures.size(); i++) {
+      if (!ListCaptureThreads(captures[i], &FLAGS_num_parts,
+                              &capture_parts[i])) {
+        return 1;
+      }
+    }
+    if (FLAGS_num_parts == 0) {
+      fprintf(stderr, "no ops to replay in the captures\n");
+      return 1;
+    }
+  }
+  if ((FLAGS_input.empty() && captures.empty()) || FLAGS_output.empty() ||
+      FLAGS_num_parts <= 0) {
+    fprintf(stderr, "usage: %s {--input=<prefix> --num_parts=<n> |"
+        " --capture=<file>[,<file>...]} --output=<file>\n", argv[0]);
+    return 1;
+  }
+
+  TraceWriter writer;
+  Status s = writer.Open(FLAGS_output, FLAGS_num_parts);
+  if (!s.ok()) {
+    fprintf(stderr, "cannot create trace: %s\n", s.ToString().c_str());
+    return 1;
+  }
+  uint64_t num_ops = 0;
+  uint64_t num_failed = 0;
+  if (captures.empty()) {
+    for (int i = 0; i < FLAGS_num_parts; i++) {
+      if (!ConvertPart(&writer, i, &num_ops)) {
+        return 1;
+      }
+    }
+  } else {
+    for (size_t i = 0; i < captures.size(); i++) {
+      if (!ConvertCapture(&writer, captures[i], capture_parts[i],
+                          &num_ops, &num_failed)) {
+        return 1;
+      }
+    }
+  }
+  s = writer.Close();
+  if (!s.ok()) {
+    fprintf(stderr, "cannot write trace: %s\n", s.ToString().c_str());
+    return 1;
+  }
+  printf("Converted %llu ops from %d parts into %s\n",
+      static_cast<unsigned long long>(num_ops), FLAGS_num_parts,
+      FLAGS_output.c_str());
+  if (num_failed > 0) {
+    printf("Left out %llu ops that had failed\n",
+        static_cast<unsigned long long>(num_failed));
+  }
+  return 0;
+}
@@ -0,0 +1,283 @@
+// Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace_format.h"
+
+namespace indexfs { namespace mpi {
+
+const char* kTraceOpNames[kNumTraceOps] = {
+  "open", "create", "delete", "rename", "mkdir",
+  "mkdirs", "listStatus", "setOwner", "setPermission",
+  "setReplication",
+  "NewFile", "MakeDirectory", "SyncDirectory",
+  "ResetMode", "GetAttr", "ListDirectory", "Remove",
+  "Rename"
+};
+
+int GetTraceOpCode(const std::string &name) {
+  for (int i = 0; i < kNumTraceOps; i++) {
+    if (name == kTraceOpNames[i]) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+namespace {
+
+static const char kTraceMagic[8] = { 'I', 'D', 'X', 'F', 'S', 'T', 'R', '1' };
+static const uint32_t kTraceVersion = 1;
+
+static inline
+Status TraceError(const std::string &fname, int err) {
+  return Status::IOError(fname, strerror(err));
+}
+
+} /* anonymous namespace */
+
+TraceWriter::TraceWriter()
+  : file_(NULL), part_(0), last_micros_(0) {
+  memset(&header_, 0, sizeof(header_));
+}
+
+TraceWriter::~TraceWriter() {
+  if (file_ != NULL) {
+    fclose(file_);
+  }
+}
+
+Status TraceWriter::Write(const void* data, size_t size) {
+  if (size > 0 && fwrite(data, size, 1, file_) != 1) {
+    return TraceError(fname_, errno);
+  }
+  return Status::OK();
+}
+
+Status TraceWriter::Open(const std::string &fname, int num_parts) {
+  fname_ = fname;
+  file_ = fopen(fname.c_str(), "wb");
+  if (file_ == NULL) {
+    return TraceError(fname, errno);
+  }
+  memcpy(header_.magic, kTraceMagic, sizeof(header_.magic));
+  header_.version = kTraceVersion;
+  header_.num_parts = num_parts;
+  parts_.assign(num_parts, TracePartition());
+  for (int i = 0; i < num_parts; i++) {
+    parts_[i].first_op = 0;
+    parts_[i].num_ops = 0;
+    parts_[i].start_micros = 0;
+  }
+  // Reserve room for the header and the partition index, which are only
+  // known once all ops have been written
+  Status s = Write(&header_, sizeof(header_));
+  if (s.ok()) {
+    s = Write(&parts_[0], sizeof(TracePartition) * parts_.size());
+  }
+  return s;
+}
+
+Status TraceWriter::Intern(const std::string &path, uint32_t* id) {
+  PathMap::iterator it = ids_.find(path);
+  if (it == ids_.end()) {
+    // The last index is kNoTracePath
+    if (paths_.size() >= kNoTracePath) {
+      return Status::InvalidArgument(fname_, "too many distinct paths");
+    }
+    uint32_t next = static_cast<uint32_t>(paths_.size());
+    it = ids_.insert(std::make_pair(path, next)).first;
+    paths_.push_back(&it->first);
+  }
+  *id = it->second;
+  return Status::OK();
+}
+
+Status TraceWriter::Append(int part, int op, const std::string &path,
+                           const std::string &path2, uint64_t micros) {
+  if (part < part_ || part >= static_cast<int>(parts_.size())) {
+    return Status::InvalidArgument(fname_, "partition out of order");
+  }
+  TraceOp rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.op = static_cast<uint8_t>(op);
+  Status s = Intern(path, &rec.path);
+  if (s.ok()) {
+    rec.path2 = kNoTracePath;
+    if (!path2.empty()) {
+      s = Intern(path2, &rec.path2);
+    }
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  if (part != part_) {
+    part_ = part;
+    last_micros_ = 0;
+  }
+  if (parts_[part].num_ops == 0) {
+    parts_[part].first_op = header_.num_ops;
+    parts_[part].start_micros = micros;
+    last_micros_ = micros;
+  }
+  if (micros != 0) {
+    header_.flags |= kTraceHasTimes;
+  }
+
+  uint64_t delta = micros > last_micros_ ? micros - last_micros_ : 0;
+  rec.delta_micros = delta > 0xffffffffu ? 0xffffffffu
+                                         : static_cast<uint32_t>(delta);
+  last_micros_ = micros > last_micros_ ? micros : last_micros_;
+
+  parts_[part].num_ops++;
+  header_.num_ops++;
+  return Write(&rec, sizeof(rec));
+}
+
+Status TraceWriter::Close() {
+  if (file_ == NULL) {
+    return Status::OK();
+  }
+  // Empty partitions start where the following ones do
+  uint64_t next = header_.num_ops;
+  for (int i = static_cast<int>(parts_.size()) - 1; i >= 0; i--) {
+    if (parts_[i].num_ops == 0) {
+      parts_[i].first_op = next;
+    }
+    next = parts_[i].first_op;
+  }
+
+  header_.num_paths = paths_.size();
+  header_.paths_offset = sizeof(header_) +
+    sizeof(TracePartition) * parts_.size() + sizeof(TraceOp) * header_.num_ops;
+  header_.blob_offset = header_.paths_offset +
+    sizeof(uint64_t) * (paths_.size() + 1);
+
+  Status s;
+  uint64_t offset = 0;
+  for (size_t i = 0; s.ok() && i < paths_.size(); i++) {
+    s = Write(&offset, sizeof(offset));
+    offset += paths_[i]->size();
+  }
+  if (s.ok()) {
+    s = Write(&offset, sizeof(offset));
+  }
+  for (size_t i = 0; s.ok() && i < paths_.size(); i++) {
+    s = Write(paths_[i]->data(), paths_[i]->size());
+  }
+  header_.blob_size = offset;
+
+  if (s.ok() && fseeko(file_, 0, SEEK_SET) != 0) {
+    s = TraceError(fname_, errno);
+  }
+  if (s.ok()) {
+    s = Write(&header_, sizeof(header_));
+  }
+  if (s.ok()) {
+    s = Write(&parts_[0], sizeof(TracePartition) * parts_.size());
+  }
+  if (fclose(file_) != 0 && s.ok()) {
+    s = TraceError(fname_, errno);
+  }
+  file_ = NULL;
+  return s;
+}
+
+TraceReader::TraceReader()
+  : base_(NULL), size_(0), header_(NULL), parts_(NULL), ops_(NULL),
+    path_offsets_(NULL), blob_(NULL) {
+}
+
+TraceReader::~TraceReader() {
+  if (base_ != NULL) {
+    munmap(base_, size_);
+  }
+}
+
+Status TraceReader::Open(const std::string &fname) {
+  int fd = open(fname.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return TraceError(fname, errno);
+  }
+  struct stat buf;
+  if (fstat(fd, &buf) != 0) {
+    int err = errno;
+    close(fd);
+    return TraceError(fname, err);
+  }
+  size_ = buf.st_size;
+  if (size_ < sizeof(TraceHeader)) {
+    close(fd);
+    return Status::Corruption(fname, "truncated trace header");
+  }
+  base_ = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+  int err = errno;
+  close(fd);
+  if (base_ == MAP_FAILED) {
+    base_ = NULL;
+    return TraceError(fname, err);
+  }
+  // Ops are read front to back, so ask for aggressive read-ahead
+  madvise(base_, size_, MADV_SEQUENTIAL);
+
+  const char* base = reinterpret_cast<const char*>(base_);
+  header_ = reinterpret_cast<const TraceHeader*>(base);
+  if (memcmp(header_->magic, kTraceMagic, sizeof(kTraceMagic)) != 0 ||
+      header_->version != kTraceVersion) {
+    return Status::Corruption(fname, "not a binary trace");
+  }
+  // Bound the counts by the file size first, so that the offsets below
+  // cannot overflow
+  if (header_->num_parts > size_ / sizeof(TracePartition) ||
+      header_->num_ops > size_ / sizeof(TraceOp) ||
+      header_->num_paths >= size_ / sizeof(uint64_t) ||
+      header_->num_paths > kNoTracePath ||
+      header_->blob_size > size_) {
+    return Status::Corruption(fname, "inconsistent trace layout");
+  }
+  uint64_t ops_offset = sizeof(TraceHeader) +
+    sizeof(TracePartition) * uint64_t(header_->num_parts);
+  if (header_->paths_offset !=
+        ops_offset + sizeof(TraceOp) * header_->num_ops ||
+      header_->blob_offset !=
+        header_->paths_offset + sizeof(uint64_t) * (header_->num_paths + 1) ||
+      header_->blob_offset + header_->blob_size != size_) {
+    return Status::Corruption(fname, "inconsistent trace layout");
+  }
+  parts_ = reinterpret_cast<const TracePartition*>(base + sizeof(TraceHeader));
+  ops_ = reinterpret_cast<const TraceOp*>(base + ops_offset);
+  path_offsets_ =
+    reinterpret_cast<const uint64_t*>(base + header_->paths_offset);
+  blob_ = base + header_->blob_offset;
+  for (uint32_t i = 0; i < header_->num_parts; i++) {
+    if (parts_[i].first_op > header_->num_ops ||
+        parts_[i].num_ops > header_->num_ops - parts_[i].first_op) {
+      return Status::Corruption(fname, "partition out of range");
+    }
+  }
+  for (uint64_t i = 0; i < header_->num_paths; i++) {
+    if (path_offsets_[i] > path_offsets_[i + 1]) {
+      return Status::Corruption(fname, "path offsets out of order");
+    }
+  }
+  if (path_offsets_[header_->num_paths] > header_->blob_size) {
+    return Status::Corruption(fname, "path out of range");
+  }
+  for (uint64_t i = 0; i < header_->num_ops; i++) {
+    if (ops_[i].path >= header_->num_paths ||
+        (ops_[i].path2 >= header_->num_paths &&
+         ops_[i].path2 != kNoTracePath)) {
+      return Status::Corruption(fname, "path index out of range");
+    }
+  }
+  return Status::OK();
+}
+
+} /* namespace mpi */ } /* namespace indexfs */
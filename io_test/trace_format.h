@@ -0,0 +1,167 @@
+// Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Binary metadata traces.  trace_convert turns the text traces read by
+// replay_test into this format, and replay_test replays them directly
+// from a memory mapping, with no parsing or per-op allocation.
+//
+// A trace file is laid out as follows, integers in host byte order:
+//
+//   TraceHeader
+//   TracePartition[num_parts]     first op, number of ops and start time
+//   TraceOp[num_ops]              ops, partition after partition
+//   uint64_t[num_paths + 1]       offsets of the paths in the path blob
+//   char[blob_size]               path blob
+//
+// Every distinct path is stored once, and ops refer to paths by index.
+// Partitions correspond to the text trace parts, and are spread over
+// replaying clients the same way.
+
+#ifndef _INDEXFS_MPI_TRACE_FORMAT_H_
+#define _INDEXFS_MPI_TRACE_FORMAT_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common/common.h"
+
+namespace indexfs { namespace mpi {
+
+enum TraceOpCode {
+  kTraceOpen, kTraceCreate, kTraceDelete, kTraceRename, kTraceMkdir,
+  kTraceMkdirs, kTraceListStatus, kTraceSetOwner, kTraceSetPermission,
+  kTraceSetReplication,
+  // Client calls, replayed with the IOClient method of the same name
+  kTraceIONewFile, kTraceIOMakeDirectory, kTraceIOSyncDirectory,
+  kTraceIOResetMode, kTraceIOGetAttr, kTraceIOListDirectory, kTraceIORemove,
+  kTraceIORename, kNumTraceOps
+};
+
+// Names of the ops, as found in text traces
+extern const char* kTraceOpNames[kNumTraceOps];
+
+// Return the code of the op named "name", or -1 if there is none
+extern int GetTraceOpCode(const std::string &name);
+
+// Path index of ops with a single path
+static const uint32_t kNoTracePath = 0xffffffffu;
+
+enum TraceFlags {
+  kTraceHasTimes = 1   // Ops carry the time since the previous op
+};
+
+struct TraceHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint32_t num_parts;
+  uint32_t reserved;
+  uint64_t num_ops;
+  uint64_t num_paths;
+  uint64_t paths_offset;   // File offset of the path offsets
+  uint64_t blob_offset;    // File offset of the path blob
+  uint64_t blob_size;
+};
+
+struct TracePartition {
+  uint64_t first_op;
+  uint64_t num_ops;
+  uint64_t start_micros;   // Time of the first op
+};
+
+struct TraceOp {
+  uint8_t op;
+  uint8_t reserved[3];
+  uint32_t path;
+  uint32_t path2;          // kNoTracePath unless the op takes two paths
+  uint32_t delta_micros;   // Since the previous op of the same partition
+};
+
+// Writes a trace, one partition after the other.  Paths are interned in
+// memory, and written out on Close().
+class TraceWriter {
+ public:
+  TraceWriter();
+  ~TraceWriter();
+
+  Status Open(const std::string &fname, int num_parts);
+
+  // Append an op to partition "part", which must not be smaller than the
+  // partition of the previous op.  "micros" is the time of the op, or 0
+  // if the trace has no times; path2 is empty for single-path ops.
+  Status Append(int part, int op, const std::string &path,
+                const std::string &path2, uint64_t micros);
+
+  Status Close();
+
+ private:
+  Status Intern(const std::string &path, uint32_t* id);
+  Status Write(const void* data, size_t size);
+
+  FILE* file_;
+  std::string fname_;
+  TraceHeader header_;
+  std::vector<TracePartition> parts_;
+  int part_;                 // Partition being written
+  uint64_t last_micros_;     // Time of the previous op in part_
+  typedef std::map<std::string, uint32_t> PathMap;
+  PathMap ids_;
+  std::vector<const std::string*> paths_;  // Keys of ids_, by index
+
+  // No copying allowed
+  TraceWriter(const TraceWriter&);
+  TraceWriter& operator=(const TraceWriter&);
+};
+
+// Maps a trace written by TraceWriter for reading.  Open() checks the
+// whole trace, so that the ops and paths it returns are always in range.
+class TraceReader {
+ public:
+  TraceReader();
+  ~TraceReader();
+
+  Status Open(const std::string &fname);
+
+  int NumPartitions() const { return header_->num_parts; }
+
+  uint64_t NumOps() const { return header_->num_ops; }
+
+  bool HasTimes() const { return (header_->flags & kTraceHasTimes) != 0; }
+
+  // Store the ops of partition "part" in [*begin, *end)
+  void GetPartition(int part,
+                    const TraceOp** begin, const TraceOp** end) const {
+    *begin = ops_ + parts_[part].first_op;
+    *end = *begin + parts_[part].num_ops;
+  }
+
+  uint64_t PartitionStartMicros(int part) const {
+    return parts_[part].start_micros;
+  }
+
+  Slice GetPath(uint32_t path) const {
+    return Slice(blob_ + path_offsets_[path],
+                 path_offsets_[path + 1] - path_offsets_[path]);
+  }
+
+ private:
+  void* base_;
+  size_t size_;
+  const TraceHeader* header_;
+  const TracePartition* parts_;
+  const TraceOp* ops_;
+  const uint64_t* path_offsets_;
+  const char* blob_;
+
+  // No copying allowed
+  TraceReader(const TraceReader&);
+  TraceReader& operator=(const TraceReader&);
+};
+
+} /* namespace mpi */ } /* namespace indexfs */
+
+#endif /* _INDEXFS_MPI_TRACE_FORMAT_H_ */
@@ -19,6 +19,7 @@ Status BuildTable(const std::string& dbname,
                   const Options& options,
                   TableCache* table_cache,
                   Iterator* iter,
+                  int level,
                   FileMetaData* meta) {
   Status s;
   meta->file_size = 0;
@@ -32,7 +33,7 @@ Status BuildTable(const std::string& dbname,
       return s;
     }
 
-    TableBuilder* builder = new TableBuilder(options, file, false);
+    TableBuilder* builder = new TableBuilder(options, file, level);
     meta->smallest.DecodeFrom(iter->key());
     for (; iter->Valid(); iter->Next()) {
       Slice key = iter->key();
@@ -12,6 +12,7 @@
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/iterator.h"
+#include "leveldb/merge_operator.h"
 #include "leveldb/options.h"
 #include "leveldb/status.h"
 #include "leveldb/write_batch.h"
@@ -19,7 +20,9 @@
 #include "leveldb/table.h"
 #include "db/dbformat.h"
 #include "db/column_db.h"
+#include "port/lock_profile.h"
 
+using leveldb::BlockFormat;
 using leveldb::Cache;
 using leveldb::Comparator;
 using leveldb::CompressionType;
@@ -30,6 +33,8 @@ using leveldb::FileLock;
 using leveldb::FilterPolicy;
 using leveldb::Iterator;
 using leveldb::Logger;
+using leveldb::MergeOperator;
+using leveldb::NewBlockedBloomFilterPolicy;
 using leveldb::NewBloomFilterPolicy;
 using leveldb::NewLRUCache;
 using leveldb::Options;
@@ -116,14 +121,15 @@ struct leveldb_filterpolicy_t : public FilterPolicy {
     return (*name_)(state_);
   }
 
-  virtual void CreateFilter(const Slice* keys, int n, std::string* dst, 
-                            bool last_level) const {
+  virtual void CreateFilter(const Slice* keys, int n, std::string* dst,
+                            int level) const {
     std::vector<const char*> key_pointers(n);
     std::vector<size_t> key_sizes(n);
     for (int i = 0; i < n; i++) {
       key_pointers[i] = keys[i].data();
       key_sizes[i] = keys[i].size();
     }
+    const bool last_level = level + 1 >= leveldb::config::kNumLevels;
     size_t len;
     char* filter = (*create_)(state_, &key_pointers[0], &key_sizes[0], n, &len,
                               (unsigned char) last_level);
@@ -137,6 +143,57 @@ struct leveldb_filterpolicy_t : public FilterPolicy {
   }
 };
 
+struct leveldb_mergeoperator_t : public MergeOperator {
+  void* state_;
+  void (*destructor_)(void*);
+  const char* (*name_)(void*);
+  bool drop_operands_without_value_;
+  char* (*full_merge_)(
+      void*,
+      const char* key, size_t key_length,
+      const char* existing_value, size_t existing_value_length,
+      const char* const* operands_list, const size_t* operands_list_length,
+      int num_operands,
+      unsigned char* success, size_t* new_value_length);
+
+  virtual ~leveldb_mergeoperator_t() {
+    (*destructor_)(state_);
+  }
+
+  virtual const char* Name() const {
+    return (*name_)(state_);
+  }
+
+  virtual bool DropsOperandsWithoutValue() const {
+    return drop_operands_without_value_;
+  }
+
+  virtual bool FullMerge(const Slice& key, const Slice* existing_value,
+                         const std::vector<Slice>& operands,
+                         std::string* new_value) const {
+    const int n = static_cast<int>(operands.size());
+    std::vector<const char*> operand_pointers(n);
+    std::vector<size_t> operand_sizes(n);
+    for (int i = 0; i < n; i++) {
+      operand_pointers[i] = operands[i].data();
+      operand_sizes[i] = operands[i].size();
+    }
+    unsigned char success = 0;
+    size_t len = 0;
+    char* result = (*full_merge_)(
+        state_, key.data(), key.size(),
+        existing_value != NULL ? existing_value->data() : NULL,
+        existing_value != NULL ? existing_value->size() : 0,
+        n > 0 ? &operand_pointers[0] : NULL,
+        n > 0 ? &operand_sizes[0] : NULL, n, &success, &len);
+    if (success) {
+      new_value->assign(result, len);
+    }
+    free(result);
+    return success != 0;
+  }
+};
+
 struct leveldb_env_t {
   Env* rep;
   bool is_default;
@@ -208,6 +265,17 @@ void leveldb_delete(
   SaveError(errptr, db->rep->Delete(options->rep, Slice(key, keylen)));
 }
 
+void leveldb_merge(
+    leveldb_t* db,
+    const leveldb_writeoptions_t* options,
+    const char* key, size_t keylen,
+    const char* val, size_t vallen,
+    char** errptr) {
+  SaveError(errptr,
+            db->rep->Merge(options->rep, Slice(key, keylen),
+                           Slice(val, vallen)));
+}
+
 
 void leveldb_write(
     leveldb_t* db,
@@ -238,6 +306,76 @@ char* leveldb_get(
   return result;
 }
 
+struct CValueVisitor {
+  void (*visitor)(void*, const char*, size_t);
+  void* arg;
+};
+
+static void VisitCValue(void* arg, const Slice& value) {
+  CValueVisitor* v = reinterpret_cast<CValueVisitor*>(arg);
+  (*v->visitor)(v->arg, value.data(), value.size());
+}
+
+unsigned char leveldb_get_with_visitor(
+    leveldb_t* db,
+    const leveldb_readoptions_t* options,
+    const char* key, size_t keylen,
+    void (*visitor)(void* arg, const char* value, size_t vallen),
+    void* arg,
+    char** errptr) {
+  CValueVisitor v;
+  v.visitor = visitor;
+  v.arg = arg;
+  Status s = db->rep->Get(options->rep, Slice(key, keylen), VisitCValue, &v);
+  if (s.ok()) {
+    return 1;
+  } else {
+    if (!s.IsNotFound()) {
+      SaveError(errptr, s);
+    }
+    return 0;
+  }
+}
+
+struct CMultiValueVisitor {
+  void (*visitor)(void*, int, const char*, size_t);
+  void* arg;
+};
+
+static void VisitCMultiValue(void* arg, int index, const Slice& value) {
+  CMultiValueVisitor* v = reinterpret_cast<CMultiValueVisitor*>(arg);
+  (*v->visitor)(v->arg, index, value.data(), value.size());
+}
+
+void leveldb_multi_get_with_visitor(
+    leveldb_t* db,
+    const leveldb_readoptions_t* options,
+    int num_keys,
+    const char* const* keys_list, const size_t* keys_list_sizes,
+    void (*visitor)(void* arg, int index, const char* value, size_t vallen),
+    void* arg,
+    unsigned char* found,
+    char** errptr) {
+  std::vector<Slice> keys(num_keys);
+  for (int i = 0; i < num_keys; i++) {
+    keys[i] = Slice(keys_list[i], keys_list_sizes[i]);
+  }
+  std::vector<Status> statuses(num_keys);
+  CMultiValueVisitor v;
+  v.visitor = visitor;
+  v.arg = arg;
+  if (num_keys > 0) {
+    db->rep->MultiGet(options->rep, num_keys, &keys[0],
+                      VisitCMultiValue, &v, &statuses[0]);
+  }
+  for (int i = 0; i < num_keys; i++) {
+    found[i] = statuses[i].ok();
+    if (!statuses[i].ok() && !statuses[i].IsNotFound()) {
+      SaveError(errptr, statuses[i]);
+    }
+  }
+}
+
 int leveldb_exists(
     leveldb_t* db,
     const leveldb_readoptions_t* options,
@@ -343,6 +481,18 @@ void leveldb_bulkinsert(
         max_sequence_number));
 }
 
+void leveldb_pin_values(
+    leveldb_t* db,
+    const leveldb_readoptions_t* options,
+    const char* begin_key, size_t begin_key_len,
+    const char* end_key, size_t end_key_len,
+    char** errptr) {
+  Slice a, b;
+  SaveError(errptr, db->rep->PinValues(options->rep,
+      (begin_key ? (a = Slice(begin_key, begin_key_len), &a) : NULL),
+      (end_key ? (b = Slice(end_key, end_key_len), &b) : NULL)));
+}
+
 void leveldb_destroy_db(
     const leveldb_options_t* options,
     const char* name,
@@ -439,6 +589,13 @@ void leveldb_writebatch_delete(
   b->rep.Delete(Slice(key, klen));
 }
 
+void leveldb_writebatch_merge(
+    leveldb_writebatch_t* b,
+    const char* key, size_t klen,
+    const char* val, size_t vlen) {
+  b->rep.Merge(Slice(key, klen), Slice(val, vlen));
+}
+
 void leveldb_writebatch_iterate(
     leveldb_writebatch_t* b,
     void* state,
@@ -501,6 +658,12 @@ void leveldb_options_set_filter_policy(
   opt->rep.filter_policy = policy;
 }
 
+void leveldb_options_set_merge_operator(
+    leveldb_options_t* opt,
+    leveldb_mergeoperator_t* merge_operator) {
+  opt->rep.merge_operator = merge_operator;
+}
+
 void leveldb_options_set_create_if_missing(
     leveldb_options_t* opt, unsigned char v) {
   opt->rep.create_if_missing = v;
@@ -536,6 +699,11 @@ void leveldb_options_set_cache(leveldb_options_t* opt, leveldb_cache_t* c) {
   opt->rep.block_cache = c->rep;
 }
 
+void leveldb_options_set_allow_mmap_reads(
+    leveldb_options_t* opt, unsigned char v) {
+  opt->rep.allow_mmap_reads = v;
+}
+
 void leveldb_options_set_block_size(leveldb_options_t* opt, size_t s) {
   opt->rep.block_size = s;
 }
@@ -560,6 +728,25 @@ void leveldb_options_disable_compaction(leveldb_options_t* opt) {
   opt->rep.disable_compaction = true;
 }
 
+void leveldb_options_set_allow_concurrent_memtable_write(
+    leveldb_options_t* opt, unsigned char v) {
+  opt->rep.allow_concurrent_memtable_write = v;
+}
+
+void leveldb_options_set_value_gc_interval(leveldb_options_t* opt, int n) {
+  opt->rep.value_gc_interval = n;
+}
+
+void leveldb_options_set_value_gc_garbage_percent(
+    leveldb_options_t* opt, int n) {
+  opt->rep.value_gc_garbage_percent = n;
+}
+
+void leveldb_options_set_value_gc_bytes_per_second(
+    leveldb_options_t* opt, uint64_t n) {
+  opt->rep.value_gc_bytes_per_second = n;
+}
+
 void leveldb_options_set_block_restart_interval(leveldb_options_t* opt, int n) {
   opt->rep.block_restart_interval = n;
 }
@@ -568,6 +755,10 @@ void leveldb_options_set_compression(leveldb_options_t* opt, int t) {
   opt->rep.compression = static_cast<CompressionType>(t);
 }
 
+void leveldb_options_set_block_format(leveldb_options_t* opt, int f) {
+  opt->rep.block_format = static_cast<BlockFormat>(f);
+}
+
 void leveldb_options_set_use_rename(
     leveldb_options_t* opt,
     int use_rename) {
@@ -620,17 +811,47 @@ void leveldb_filterpolicy_destroy(leveldb_filterpolicy_t* filter) {
   delete filter;
 }
 
-leveldb_filterpolicy_t* leveldb_filterpolicy_create_bloom(int bits_per_key) {
+leveldb_mergeoperator_t* leveldb_mergeoperator_create(
+    void* state,
+    void (*destructor)(void*),
+    char* (*full_merge)(
+        void*,
+        const char* key, size_t key_length,
+        const char* existing_value, size_t existing_value_length,
+        const char* const* operands_list, const size_t* operands_list_length,
+        int num_operands,
+        unsigned char* success, size_t* new_value_length),
+    const char* (*name)(void*)) {
+  leveldb_mergeoperator_t* result = new leveldb_mergeoperator_t;
+  result->state_ = state;
+  result->destructor_ = destructor;
+  result->full_merge_ = full_merge;
+  result->name_ = name;
+  result->drop_operands_without_value_ = false;
+  return result;
+}
+
+void leveldb_mergeoperator_destroy(leveldb_mergeoperator_t* merge_operator) {
+  delete merge_operator;
+}
+
+void leveldb_mergeoperator_set_drop_operands_without_value(
+    leveldb_mergeoperator_t* merge_operator, unsigned char v) {
+  merge_operator->drop_operands_without_value_ = v;
+}
+
+static leveldb_filterpolicy_t* WrapBuiltinFilterPolicy(
+    const FilterPolicy* policy) {
   // Make a leveldb_filterpolicy_t, but override all of its methods so
-  // they delegate to a NewBloomFilterPolicy() instead of user
-  // supplied C functions.
+  // they delegate to a builtin policy instead of user supplied C
+  // functions.
   struct Wrapper : public leveldb_filterpolicy_t {
     const FilterPolicy* rep_;
     ~Wrapper() { delete rep_; }
     const char* Name() const { return rep_->Name(); }
     void CreateFilter(const Slice* keys, int n, std::string* dst,
-                      bool last_level) const {
-      return rep_->CreateFilter(keys, n, dst, last_level);
+                      int level) const {
+      return rep_->CreateFilter(keys, n, dst, level);
     }
     bool KeyMayMatch(const Slice& key, const Slice& filter) const {
       return rep_->KeyMayMatch(key, filter);
@@ -638,12 +859,27 @@ leveldb_filterpolicy_t* leveldb_filterpolicy_create_bloom(int bits_per_key) {
     static void DoNothing(void*) { }
   };
   Wrapper* wrapper = new Wrapper;
-  wrapper->rep_ = NewBloomFilterPolicy(bits_per_key);
+  wrapper->rep_ = policy;
   wrapper->state_ = NULL;
   wrapper->destructor_ = &Wrapper::DoNothing;
   return wrapper;
 }
 
+leveldb_filterpolicy_t* leveldb_filterpolicy_create_bloom(int bits_per_key) {
+  return WrapBuiltinFilterPolicy(NewBloomFilterPolicy(bits_per_key));
+}
+
+leveldb_filterpolicy_t* leveldb_filterpolicy_create_blocked_bloom(
+    int bits_per_key) {
+  return WrapBuiltinFilterPolicy(NewBlockedBloomFilterPolicy(bits_per_key));
+}
+
+leveldb_filterpolicy_t* leveldb_filterpolicy_create_blocked_bloom_per_level(
+    const int* bits_per_level, int num_levels) {
+  return WrapBuiltinFilterPolicy(
+      NewBlockedBloomFilterPolicy(bits_per_level, num_levels));
+}
+
 leveldb_readoptions_t* leveldb_readoptions_create() {
   return new leveldb_readoptions_t;
 }
@@ -663,6 +899,21 @@ void leveldb_readoptions_set_fill_cache(
   opt->rep.fill_cache = v;
 }
 
+void leveldb_readoptions_set_scan_hint(
+    leveldb_readoptions_t* opt, unsigned char v) {
+  opt->rep.scan_hint = v;
+}
+
+void leveldb_readoptions_set_readahead_blocks(
+    leveldb_readoptions_t* opt, int n) {
+  opt->rep.readahead_blocks = n;
+}
+
+void leveldb_readoptions_set_prefetch_values(
+    leveldb_readoptions_t* opt, unsigned char v) {
+  opt->rep.prefetch_values = v;
+}
+
 void leveldb_readoptions_set_snapshot(
     leveldb_readoptions_t* opt,
     const leveldb_snapshot_t* snap) {
@@ -693,6 +944,22 @@ void leveldb_cache_destroy(leveldb_cache_t* cache) {
   delete cache;
 }
 
+void leveldb_cache_get_lookup_stats(
+    leveldb_cache_t* cache, uint64_t* lookups, uint64_t* hits) {
+  cache->rep->GetLookupStats(lookups, hits);
+}
+
+uint64_t leveldb_lock_profile_now_nanos() {
+  return leveldb::port::LockClass::NowNanos();
+}
+
+void leveldb_lock_profile_record(
+    const char* lock_class, uint64_t tag,
+    uint64_t wait_nanos, uint64_t hold_nanos) {
+  leveldb::port::LockClass::Get(lock_class)->Record(tag, wait_nanos,
+                                                    hold_nanos);
+}
+
 leveldb_env_t* leveldb_create_default_env() {
   leveldb_env_t* result = new leveldb_env_t;
   result->rep = Env::Default();
@@ -700,6 +967,13 @@ leveldb_env_t* leveldb_create_default_env() {
   return result;
 }
 
+leveldb_env_t* leveldb_create_io_uring_env() {
+  leveldb_env_t* result = new leveldb_env_t;
+  result->rep = Env::IOUringEnv();
+  result->is_default = (result->rep == Env::Default());
+  return result;
+}
+
 #if defined(OS_LINUX)
 #if defined(HDFS)
 leveldb_env_t* leveldb_create_hdfs_env(const char* serverIP,
@@ -733,7 +1007,7 @@ leveldb_tablebuilder_t* leveldb_tablebuilder_create(
   Status s = env->rep->NewWritableFile(std::string(name),
                                        &result->file);
   if (s.ok()) {
-    result->rep = new TableBuilder(options->rep, result->file, false);
+    result->rep = new TableBuilder(options->rep, result->file, -1);
   } else {
     SaveError(errptr, s);
     delete result;
@@ -756,9 +1030,9 @@ leveldb_tablebuilder_t* leveldb_tablebuilder_create_with_sanitization(
       Options opt(options->rep);
       policy = new InternalFilterPolicy(options->rep.filter_policy);
       opt.filter_policy = policy;
-      result->rep = new TableBuilder(opt, result->file, false);
+      result->rep = new TableBuilder(opt, result->file, -1);
     } else {
-      result->rep = new TableBuilder(options->rep, result->file, false);
+      result->rep = new TableBuilder(options->rep, result->file, -1);
     }
   } else {
     SaveError(errptr, s);
@@ -3,23 +3,50 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "db/cdb_iter.h"
+
+#include <algorithm>
+#include <set>
+#include <utility>
+#include <vector>
+#include "db/data_cache.h"
 #include "db/dbformat.h"
 
 namespace leveldb {
 
+// Scans of records that were written one after the other read them
+// ahead in windows that grow up to this size.
+static const uint64_t kMaxReadaheadBytes = 256 << 10;
+// Scans out of write order prefetch values in aligned chunks of this
+// size, each at most once, as most of the records of a long scan share
+// their chunk with others of the same scan.
+static const uint64_t kPrefetchChunkBytes = 64 << 10;
+
 class ColumnDBIter: public Iterator {
  public:
-  ColumnDBIter(const ReadOptions& options, ColumnDB* db, Iterator* iter)
+  ColumnDBIter(const ReadOptions& options, ColumnDB* db, Iterator* iter,
+               uint64_t gc_epoch)
       : options_(options),
         db_(db),
         iter_(iter),
-        is_result_loaded_(false) {
+        gc_epoch_(gc_epoch),
+        is_result_loaded_(false),
+        window_handle_(NULL),
+        window_file_(0),
+        window_offset_(0),
+        next_offset_(0),
+        readahead_(0),
+        forward_(true),
+        ahead_(NULL),
+        ahead_count_(-1) {
       buf_ = new char[config::kBufSize];
       current_buf_size_ = config::kBufSize;
   }
   virtual ~ColumnDBIter() {
+    ReleaseWindow();
+    delete ahead_;
     delete iter_;
     delete [] buf_;
+    db_->ReaderDone(gc_epoch_);
   }
   virtual bool Valid() const { return iter_->Valid(); }
   virtual Slice internalkey() const {
@@ -49,53 +76,189 @@ class ColumnDBIter: public Iterator {
   virtual void Next() {
     iter_->Next();
     is_result_loaded_ = false;
+    if (forward_ && ahead_count_ > 0) {
+      ahead_count_--;
+    } else {
+      ahead_count_ = -1;
+    }
+    forward_ = true;
   }
 
   virtual void Prev() {
     iter_->Prev();
     is_result_loaded_ = false;
+    forward_ = false;
+    ahead_count_ = -1;
   }
 
   virtual void Seek(const Slice& target) {
     iter_->Seek(target);
     is_result_loaded_ = false;
+    forward_ = true;
+    ahead_count_ = -1;
   }
 
   virtual void SeekToFirst() {
     iter_->SeekToFirst();
     is_result_loaded_ = false;
+    forward_ = true;
+    ahead_count_ = -1;
   }
 
   virtual void SeekToLast() {
     iter_->SeekToLast();
     is_result_loaded_ = false;
+    forward_ = false;
+    ahead_count_ = -1;
   }
 
  private:
   ColumnDB* const db_;
   Iterator* const iter_;
+  const uint64_t gc_epoch_;   // See ColumnDB::AddReader()
   char* buf_;
   size_t current_buf_size_;
   ReadOptions options_;
   Slice saved_result_;
   bool is_result_loaded_;
 
+  // Data read from file window_file_ starting at window_offset_.  It
+  // points into buf_ or, if window_handle_ is set, into the file itself.
+  Slice window_;
+  Cache::Handle* window_handle_;
+  uint64_t window_file_;
+  uint64_t window_offset_;
+
+  // Where the last record loaded ends, and how much to read ahead if the
+  // next one starts there.
+  uint64_t next_offset_;
+  uint64_t readahead_;
+
+  // With options_.prefetch_values set and options_.readahead_blocks
+  // positive, forward scans that keep missing the window keep ahead_ up
+  // to that many entries in front of iter_ and prefetch the records of
+  // the values it passes.  ahead_count_ is how far in front it is, or -1
+  // if it has to be repositioned.  prefetched_ holds the (file number,
+  // chunk) pairs prefetched so far.
+  bool forward_;
+  Iterator* ahead_;
+  int ahead_count_;
+  std::set<std::pair<uint64_t, uint64_t> > prefetched_;
 
   void LoadResult() {
-    uint64_t file_loc_val = DecodeFixed64(iter_->value().data());
-    uint64_t file_number, offset, buf_size;
-    db_->DecodeFileLoc(file_loc_val, &file_number, &offset, &buf_size);
-    Reallocate(buf_size);
-    Status s = db_->InternalGet(options_, file_number, offset, buf_size, buf_,
-                                &saved_result_);
-    if (!s.ok()) {
+    saved_result_ = Slice(NULL, 0);
+    is_result_loaded_ = true;
+    uint64_t file_number, offset, size;
+    if (!ColumnDB::DecodeFileLoc(iter_->value(), &file_number, &offset,
+                                 &size)) {
+      return;
+    }
+
+    // Sequentially written records come back in the same window;
+    // otherwise read just the record and start over.
+    if (file_number != window_file_ || offset < window_offset_ ||
+        offset + size > window_offset_ + window_.size()) {
+      if (file_number == window_file_ && offset == next_offset_) {
+        readahead_ = std::min(std::max(2 * readahead_, size),
+                              kMaxReadaheadBytes);
+      } else {
+        readahead_ = 0;
+        // Values out of write order: reads ahead of the window are of
+        // no use, so prefetch the records of the coming entries instead
+        if (forward_ && options_.prefetch_values &&
+            options_.readahead_blocks > 0) {
+          PrefetchValues();
+        }
+      }
+      ReleaseWindow();
+      const uint64_t n = std::max(size, readahead_);
+      Reallocate(n);
+      Status s = db_->ReadData(options_, file_number, offset, n, buf_,
+                               &window_, &window_handle_);
+      if (!s.ok()) {
+        window_ = Slice();
+        return;
+      }
+      window_file_ = file_number;
+      window_offset_ = offset;
+    }
+    next_offset_ = offset + size;
+
+    Slice data(window_.data() + (offset - window_offset_),
+               window_.size() - (offset - window_offset_));
+    if (!ColumnDB::ParseRecord(data, &saved_result_).ok()) {
       saved_result_ = Slice(NULL, 0);
     }
-    is_result_loaded_ = true;
+  }
+
+  // Top up the prefetched values once half of them have been passed
+  void PrefetchValues() {
+    const int n = options_.readahead_blocks;
+    if (ahead_count_ > n / 2) {
+      return;
+    }
+    if (ahead_count_ < 0) {
+      if (ahead_ == NULL) {
+        ahead_ = db_->indexdb_->NewIterator(options_);
+      }
+      ahead_->Seek(iter_->key());
+      ahead_count_ = 0;
+    }
+    std::vector<std::pair<uint64_t, uint64_t> > chunks;
+    while (ahead_count_ < n && ahead_->Valid()) {
+      ahead_->Next();
+      if (!ahead_->Valid()) {
+        break;
+      }
+      ahead_count_++;
+      uint64_t file_number, offset, size;
+      if (!ColumnDB::DecodeFileLoc(ahead_->value(), &file_number, &offset,
+                                   &size) || size == 0) {
+        continue;
+      }
+      const uint64_t last = (offset + size - 1) / kPrefetchChunkBytes;
+      for (uint64_t c = offset / kPrefetchChunkBytes; c <= last; c++) {
+        if (prefetched_.insert(std::make_pair(file_number, c)).second) {
+          chunks.push_back(std::make_pair(file_number, c));
+        }
+      }
+    }
+
+    // Keys are not in write order, so sort the new chunks, merge the
+    // adjacent ones, and hand all the ranges of a file over at once
+    std::sort(chunks.begin(), chunks.end());
+    std::vector<uint64_t> offsets;
+    std::vector<size_t> sizes;
+    for (size_t i = 0; i < chunks.size(); i++) {
+      const uint64_t file_number = chunks[i].first;
+      const uint64_t offset = chunks[i].second * kPrefetchChunkBytes;
+      if (!offsets.empty() && chunks[i-1].first == file_number &&
+          offsets.back() + sizes.back() == offset) {
+        sizes.back() += kPrefetchChunkBytes;
+      } else {
+        offsets.push_back(offset);
+        sizes.push_back(kPrefetchChunkBytes);
+      }
+      if (i + 1 == chunks.size() || chunks[i+1].first != file_number) {
+        db_->data_cache_->Prefetch(file_number, offsets.size(),
+                                   &offsets[0], &sizes[0]);
+        offsets.clear();
+        sizes.clear();
+      }
+    }
+  }
+
+  void ReleaseWindow() {
+    if (window_handle_ != NULL) {
+      db_->data_cache_->Release(window_handle_);
+      window_handle_ = NULL;
+    }
+    window_ = Slice();
   }
 
   void Reallocate(uint64_t buf_size) {
     if (buf_size > current_buf_size_) {
+      ReleaseWindow();  // May point into buf_
       delete [] buf_;
       buf_ = new char[buf_size];
       current_buf_size_ = buf_size;
@@ -110,8 +273,9 @@ class ColumnDBIter: public Iterator {
 Iterator* NewColumnDBIterator(
     const ReadOptions& options,
     ColumnDB* db,
-    Iterator* internal_iter) {
-  return new ColumnDBIter(options, db, internal_iter);
+    Iterator* internal_iter,
+    uint64_t gc_epoch) {
+  return new ColumnDBIter(options, db, internal_iter, gc_epoch);
 }
 
 }  // namespace leveldb
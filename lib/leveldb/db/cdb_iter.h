@@ -12,11 +12,13 @@ namespace leveldb {
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  "gc_epoch" is the reader epoch of
+// the iterator, which ends when it is deleted.
 extern Iterator* NewColumnDBIterator(
     const ReadOptions& opttions,
     ColumnDB* db,
-    Iterator* internal_iter);
+    Iterator* internal_iter,
+    uint64_t gc_epoch);
 
 }  // namespace leveldb
 
@@ -6,7 +6,11 @@
 
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/write_batch.h"
 #include "util/coding.h"
+#include "util/hash.h"
+#include "util/logging.h"
+#include "util/random.h"
 #include "db/filename.h"
 #include "db/dbformat.h"
 #include "db/cdb_iter.h"
@@ -14,10 +18,14 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <algorithm>
+#include <map>
 
 namespace leveldb {
 
-static const uint64_t kColumnMagicNumber = 0x18ca;
+// Number of index entries per data file whose record sizes are sampled
+// to estimate the live bytes of the file.
+static const size_t kGCSamplesPerFile = 32;
 
 bool stringEndsWith(const std::string &src, const std::string &suffix) {
   if (src.length() >= suffix.length()) {
@@ -29,59 +37,91 @@ bool stringEndsWith(const std::string &src, const std::string &suffix) {
   }
 }
 
+// Parse a data file name of the form "db<number>.dat".
+static bool ParseDataFileName(const std::string& fname, uint64_t* number) {
+  if (fname.compare(0, 2, "db") != 0 || !stringEndsWith(fname, ".dat")) {
+    return false;
+  }
+  Slice rest(fname.data() + 2, fname.size() - 2 - 4);
+  return ConsumeDecimalNumber(&rest, number) && rest.empty();
+}
+
 ColumnDB::ColumnDB(const Options& options, const std::string& dbname,
                    Status &s) :
-  dbname_(dbname), env_(options.env), datafile_(NULL), indexdb_(NULL),
-  membuf_(NULL), data_cache_(NULL), server_id_(options.server_id),
+  env_(options.env), options_(options), dbname_(dbname), indexdb_(NULL),
+  mem_(NULL), shutting_down_(NULL), datafile_(NULL), gc_cv_(&mutex_),
+  gc_thread_running_(false), gc_epoch_(0),
+  data_cache_(NULL), server_id_(options.server_id),
   log_number_(0), current_log_number_(0) {
+  membufs_[0] = membufs_[1] = NULL;
   MutexLock mutex_lock(&mutex_);
   s = DB::Open(options, dbname, &indexdb_);
   if (!s.ok()) {
     printf("%s\n", s.ToString().c_str());
     return;
   }
-  RecoverDB();
 
   int pos = dbname.find_last_of('/');
   dbname_prefix_ = dbname.substr(0, pos);
+  RecoverDB();
+  file_mutex_.Lock();
   s = NewDataFile();
+  file_mutex_.Unlock();
   if (!s.ok()) {
     printf("%s\n", s.ToString().c_str());
     return;
   }
-  membuf_ = new MemBuffer(63 << 20);
+  membufs_[0] = new MemBuffer(63 << 20);
+  membufs_[1] = new MemBuffer(63 << 20);
+  membufs_[0]->Reset(GetLogNumber());
+  mem_.Release_Store(membufs_[0]);
   data_cache_ = new DataCache(dbname_prefix_, &options, options.max_open_files);
+
+  s = LoadPinnedFiles();
+  if (s.ok() && options.value_gc_interval > 0) {
+    gc_thread_running_ = true;
+    env_->StartThread(&ColumnDB::GCThread, this);
+  }
 }
 
 void ColumnDB::RecoverDB() {
   log_number_ = server_id_ << 14;
 
-  if (env_->FileExists(dbname_))  {
-    std::vector<std::string> result;
-    Status s = env_->GetChildren(dbname_, &result);
-    if (s.ok()) {
-      for (int i = 0; i < result.size(); ++i)
-        if (stringEndsWith(result[i], ".dat")) {
-          std::string num = result[i].substr(2, 6);
-          uint64_t number = atoi(num.c_str());
-          if (number > log_number_) {
-            log_number_ = number;
-          }
-        }
-      return;
+  // Never reuse the number of an existing data file
+  std::vector<std::string> result;
+  Status s = env_->GetChildren(DataDirName(), &result);
+  if (s.ok()) {
+    for (size_t i = 0; i < result.size(); ++i) {
+      uint64_t number;
+      if (ParseDataFileName(result[i], &number) && number >= log_number_) {
+        log_number_ = number + 1;
+      }
     }
   }
 }
 
+std::string ColumnDB::DataDirName() const {
+  std::string fname = DataFileName(dbname_prefix_, server_id_ << 14);
+  return fname.substr(0, fname.find_last_of('/'));
+}
+
 ColumnDB::~ColumnDB() {
+  // Wait for the garbage collector to finish
+  shutting_down_.Release_Store(this);  // Any non-NULL value is ok
   MutexLock mutex_lock(&mutex_);
+  while (gc_thread_running_) {
+    gc_cv_.Wait();
+  }
   if (datafile_ != NULL) {
+    MemBuffer* mem = reinterpret_cast<MemBuffer*>(mem_.NoBarrier_Load());
+    if (mem != NULL) {
+      FlushMemBuffer(mem, mem->file_number(), 0);
+    }
     datafile_->Close();
     delete datafile_;
   }
-  if (membuf_ != NULL) {
-    delete membuf_;
-  }
+  delete membufs_[0];
+  delete membufs_[1];
   if (data_cache_ != NULL) {
     delete data_cache_;
   }
@@ -98,122 +138,292 @@ Status ColumnDB::NewDataFile() {
   if (s.ok()) {
     SetLogNumber(new_log_number);
     if (datafile_ != NULL) {
+      // The garbage collector relies on full data files being durable
+      datafile_->Sync();
       datafile_->Close();
       delete datafile_;
     }
     datafile_ = lfile;
-  } else {
-    return s;
   }
+  return s;
 }
 
-Status ColumnDB::Put(const WriteOptions& opt, const Slice& key,
-                     const Slice& value) {
+Status ColumnDB::AppendRecord(const Slice& key, const Slice& value,
+                              char* loc) {
+  const size_t total_size = kColumnHeaderSize+key.size()+value.size();
+  size_t location;
+  MemBuffer* mem = reinterpret_cast<MemBuffer*>(mem_.Acquire_Load());
+  uint64_t file_number = mem->file_number();
+  while (!mem->Reserve(total_size, &location)) {
+    if (total_size > mem->capacity()) {
+      return Status::InvalidArgument("Record larger than a data file");
+    }
+    Status s = SwitchMemBuffer(file_number);
+    if (!s.ok()) return s;
+    mem = reinterpret_cast<MemBuffer*>(mem_.Acquire_Load());
+    file_number = mem->file_number();
+  }
+  // The buffer cannot be reset before we fill the record in, so this is
+  // the file our space belongs to
+  file_number = mem->file_number();
+  mem->Fill(location, key, value);
+
+  // The record must be in the data file before the index can point at
+  // it.  Writers that queue up behind one that is writing find their
+  // records written along with its own.
+  Status s = FlushMemBuffer(mem, file_number, location + total_size);
+  if (!s.ok()) return s;
+
+  EncodeFileLoc(file_number, location, total_size, loc);
+  return Status::OK();
+}
+
+Status ColumnDB::SwitchMemBuffer(uint64_t full_file_number) {
+  MutexLock l(&mutex_);
+  MemBuffer* full = reinterpret_cast<MemBuffer*>(mem_.NoBarrier_Load());
+  if (full->file_number() != full_file_number) {
+    return Status::OK();  // Somebody else switched already
+  }
+
+  // Wait for the writers still filling in records of the full buffer
+  const size_t end = full->Seal();
+  while (full->CompletePrefix() < end) {
+    env_->SleepForMicroseconds(1);
+  }
+
+  MutexLock file_lock(&file_mutex_);
   Status s;
-  mutex_.Lock();
-  uint64_t total_size = sizeof(uint64_t)+key.size()+value.size();
-  if (!membuf_->HasEnough(total_size)) {
+  if (full->flushed() < end) {
+    s = datafile_->Append(full->Unflushed(end));
+    full->MarkFlushed(end);
+  }
+  if (s.ok()) {
     s = NewDataFile();
-    if (!s.ok())
-      return s;
-    membuf_->Truncate();
   }
+  if (!s.ok()) {
+    return s;
+  }
+  // The other buffer was written out when it was sealed
+  MemBuffer* next = (full == membufs_[0]) ? membufs_[1] : membufs_[0];
+  next->Reset(GetLogNumber());
+  mem_.Release_Store(next);
+  return s;
+}
 
-  //Put header
-  size_t location;
-  char buf[sizeof(uint64_t)];
-  // magic number--16b key size--28b  value size--20b
-  EncodeFixed64(buf, (kColumnMagicNumber<<48)+(key.size()<<20)+(value.size()));
-  membuf_->Append(Slice(buf, sizeof(buf)), location);
-  datafile_->Append(Slice(buf, sizeof(buf)));
-
-  //Put Key Value
-  size_t tmp;
-  membuf_->Append(key, tmp);
-  membuf_->Append(value, tmp);
-  s = datafile_->Append(key);
-  if (!s.ok()) return s;
-  s = datafile_->Append(value);
+Status ColumnDB::FlushMemBuffer(MemBuffer* mem, uint64_t file_number,
+                                size_t end) {
+  MutexLock l(&file_mutex_);
+  if (mem->file_number() != file_number ||
+      mem_.NoBarrier_Load() != mem) {
+    return Status::OK();  // Sealed and written out by SwitchMemBuffer()
+  }
+  // Records before "end" are being filled in without locks, so they
+  // are done shortly
+  size_t complete = mem->CompletePrefix();
+  while (complete < end) {
+    env_->SleepForMicroseconds(1);
+    complete = mem->CompletePrefix();
+  }
+  Status s;
+  if (complete > mem->flushed()) {
+    s = datafile_->Append(mem->Unflushed(complete));
+    if (s.ok()) {
+      mem->MarkFlushed(complete);
+    }
+  }
+  return s;
+}
+
+Status ColumnDB::SyncDataFile() {
+  MemBuffer* mem = reinterpret_cast<MemBuffer*>(mem_.Acquire_Load());
+  Status s = FlushMemBuffer(mem, mem->file_number(), 0);
   if (!s.ok()) return s;
-  if (opt.sync)
-    datafile_->Flush();
-  mutex_.Unlock();
+  MutexLock l(&file_mutex_);
+  return datafile_->Sync();
+}
 
-  // lognumber--22b location--32b  value size/1KB--10b
-  EncodeFixed64(buf, (GetLogNumber()<<42)+(location<<10)+
-                     ((total_size+1023)/1024));
-  indexdb_->Put(opt, key, Slice(buf, sizeof(buf)));
+port::Mutex* ColumnDB::KeyLock(const Slice& key) {
+  return &key_locks_[Hash(key.data(), key.size(), 0) % kNumKeyLocks];
+}
 
-  return Status::OK();
+Status ColumnDB::Put(const WriteOptions& opt, const Slice& key,
+                     const Slice& value) {
+  MutexLock key_lock(KeyLock(key));
+  return PutLocked(opt, key, value);
+}
+
+Status ColumnDB::PutLocked(const WriteOptions& opt, const Slice& key,
+                           const Slice& value) {
+  char loc[kFileLocSize];
+  Status s = AppendRecord(key, value, loc);
+  if (s.ok() && opt.sync) {
+    s = SyncDataFile();
+  }
+  if (!s.ok()) return s;
+
+  return indexdb_->Put(opt, key, Slice(loc, sizeof(loc)));
 }
 
 Status ColumnDB::Delete(const WriteOptions& opt, const Slice& key) {
+  MutexLock key_lock(KeyLock(key));
   return indexdb_->Delete(opt, key);
 }
 
+Status ColumnDB::Merge(const WriteOptions& opt, const Slice& key,
+                       const Slice& value) {
+  if (options_.merge_operator == NULL) {
+    return Status::NotSupported("no merge operator");
+  }
+  MutexLock key_lock(KeyLock(key));
+  std::string existing;
+  Status s = Get(ReadOptions(), key, &existing);
+  if (!s.ok() && !s.IsNotFound()) return s;
+  if (s.IsNotFound() && options_.merge_operator->DropsOperandsWithoutValue()) {
+    return s;
+  }
+
+  std::vector<Slice> operands(1, value);
+  Slice existing_value(existing);
+  std::string new_value;
+  if (!options_.merge_operator->FullMerge(key,
+                                          s.ok() ? &existing_value : NULL,
+                                          operands, &new_value)) {
+    return Status::Corruption("merge failed for ", key);
+  }
+  return PutLocked(opt, key, new_value);
+}
+
 Status ColumnDB::Write(const WriteOptions& options, WriteBatch* updates) {
   return indexdb_->Write(options, updates);
 }
 
-Status ColumnDB::InternalGet(const ReadOptions& options,
-                             uint64_t file_number, uint64_t offset,
-                             uint64_t buf_size, char* buf,
-                             Slice* result) {
-  Status s;
-
-  if (file_number == GetLogNumber()) {
-    mutex_.Lock();
-    if (file_number == GetLogNumber()) {
-      s = membuf_->Get(offset, buf_size, result, buf);
-      mutex_.Unlock();
-    } else {
-      mutex_.Unlock();
-      s = data_cache_->Get(options, file_number, offset, buf_size,
-                           result, buf);
-    }
-  } else {
-    s = data_cache_->Get(options, file_number, offset, buf_size,
-                         result, buf);
+Status ColumnDB::ReadData(const ReadOptions& options,
+                          uint64_t file_number, uint64_t offset,
+                          uint64_t size, char* scratch, Slice* result,
+                          Cache::Handle** handle) {
+  // Recent records are still in one of the memory buffers
+  *handle = NULL;
+  if (membufs_[0]->Get(file_number, offset, size, result, scratch) ||
+      membufs_[1]->Get(file_number, offset, size, result, scratch)) {
+    return Status::OK();
   }
-  if (!s.ok())
-    return s;
+  return data_cache_->Read(options, file_number, offset, size,
+                           result, scratch, handle);
+}
 
-  uint64_t header = DecodeFixed64(result->data());
+Status ColumnDB::ParseRecord(const Slice& data, Slice* value) {
+  if (data.size() < kColumnHeaderSize) {
+    return Status::IOError("Failed to read a record header.");
+  }
+  uint64_t header = DecodeFixed64(data.data());
   uint64_t magic_number = header >> 48;
   if (magic_number != kColumnMagicNumber) {
     return Status::IOError("Magic Number Not Match");
   }
-  header = header & ((1L<<48)-1);
+  header = header & ((1ull<<48)-1);
   uint64_t key_size = header >> 20;
-  uint64_t val_size = header & ((1L<<20)-1);
-  if (key_size + val_size + sizeof(header) > result->size()) {
+  uint64_t val_size = header & ((1ull<<20)-1);
+  if (key_size + val_size + kColumnHeaderSize > data.size()) {
     return Status::IOError("Failed to read a full key value pair.");
   }
-  *result = Slice(result->data()+sizeof(uint64_t)+key_size, val_size);
+  *value = Slice(data.data()+kColumnHeaderSize+key_size, val_size);
+  return Status::OK();
+}
+
+Status ColumnDB::ReadValue(const ReadOptions& options,
+                           const std::string& location_val,
+                           ValueVisitor visitor, void* arg) {
+  uint64_t file_number, offset, size;
+  if (!DecodeFileLoc(location_val, &file_number, &offset, &size)) {
+    return Status::Corruption("Bad record location in index");
+  }
+  // Most records are small enough for the stack
+  char stack_buf[1024];
+  char* buf = size <= sizeof(stack_buf) ? stack_buf : new char[size];
+  Slice data, result;
+  Cache::Handle* handle;
+  Status s = ReadData(options, file_number, offset, size, buf, &data,
+                      &handle);
+  if (s.ok()) {
+    s = ParseRecord(data, &result);
+  }
+  if (s.ok()) {
+    (*visitor)(arg, result);
+  }
+  if (handle != NULL) {
+    data_cache_->Release(handle);
+  }
+  if (buf != stack_buf) {
+    delete [] buf;
+  }
   return s;
 }
 
+static void SaveValueTo(void* arg, const Slice& value) {
+  reinterpret_cast<std::string*>(arg)->assign(value.data(), value.size());
+}
+
 Status ColumnDB::Get(const ReadOptions& options,
                      const Slice& key,
                      std::string* value) {
+  return Get(options, key, SaveValueTo, value);
+}
+
+Status ColumnDB::Get(const ReadOptions& options,
+                     const Slice& key,
+                     ValueVisitor visitor, void* arg) {
   std::string location_val;
   Status s = indexdb_->Get(options, key, &location_val);
   if (!s.ok()) return s;
 
-  uint64_t file_loc = DecodeFixed64(location_val.c_str());
-  uint64_t file_number, offset, buf_size;
-  DecodeFileLoc(file_loc, &file_number, &offset, &buf_size);
-  char buf[buf_size];
-  Slice result;
-  s = InternalGet(options, file_number, offset, buf_size, buf, &result);
-
-  if (s.ok()) {
-    value->assign(result.data(), result.size());
+  s = ReadValue(options, location_val, visitor, arg);
+  if (!s.ok()) {
+    // The garbage collector may have moved the record and deleted its
+    // old data file after we read the location.  Follow the new one.
+    std::string new_location_val;
+    if (indexdb_->Get(options, key, &new_location_val).ok() &&
+        new_location_val != location_val) {
+      s = ReadValue(options, new_location_val, visitor, arg);
+    }
   }
-
   return s;
 }
 
+static void SaveLocationTo(void* arg, int index, const Slice& location) {
+  (*reinterpret_cast<std::vector<std::string>*>(arg))[index].assign(
+      location.data(), location.size());
+}
+
+void ColumnDB::MultiGet(const ReadOptions& options,
+                        int n, const Slice* keys,
+                        MultiValueVisitor visitor, void* arg,
+                        Status* statuses) {
+  std::vector<std::string> locations(n);
+  indexdb_->MultiGet(options, n, keys, SaveLocationTo, &locations, statuses);
+
+  // Read the records in data file order.  The high bits of a location
+  // are its file number and offset.
+  std::vector<std::pair<uint64_t, int> > order;
+  order.reserve(n);
+  for (int i = 0; i < n; i++) {
+    if (statuses[i].ok()) {
+      const uint64_t position = locations[i].size() >= sizeof(uint64_t) ?
+          DecodeFixed64(locations[i].data()) : 0;
+      order.push_back(std::make_pair(position, i));
+    }
+  }
+  std::sort(order.begin(), order.end());
+  for (size_t j = 0; j < order.size(); j++) {
+    const int i = order[j].second;
+    MultiGetVisit visit(visitor, arg, i);
+    statuses[i] = ReadValue(options, locations[i], VisitMultiGetValue, &visit);
+    if (!statuses[i].ok()) {
+      // The record may have been moved by the garbage collector
+      statuses[i] = Get(options, keys[i], VisitMultiGetValue, &visit);
+    }
+  }
+}
+
 Status ColumnDB::Exists(const ReadOptions& options,
                         const Slice& key) {
   std::string location_val;
@@ -222,17 +432,90 @@ Status ColumnDB::Exists(const ReadOptions& options,
 }
 
 Iterator* ColumnDB::NewIterator(const ReadOptions& opt) {
-  return NewColumnDBIterator(opt, this, indexdb_->NewIterator(opt));;
+  const uint64_t epoch = AddReader();
+  return NewColumnDBIterator(opt, this, indexdb_->NewIterator(opt), epoch);
 }
 
+// The index seen by a reader opened in epoch e may still locate records
+// in the files collected in epoch e or later, but not in those collected
+// before: their records were repointed before the epoch moved on.
+uint64_t ColumnDB::AddReader() {
+  MutexLock l(&mutex_);
+  readers_[gc_epoch_]++;
+  return gc_epoch_;
+}
+
+void ColumnDB::ReaderDone(uint64_t epoch) {
+  std::vector<uint64_t> files;
+  mutex_.Lock();
+  std::map<uint64_t, int>::iterator it = readers_.find(epoch);
+  assert(it != readers_.end());
+  if (--it->second == 0) {
+    readers_.erase(it);
+    TakeDeletableFiles(&files);
+  }
+  mutex_.Unlock();
+  for (size_t i = 0; i < files.size(); i++) {
+    DeleteDataFile(files[i]);
+  }
+}
+
+void ColumnDB::TakeDeletableFiles(std::vector<uint64_t>* files) {
+  mutex_.AssertHeld();
+  // obsolete_files_ is in epoch order
+  size_t n = 0;
+  while (n < obsolete_files_.size() &&
+         (readers_.empty() ||
+          obsolete_files_[n].first < readers_.begin()->first)) {
+    // PinValues() through an old snapshot may have pinned it since
+    if (pinned_files_.count(obsolete_files_[n].second) == 0) {
+      files->push_back(obsolete_files_[n].second);
+    }
+    n++;
+  }
+  obsolete_files_.erase(obsolete_files_.begin(), obsolete_files_.begin() + n);
+}
+
+// A snapshot of the index is a snapshot of the whole database as long
+// as the records it locates stay where they are, so it holds back the
+// deletion of collected data files like an iterator does.  Reads with
+// options.snapshot set go to indexdb_ as they are.
 const Snapshot* ColumnDB::GetSnapshot() {
-  return NULL;
+  const uint64_t epoch = AddReader();
+  const Snapshot* snapshot = indexdb_->GetSnapshot();
+  MutexLock l(&mutex_);
+  snapshot_epochs_[snapshot] = epoch;
+  return snapshot;
 }
 
 void ColumnDB::ReleaseSnapshot(const Snapshot* snapshot) {
+  mutex_.Lock();
+  std::map<const Snapshot*, uint64_t>::iterator it =
+      snapshot_epochs_.find(snapshot);
+  assert(it != snapshot_epochs_.end());
+  const uint64_t epoch = it->second;
+  snapshot_epochs_.erase(it);
+  mutex_.Unlock();
+  indexdb_->ReleaseSnapshot(snapshot);
+  ReaderDone(epoch);
 }
 
 bool ColumnDB::GetProperty(const Slice& property, std::string* value) {
+  if (property == Slice("leveldb.value-gc")) {
+    char buf[200];
+    MutexLock l(&mutex_);
+    snprintf(buf, sizeof(buf),
+             "Value GC rounds: %llu\n"
+             "Files collected: %llu\n"
+             "Bytes rewritten: %llu\n"
+             "Bytes reclaimed: %llu\n",
+             static_cast<unsigned long long>(gc_stats_.rounds),
+             static_cast<unsigned long long>(gc_stats_.files_collected),
+             static_cast<unsigned long long>(gc_stats_.bytes_rewritten),
+             static_cast<unsigned long long>(gc_stats_.bytes_reclaimed));
+    *value = buf;
+    return true;
+  }
   return indexdb_->GetProperty(property, value);
 }
 
@@ -247,7 +530,28 @@ void ColumnDB::CompactRange(const Slice* begin, const Slice* end) {
 Status ColumnDB::BulkSplit(const WriteOptions& options, uint64_t sequence,
                            const Slice* begin, const Slice* end,
                            const std::string& dname) {
-  return indexdb_->BulkSplit(options, sequence, begin, end, dname);
+  // The split-off index entries keep pointing into our data files, and
+  // nothing tells when the server they move to is done with them.
+  // Records written into the range meanwhile may land in data files
+  // started during the split.
+  mutex_.Lock();
+  const uint64_t first = GetLogNumber();
+  mutex_.Unlock();
+  Status s = PinValues(ReadOptions(), begin, end);
+  if (!s.ok()) return s;
+  s = indexdb_->BulkSplit(options, sequence, begin, end, dname);
+
+  std::set<uint64_t> files;
+  mutex_.Lock();
+  for (uint64_t number = first + 1; number <= GetLogNumber(); number++) {
+    files.insert(number);
+  }
+  mutex_.Unlock();
+  if (s.ok() && !files.empty()) {
+    MutexLock gc_lock(&gc_mutex_);
+    s = PinFiles(files);
+  }
+  return s;
 }
 
 Status ColumnDB::BulkInsert(const WriteOptions& options,
@@ -258,6 +562,366 @@ Status ColumnDB::BulkInsert(const WriteOptions& options,
                               min_sequence_number, max_sequence_number);;
 }
 
+Status ColumnDB::PinValues(const ReadOptions& options,
+                           const Slice* begin, const Slice* end) {
+  // Keep collection out so that no file is collected after we looked
+  // at the entries that point into it
+  MutexLock gc_lock(&gc_mutex_);
+  std::set<uint64_t> files;
+  mutex_.Lock();
+  files.insert(GetLogNumber());
+  mutex_.Unlock();
+  ReadOptions read_options = options;
+  read_options.fill_cache = false;
+  Iterator* iter = indexdb_->NewIterator(read_options);
+  if (begin != NULL) {
+    iter->Seek(*begin);
+  } else {
+    iter->SeekToFirst();
+  }
+  for (; iter->Valid() && (end == NULL ||
+         options_.comparator->Compare(iter->key(), *end) <= 0);
+       iter->Next()) {
+    uint64_t file_number, offset, size;
+    if (DecodeFileLoc(iter->value(), &file_number, &offset, &size)) {
+      files.insert(file_number);
+    }
+  }
+  Status s = iter->status();
+  delete iter;
+  if (s.ok()) {
+    s = PinFiles(files);
+  }
+  return s;
+}
+
+// The pinned data files are listed in PINNED, one number per line.
+Status ColumnDB::LoadPinnedFiles() {
+  std::string data;
+  Status s = ReadFileToString(env_, DataDirName() + "/PINNED", &data);
+  if (s.ok()) {
+    Slice in(data);
+    while (!in.empty()) {
+      uint64_t number;
+      if (!ConsumeDecimalNumber(&in, &number) ||
+          in.empty() || in[0] != '\n') {
+        return Status::Corruption("bad pinned file list", DataDirName());
+      }
+      in.remove_prefix(1);
+      pinned_files_.insert(number);
+    }
+  } else if (!env_->FileExists(DataDirName() + "/PINNED")) {
+    s = Status::OK();
+  }
+  return s;
+}
+
+Status ColumnDB::PinFiles(const std::set<uint64_t>& files) {
+  mutex_.Lock();
+  std::set<uint64_t> pinned = pinned_files_;
+  mutex_.Unlock();
+  pinned.insert(files.begin(), files.end());
+
+  const std::string fname = DataDirName() + "/PINNED";
+  const std::string tmp = fname + ".tmp";
+  std::string data;
+  for (std::set<uint64_t>::const_iterator it = pinned.begin();
+       it != pinned.end(); ++it) {
+    AppendNumberTo(&data, *it);
+    data.push_back('\n');
+  }
+  WritableFile* file;
+  Status s = env_->NewWritableFile(tmp, &file);
+  if (!s.ok()) return s;
+  s = file->Append(data);
+  if (s.ok()) s = file->Sync();
+  if (s.ok()) s = file->Close();
+  delete file;
+  if (s.ok()) s = env_->RenameFile(tmp, fname);
+  if (s.ok()) {
+    MutexLock l(&mutex_);
+    pinned_files_.swap(pinned);
+  }
+  return s;
+}
+
+void ColumnDB::GCThread(void* db) {
+  reinterpret_cast<ColumnDB*>(db)->BackgroundGC();
+}
+
+void ColumnDB::BackgroundGC() {
+  const uint64_t interval = options_.value_gc_interval * 1000000ull;
+  uint64_t next_round = env_->NowMicros() + interval;
+  while (!shutting_down_.Acquire_Load()) {
+    if (env_->NowMicros() < next_round) {
+      env_->SleepForMicroseconds(100000);
+      continue;
+    }
+    Status s = CollectGarbage();
+    if (!s.ok()) {
+      Log(options_.info_log, "Value GC error: %s", s.ToString().c_str());
+    }
+    next_round = env_->NowMicros() + interval;
+  }
+  MutexLock l(&mutex_);
+  gc_thread_running_ = false;
+  gc_cv_.SignalAll();
+}
+
+void ColumnDB::ThrottleGC(uint64_t start_micros, uint64_t bytes_read) {
+  const uint64_t rate = options_.value_gc_bytes_per_second;
+  if (rate == 0) return;
+  const uint64_t due = start_micros + bytes_read * 1000000 / rate;
+  const uint64_t now = env_->NowMicros();
+  if (due > now) {
+    env_->SleepForMicroseconds(
+        static_cast<int>(std::min<uint64_t>(due - now, 1000000)));
+  }
+}
+
+void ColumnDB::DeleteDataFile(uint64_t file_number) {
+  data_cache_->Evict(file_number);
+  env_->DeleteFile(DataFileName(dbname_prefix_, file_number));
+}
+
+namespace {
+struct FileUsage {
+  uint64_t exact_bytes;         // Total size of records of known size
+  uint64_t sampled_records;     // Records of unknown size
+  std::vector<uint64_t> sample_offsets;
+  FileUsage() : exact_bytes(0), sampled_records(0) { }
+};
+}  // namespace
+
+Status ColumnDB::CollectGarbage() {
+  MutexLock gc_lock(&gc_mutex_);
+  const uint64_t start_micros = env_->NowMicros();
+
+  // Every data file but the one being written, those pinned by a bulk
+  // split and those already collected is a candidate.
+  std::vector<std::string> children;
+  Status s = env_->GetChildren(DataDirName(), &children);
+  if (!s.ok()) return s;
+  std::map<uint64_t, FileUsage> usage;
+  mutex_.Lock();
+  const uint64_t current = GetLogNumber();
+  for (size_t i = 0; i < children.size(); i++) {
+    uint64_t number;
+    if (ParseDataFileName(children[i], &number) && number < current &&
+        pinned_files_.count(number) == 0) {
+      usage[number];
+    }
+  }
+  for (size_t i = 0; i < obsolete_files_.size(); i++) {
+    usage.erase(obsolete_files_[i].second);
+  }
+  mutex_.Unlock();
+
+  // Count the index entries that point into each candidate.  Entries
+  // without an exact record size only give a sample of their offsets.
+  Random rnd(0xdeadbeef);
+  ReadOptions read_options;
+  read_options.fill_cache = false;
+  Iterator* iter = indexdb_->NewIterator(read_options);
+  for (iter->SeekToFirst();
+       iter->Valid() && !usage.empty() && !shutting_down_.Acquire_Load();
+       iter->Next()) {
+    uint64_t file_number, offset, size;
+    if (!DecodeFileLoc(iter->value(), &file_number, &offset, &size)) {
+      continue;
+    }
+    std::map<uint64_t, FileUsage>::iterator it = usage.find(file_number);
+    if (it == usage.end()) continue;
+    FileUsage* u = &it->second;
+    if (iter->value().size() == kFileLocSize) {
+      u->exact_bytes += size;
+    } else if (u->sample_offsets.size() < kGCSamplesPerFile) {
+      u->sample_offsets.push_back(offset);
+      u->sampled_records++;
+    } else {
+      // Reservoir sampling
+      u->sampled_records++;
+      uint64_t j = rnd.Next() % u->sampled_records;
+      if (j < kGCSamplesPerFile) u->sample_offsets[j] = offset;
+    }
+  }
+  s = iter->status();
+  delete iter;
+  if (!s.ok()) return s;
+
+  // Estimate the live bytes of each file, scaling up the sizes of the
+  // sampled records, and pick the files that are garbage enough, sparsest first.
+  std::vector<std::pair<double, uint64_t> > victims;
+  for (std::map<uint64_t, FileUsage>::iterator it = usage.begin();
+       it != usage.end(); ++it) {
+    const uint64_t file_number = it->first;
+    const FileUsage& u = it->second;
+    uint64_t file_size;
+    if (!env_->GetFileSize(DataFileName(dbname_prefix_, file_number),
+                           &file_size).ok()) {
+      continue;
+    }
+    uint64_t sampled_bytes = 0;
+    uint64_t num_sampled = 0;
+    for (size_t i = 0; i < u.sample_offsets.size(); i++) {
+      char buf[sizeof(uint64_t)];
+      Slice header;
+      if (data_cache_->Get(read_options, file_number, u.sample_offsets[i],
+                           sizeof(buf), &header, buf).ok() &&
+          header.size() == sizeof(buf)) {
+        uint64_t h = DecodeFixed64(header.data());
+        h &= (1ull<<48)-1;
+        sampled_bytes += sizeof(buf) + (h >> 20) + (h & ((1<<20)-1));
+        num_sampled++;
+      }
+    }
+    uint64_t live_bytes = file_size;
+    if (u.sampled_records == 0) {
+      live_bytes = std::min<uint64_t>(file_size, u.exact_bytes);
+    } else if (num_sampled > 0) {
+      live_bytes = std::min<uint64_t>(
+          file_size,
+          u.exact_bytes + u.sampled_records * sampled_bytes / num_sampled);
+    }
+    if ((file_size - live_bytes) * 100 >=
+        file_size * options_.value_gc_garbage_percent) {
+      double live_ratio = file_size > 0 ? 1.0 * live_bytes / file_size : 0;
+      victims.push_back(std::make_pair(live_ratio, file_number));
+    }
+  }
+  std::sort(victims.begin(), victims.end());
+
+  uint64_t bytes_read = 0;
+  uint64_t round_rewritten = 0;
+  uint64_t round_reclaimed = 0;
+  int num_collected = 0;
+  for (size_t i = 0; i < victims.size() && s.ok(); i++) {
+    const uint64_t file_number = victims[i].second;
+    uint64_t file_size = 0;
+    env_->GetFileSize(DataFileName(dbname_prefix_, file_number), &file_size);
+    uint64_t rewritten = 0;
+    s = CollectFile(file_number, start_micros, &bytes_read, &rewritten);
+    if (!s.ok()) break;
+
+    std::vector<uint64_t> files;
+    mutex_.Lock();
+    gc_stats_.files_collected++;
+    gc_stats_.bytes_rewritten += rewritten;
+    if (file_size > rewritten) {
+      gc_stats_.bytes_reclaimed += file_size - rewritten;
+      round_reclaimed += file_size - rewritten;
+    }
+    // Readers opened from now on only see the new locations
+    obsolete_files_.push_back(std::make_pair(gc_epoch_, file_number));
+    gc_epoch_++;
+    TakeDeletableFiles(&files);
+    mutex_.Unlock();
+    for (size_t j = 0; j < files.size(); j++) {
+      DeleteDataFile(files[j]);
+    }
+    round_rewritten += rewritten;
+    num_collected++;
+  }
+
+  mutex_.Lock();
+  gc_stats_.rounds++;
+  mutex_.Unlock();
+  Log(options_.info_log,
+      "Value GC: collected %d of %d files, rewrote %llu bytes, "
+      "reclaimed %llu bytes in %llu ms: %s",
+      num_collected, static_cast<int>(usage.size()),
+      static_cast<unsigned long long>(round_rewritten),
+      static_cast<unsigned long long>(round_reclaimed),
+      static_cast<unsigned long long>(
+          (env_->NowMicros() - start_micros) / 1000),
+      s.ToString().c_str());
+  return s;
+}
+
+// Copy every record of data file "file_number" that the index still
+// points to into the current data file and repoint the index.
+Status ColumnDB::CollectFile(uint64_t file_number, uint64_t start_micros,
+                             uint64_t* bytes_read,
+                             uint64_t* bytes_rewritten) {
+  SequentialFile* file;
+  Status s = env_->NewSequentialFile(DataFileName(dbname_prefix_, file_number),
+                                     &file);
+  if (!s.ok()) return s;
+
+  const WriteOptions write_options;
+  const ReadOptions read_options;
+  char header_buf[sizeof(uint64_t)];
+  std::string record;
+  uint64_t offset = 0;
+  while (true) {
+    if (shutting_down_.Acquire_Load()) {
+      s = Status::IOError("Deleting DB during value log gc");
+      break;
+    }
+    Slice header;
+    s = file->Read(sizeof(header_buf), &header, header_buf);
+    if (!s.ok() || header.size() < sizeof(header_buf)) {
+      break;  // End of file, possibly with a torn record
+    }
+    uint64_t h = DecodeFixed64(header.data());
+    if ((h >> 48) != kColumnMagicNumber) {
+      s = Status::Corruption("bad record in data file",
+                             DataFileName(dbname_prefix_, file_number));
+      break;
+    }
+    h &= (1ull<<48)-1;
+    const size_t key_size = h >> 20;
+    const size_t val_size = h & ((1<<20)-1);
+    Slice kv;
+    if (key_size + val_size > 0) {
+      record.resize(key_size + val_size);
+      s = file->Read(record.size(), &kv, &record[0]);
+      if (!s.ok() || kv.size() < record.size()) {
+        break;
+      }
+    }
+    const uint64_t record_size = sizeof(header_buf) + key_size + val_size;
+    Slice key(kv.data(), key_size);
+    Slice value(kv.data() + key_size, val_size);
+
+    MutexLock key_lock(KeyLock(key));
+    std::string location_val;
+    Status ls = indexdb_->Get(read_options, key, &location_val);
+    uint64_t number, loc, size;
+    if (ls.ok() && DecodeFileLoc(location_val, &number, &loc, &size)) {
+      if (number == file_number && loc == offset) {
+        char new_loc[kFileLocSize];
+        s = AppendRecord(key, value, new_loc);
+        if (s.ok()) {
+          s = indexdb_->Put(write_options, key,
+                            Slice(new_loc, sizeof(new_loc)));
+        }
+        *bytes_rewritten += record_size;
+      }
+    } else if (!ls.ok() && !ls.IsNotFound()) {
+      s = ls;
+    }
+    if (!s.ok()) break;
+
+    offset += record_size;
+    *bytes_read += record_size;
+    ThrottleGC(start_micros, *bytes_read);
+  }
+  delete file;
+  if (!s.ok()) return s;
+
+  // Make the copies and the index entries pointing to them durable
+  // before the old file goes away.
+  s = SyncDataFile();
+  if (s.ok()) {
+    WriteOptions sync_options;
+    sync_options.sync = true;
+    WriteBatch empty_batch;
+    s = indexdb_->Write(sync_options, &empty_batch);
+  }
+  return s;
+}
+
 Status ColumnDBOpen(const Options& options,
                     const std::string& name,
                     DB** dbptr) {
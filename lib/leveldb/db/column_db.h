@@ -5,9 +5,15 @@
 #ifndef STORAGE_LEVELDB_DB_COLUMN_DB_H_
 #define STORAGE_LEVELDB_DB_COLUMN_DB_H_
 
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
 #include "db/db_impl.h"
 #include "db/membuf.h"
 #include "db/data_cache.h"
+#include "port/port.h"
+#include "util/coding.h"
 
 namespace leveldb {
 
@@ -21,12 +27,23 @@ class ColumnDB : public DB {
   // Implementations of the DB interface
   virtual Status Put(const WriteOptions&, const Slice& key, const Slice& value);
   virtual Status Delete(const WriteOptions&, const Slice& key);
+  // The index only holds value locations, so operands are applied to
+  // the current value right away under the key lock.
+  virtual Status Merge(const WriteOptions&, const Slice& key,
+                       const Slice& value);
   virtual Status Write(const WriteOptions& options, WriteBatch* updates);
   virtual Status Get(const ReadOptions& options,
                      const Slice& key,
                      std::string* value);
+  virtual Status Get(const ReadOptions& options,
+                     const Slice& key,
+                     ValueVisitor visitor, void* arg);
   virtual Status Exists(const ReadOptions& options,
                         const Slice& key);
+  virtual void MultiGet(const ReadOptions& options,
+                        int n, const Slice* keys,
+                        MultiValueVisitor visitor, void* arg,
+                        Status* statuses);
   virtual Iterator* NewIterator(const ReadOptions&);
   virtual const Snapshot* GetSnapshot();
   virtual void ReleaseSnapshot(const Snapshot* snapshot);
@@ -40,10 +57,35 @@ class ColumnDB : public DB {
                             const std::string& fname,
                             uint64_t min_sequence_number,
                             uint64_t max_sequence_number);
+  // Exclude the data files the index entries of the keys point to from
+  // garbage collection, along with the current one, which later writes
+  // to the keys may go to.
+  virtual Status PinValues(const ReadOptions& options,
+                           const Slice* begin, const Slice* end);
+
+  // Run one round of value log garbage collection: estimate how much of
+  // each data file is still referenced by the index, copy the live
+  // records of the files that are mostly garbage to the current data
+  // file and delete them.  Also run periodically in the background when
+  // options.value_gc_interval is set.
+  Status CollectGarbage();
 
   friend class ColumnDBIter;
 
  private:
+  struct GCStats {
+    uint64_t rounds;
+    uint64_t files_collected;
+    uint64_t bytes_rewritten;
+    uint64_t bytes_reclaimed;
+    GCStats() : rounds(0), files_collected(0), bytes_rewritten(0),
+                bytes_reclaimed(0) { }
+  };
+
+  // Writers and the garbage collector serialize on a key by taking the
+  // lock its hash maps to, so that a record is never moved while a newer
+  // version of it is being written.
+  static const int kNumKeyLocks = 64;
 
   Env* const env_;
   const Options options_;  // options_.comparator == &internal_comparator_
@@ -51,11 +93,32 @@ class ColumnDB : public DB {
   std::string dbname_prefix_;
 
   DB* indexdb_;
+  MemBuffer* membufs_[2];
+  port::AtomicPointer mem_;         // The one of membufs_ being appended to
+  port::Mutex key_locks_[kNumKeyLocks];
+  port::Mutex gc_mutex_;            // Held for a whole round of collection
+  port::AtomicPointer shutting_down_;
+
+  // Protects datafile_ and the writing out of memory buffers
+  port::Mutex file_mutex_;
+  WritableFile* datafile_;
 
   // State below is protected by mutex_
   port::Mutex mutex_;
-  WritableFile* datafile_;
-  MemBuffer* membuf_;
+  port::CondVar gc_cv_;             // Signalled when the gc thread exits
+  bool gc_thread_running_;
+  // Open iterators and snapshots may still read records from data files
+  // the garbage collector has copied out of.  Readers are counted under
+  // the gc epoch they were opened in, which moves on with every file
+  // collected, and a collected file is deleted once no reader of its
+  // epoch or an earlier one is left.
+  uint64_t gc_epoch_;
+  std::map<uint64_t, int> readers_;           // Open readers per epoch
+  std::map<const Snapshot*, uint64_t> snapshot_epochs_;
+  std::vector<std::pair<uint64_t, uint64_t> > obsolete_files_;  // (epoch, file)
+  std::set<uint64_t> pinned_files_; // Used by split-off index entries;
+                                    // never deleted
+  GCStats gc_stats_;
   DataCache* data_cache_;
   int server_id_;
   uint64_t log_number_;
@@ -71,19 +134,96 @@ class ColumnDB : public DB {
     return current_log_number_;
   }
 
+  // REQUIRES: mutex_ and file_mutex_ held.
   Status NewDataFile();
-  Status InternalGet(const ReadOptions& options,
-                     uint64_t file_number,
-                     uint64_t offset,
-                     uint64_t buf_size,
-                     char* scratch, Slice* result);
-
-  void DecodeFileLoc(uint64_t file_loc, uint64_t* file_number,
-                     uint64_t* offset, uint64_t* buf_size) {
+
+  // Append a record to the current data file and encode its location
+  // into "loc", which must have room for kFileLocSize bytes.
+  Status AppendRecord(const Slice& key, const Slice& value, char* loc);
+
+  // Store "value" as the new value of "key".
+  // REQUIRES: KeyLock(key) held.
+  Status PutLocked(const WriteOptions&, const Slice& key, const Slice& value);
+
+  // Write out the full memory buffer of data file "full_file_number"
+  // and start a new data file, unless another writer did already.
+  Status SwitchMemBuffer(uint64_t full_file_number);
+
+  // Write the complete records of "mem" to the data file if it is still
+  // the current buffer, for data file "file_number".  Records that end
+  // at or before "end" are waited for if they are still being filled in.
+  Status FlushMemBuffer(MemBuffer* mem, uint64_t file_number, size_t end);
+  Status SyncDataFile();
+
+  port::Mutex* KeyLock(const Slice& key);
+
+  std::string DataDirName() const;
+  Status LoadPinnedFiles();
+  // Exclude "files" from garbage collection for good.
+  // REQUIRES: gc_mutex_ held.
+  Status PinFiles(const std::set<uint64_t>& files);
+
+  static void GCThread(void* db);
+  void BackgroundGC();
+  void ThrottleGC(uint64_t start_micros, uint64_t bytes_read);
+  Status CollectFile(uint64_t file_number, uint64_t start_micros,
+                     uint64_t* bytes_read, uint64_t* bytes_rewritten);
+  void DeleteDataFile(uint64_t file_number);
+  // Count a new reader and return its epoch, to be passed to
+  // ReaderDone() once it is gone.
+  uint64_t AddReader();
+  void ReaderDone(uint64_t epoch);
+  // Move the collected files no reader can use any more to *files.
+  // REQUIRES: mutex_ held.
+  void TakeDeletableFiles(std::vector<uint64_t>* files);
+  // Call (*visitor)(arg, value) with the value of the record located
+  // by index entry "location_val".
+  Status ReadValue(const ReadOptions& options,
+                   const std::string& location_val,
+                   ValueVisitor visitor, void* arg);
+
+  // Read "size" bytes at "offset" of data file "file_number", either
+  // from a memory buffer into "scratch" or through data_cache_.  If
+  // *result points into a data file mapped in memory, *handle is set
+  // and must be passed to data_cache_->Release() once done with it.
+  Status ReadData(const ReadOptions& options,
+                  uint64_t file_number,
+                  uint64_t offset,
+                  uint64_t size,
+                  char* scratch, Slice* result,
+                  Cache::Handle** handle);
+
+  // Point *value at the value of the record that starts "data".
+  static Status ParseRecord(const Slice& data, Slice* value);
+
+  // Index entries locate records in the data files:
+  //    lognumber--22b location--32b  record size/1KB--10b  (fixed64)
+  //    record size                                       (fixed32)
+  // Entries written before exact sizes were kept have only the first
+  // word, and their records are read in whole kilobytes.
+  static const size_t kFileLocSize = 12;
+
+  static void EncodeFileLoc(uint64_t file_number, uint64_t offset,
+                            uint64_t size, char* buf) {
+    EncodeFixed64(buf, (file_number<<42)+(offset<<10)+((size+1023)/1024));
+    EncodeFixed32(buf + 8, static_cast<uint32_t>(size));
+  }
+
+  static bool DecodeFileLoc(const Slice& loc, uint64_t* file_number,
+                            uint64_t* offset, uint64_t* size) {
+    if (loc.size() != sizeof(uint64_t) && loc.size() != kFileLocSize) {
+      return false;
+    }
+    uint64_t file_loc = DecodeFixed64(loc.data());
     *file_number = file_loc >> 42;
-    file_loc = file_loc & ((1L<<42)-1);
+    file_loc = file_loc & ((1ull<<42)-1);
     *offset = file_loc >> 10;
-    *buf_size = (file_loc & 1023) * 1024;
+    if (loc.size() == kFileLocSize) {
+      *size = DecodeFixed32(loc.data() + 8);
+    } else {
+      *size = (file_loc & 1023) * 1024;
+    }
+    return true;
   }
 
   void RecoverDB();
@@ -4,6 +4,8 @@
 
 #include "db/data_cache.h"
 
+#include <string.h>
+
 #include "db/filename.h"
 #include "leveldb/env.h"
 #include "util/coding.h"
@@ -89,16 +91,54 @@ Status DataCache::Get(const ReadOptions& options,
                       Slice* result,
                       char* scratch) {
   Cache::Handle* handle = NULL;
-  Status s = FindTable(file_number, &handle);
+  Status s = Read(options, file_number, offset, size, result, scratch,
+                  &handle);
+  if (handle != NULL) {
+    // The data may be unmapped once the file is evicted
+    memcpy(scratch, result->data(), result->size());
+    *result = Slice(scratch, result->size());
+    Release(handle);
+  }
+  return s;
+}
+
+Status DataCache::Read(const ReadOptions& options,
+                       uint64_t file_number,
+                       uint64_t offset,
+                       uint64_t size,
+                       Slice* result,
+                       char* scratch,
+                       Cache::Handle** handle) {
+  *handle = NULL;
+  Cache::Handle* h = NULL;
+  Status s = FindTable(file_number, &h);
   if (s.ok()) {
     RandomAccessFile* t =
-      reinterpret_cast<RandomAccessFile*>(cache_->Value(handle));
+      reinterpret_cast<RandomAccessFile*>(cache_->Value(h));
     s = t->Read(offset, size, result, scratch);
-    cache_->Release(handle);
+    if (s.ok() && result->size() > 0 && result->data() != scratch) {
+      *handle = h;
+      return s;
+    }
+    cache_->Release(h);
   }
   return s;
 }
 
+void DataCache::Release(Cache::Handle* handle) {
+  cache_->Release(handle);
+}
+
+void DataCache::Prefetch(uint64_t file_number, int n,
+                         const uint64_t* offsets, const size_t* sizes) {
+  Cache::Handle* h = NULL;
+  if (FindTable(file_number, &h).ok()) {
+    reinterpret_cast<RandomAccessFile*>(cache_->Value(h))->Prefetch(
+        n, offsets, sizes);
+    cache_->Release(h);
+  }
+}
+
 void DataCache::Evict(uint64_t file_number) {
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
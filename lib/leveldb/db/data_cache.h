@@ -23,8 +23,8 @@ class DataCache {
   DataCache(const std::string& dbname, const Options* options, int entries);
   ~DataCache();
 
-  // If a seek to internal key "k" in specified file finds an entry,
-  // call (*handle_result)(arg, found_key, found_value).
+  // Read "size" bytes at "offset" of data file "file_number" into
+  // "scratch" and point *result at them.
   Status Get(const ReadOptions& options,
              uint64_t file_number,
              uint64_t offset,
@@ -32,6 +32,25 @@ class DataCache {
              Slice* result,
              char* scratch);
 
+  // Like Get(), but without copying data the file keeps in memory (e.g.
+  // when it is mmapped): *result may point into the file instead of
+  // "scratch".  Then *handle is set and keeps that memory valid until it
+  // is passed to Release(); otherwise *handle is set to NULL.
+  Status Read(const ReadOptions& options,
+              uint64_t file_number,
+              uint64_t offset,
+              uint64_t size,
+              Slice* result,
+              char* scratch,
+              Cache::Handle** handle);
+
+  void Release(Cache::Handle* handle);
+
+  // Hint that the "n" ranges of sizes[i] bytes at offsets[i] of data
+  // file "file_number" are about to be read.
+  void Prefetch(uint64_t file_number, int n,
+                const uint64_t* offsets, const size_t* sizes);
+
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
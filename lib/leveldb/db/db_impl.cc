@@ -49,7 +49,17 @@ struct DBImpl::Writer {
   bool done;
   port::CondVar cv;
 
-  explicit Writer(port::Mutex* mu) : cv(mu) { }
+  // Set by the group leader when this writer should insert its own batch
+  // into "parallel_mem" (see InsertBatchGroupConcurrently).
+  MemTable* parallel_mem;
+  Writer* leader;
+  // Only used by a group leader: number of batches still being inserted
+  // and the first error reported by any of them.
+  int parallel_pending;
+  Status parallel_status;
+
+  explicit Writer(port::Mutex* mu)
+      : cv(mu), parallel_mem(NULL), leader(NULL), parallel_pending(0) { }
 };
 
 struct DBImpl::CompactionState {
@@ -538,10 +548,24 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long) meta.number);
 
+  // The memtable is sorted, so its first and last keys bound the table
+  // and the level it goes to can be picked before it is built.  The
+  // table's filter is then sized for that level.
+  int level = 0;
+  if (base != NULL) {
+    iter->SeekToFirst();
+    if (iter->Valid()) {
+      const Slice min_user_key = ExtractUserKey(iter->key());
+      iter->SeekToLast();
+      const Slice max_user_key = ExtractUserKey(iter->key());
+      level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
+    }
+  }
+
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, env_, options_, table_cache_, iter, level, &meta);
     mutex_.Lock();
   }
 
@@ -555,13 +579,7 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
 
   // Note that if file_size is zero, the file has been deleted and
   // should not be added to the manifest.
-  int level = 0;
   if (s.ok() && meta.file_size > 0) {
-    const Slice min_user_key = meta.smallest.user_key();
-    const Slice max_user_key = meta.largest.user_key();
-    if (base != NULL) {
-      level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
-    }
     edit->AddFile(level, meta.number, meta.file_size,
                   meta.smallest, meta.largest);
   }
@@ -839,7 +857,7 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   Status s = env_->NewWritableFile(fname, &compact->outfile);
   if (s.ok()) {
     compact->builder = new TableBuilder(options_, compact->outfile,
-                  compact->compaction->level()+2 >= config::kNumLevels);
+                                        compact->compaction->level() + 1);
   }
   return s;
 }
@@ -954,6 +972,92 @@ void DBImpl::MonitorThread(void* db) {
   mdb->mt_mutex_.Unlock();
 }
 
+Status DBImpl::AddToCompactionOutput(CompactionState* compact,
+                                     const Slice& key, const Slice& value,
+                                     Iterator* input) {
+  // Open output file if necessary
+  Status status;
+  if (compact->builder == NULL) {
+    status = OpenCompactionOutputFile(compact);
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  if (compact->builder->NumEntries() == 0) {
+    compact->current_output()->smallest.DecodeFrom(key);
+  }
+  compact->current_output()->largest.DecodeFrom(key);
+  compact->builder->Add(key, value);
+
+  // Close output file if it is big enough
+  if (compact->builder->FileSize() >=
+      compact->compaction->MaxOutputFileSize()) {
+    status = FinishCompactionOutputFile(compact, input);
+  }
+  return status;
+}
+
+// "input" is at merge operand "ikey", which no snapshot separates from
+// the older entries for its user key.  Consume the run of operands that
+// starts there and write out their merged result if the value beneath
+// them is known, or else the operands themselves.  Operands known to
+// have no value beneath them are dropped if the merge operator says so.
+// Sets *merged to whether the result was written.  Leaves "input" at
+// the first entry that was not consumed.
+Status DBImpl::MergeCompactionInput(CompactionState* compact,
+                                    const ParsedInternalKey& ikey,
+                                    Iterator* input, bool* merged) {
+  const std::string user_key = ikey.user_key.ToString();
+  const SequenceNumber sequence = ikey.sequence;
+  std::vector<std::string> keys;
+  std::vector<std::string> operands;  // Newest first
+  bool found_base = false;
+  std::string base;
+  bool has_base = false;
+  for (; input->Valid(); input->Next()) {
+    ParsedInternalKey older;
+    if (!ParseInternalKey(input->key(), &older) ||
+        user_comparator()->Compare(older.user_key, user_key) != 0) {
+      break;
+    }
+    if (older.type != kTypeMerge) {
+      // Left in place to be hidden by the merged result
+      found_base = true;
+      if (older.type == kTypeValue) {
+        base = input->value().ToString();
+        has_base = true;
+      }
+      break;
+    }
+    keys.push_back(input->key().ToString());
+    operands.push_back(input->value().ToString());
+  }
+
+  std::string result;
+  *merged = false;
+  if (found_base || compact->compaction->IsBaseLevelForKey(user_key)) {
+    if (!has_base && options_.merge_operator->DropsOperandsWithoutValue()) {
+      // A deletion left in "input" still hides older values
+      return Status::OK();
+    }
+    std::vector<Slice> ops(operands.rbegin(), operands.rend());
+    Slice existing(base);
+    *merged = options_.merge_operator->FullMerge(user_key,
+                                                 has_base ? &existing : NULL,
+                                                 ops, &result);
+  }
+  if (*merged) {
+    std::string key;
+    AppendInternalKey(&key, ParsedInternalKey(user_key, sequence, kTypeValue));
+    return AddToCompactionOutput(compact, key, result, input);
+  }
+  Status status;
+  for (size_t i = 0; i < keys.size() && status.ok(); i++) {
+    status = AddToCompactionOutput(compact, keys[i], operands[i], input);
+  }
+  return status;
+}
+
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
   mutex_.AssertHeld();
 
@@ -1038,9 +1142,27 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         //     few iterations of this loop (by rule (A) above).
         // Therefore this deletion marker is obsolete and can be dropped.
         drop = true;
+      } else if (ikey.type == kTypeMerge &&
+                 ikey.sequence <= compact->smallest_snapshot &&
+                 options_.merge_operator != NULL) {
+        // No snapshot can see the entries for this user key apart, so
+        // its operands can be folded into the value beneath them.  The
+        // older entries are then hidden by the result through rule (A).
+        bool merged;
+        status = MergeCompactionInput(compact, ikey, input, &merged);
+        if (!status.ok()) {
+          break;
+        }
+        if (merged) {
+          last_sequence_for_key = ikey.sequence;
+        }
+        continue;
       }
 
-      last_sequence_for_key = ikey.sequence;
+      if (ikey.type != kTypeMerge) {
+        // Merge operands do not hide the entries beneath them
+        last_sequence_for_key = ikey.sequence;
+      }
     }
 #if 0
     Log(options_.info_log,
@@ -1053,26 +1175,9 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 #endif
 
     if (!drop) {
-      // Open output file if necessary
-      if (compact->builder == NULL) {
-        status = OpenCompactionOutputFile(compact);
-        if (!status.ok()) {
-          break;
-        }
-      }
-      if (compact->builder->NumEntries() == 0) {
-        compact->current_output()->smallest.DecodeFrom(key);
-      }
-      compact->current_output()->largest.DecodeFrom(key);
-      compact->builder->Add(key, input->value());
-
-      // Close output file if it is big enough
-      if (compact->builder->FileSize() >=
-          compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
-        if (!status.ok()) {
-          break;
-        }
+      status = AddToCompactionOutput(compact, key, input->value(), input);
+      if (!status.ok()) {
+        break;
       }
     }
 
@@ -1176,9 +1281,22 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
   return versions_->MaxNextLevelOverlappingBytes();
 }
 
+static void IgnoreValue(void* arg, const Slice& value) {
+}
+
+static void SaveValueTo(void* arg, const Slice& value) {
+  reinterpret_cast<std::string*>(arg)->assign(value.data(), value.size());
+}
+
 Status DBImpl::Get(const ReadOptions& options,
                    const Slice& key,
                    std::string* value) {
+  return Get(options, key, SaveValueTo, value);
+}
+
+Status DBImpl::Get(const ReadOptions& options,
+                   const Slice& key,
+                   ValueVisitor visitor, void* arg) {
   Status s;
   MutexLock l(&mutex_);
   SequenceNumber snapshot;
@@ -1203,12 +1321,13 @@ Status DBImpl::Get(const ReadOptions& options,
     mutex_.Unlock();
     // First look in the memtable, then in the immutable memtable (if any).
     LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
+    MergeContext merge(options_.merge_operator);
+    if (mem->Get(lkey, visitor, arg, &s, &merge)) {
       // Done
-    } else if (imm != NULL && imm->Get(lkey, value, &s)) {
+    } else if (imm != NULL && imm->Get(lkey, visitor, arg, &s, &merge)) {
       // Done
     } else {
-      s = current->Get(options, lkey, value, &stats);
+      s = current->Get(options, lkey, visitor, arg, &merge, &stats);
       have_stat_update = true;
     }
     mutex_.Lock();
@@ -1224,11 +1343,97 @@ Status DBImpl::Get(const ReadOptions& options,
   return s;
 }
 
+namespace {
+// Orders the indexes of a MultiGet() batch by their keys.
+struct KeyIndexLess {
+  const Comparator* ucmp;
+  const Slice* keys;
+
+  KeyIndexLess(const Comparator* c, const Slice* k) : ucmp(c), keys(k) { }
+  bool operator()(int a, int b) const {
+    return ucmp->Compare(keys[a], keys[b]) < 0;
+  }
+};
+}  // namespace
+
+void DBImpl::MultiGet(const ReadOptions& options, int n, const Slice* keys,
+                      MultiValueVisitor visitor, void* arg,
+                      Status* statuses) {
+  if (n <= 0) return;
+  MutexLock l(&mutex_);
+  SequenceNumber snapshot;
+  if (options.snapshot != NULL) {
+    snapshot = reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_;
+  } else {
+    snapshot = versions_->LastSequence();
+  }
+
+  MemTable* mem = mem_;
+  MemTable* imm = imm_;
+  Version* current = versions_->current();
+  mem->Ref();
+  if (imm != NULL) imm->Ref();
+  current->Ref();
+
+  // Unlock while reading from files and memtables
+  {
+    mutex_.Unlock();
+    std::vector<int> order(n);
+    for (int i = 0; i < n; i++) {
+      order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), KeyIndexLess(user_comparator(), keys));
+
+    std::vector<MultiGetVisit> visits;
+    visits.reserve(n);
+    for (int i = 0; i < n; i++) {
+      visits.push_back(MultiGetVisit(visitor, arg, i));
+    }
+    std::vector<MergeContext> merges(n, MergeContext(options_.merge_operator));
+    std::vector<LookupKey*> lkeys(n);
+
+    // Keys missed by the memtables go to the tables together, in order.
+    std::vector<Version::GetRequest> pending;
+    for (int j = 0; j < n; j++) {
+      const int i = order[j];
+      lkeys[i] = new LookupKey(keys[i], snapshot);
+      Status s;
+      if (mem->Get(*lkeys[i], VisitMultiGetValue, &visits[i], &s,
+                   &merges[i]) ||
+          (imm != NULL && imm->Get(*lkeys[i], VisitMultiGetValue, &visits[i],
+                                   &s, &merges[i]))) {
+        statuses[i] = s;
+      } else {
+        Version::GetRequest req;
+        req.key = lkeys[i];
+        req.visitor = VisitMultiGetValue;
+        req.arg = &visits[i];
+        req.merge = &merges[i];
+        req.status = &statuses[i];
+        pending.push_back(req);
+      }
+    }
+    if (!pending.empty()) {
+      current->MultiGet(options, &pending[0], pending.size());
+    }
+    for (int i = 0; i < n; i++) {
+      delete lkeys[i];
+    }
+    mutex_.Lock();
+  }
+
+  mem->Unref();
+  if (imm != NULL) imm->Unref();
+  current->Unref();
+  op_stats_.get_count += n;
+}
+
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   Iterator* internal_iter = NewInternalIterator(options, &latest_snapshot);
   return NewDBIterator(
-      &dbname_, env_, user_comparator(), internal_iter,
+      &dbname_, env_, user_comparator(), options_.merge_operator,
+      internal_iter,
       (options.snapshot != NULL
        ? reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_
        : latest_snapshot));
@@ -1253,6 +1458,14 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
+Status DBImpl::Merge(const WriteOptions& o, const Slice& key,
+                     const Slice& val) {
+  if (options_.merge_operator == NULL) {
+    return Status::NotSupported("no merge operator");
+  }
+  return DB::Merge(o, key, val);
+}
+
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
   Writer w(&mutex_);
   w.batch = my_batch;
@@ -1263,6 +1476,10 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
   MutexLock l(&mutex_);
   writers_.push_back(&w);
   while (!w.done && &w != writers_.front()) {
+    if (w.parallel_mem != NULL) {
+      InsertOwnBatchConcurrently(&w);
+      continue;
+    }
     w.cv.Wait();
   }
   if (w.done) {
@@ -1275,8 +1492,13 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
   if (status.ok() && my_batch != NULL) {  // NULL batch is for compactions
     WriteBatch* updates = BuildBatchGroup(&last_writer);
     uint64_t last_sequence = versions_->LastSequence();
-    WriteBatchInternal::SetSequence(updates, last_sequence + 1);
+    const SequenceNumber first_sequence = last_sequence + 1;
+    WriteBatchInternal::SetSequence(updates, first_sequence);
     last_sequence += WriteBatchInternal::Count(updates);
+    // A group made of several batches may be inserted by its members in
+    // parallel; a lone batch gains nothing from the hand-off.
+    const bool parallel = options_.allow_concurrent_memtable_write &&
+                          updates != my_batch;
 
     // Add to log and apply to memtable.  We can release the lock
     // during this phase since &w is currently responsible for logging
@@ -1290,11 +1512,14 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
           status = logfile_->Sync();
         }
       }
-      if (status.ok()) {
+      if (status.ok() && !parallel) {
         status = WriteBatchInternal::InsertInto(updates, mem_);
       }
       mutex_.Lock();
     }
+    if (status.ok() && parallel) {
+      status = InsertBatchGroupConcurrently(&w, last_writer, first_sequence);
+    }
     if (updates == tmp_batch_) tmp_batch_->Clear();
 
     if (last_sequence > versions_->LastSequence())
@@ -1320,6 +1545,67 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
   return status;
 }
 
+// REQUIRES: mutex_ is held
+// REQUIRES: "leader" is at the front of the writer queue and has already
+// logged the group [leader, last_writer]
+Status DBImpl::InsertBatchGroupConcurrently(Writer* leader,
+                                            Writer* last_writer,
+                                            SequenceNumber sequence) {
+  mutex_.AssertHeld();
+  assert(writers_.front() == leader);
+  MemTable* mem = mem_;
+  leader->parallel_pending = 1;
+  leader->parallel_status = Status::OK();
+
+  // Hand out sequence numbers in queue order, matching the order in
+  // which BuildBatchGroup() concatenated the batches for the log.
+  std::deque<Writer*>::iterator iter = writers_.begin();
+  for (; iter != writers_.end(); ++iter) {
+    Writer* w = *iter;
+    if (w->batch != NULL) {
+      WriteBatchInternal::SetSequence(w->batch, sequence);
+      sequence += WriteBatchInternal::Count(w->batch);
+      if (w != leader) {
+        w->leader = leader;
+        w->parallel_mem = mem;
+        leader->parallel_pending++;
+        w->cv.Signal();
+      }
+    }
+    if (w == last_writer) break;
+  }
+
+  mutex_.Unlock();
+  Status s = WriteBatchInternal::InsertIntoConcurrently(leader->batch, mem);
+  mutex_.Lock();
+  if (!s.ok() && leader->parallel_status.ok()) {
+    leader->parallel_status = s;
+  }
+  leader->parallel_pending--;
+  while (leader->parallel_pending > 0) {
+    leader->cv.Wait();
+  }
+  return leader->parallel_status;
+}
+
+// REQUIRES: mutex_ is held
+// REQUIRES: w->parallel_mem has been set by the group leader
+void DBImpl::InsertOwnBatchConcurrently(Writer* w) {
+  mutex_.AssertHeld();
+  MemTable* mem = w->parallel_mem;
+  w->parallel_mem = NULL;
+  mutex_.Unlock();
+  Status s = WriteBatchInternal::InsertIntoConcurrently(w->batch, mem);
+  mutex_.Lock();
+  Writer* leader = w->leader;
+  if (!s.ok() && leader->parallel_status.ok()) {
+    leader->parallel_status = s;
+  }
+  if (--leader->parallel_pending == 0) {
+    leader->cv.Signal();
+  }
+}
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-NULL batch
 WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
@@ -1393,10 +1679,13 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       // individual write by 1ms to reduce latency variance.  Also,
       // this delay hands over some CPU to the compaction thread in
       // case it is sharing the same core as the writer.
+      const uint64_t start = env_->NowMicros();
       mutex_.Unlock();
       env_->SleepForMicroseconds(1000);
       allow_delay = false;  // Do not delay a single write more than once
       mutex_.Lock();
+      op_stats_.stall_count++;
+      op_stats_.stall_micros += env_->NowMicros() - start;
     } else if (!force &&
                (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
       // There is room in current memtable
@@ -1404,7 +1693,10 @@ Status DBImpl::MakeRoomForWrite(bool force) {
     } else if (imm_ != NULL) {
       // We have filled up the current memtable, but the previous
       // one is still being compacted, so we wait.
+      const uint64_t start = env_->NowMicros();
       bg_cv_.Wait();
+      op_stats_.stall_count++;
+      op_stats_.stall_micros += env_->NowMicros() - start;
     } /* else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
       // There are too many level-0 files.
       Log(options_.info_log, "waiting...\n");
@@ -1457,6 +1749,45 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
       *value = buf;
       return true;
     }
+  } else if (in.starts_with("bytes-at-level")) {
+    in.remove_prefix(strlen("bytes-at-level"));
+    uint64_t level;
+    bool ok = ConsumeDecimalNumber(&in, &level) && in.empty();
+    if (!ok || level >= config::kNumLevels) {
+      return false;
+    } else {
+      char buf[100];
+      snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(
+               versions_->NumLevelBytes(static_cast<int>(level))));
+      *value = buf;
+      return true;
+    }
+  } else if (in == "counters") {
+    // Running totals, one "name value" pair per line
+    CompactionStats tot_stat;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      tot_stat.Add(stats_[level]);
+    }
+    char buf[400];
+    snprintf(buf, sizeof(buf),
+             "compactions %lld\n"
+             "compaction-micros %lld\n"
+             "compaction-bytes-read %lld\n"
+             "compaction-bytes-written %lld\n"
+             "writes %lld\n"
+             "gets %lld\n"
+             "write-stalls %lld\n"
+             "write-stall-micros %lld\n",
+             static_cast<long long>(tot_stat.counter),
+             static_cast<long long>(tot_stat.micros),
+             static_cast<long long>(tot_stat.bytes_read),
+             static_cast<long long>(tot_stat.bytes_written),
+             static_cast<long long>(op_stats_.write_count),
+             static_cast<long long>(op_stats_.get_count),
+             static_cast<long long>(op_stats_.stall_count),
+             static_cast<long long>(op_stats_.stall_micros));
+    *value = buf;
+    return true;
   } else if (in == "stats") {
     char buf[200];
     CompactionStats tot_stat;
@@ -1548,7 +1879,8 @@ Status DBImpl::OpenDeletionOutputFile(DeletionState* deletion) {
   std::string fname = TableFileName(deletion->dname_, file_number);
   Status s = env_->NewWritableFile(fname, &deletion->outfile);
   if (s.ok()) {
-    deletion->builder = new TableBuilder(options_, deletion->outfile, true);
+    deletion->builder = new TableBuilder(options_, deletion->outfile,
+                                         config::kNumLevels - 1);
   }
   return s;
 }
@@ -1620,6 +1952,7 @@ Status DBImpl::BulkSplit(const WriteOptions& write_opt,
   DeletionState* deletion = new DeletionState(dname);
   ReadOptions read_options;
   read_options.fill_cache = false;
+  read_options.readahead_blocks = config::kScanReadaheadBlocks;
   Status status;
   Iterator* iter =  NewIterator(read_options);
   WriteBatch batch;
@@ -1823,6 +2156,40 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::Merge(const WriteOptions& opt, const Slice& key,
+                 const Slice& value) {
+  WriteBatch batch;
+  batch.Merge(key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::Get(const ReadOptions& options, const Slice& key,
+               ValueVisitor visitor, void* arg) {
+  std::string value;
+  Status s = Get(options, key, &value);
+  if (s.ok()) {
+    (*visitor)(arg, value);
+  }
+  return s;
+}
+
+Status DB::Exists(const ReadOptions& options, const Slice& key) {
+  return Get(options, key, IgnoreValue, NULL);
+}
+
+void DB::MultiGet(const ReadOptions& options, int n, const Slice* keys,
+                  MultiValueVisitor visitor, void* arg, Status* statuses) {
+  for (int i = 0; i < n; i++) {
+    MultiGetVisit visit(visitor, arg, i);
+    statuses[i] = Get(options, keys[i], VisitMultiGetValue, &visit);
+  }
+}
+
+Status DB::PinValues(const ReadOptions& options,
+                     const Slice* begin, const Slice* end) {
+  return Status::OK();
+}
+
 DB::~DB() { }
 
 Status DB::Open(const Options& options, const std::string& dbname,
@@ -31,10 +31,19 @@ class DBImpl : public DB {
   // Implementations of the DB interface
   virtual Status Put(const WriteOptions&, const Slice& key, const Slice& value);
   virtual Status Delete(const WriteOptions&, const Slice& key);
+  virtual Status Merge(const WriteOptions&, const Slice& key,
+                       const Slice& value);
   virtual Status Write(const WriteOptions& options, WriteBatch* updates);
   virtual Status Get(const ReadOptions& options,
                      const Slice& key,
                      std::string* value);
+  virtual Status Get(const ReadOptions& options,
+                     const Slice& key,
+                     ValueVisitor visitor, void* arg);
+  virtual void MultiGet(const ReadOptions& options,
+                        int n, const Slice* keys,
+                        MultiValueVisitor visitor, void* arg,
+                        Status* statuses);
   virtual Iterator* NewIterator(const ReadOptions&);
   virtual const Snapshot* GetSnapshot();
   virtual void ReleaseSnapshot(const Snapshot* snapshot);
@@ -99,6 +108,9 @@ class DBImpl : public DB {
 
   Status MakeRoomForWrite(bool force /* compact even if there is room? */);
   WriteBatch* BuildBatchGroup(Writer** last_writer);
+  Status InsertBatchGroupConcurrently(Writer* leader, Writer* last_writer,
+                                      SequenceNumber sequence);
+  void InsertOwnBatchConcurrently(Writer* w);
 
   void MaybeScheduleCompaction();
   static void BGWork(void* db);
@@ -109,6 +121,11 @@ class DBImpl : public DB {
 
   Status OpenCompactionOutputFile(CompactionState* compact);
   Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+  Status AddToCompactionOutput(CompactionState* compact, const Slice& key,
+                               const Slice& value, Iterator* input);
+  Status MergeCompactionInput(CompactionState* compact,
+                              const ParsedInternalKey& ikey, Iterator* input,
+                              bool* merged);
   Status InstallCompactionResults(CompactionState* compact);
 
   void  LogLiveFiles(std::string location, VersionEdit *edit);
@@ -196,8 +213,11 @@ class DBImpl : public DB {
   struct OperationStats {
     int64_t get_count;
     int64_t write_count;
+    int64_t stall_count;    // Writes delayed by MakeRoomForWrite()
+    int64_t stall_micros;   // Time those writes spent waiting
 
-    OperationStats() : write_count(0), get_count(0) { }
+    OperationStats() : get_count(0), write_count(0),
+                       stall_count(0), stall_micros(0) { }
   };
   OperationStats op_stats_;
 
@@ -33,7 +33,7 @@ namespace {
 // (userkey,seq,type) => uservalue entries.  DBIter
 // combines multiple entries for the same userkey found in the DB
 // representation into a single entry while accounting for sequence
-// numbers, deletion markers, overwrites, etc.
+// numbers, deletion markers, overwrites, merge operands, etc.
 class DBIter: public Iterator {
  public:
   // Which direction is the iterator currently moving?
@@ -41,20 +41,26 @@ class DBIter: public Iterator {
   //     the exact entry that yields this->key(), this->value()
   // (2) When moving backwards, the internal iterator is positioned
   //     just before all entries whose user key == this->key().
+  // Except that when moving forward onto merge operands, the internal
+  // iterator is positioned past the entries that were merged and the
+  // merged result is kept in saved_key_, saved_value_ (merged_ is true).
   enum Direction {
     kForward,
     kReverse
   };
 
   DBIter(const std::string* dbname, Env* env,
-         const Comparator* cmp, Iterator* iter, SequenceNumber s)
+         const Comparator* cmp, const MergeOperator* merge_operator,
+         Iterator* iter, SequenceNumber s)
       : dbname_(dbname),
         env_(env),
         user_comparator_(cmp),
+        merge_operator_(merge_operator),
         iter_(iter),
         sequence_(s),
         direction_(kForward),
-        valid_(false) {
+        valid_(false),
+        merged_(false) {
   }
   virtual ~DBIter() {
     delete iter_;
@@ -62,15 +68,17 @@ class DBIter: public Iterator {
   virtual bool Valid() const { return valid_; }
   virtual Slice internalkey() const {
     assert(valid_);
-    return iter_->key();
+    return merged_ ? Slice(merged_ikey_) : iter_->key();
   }
   virtual Slice key() const {
     assert(valid_);
-    return (direction_ == kForward) ? ExtractUserKey(iter_->key()) : saved_key_;
+    return (direction_ == kForward && !merged_) ?
+        ExtractUserKey(iter_->key()) : saved_key_;
   }
   virtual Slice value() {
     assert(valid_);
-    return (direction_ == kForward) ? iter_->value() : saved_value_;
+    return (direction_ == kForward && !merged_) ?
+        iter_->value() : saved_value_;
   }
   virtual Status status() const {
     if (status_.ok()) {
@@ -89,6 +97,12 @@ class DBIter: public Iterator {
  private:
   void FindNextUserEntry(bool skipping, std::string* skip);
   void FindPrevUserEntry();
+  bool MergeForward(const ParsedInternalKey& ikey);
+  bool DropsOperands(bool has_base) const {
+    return !has_base && merge_operator_ != NULL &&
+           merge_operator_->DropsOperandsWithoutValue();
+  }
+  bool Merge(const Slice* existing_value, const std::vector<Slice>& operands);
   bool ParseKey(ParsedInternalKey* key);
 
   inline void SaveKey(const Slice& k, std::string* dst) {
@@ -107,14 +121,17 @@ class DBIter: public Iterator {
   const std::string* const dbname_;
   Env* const env_;
   const Comparator* const user_comparator_;
+  const MergeOperator* const merge_operator_;
   Iterator* const iter_;
   SequenceNumber const sequence_;
 
   Status status_;
   std::string saved_key_;     // == current key when direction_==kReverse
   std::string saved_value_;   // == current raw value when direction_==kReverse
+  std::string merged_ikey_;   // == internal key of the merged entry
   Direction direction_;
   bool valid_;
+  bool merged_;
 
   // No copying allowed
   DBIter(const DBIter&);
@@ -133,6 +150,19 @@ inline bool DBIter::ParseKey(ParsedInternalKey* ikey) {
 void DBIter::Next() {
   assert(valid_);
 
+  if (merged_) {
+    // iter_ is already past the merged entries, and saved_key_ holds
+    // their user key
+    merged_ = false;
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      return;
+    }
+    FindNextUserEntry(true, &saved_key_);
+    return;
+  }
+
   if (direction_ == kReverse) {  // Switch directions?
     direction_ = kForward;
     // iter_ is pointing just before the entries for this->key(),
@@ -180,6 +210,22 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
             return;
           }
           break;
+        case kTypeMerge:
+          if (skipping &&
+              user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
+            // Entry hidden
+          } else if (MergeForward(ikey)) {
+            return;
+          } else {
+            // The operands of a deleted key were dropped, and iter_ is
+            // past them; skip whatever else is left of the key
+            if (skip != &saved_key_) {
+              *skip = saved_key_;
+            }
+            skipping = true;
+            continue;
+          }
+          break;
       }
     }
     iter_->Next();
@@ -188,14 +234,79 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   valid_ = false;
 }
 
+// Combine the merge operand iter_ points at with the older entries for
+// its user key, leaving iter_ past the operands.  Returns false if the
+// operands were dropped because the key has no value.
+bool DBIter::MergeForward(const ParsedInternalKey& ikey) {
+  SaveKey(ikey.user_key, &saved_key_);
+  merged_ikey_.clear();
+  AppendInternalKey(&merged_ikey_,
+                    ParsedInternalKey(saved_key_, ikey.sequence, kTypeValue));
+  std::vector<std::string> operands;  // Newest first
+  operands.push_back(iter_->value().ToString());
+  Slice base;
+  bool has_base = false;
+  for (iter_->Next(); iter_->Valid(); iter_->Next()) {
+    ParsedInternalKey older;
+    if (!ParseKey(&older) ||
+        user_comparator_->Compare(older.user_key, saved_key_) != 0) {
+      break;
+    }
+    if (older.type == kTypeMerge) {
+      operands.push_back(iter_->value().ToString());
+    } else {
+      // iter_ stays here; Next() skips the remaining entries
+      if (older.type == kTypeValue) {
+        base = iter_->value();
+        has_base = true;
+      }
+      break;
+    }
+  }
+  if (DropsOperands(has_base)) {
+    return false;
+  }
+  std::vector<Slice> ops(operands.rbegin(), operands.rend());
+  merged_ = Merge(has_base ? &base : NULL, ops);
+  valid_ = merged_;
+  if (!valid_) {
+    saved_key_.clear();
+  }
+  return true;
+}
+
+// Store the merged value of saved_key_ in saved_value_.
+bool DBIter::Merge(const Slice* existing_value,
+                   const std::vector<Slice>& operands) {
+  std::string result;
+  if (merge_operator_ == NULL) {
+    status_ = Status::NotSupported("merge operand without merge operator");
+    return false;
+  } else if (!merge_operator_->FullMerge(saved_key_, existing_value,
+                                         operands, &result)) {
+    status_ = Status::Corruption("merge failed for ", saved_key_);
+    return false;
+  }
+  saved_value_.swap(result);
+  return true;
+}
+
 void DBIter::Prev() {
   assert(valid_);
 
   if (direction_ == kForward) {  // Switch directions?
     // iter_ is pointing at the current entry.  Scan backwards until
     // the key changes so we can use the normal reverse scanning code.
-    assert(iter_->Valid());  // Otherwise valid_ would have been false
-    SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    if (merged_) {
+      // iter_ is past the merged entries, possibly at the end
+      merged_ = false;
+      if (!iter_->Valid()) {
+        iter_->SeekToLast();
+      }
+    } else {
+      assert(iter_->Valid());  // Otherwise valid_ would have been false
+      SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    }
     while (true) {
       iter_->Prev();
       if (!iter_->Valid()) {
@@ -219,31 +330,60 @@ void DBIter::FindPrevUserEntry() {
   assert(direction_ == kReverse);
 
   ValueType value_type = kTypeDeletion;
-  if (iter_->Valid()) {
-    do {
-      ParsedInternalKey ikey;
-      if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
-        if ((value_type != kTypeDeletion) &&
-            user_comparator_->Compare(ikey.user_key, saved_key_) < 0) {
-          // We encountered a non-deleted value in entries for previous keys,
-          break;
-        }
-        value_type = ikey.type;
-        if (value_type == kTypeDeletion) {
-          saved_key_.clear();
-          ClearSavedValue();
-        } else {
-          Slice raw_value = iter_->value();
-          if (saved_value_.capacity() > raw_value.size() + 1048576) {
-            std::string empty;
-            swap(empty, saved_value_);
+  bool has_base = false;              // saved_value_ holds a kTypeValue
+  std::vector<std::string> operands;  // Oldest first
+  while (true) {
+    if (iter_->Valid()) {
+      do {
+        ParsedInternalKey ikey;
+        if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+          if ((value_type != kTypeDeletion) &&
+              user_comparator_->Compare(ikey.user_key, saved_key_) < 0) {
+            // We encountered a non-deleted value in entries for previous keys,
+            break;
+          }
+          value_type = ikey.type;
+          if (value_type == kTypeDeletion) {
+            saved_key_.clear();
+            ClearSavedValue();
+            has_base = false;
+            operands.clear();
+          } else if (value_type == kTypeMerge) {
+            // Newer than the entries seen so far for this key
+            SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+            operands.push_back(iter_->value().ToString());
+          } else {
+            has_base = true;
+            operands.clear();
+            Slice raw_value = iter_->value();
+            if (saved_value_.capacity() > raw_value.size() + 1048576) {
+              std::string empty;
+              swap(empty, saved_value_);
+            }
+            SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+            saved_value_.assign(raw_value.data(), raw_value.size());
           }
-          SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
-          saved_value_.assign(raw_value.data(), raw_value.size());
         }
+        iter_->Prev();
+      } while (iter_->Valid());
+    }
+
+    if (value_type != kTypeDeletion && !operands.empty()) {
+      if (DropsOperands(has_base)) {
+        // The key has been deleted, and iter_ is at the entries of the
+        // key before it, if any
+        value_type = kTypeDeletion;
+        saved_key_.clear();
+        operands.clear();
+        continue;
       }
-      iter_->Prev();
-    } while (iter_->Valid());
+      std::vector<Slice> ops(operands.begin(), operands.end());
+      Slice base(saved_value_);
+      if (!Merge(has_base ? &base : NULL, ops)) {
+        value_type = kTypeDeletion;
+      }
+    }
+    break;
   }
 
   if (value_type == kTypeDeletion) {
@@ -259,6 +399,7 @@ void DBIter::FindPrevUserEntry() {
 
 void DBIter::Seek(const Slice& target) {
   direction_ = kForward;
+  merged_ = false;
   ClearSavedValue();
   saved_key_.clear();
   AppendInternalKey(
@@ -273,6 +414,7 @@ void DBIter::Seek(const Slice& target) {
 
 void DBIter::SeekToFirst() {
   direction_ = kForward;
+  merged_ = false;
   ClearSavedValue();
   iter_->SeekToFirst();
   if (iter_->Valid()) {
@@ -284,6 +426,7 @@ void DBIter::SeekToFirst() {
 
 void DBIter::SeekToLast() {
   direction_ = kReverse;
+  merged_ = false;
   ClearSavedValue();
   iter_->SeekToLast();
   FindPrevUserEntry();
@@ -295,9 +438,11 @@ Iterator* NewDBIterator(
     const std::string* dbname,
     Env* env,
     const Comparator* user_key_comparator,
+    const MergeOperator* merge_operator,
     Iterator* internal_iter,
     const SequenceNumber& sequence) {
-  return new DBIter(dbname, env, user_key_comparator, internal_iter, sequence);
+  return new DBIter(dbname, env, user_key_comparator, merge_operator,
+                    internal_iter, sequence);
 }
 
 }  // namespace leveldb
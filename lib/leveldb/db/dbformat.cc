@@ -104,7 +104,7 @@ const char* InternalFilterPolicy::Name() const {
 
 void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
                                         std::string* dst,
-                                        bool lastLayer) const {
+                                        int level) const {
   // We rely on the fact that the code in table.cc does not mind us
   // adjusting keys[].
   Slice* mkey = const_cast<Slice*>(keys);
@@ -112,7 +112,7 @@ void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
     mkey[i] = ExtractUserKey(keys[i]);
     // TODO(sanjay): Suppress dups?
   }
-  user_policy_->CreateFilter(keys, n, dst, lastLayer);
+  user_policy_->CreateFilter(keys, n, dst, level);
 }
 
 bool InternalFilterPolicy::KeyMayMatch(const Slice& key, const Slice& f) const {
@@ -138,4 +138,24 @@ LookupKey::LookupKey(const Slice& user_key, SequenceNumber s) {
   end_ = dst;
 }
 
+Status MergeContext::Finish(const Slice& user_key,
+                            const Slice* existing_value,
+                            void (*visitor)(void* arg, const Slice& value),
+                            void* arg) const {
+  if (existing_value == NULL && merge_operator->DropsOperandsWithoutValue()) {
+    return Status::NotFound(Slice());
+  }
+  std::vector<Slice> ops;
+  ops.reserve(operands.size());
+  for (size_t i = operands.size(); i > 0; i--) {
+    ops.push_back(operands[i - 1]);
+  }
+  std::string merged;
+  if (!merge_operator->FullMerge(user_key, existing_value, ops, &merged)) {
+    return Status::Corruption("cannot merge operands for ", user_key);
+  }
+  (*visitor)(arg, merged);
+  return Status::OK();
+}
+
 }  // namespace leveldb
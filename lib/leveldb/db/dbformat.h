@@ -6,9 +6,12 @@
 #define STORAGE_LEVELDB_DB_FORMAT_H_
 
 #include <stdio.h>
+#include <string>
+#include <vector>
 #include "leveldb/comparator.h"
 #include "leveldb/db.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/merge_operator.h"
 #include "leveldb/slice.h"
 #include "leveldb/table_builder.h"
 #include "util/coding.h"
@@ -40,6 +43,9 @@ static const int kMaxMemCompactLevel = 2;
 
 static const int kBufSize = 1024;
 
+// Data blocks (or ColumnDB values) read ahead by bulk scans.
+static const int kScanReadaheadBlocks = 16;
+
 }  // namespace config
 
 class InternalKey;
@@ -49,7 +55,8 @@ class InternalKey;
 // data structures.
 enum ValueType {
   kTypeDeletion = 0x0,
-  kTypeValue = 0x1
+  kTypeValue = 0x1,
+  kTypeMerge = 0x2
 };
 // kValueTypeForSeek defines the ValueType that should be passed when
 // constructing a ParsedInternalKey object for seeking to a particular
@@ -57,7 +64,7 @@ enum ValueType {
 // and the value type is embedded as the low 8 bits in the sequence
 // number in internal keys, we need to use the highest-numbered
 // ValueType, not the lowest).
-static const ValueType kValueTypeForSeek = kTypeValue;
+static const ValueType kValueTypeForSeek = kTypeMerge;
 
 typedef uint64_t SequenceNumber;
 
@@ -134,7 +141,7 @@ class InternalFilterPolicy : public FilterPolicy {
   explicit InternalFilterPolicy(const FilterPolicy* p) : user_policy_(p) { }
   virtual const char* Name() const;
   virtual void CreateFilter(const Slice* keys, int n, std::string* dst,
-                            bool lastLayer) const;
+                            int level) const;
   virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const;
 };
 
@@ -182,7 +189,39 @@ inline bool ParseInternalKey(const Slice& internal_key,
   result->sequence = num >> 8;
   result->type = static_cast<ValueType>(c);
   result->user_key = Slice(internal_key.data(), n - 8);
-  return (c <= static_cast<unsigned char>(kTypeValue));
+  return (c <= static_cast<unsigned char>(kTypeMerge));
+}
+
+// Merge operands met by a point lookup, newest first, on its way down
+// to the value they apply to.
+struct MergeContext {
+  const MergeOperator* merge_operator;
+  std::vector<std::string> operands;
+
+  explicit MergeContext(const MergeOperator* op) : merge_operator(op) { }
+
+  // Apply the operands to "existing_value", which is NULL if the key has
+  // no value underneath them, and call (*visitor)(arg, result).  Returns
+  // NotFound if there is no value and the operator drops such operands.
+  Status Finish(const Slice& user_key, const Slice* existing_value,
+                void (*visitor)(void* arg, const Slice& value),
+                void* arg) const;
+};
+
+// Forwards the value found for key "index" of a DB::MultiGet() to the
+// caller's visitor; passed to single-key lookups as their visitor arg.
+struct MultiGetVisit {
+  DB::MultiValueVisitor visitor;
+  void* arg;
+  int index;
+
+  MultiGetVisit(DB::MultiValueVisitor v, void* a, int i)
+      : visitor(v), arg(a), index(i) { }
+};
+
+inline void VisitMultiGetValue(void* arg, const Slice& value) {
+  MultiGetVisit* visit = reinterpret_cast<MultiGetVisit*>(arg);
+  (*visit->visitor)(visit->arg, visit->index, value);
 }
 
 // A helper class useful for DBImpl::Get()
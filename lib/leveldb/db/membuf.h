@@ -1,58 +1,178 @@
 // Copyright (c) 2014 The IndexFS Authors. All rights reserved.
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// In-memory copy of the data file ColumnDB is appending to.
+//
+// Writers reserve space by bumping the reserved offset with a
+// compare-and-swap and then fill their record in without any lock.  A
+// record is laid out as in the data file:
+//
+//    header:  magic number--16b key size--28b  value size--20b (fixed64)
+//    key
+//    value
+//
+// The last byte of the header (the high byte of the magic number) is
+// stored last, after a memory barrier, so a record whose last header
+// byte is non-zero is complete.  This lets the owner find the prefix of
+// the buffer that can be written to the data file while later records
+// are still being filled in.
+//
+// Once full the buffer is sealed and written out; it then stays
+// readable until it is Reset() for a later data file.  Readers do not
+// lock: they check the file number before and after copying a record
+// out and fall back to the data file if the buffer was reset meanwhile.
 
 #ifndef STORAGE_LEVELDB_UTIL_MEMBUF_H_
 #define STORAGE_LEVELDB_UTIL_MEMBUF_H_
 
+#include <stdint.h>
+#include <string.h>
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+#include "port/port.h"
+#include "util/coding.h"
+
 namespace leveldb {
 
-class MemBuffer {
+static const uint64_t kColumnMagicNumber = 0x18ca;
+static const size_t kColumnHeaderSize = sizeof(uint64_t);
 
-public:
-  MemBuffer(size_t write_buffer_size) :
-    buffer_size(write_buffer_size), free_buffer_size(write_buffer_size) {
-    buffer = new char[write_buffer_size];
+class MemBuffer {
+ public:
+  explicit MemBuffer(size_t write_buffer_size)
+      : buffer_size_(write_buffer_size),
+        file_number_(reinterpret_cast<void*>(~static_cast<uintptr_t>(0))),
+        reserved_(NULL),
+        sealed_end_(0),
+        flushed_(0) {
+    buffer_ = new char[write_buffer_size];
+    memset(buffer_, 0, write_buffer_size);
   }
 
   ~MemBuffer() {
-    delete [] buffer;
+    delete [] buffer_;
+  }
+
+  size_t capacity() const { return buffer_size_; }
+
+  uint64_t file_number() const {
+    return reinterpret_cast<uintptr_t>(file_number_.Acquire_Load());
   }
 
-  bool HasEnough(size_t bytes) {
-    return free_buffer_size >= bytes;
+  // Start over as the copy of data file "file_number".  REQUIRES: the
+  // buffer is new or sealed, and no record is still being filled in.
+  void Reset(uint64_t file_number) {
+    // Fail the check of readers still copying out of the old contents
+    file_number_.Release_Store(reinterpret_cast<void*>(file_number));
+    memset(buffer_, 0, sealed_end_);
+    sealed_end_ = 0;
+    flushed_ = 0;
+    reserved_.Release_Store(NULL);
   }
 
-  Status Append(const Slice& data, size_t &location) {
-    if (data.size() > free_buffer_size) {
-      return Status::BufferFull("Appending data to a nearly full buffer");
+  // Reserve room for a record of "size" bytes and store its offset in
+  // *location.  Returns false if the buffer is sealed or too full.
+  bool Reserve(size_t size, size_t* location) {
+    while (true) {
+      const size_t cur = Reserved();
+      if (cur > buffer_size_ || size > buffer_size_ - cur) {
+        return false;
+      }
+      if (reserved_.CompareAndSwap(reinterpret_cast<void*>(cur),
+                                   reinterpret_cast<void*>(cur + size))) {
+        *location = cur;
+        return true;
+      }
     }
-    location = buffer_size - free_buffer_size;
-    memcpy(buffer + location, data.data(), data.size());
-    free_buffer_size -= data.size();
-    return Status::OK();
   }
 
-  Status Get(size_t offset, size_t size, Slice* result, char* scratch) {
-    if (offset >= buffer_size)
-      return Status::IOError("Exceeding memory buffer size");
-    if (size + offset > buffer_size) {
-      size = buffer_size - offset;
+  // Fill in the record reserved at "location".
+  void Fill(size_t location, const Slice& key, const Slice& value) {
+    char* p = buffer_ + location;
+    memcpy(p + kColumnHeaderSize, key.data(), key.size());
+    memcpy(p + kColumnHeaderSize + key.size(), value.data(), value.size());
+    char header[kColumnHeaderSize];
+    // magic number--16b key size--28b  value size--20b
+    EncodeFixed64(header, (kColumnMagicNumber<<48)+(key.size()<<20)+
+                          value.size());
+    memcpy(p, header, kColumnHeaderSize - 1);
+    port::MemoryBarrier();
+    p[kColumnHeaderSize - 1] = header[kColumnHeaderSize - 1];
+  }
+
+  // Refuse any further reservation.  Returns the end of the last record.
+  size_t Seal() {
+    while (true) {
+      const size_t cur = Reserved();
+      if (cur > buffer_size_) {
+        return sealed_end_;
+      }
+      if (reserved_.CompareAndSwap(reinterpret_cast<void*>(cur),
+                                   reinterpret_cast<void*>(buffer_size_+1))) {
+        sealed_end_ = cur;
+        return cur;
+      }
     }
-    memcpy(scratch, buffer+offset, size);
-    *result = Slice(scratch, size);
-    return Status::OK();
   }
 
-  void Truncate() {
-    free_buffer_size = buffer_size;
+  // Return the end of the longest run of complete records that starts
+  // at the first byte not yet written out.
+  size_t CompletePrefix() const {
+    size_t end = Reserved();
+    if (end > buffer_size_) end = sealed_end_;
+    size_t pos = flushed_;
+    while (pos + kColumnHeaderSize <= end &&
+           buffer_[pos + kColumnHeaderSize - 1] != 0) {
+      port::MemoryBarrier();
+      uint64_t header = DecodeFixed64(buffer_ + pos) & ((1ull<<48)-1);
+      pos += kColumnHeaderSize + (header >> 20) + (header & ((1<<20)-1));
+    }
+    return pos;
+  }
+
+  // Bytes [flushed(), CompletePrefix()) are ready to be written out.
+  // The caller serializes these two.
+  size_t flushed() const { return flushed_; }
+  Slice Unflushed(size_t end) const {
+    return Slice(buffer_ + flushed_, end - flushed_);
+  }
+  void MarkFlushed(size_t end) { flushed_ = end; }
+
+  // Copy "size" bytes at "offset" of data file "file_number" into
+  // "scratch".  Returns false if the buffer does not hold that file.
+  bool Get(uint64_t file_number, size_t offset, size_t size,
+           Slice* result, char* scratch) const {
+    if (this->file_number() != file_number || offset >= buffer_size_) {
+      return false;
+    }
+    if (size + offset > buffer_size_) {
+      size = buffer_size_ - offset;
+    }
+    memcpy(scratch, buffer_ + offset, size);
+    port::MemoryBarrier();
+    if (this->file_number() != file_number) {
+      return false;
+    }
+    *result = Slice(scratch, size);
+    return true;
   }
 
-private:
-  char* buffer;
-  size_t buffer_size;
-  size_t free_buffer_size;
+ private:
+  char* buffer_;
+  const size_t buffer_size_;
+  port::AtomicPointer file_number_;
+  port::AtomicPointer reserved_;   // Next free offset; > size when sealed
+  size_t sealed_end_;
+  size_t flushed_;
+
+  size_t Reserved() const {
+    return reinterpret_cast<uintptr_t>(reserved_.Acquire_Load());
+  }
 
+  // No copying allowed
+  MemBuffer(const MemBuffer&);
+  void operator=(const MemBuffer&);
 };
 
 } //namespace leveldb
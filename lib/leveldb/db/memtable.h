@@ -57,11 +57,22 @@ class MemTable {
            const Slice& key,
            const Slice& value);
 
-  // If memtable contains a value for key, store it in *value and return true.
+  // Same as Add(), but may be called by several threads at once.
+  // REQUIRES: no thread is calling Add() at the same time.
+  void AddConcurrently(SequenceNumber seq, ValueType type,
+                       const Slice& key,
+                       const Slice& value);
+
+  // If memtable contains a value for key, call (*visitor)(arg, value)
+  // and return true.
   // If memtable contains a deletion for key, store a NotFound() error
   // in *status and return true.
+  // Merge operands for key are added to *merge; once they reach a value
+  // or a deletion the merged result is passed to "visitor" instead.
   // Else, return false.
-  bool Get(const LookupKey& key, std::string* value, Status* s);
+  bool Get(const LookupKey& key,
+           void (*visitor)(void* arg, const Slice& value), void* arg,
+           Status* s, MergeContext* merge);
 
  private:
   ~MemTable();  // Private since only Unref() should be used to delete it
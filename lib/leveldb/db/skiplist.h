@@ -6,6 +6,10 @@
 // -------------
 //
 // Writes require external synchronization, most likely a mutex.
+// The one exception is InsertConcurrently(), which may be invoked by
+// several threads at once as long as no thread is calling Insert() at
+// the same time.  It links new nodes with compare-and-swap operations
+// on the next pointers instead of relying on the caller's mutex.
 // Reads require a guarantee that the SkipList will not be destroyed
 // while the read is in progress.  Apart from that, reads progress
 // without any internal locking or synchronization.
@@ -49,6 +53,11 @@ class SkipList {
   // REQUIRES: nothing that compares equal to key is currently in the list.
   void Insert(const Key& key);
 
+  // Like Insert(), but safe to call from multiple threads at once.
+  // REQUIRES: nothing that compares equal to key is currently in the list,
+  // and no thread is calling Insert() at the same time.
+  void InsertConcurrently(const Key& key);
+
   // Returns true iff an entry that compares equal to key is in the list.
   bool Contains(const Key& key) const;
 
@@ -112,8 +121,14 @@ class SkipList {
   // Read/written only by Insert().
   Random rnd_;
 
+  // Random seed shared by InsertConcurrently() callers.  Advanced with
+  // compare-and-swap so that concurrent inserts never share a draw.
+  port::AtomicPointer concurrent_seed_;
+
   Node* NewNode(const Key& key, int height);
+  Node* NewNodeConcurrently(const Key& key, int height);
   int RandomHeight();
+  int RandomHeightConcurrently();
   bool Equal(const Key& a, const Key& b) const { return (compare_(a, b) == 0); }
 
   // Return true if key is greater than the data stored in "n"
@@ -124,7 +139,13 @@ class SkipList {
   //
   // If prev is non-NULL, fills prev[level] with pointer to previous
   // node at "level" for every level in [0..max_height_-1].
-  Node* FindGreaterOrEqual(const Key& key, Node** prev) const;
+  Node* FindGreaterOrEqual(const Key& key, Node** prev) const {
+    return FindGreaterOrEqual(key, prev, GetMaxHeight());
+  }
+
+  // Like the above, but searches the levels below "height" only, and
+  // fills prev[0..height-1].
+  Node* FindGreaterOrEqual(const Key& key, Node** prev, int height) const;
 
   // Return the latest node with a key < key.
   // Return head_ if there is no such node.
@@ -171,6 +192,14 @@ struct SkipList<Key,Comparator>::Node {
     next_[n].NoBarrier_Store(x);
   }
 
+  // Publish "x" as the successor at level "n" iff the current successor
+  // is still "expected".  The swap implies a full barrier, so readers
+  // that observe "x" also observe its initialized contents.
+  bool CASNext(int n, Node* expected, Node* x) {
+    assert(n >= 0);
+    return next_[n].CompareAndSwap(expected, x);
+  }
+
  private:
   // Array of length equal to the node height.  next_[0] is lowest level link.
   port::AtomicPointer next_[1];
@@ -184,6 +213,14 @@ SkipList<Key,Comparator>::NewNode(const Key& key, int height) {
   return new (mem) Node(key);
 }
 
+template<typename Key, class Comparator>
+typename SkipList<Key,Comparator>::Node*
+SkipList<Key,Comparator>::NewNodeConcurrently(const Key& key, int height) {
+  char* mem = arena_->AllocateAlignedConcurrently(
+      sizeof(Node) + sizeof(port::AtomicPointer) * (height - 1));
+  return new (mem) Node(key);
+}
+
 template<typename Key, class Comparator>
 inline SkipList<Key,Comparator>::Iterator::Iterator(const SkipList* list) {
   list_ = list;
@@ -249,6 +286,31 @@ int SkipList<Key,Comparator>::RandomHeight() {
   return height;
 }
 
+template<typename Key, class Comparator>
+int SkipList<Key,Comparator>::RandomHeightConcurrently() {
+  static const unsigned int kBranching = 4;
+  int height = 1;
+  while (height < kMaxHeight) {
+    // Same generator as rnd_, but the seed is advanced atomically so
+    // that concurrent callers draw distinct values.
+    void* prev_seed;
+    uint32_t r;
+    do {
+      prev_seed = concurrent_seed_.NoBarrier_Load();
+      Random rnd(static_cast<uint32_t>(reinterpret_cast<uintptr_t>(prev_seed)));
+      r = rnd.Next();
+    } while (!concurrent_seed_.CompareAndSwap(
+                 prev_seed, reinterpret_cast<void*>(static_cast<uintptr_t>(r))));
+    if ((r % kBranching) != 0) {
+      break;
+    }
+    height++;
+  }
+  assert(height > 0);
+  assert(height <= kMaxHeight);
+  return height;
+}
+
 template<typename Key, class Comparator>
 bool SkipList<Key,Comparator>::KeyIsAfterNode(const Key& key, Node* n) const {
   // NULL n is considered infinite
@@ -256,10 +318,10 @@ bool SkipList<Key,Comparator>::KeyIsAfterNode(const Key& key, Node* n) const {
 }
 
 template<typename Key, class Comparator>
-typename SkipList<Key,Comparator>::Node* SkipList<Key,Comparator>::FindGreaterOrEqual(const Key& key, Node** prev)
-    const {
+typename SkipList<Key,Comparator>::Node* SkipList<Key,Comparator>::FindGreaterOrEqual(const Key& key, Node** prev,
+                                              int height) const {
   Node* x = head_;
-  int level = GetMaxHeight() - 1;
+  int level = height - 1;
   while (true) {
     Node* next = x->Next(level);
     if (KeyIsAfterNode(key, next)) {
@@ -324,7 +386,8 @@ SkipList<Key,Comparator>::SkipList(Comparator cmp, Arena* arena)
       arena_(arena),
       head_(NewNode(0 /* any key will do */, kMaxHeight)),
       max_height_(reinterpret_cast<void*>(1)),
-      rnd_(0xdeadbeef) {
+      rnd_(0xdeadbeef),
+      concurrent_seed_(reinterpret_cast<void*>(0xdeadbeef & 0x7fffffff)) {
   for (int i = 0; i < kMaxHeight; i++) {
     head_->SetNext(i, NULL);
   }
@@ -366,6 +429,51 @@ void SkipList<Key,Comparator>::Insert(const Key& key) {
   }
 }
 
+template<typename Key, class Comparator>
+void SkipList<Key,Comparator>::InsertConcurrently(const Key& key) {
+  // Other inserters may raise max_height_ at any time, so remember the
+  // height the search used: prev[] is only filled below it.
+  Node* prev[kMaxHeight];
+  int max_height = GetMaxHeight();
+  Node* x = FindGreaterOrEqual(key, prev, max_height);
+
+  // Our data structure does not allow duplicate insertion
+  assert(x == NULL || !Equal(key, x->key));
+
+  // Levels above the height searched start from head_.  Raise
+  // max_height_ with a CAS so that concurrent inserters never lower it.
+  int height = RandomHeightConcurrently();
+  for (int i = max_height; i < height; i++) {
+    prev[i] = head_;
+  }
+  while (height > max_height) {
+    if (max_height_.CompareAndSwap(reinterpret_cast<void*>(max_height),
+                                   reinterpret_cast<void*>(height))) {
+      break;
+    }
+    max_height = GetMaxHeight();
+  }
+
+  x = NewNodeConcurrently(key, height);
+  for (int i = 0; i < height; i++) {
+    // Other threads may have linked nodes after prev[i] since the
+    // search; nodes are never removed, so walking forward from prev[i]
+    // until the successor sorts after key yields the correct splice.
+    while (true) {
+      Node* next = prev[i]->Next(i);
+      if (KeyIsAfterNode(key, next)) {
+        prev[i] = next;
+        continue;
+      }
+      assert(next == NULL || !Equal(key, next->key));
+      x->NoBarrier_SetNext(i, next);
+      if (prev[i]->CASNext(i, next, x)) {
+        break;
+      }
+    }
+  }
+}
+
 template<typename Key, class Comparator>
 bool SkipList<Key,Comparator>::Contains(const Key& key) const {
   Node* x = FindGreaterOrEqual(key, NULL);
@@ -0,0 +1,132 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Stress test of SkipList::InsertConcurrently().  Several threads insert
+// disjoint keys into fresh lists at once, so that they keep racing to
+// raise the list height, then the list is checked to hold every key in
+// order, at every level.  Exits non-zero on the first error.
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+#include "db/skiplist.h"
+#include "port/port.h"
+#include "util/arena.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+typedef uint64_t Key;
+
+struct TestComparator {
+  int operator()(const Key& a, const Key& b) const {
+    if (a < b) {
+      return -1;
+    } else if (a > b) {
+      return +1;
+    } else {
+      return 0;
+    }
+  }
+};
+
+typedef SkipList<Key, TestComparator> TestList;
+
+static const int kThreads = 8;
+static const int kKeysPerThread = 5000;
+static const int kRounds = 40;
+
+static void Check(bool ok, const char* what, int round, Key key) {
+  if (!ok) {
+    fprintf(stderr, "skiplist_test: %s (round %d, key %llu)\n", what, round,
+            static_cast<unsigned long long>(key));
+    exit(EXIT_FAILURE);
+  }
+}
+
+struct InsertState {
+  TestList* list;
+  port::AtomicPointer* ready;   // Number of threads waiting to start
+  int thread;
+  int round;
+};
+
+// Insert the keys of one thread in random order, once all threads are
+// ready, so that they start on an empty list together.
+static void* InsertKeys(void* arg) {
+  InsertState* state = reinterpret_cast<InsertState*>(arg);
+  std::vector<Key> keys(kKeysPerThread);
+  for (int i = 0; i < kKeysPerThread; i++) {
+    keys[i] = static_cast<Key>(i) * kThreads + state->thread;
+  }
+  Random rnd(1 + state->round * kThreads + state->thread);
+  for (int i = kKeysPerThread - 1; i > 0; i--) {
+    std::swap(keys[i], keys[rnd.Uniform(i + 1)]);
+  }
+
+  void* ready;
+  do {
+    ready = state->ready->Acquire_Load();
+  } while (!state->ready->CompareAndSwap(
+      ready, reinterpret_cast<char*>(ready) - 1));
+  while (state->ready->Acquire_Load() != NULL) {
+  }
+  for (int i = 0; i < kKeysPerThread; i++) {
+    state->list->InsertConcurrently(keys[i]);
+  }
+  return NULL;
+}
+
+static void TestConcurrentInserts(int round) {
+  Arena arena;
+  TestComparator cmp;
+  TestList list(cmp, &arena);
+  port::AtomicPointer ready(reinterpret_cast<void*>(kThreads));
+
+  pthread_t threads[kThreads];
+  InsertState states[kThreads];
+  for (int t = 0; t < kThreads; t++) {
+    states[t].list = &list;
+    states[t].ready = &ready;
+    states[t].thread = t;
+    states[t].round = round;
+    Check(pthread_create(&threads[t], NULL, &InsertKeys, &states[t]) == 0,
+          "cannot create thread", round, 0);
+  }
+  for (int t = 0; t < kThreads; t++) {
+    pthread_join(threads[t], NULL);
+  }
+
+  // Level 0 holds every key, in order
+  const Key num_keys = static_cast<Key>(kThreads) * kKeysPerThread;
+  TestList::Iterator iter(&list);
+  Key expected = 0;
+  for (iter.SeekToFirst(); iter.Valid(); iter.Next(), expected++) {
+    Check(iter.key() == expected, "missing or misplaced key", round,
+          expected);
+  }
+  Check(expected == num_keys, "missing keys at the end", round, expected);
+
+  // Searches go through the upper levels, which must be ordered too
+  for (Key k = 0; k < num_keys; k++) {
+    Check(list.Contains(k), "key not found", round, k);
+    iter.Seek(k);
+    Check(iter.Valid() && iter.key() == k, "seek failed", round, k);
+  }
+  Check(!list.Contains(num_keys), "extra key found", round, num_keys);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  for (int round = 0; round < leveldb::kRounds; round++) {
+    leveldb::TestConcurrentInserts(round);
+  }
+  fprintf(stderr, "skiplist_test: PASS\n");
+  return 0;
+}
@@ -52,15 +52,15 @@ void SetSeekCompaction(bool enable) {
   kEnableSeekCompaction = enable;
 }
 
-uint64_t SetLevel0Factor(double factor) {
+void SetLevel0Factor(double factor) {
   kLevel0Factor = factor;
 }
 
-uint64_t SetLevelFactor(double factor) {
+void SetLevelFactor(double factor) {
   kLevelFactor = factor;
 }
 
-uint64_t SetMaxFileSizeForLevel(int64_t file_size) {
+void SetMaxFileSizeForLevel(int64_t file_size) {
   kTargetFileSize = file_size;
 }
 
@@ -288,27 +288,58 @@ enum SaverState {
   kFound,
   kDeleted,
   kCorrupt,
+  kMerging,
 };
 struct Saver {
   SaverState state;
+  Status status;      // Result of merging, if state == kFound
   const Comparator* ucmp;
   Slice user_key;
-  std::string* value;
+  void (*visitor)(void* arg, const Slice& value);
+  void* arg;
+  MergeContext* merge;
 };
 }
-static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
+// Returns true if the entry that follows ikey is wanted as well.
+static bool SaveValue(void* arg, const Slice& ikey, const Slice& v) {
   Saver* s = reinterpret_cast<Saver*>(arg);
   ParsedInternalKey parsed_key;
   if (!ParseInternalKey(ikey, &parsed_key)) {
     s->state = kCorrupt;
-  } else {
-    if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
-      if (s->state == kFound) {
-        s->value->assign(v.data(), v.size());
+    return false;
+  }
+  if (s->ucmp->Compare(parsed_key.user_key, s->user_key) != 0) {
+    return false;
+  }
+  switch (parsed_key.type) {
+    case kTypeValue:
+      s->state = kFound;
+      if (s->merge->operands.empty()) {
+        (*s->visitor)(s->arg, v);
+      } else {
+        s->status = s->merge->Finish(s->user_key, &v, s->visitor, s->arg);
       }
-    }
+      return false;
+    case kTypeDeletion:
+      if (s->merge->operands.empty()) {
+        s->state = kDeleted;
+      } else {
+        s->state = kFound;
+        s->status = s->merge->Finish(s->user_key, NULL, s->visitor, s->arg);
+      }
+      return false;
+    case kTypeMerge:
+      if (s->merge->merge_operator == NULL) {
+        s->state = kFound;
+        s->status = Status::NotSupported(
+            "merge operand without merge operator");
+        return false;
+      }
+      s->state = kMerging;
+      s->merge->operands.push_back(v.ToString());
+      return true;
   }
+  return false;
 }
 
 static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
@@ -317,7 +348,9 @@ static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
 
 Status Version::Get(const ReadOptions& options,
                     const LookupKey& k,
-                    std::string* value,
+                    void (*visitor)(void* arg, const Slice& value),
+                    void* arg,
+                    MergeContext* merge,
                     GetStats* stats) {
   Slice ikey = k.internal_key();
   Slice user_key = k.user_key();
@@ -332,8 +365,15 @@ Status Version::Get(const ReadOptions& options,
   // We can search level-by-level since entries never hop across
   // levels.  Therefore we are guaranteed that if we find data
   // in an smaller level, later levels are irrelevant.
+  Saver saver;
+  saver.state = kNotFound;
+  saver.ucmp = ucmp;
+  saver.user_key = user_key;
+  saver.visitor = visitor;
+  saver.arg = arg;
+  saver.merge = merge;
+
   std::vector<FileMetaData*> tmp;
-  FileMetaData* tmp2;
   for (int level = 0; level < config::kNumLevels; level++) {
     size_t num_files = files_[level].size();
     if (num_files == 0) continue;
@@ -363,14 +403,21 @@ Status Version::Get(const ReadOptions& options,
         files = NULL;
         num_files = 0;
       } else {
-        tmp2 = files[index];
-        if (ucmp->Compare(user_key, tmp2->smallest.user_key()) < 0) {
-          // All of "tmp2" is past any data for user_key
+        if (ucmp->Compare(user_key, files[index]->smallest.user_key()) < 0) {
+          // All of "files[index]" is past any data for user_key
           files = NULL;
           num_files = 0;
         } else {
-          files = &tmp2;
-          num_files = 1;
+          // Merge operands for user_key may run on into the next files
+          // of the level
+          uint32_t limit = index + 1;
+          while (limit < num_files &&
+                 ucmp->Compare(user_key,
+                               files[limit]->smallest.user_key()) == 0) {
+            limit++;
+          }
+          files = &files[index];
+          num_files = limit - index;
         }
       }
     }
@@ -386,11 +433,6 @@ Status Version::Get(const ReadOptions& options,
       last_file_read = f;
       last_file_read_level = level;
 
-      Saver saver;
-      saver.state = kNotFound;
-      saver.ucmp = ucmp;
-      saver.user_key = user_key;
-      saver.value = value;
       s = vset_->table_cache_->Get(options, f->number, f->file_size,
                                    ikey, &saver, SaveValue);
       if (!s.ok()) {
@@ -398,9 +440,10 @@ Status Version::Get(const ReadOptions& options,
       }
       switch (saver.state) {
         case kNotFound:
+        case kMerging:
           break;      // Keep searching in other files
         case kFound:
-          return s;
+          return saver.status;
         case kDeleted:
           s = Status::NotFound(Slice());  // Use empty error message for speed
           return s;
@@ -411,9 +454,174 @@ Status Version::Get(const ReadOptions& options,
     }
   }
 
+  if (!merge->operands.empty()) {
+    // Nothing underneath the merge operands
+    return merge->Finish(user_key, NULL, visitor, arg);
+  }
   return Status::NotFound(Slice());  // Use an empty error message for speed
 }
 
+static Status SaverResult(const Saver& saver) {
+  switch (saver.state) {
+    case kFound:
+      return saver.status;
+    case kCorrupt:
+      return Status::Corruption("corrupted key for ", saver.user_key);
+    case kMerging:
+      // Nothing underneath the merge operands
+      return saver.merge->Finish(saver.user_key, NULL,
+                                 saver.visitor, saver.arg);
+    default:
+      return Status::NotFound(Slice());  // Use an empty error message for speed
+  }
+}
+
+namespace {
+// The visitors of all the requests for one key, which is looked up once
+struct VisitorList {
+  std::vector<std::pair<void (*)(void*, const Slice&), void*> > visitors;
+};
+
+void VisitAll(void* arg, const Slice& value) {
+  VisitorList* list = reinterpret_cast<VisitorList*>(arg);
+  for (size_t i = 0; i < list->visitors.size(); i++) {
+    (*list->visitors[i].first)(list->visitors[i].second, value);
+  }
+}
+}  // namespace
+
+void Version::MultiGet(const ReadOptions& options, GetRequest* reqs, int n) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  TableCache* table_cache = vset_->table_cache_;
+
+  // Requests for the same key are next to each other.  Only the first of
+  // them is looked up, and its value goes to the visitors of them all.
+  std::vector<int> first(n);
+  std::vector<VisitorList> lists(n);
+  for (int i = 0; i < n; i++) {
+    first[i] = i;
+    if (i > 0 && ucmp->Compare(reqs[i].key->user_key(),
+                               reqs[first[i - 1]].key->user_key()) == 0) {
+      first[i] = first[i - 1];
+      VisitorList& list = lists[first[i]];
+      if (list.visitors.empty()) {
+        list.visitors.push_back(std::make_pair(reqs[first[i]].visitor,
+                                               reqs[first[i]].arg));
+      }
+      list.visitors.push_back(std::make_pair(reqs[i].visitor, reqs[i].arg));
+    }
+  }
+
+  std::vector<Saver> savers(n);
+  // Indexes of the requests still looking, in key order
+  std::vector<int> pending;
+  pending.reserve(n);
+  for (int i = 0; i < n; i++) {
+    if (first[i] != i) continue;
+    Saver& saver = savers[i];
+    saver.state = reqs[i].merge->operands.empty() ? kNotFound : kMerging;
+    saver.ucmp = ucmp;
+    saver.user_key = reqs[i].key->user_key();
+    if (lists[i].visitors.empty()) {
+      saver.visitor = reqs[i].visitor;
+      saver.arg = reqs[i].arg;
+    } else {
+      saver.visitor = VisitAll;
+      saver.arg = &lists[i];
+    }
+    saver.merge = reqs[i].merge;
+    pending.push_back(i);
+  }
+  std::vector<Slice> ikeys;
+  std::vector<void*> args;
+  std::vector<FileMetaData*> tmp;
+  Status s;
+  for (int level = 0; level < config::kNumLevels && !pending.empty(); level++) {
+    const std::vector<FileMetaData*>& files = files_[level];
+    if (files.empty()) continue;
+
+    if (level == 0) {
+      // Level-0 files may overlap each other.  Visit them from newest to
+      // oldest, each with the pending keys inside its range.
+      tmp = files;
+      std::sort(tmp.begin(), tmp.end(), NewestFirst);
+      for (size_t f = 0; f < tmp.size() && s.ok(); f++) {
+        ikeys.clear();
+        args.clear();
+        for (size_t j = 0; j < pending.size(); j++) {
+          Saver* saver = &savers[pending[j]];
+          if (saver->state != kNotFound && saver->state != kMerging) continue;
+          if (ucmp->Compare(saver->user_key, tmp[f]->smallest.user_key()) >= 0 &&
+              ucmp->Compare(saver->user_key, tmp[f]->largest.user_key()) <= 0) {
+            ikeys.push_back(reqs[pending[j]].key->internal_key());
+            args.push_back(saver);
+          }
+        }
+        if (!ikeys.empty()) {
+          s = table_cache->MultiGet(options, tmp[f]->number,
+                                    tmp[f]->file_size, ikeys.size(),
+                                    &ikeys[0], &args[0], SaveValue);
+        }
+      }
+    } else {
+      // The pending keys are sorted, so each file of the level gets a
+      // consecutive run of them.
+      size_t j = 0;
+      while (j < pending.size() && s.ok()) {
+        const LookupKey* key = reqs[pending[j]].key;
+        uint32_t index = FindFile(vset_->icmp_, files, key->internal_key());
+        if (index >= files.size()) break;   // Later keys are past the level
+        FileMetaData* f = files[index];
+        ikeys.clear();
+        args.clear();
+        for (; j < pending.size(); j++) {
+          const LookupKey* k = reqs[pending[j]].key;
+          if (vset_->icmp_.Compare(k->internal_key(), f->largest.Encode()) > 0) {
+            break;                            // Belongs to a later file
+          }
+          if (ucmp->Compare(k->user_key(), f->smallest.user_key()) >= 0) {
+            ikeys.push_back(k->internal_key());
+            args.push_back(&savers[pending[j]]);
+          }
+        }
+        if (ikeys.empty()) continue;
+        s = table_cache->MultiGet(options, f->number, f->file_size,
+                                  ikeys.size(), &ikeys[0], &args[0],
+                                  SaveValue);
+        // Merge operands for the last key may run on into the next files
+        Saver* last = reinterpret_cast<Saver*>(args.back());
+        for (uint32_t next = index + 1;
+             s.ok() && last->state == kMerging && next < files.size() &&
+             ucmp->Compare(last->user_key,
+                           files[next]->smallest.user_key()) == 0;
+             next++) {
+          s = table_cache->Get(options, files[next]->number,
+                               files[next]->file_size,
+                               ikeys.back(), last, SaveValue);
+        }
+      }
+    }
+    if (!s.ok()) break;
+
+    size_t still = 0;
+    for (size_t j = 0; j < pending.size(); j++) {
+      SaverState state = savers[pending[j]].state;
+      if (state == kNotFound || state == kMerging) {
+        pending[still++] = pending[j];
+      }
+    }
+    pending.resize(still);
+  }
+
+  for (int i = 0; i < n; i++) {
+    if (first[i] == i) {
+      *reqs[i].status = s.ok() ? SaverResult(savers[i]) : s;
+    } else {
+      *reqs[i].status = *reqs[first[i]].status;
+    }
+  }
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
   if (f != NULL) {
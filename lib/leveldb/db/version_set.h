@@ -56,10 +56,10 @@ extern bool SomeFileOverlapsRange(
     const Slice* largest_user_key);
 
 extern uint64_t MaxFileSizeForLevel(int level);
-extern uint64_t SetLevel0Factor(double factor);
-extern uint64_t SetLevelFactor(double factor);
+extern void SetLevel0Factor(double factor);
+extern void SetLevelFactor(double factor);
 extern void SetSeekCompaction(bool enable);
-extern uint64_t SetMaxFileSizeForLevel(int64_t file_size);
+extern void SetMaxFileSizeForLevel(int64_t file_size);
 
 class Version {
  public:
@@ -68,15 +68,34 @@ class Version {
   // REQUIRES: This version has been saved (see VersionSet::SaveTo)
   void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 
-  // Lookup the value for key.  If found, store it in *val and
-  // return OK.  Else return a non-OK status.  Fills *stats.
+  // Lookup the value for key.  If found, call (*visitor)(arg, value)
+  // and return OK.  Else return a non-OK status.  Merge operands are
+  // collected into *merge, which may already hold newer operands found
+  // in the memtables.  Fills *stats.
   // REQUIRES: lock is not held
   struct GetStats {
     FileMetaData* seek_file;
     int seek_file_level;
   };
-  Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
-             GetStats* stats);
+  Status Get(const ReadOptions&, const LookupKey& key,
+             void (*visitor)(void* arg, const Slice& value), void* arg,
+             MergeContext* merge, GetStats* stats);
+
+  // One key of a MultiGet(): where to send its value, the merge operands
+  // found for it so far, and where to store the outcome of its Get().
+  struct GetRequest {
+    const LookupKey* key;
+    void (*visitor)(void* arg, const Slice& value);
+    void* arg;
+    MergeContext* merge;
+    Status* status;
+  };
+
+  // Look up reqs[0,n-1], which must be sorted by user key, as Get()
+  // would, but visit each table once for all the keys it may hold.
+  // Duplicate keys are looked up once.  Does not charge seeks to files.
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, GetRequest* reqs, int n);
 
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
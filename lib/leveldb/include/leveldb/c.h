@@ -58,6 +58,7 @@ typedef struct leveldb_filelock_t      leveldb_filelock_t;
 typedef struct leveldb_filterpolicy_t  leveldb_filterpolicy_t;
 typedef struct leveldb_iterator_t      leveldb_iterator_t;
 typedef struct leveldb_logger_t        leveldb_logger_t;
+typedef struct leveldb_mergeoperator_t leveldb_mergeoperator_t;
 typedef struct leveldb_options_t       leveldb_options_t;
 typedef struct leveldb_randomfile_t    leveldb_randomfile_t;
 typedef struct leveldb_readoptions_t   leveldb_readoptions_t;
@@ -92,6 +93,13 @@ extern void leveldb_delete(
     const char* key, size_t keylen,
     char** errptr);
 
+extern void leveldb_merge(
+    leveldb_t* db,
+    const leveldb_writeoptions_t* options,
+    const char* key, size_t keylen,
+    const char* val, size_t vallen,
+    char** errptr);
+
 extern void leveldb_write(
     leveldb_t* db,
     const leveldb_writeoptions_t* options,
@@ -107,6 +115,31 @@ extern char* leveldb_get(
     size_t* vallen,
     char** errptr);
 
+/* Calls (*visitor)(arg, value, vallen) with the value stored for "key"
+   and returns 1, or returns 0 without calling it if not found.  The
+   value is not copied: it is only valid during the call. */
+extern unsigned char leveldb_get_with_visitor(
+    leveldb_t* db,
+    const leveldb_readoptions_t* options,
+    const char* key, size_t keylen,
+    void (*visitor)(void* arg, const char* value, size_t vallen),
+    void* arg,
+    char** errptr);
+
+/* Looks up keys_list[0..num_keys-1] in one batch.  Calls
+   (*visitor)(arg, i, value, vallen) for each key i that is found and
+   sets found[i] to whether it was.  Values are only valid during the
+   call.  Sets *errptr if any of the lookups failed. */
+extern void leveldb_multi_get_with_visitor(
+    leveldb_t* db,
+    const leveldb_readoptions_t* options,
+    int num_keys,
+    const char* const* keys_list, const size_t* keys_list_sizes,
+    void (*visitor)(void* arg, int index, const char* value, size_t vallen),
+    void* arg,
+    unsigned char* found,
+    char** errptr);
+
 extern int leveldb_exists(
     leveldb_t* db,
     const leveldb_readoptions_t* options,
@@ -159,6 +192,13 @@ extern void leveldb_bulkinsert(
     uint64_t max_sequence_number,
     char** errptr);
 
+extern void leveldb_pin_values(
+    leveldb_t* db,
+    const leveldb_readoptions_t* options,
+    const char* begin_key, size_t begin_key_len,
+    const char* end_key, size_t end_key_len,
+    char** errptr);
+
 /* Management operations */
 
 extern void leveldb_destroy_db(
@@ -198,6 +238,10 @@ extern void leveldb_writebatch_put(
 extern void leveldb_writebatch_delete(
     leveldb_writebatch_t*,
     const char* key, size_t klen);
+extern void leveldb_writebatch_merge(
+    leveldb_writebatch_t*,
+    const char* key, size_t klen,
+    const char* val, size_t vlen);
 extern void leveldb_writebatch_iterate(
     leveldb_writebatch_t*,
     void* state,
@@ -224,6 +268,9 @@ extern void leveldb_options_set_comparator(
 extern void leveldb_options_set_filter_policy(
     leveldb_options_t*,
     leveldb_filterpolicy_t*);
+extern void leveldb_options_set_merge_operator(
+    leveldb_options_t*,
+    leveldb_mergeoperator_t*);
 extern void leveldb_options_set_create_if_missing(
     leveldb_options_t*, unsigned char);
 extern void leveldb_options_set_error_if_exists(
@@ -235,6 +282,8 @@ extern void leveldb_options_set_info_log(leveldb_options_t*, leveldb_logger_t*);
 extern void leveldb_options_set_write_buffer_size(leveldb_options_t*, size_t);
 extern void leveldb_options_set_max_open_files(leveldb_options_t*, int);
 extern void leveldb_options_set_cache(leveldb_options_t*, leveldb_cache_t*);
+extern void leveldb_options_set_allow_mmap_reads(
+    leveldb_options_t*, unsigned char);
 extern void leveldb_options_set_block_size(leveldb_options_t*, size_t);
 extern void leveldb_options_set_block_restart_interval(leveldb_options_t*, int);
 extern void leveldb_options_set_server_id(leveldb_options_t*, int);
@@ -242,6 +291,13 @@ extern void leveldb_options_set_max_sst_file_size(leveldb_options_t*, int);
 extern void leveldb_options_set_level_zero_factor(leveldb_options_t*, double);
 extern void leveldb_options_set_level_factor(leveldb_options_t*, double);
 extern void leveldb_options_disable_compaction(leveldb_options_t*);
+extern void leveldb_options_set_allow_concurrent_memtable_write(
+    leveldb_options_t*, unsigned char);
+extern void leveldb_options_set_value_gc_interval(leveldb_options_t*, int);
+extern void leveldb_options_set_value_gc_garbage_percent(
+    leveldb_options_t*, int);
+extern void leveldb_options_set_value_gc_bytes_per_second(
+    leveldb_options_t*, uint64_t);
 
 enum {
   leveldb_no_compression = 0,
@@ -249,6 +305,13 @@ enum {
 };
 extern void leveldb_options_set_compression(leveldb_options_t*, int);
 
+enum {
+  leveldb_prefix_compressed_block = 0,
+  leveldb_fixed_key_block = 1,
+  leveldb_fixed_key_delta_block = 2
+};
+extern void leveldb_options_set_block_format(leveldb_options_t*, int);
+
 /* Comparator */
 
 extern leveldb_comparator_t* leveldb_comparator_create(
@@ -280,6 +343,33 @@ extern void leveldb_filterpolicy_destroy(leveldb_filterpolicy_t*);
 
 extern leveldb_filterpolicy_t* leveldb_filterpolicy_create_bloom(
     int bits_per_key);
+extern leveldb_filterpolicy_t* leveldb_filterpolicy_create_blocked_bloom(
+    int bits_per_key);
+extern leveldb_filterpolicy_t*
+    leveldb_filterpolicy_create_blocked_bloom_per_level(
+    const int* bits_per_level, int num_levels);
+
+/* Merge operator */
+
+/* full_merge gets the operands oldest first and existing_value is NULL
+ * if the key has no value beneath them.  It returns the merged value in
+ * a buffer allocated with malloc(), or sets *success to 0. */
+extern leveldb_mergeoperator_t* leveldb_mergeoperator_create(
+    void* state,
+    void (*destructor)(void*),
+    char* (*full_merge)(
+        void*,
+        const char* key, size_t key_length,
+        const char* existing_value, size_t existing_value_length,
+        const char* const* operands_list, const size_t* operands_list_length,
+        int num_operands,
+        unsigned char* success, size_t* new_value_length),
+    const char* (*name)(void*));
+extern void leveldb_mergeoperator_destroy(leveldb_mergeoperator_t*);
+/* Treat operands with no value beneath them as applying to a deleted
+ * key, so that they are dropped instead of passed to full_merge. */
+extern void leveldb_mergeoperator_set_drop_operands_without_value(
+    leveldb_mergeoperator_t*, unsigned char);
 
 /* Read options */
 
@@ -290,6 +380,12 @@ extern void leveldb_readoptions_set_verify_checksums(
     unsigned char);
 extern void leveldb_readoptions_set_fill_cache(
     leveldb_readoptions_t*, unsigned char);
+extern void leveldb_readoptions_set_scan_hint(
+    leveldb_readoptions_t*, unsigned char);
+extern void leveldb_readoptions_set_readahead_blocks(
+    leveldb_readoptions_t*, int);
+extern void leveldb_readoptions_set_prefetch_values(
+    leveldb_readoptions_t*, unsigned char);
 extern void leveldb_readoptions_set_snapshot(
     leveldb_readoptions_t*,
     const leveldb_snapshot_t*);
@@ -305,10 +401,14 @@ extern void leveldb_writeoptions_set_sync(
 
 extern leveldb_cache_t* leveldb_cache_create_lru(size_t capacity);
 extern void leveldb_cache_destroy(leveldb_cache_t* cache);
+extern void leveldb_cache_get_lookup_stats(
+    leveldb_cache_t* cache, uint64_t* lookups, uint64_t* hits);
 
 /* Env */
 
 extern leveldb_env_t* leveldb_create_default_env();
+/* Falls back to the default env when io_uring is not available */
+extern leveldb_env_t* leveldb_create_io_uring_env();
 #if defined(OS_LINUX)
 #if defined(HDFS)
 extern leveldb_env_t* leveldb_create_hdfs_env(const char* ip, int port);
@@ -319,6 +419,15 @@ extern leveldb_env_t* leveldb_create_pvfs_env(int buffer_size);
 #endif
 extern void leveldb_env_destroy(leveldb_env_t*);
 
+/* Lock profiling, for locks other than port::Mutex; see
+   port/lock_profile.h.  Counts one acquisition of a lock of class
+   "lock_class" under "tag". */
+
+extern uint64_t leveldb_lock_profile_now_nanos();
+extern void leveldb_lock_profile_record(
+    const char* lock_class, uint64_t tag,
+    uint64_t wait_nanos, uint64_t hold_nanos);
+
 /* TableBuilder */
 extern leveldb_tablebuilder_t* leveldb_tablebuilder_create(
     const leveldb_options_t* options,
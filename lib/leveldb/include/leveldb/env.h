@@ -48,6 +48,15 @@ class Env {
   static Env* PVFSEnv(int log_buffer_size = 4096);
 #endif
 
+  // Return an environment that moves the I/O of table files onto Linux
+  // io_uring: RandomAccessFile::Prefetch() submits all of its ranges
+  // with one system call, and table files are written out in the
+  // background.  Returns Default() when io_uring is not available.
+  //
+  // The result of IOUringEnv() belongs to leveldb and must never be
+  // deleted.
+  static Env* IOUringEnv();
+
   // Create a brand new sequentially-readable file with the specified name.
   // On success, stores a pointer to the new file in *result and returns OK.
   // On failure stores NULL in *result and returns non-OK.  If the file does
@@ -67,6 +76,15 @@ class Env {
   virtual Status NewRandomAccessFile(const std::string& fname,
                                      RandomAccessFile** result) = 0;
 
+  // Like NewRandomAccessFile(), but the returned file is never memory
+  // mapped: reads copy into the caller's scratch buffer, so that what is
+  // read can be cached.  The default implementation calls
+  // NewRandomAccessFile(), for Envs that never map files.
+  virtual Status NewUnmappedRandomAccessFile(const std::string& fname,
+                                             RandomAccessFile** result) {
+    return NewRandomAccessFile(fname, result);
+  }
+
   // Create an object that writes to a new file with the specified
   // name.  Deletes any existing file with the same name and creates a
   // new file.  On success, stores a pointer to the new file in
@@ -214,6 +232,14 @@ class RandomAccessFile {
   // Safe for concurrent use by multiple threads.
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const = 0;
+
+  // Hint that the "n" ranges of sizes[i] bytes at offsets[i] are about
+  // to be read, so that they can be fetched from storage all at once
+  // rather than one Read() at a time.  The default does nothing.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual void Prefetch(int n, const uint64_t* offsets,
+                        const size_t* sizes) const;
 };
 
 // A file abstraction for sequential writing.  The implementation
@@ -296,6 +322,10 @@ class EnvWrapper : public Env {
   Status NewRandomAccessFile(const std::string& f, RandomAccessFile** r) {
     return target_->NewRandomAccessFile(f, r);
   }
+  Status NewUnmappedRandomAccessFile(const std::string& f,
+                                     RandomAccessFile** r) {
+    return target_->NewUnmappedRandomAccessFile(f, r);
+  }
   Status NewWritableFile(const std::string& f, WritableFile** r) {
     return target_->NewWritableFile(f, r);
   }
@@ -312,9 +342,15 @@ class EnvWrapper : public Env {
   Status CopyFile(const std::string& s, const std::string& t) {
     return target_->CopyFile(s, t);
   }
+  Status SymlinkFile(const std::string& s, const std::string& t) {
+    return target_->SymlinkFile(s, t);
+  }
   Status RenameFile(const std::string& s, const std::string& t) {
     return target_->RenameFile(s, t);
   }
+  Status LinkFile(const std::string& s, const std::string& t) {
+    return target_->LinkFile(s, t);
+  }
   Status LockFile(const std::string& f, FileLock** l) {
     return target_->LockFile(f, l);
   }
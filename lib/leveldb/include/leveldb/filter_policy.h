@@ -36,10 +36,14 @@ class FilterPolicy {
   // that are ordered according to the user supplied comparator.
   // Append a filter that summarizes keys[0,n-1] to *dst.
   //
+  // "level" is the level of the table the filter is being built for,
+  // or -1 if it is not known.  Policies may use it to spend more or
+  // fewer bits on different levels.
+  //
   // Warning: do not change the initial contents of *dst.  Instead,
   // append the newly constructed filter to *dst.
   virtual void CreateFilter(const Slice* keys, int n, std::string* dst,
-                            bool lastLyaer)
+                            int level)
       const = 0;
 
   // "filter" contains the data appended by a preceding call to
@@ -68,6 +72,20 @@ extern const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
 
 extern const FilterPolicy* NewZigzagFilterPolicy(int bits_per_key);
 
+// Return a new filter policy that uses a cache-line blocked bloom filter:
+// every probe for a key falls within the same 64-byte block, so a lookup
+// costs one cache miss instead of one per probe.  The price is a
+// slightly higher false positive rate than NewBloomFilterPolicy() at the
+// same bits_per_key.  The same caveats about custom comparators apply.
+extern const FilterPolicy* NewBlockedBloomFilterPolicy(int bits_per_key);
+
+// Like above, but tables at level i use bits_per_level[i] bits per key.
+// Tables at levels >= num_levels, or whose level is not known, use
+// bits_per_level[num_levels-1].  Since most negative lookups reach the
+// deepest levels, giving those levels more bits saves the most I/O.
+extern const FilterPolicy* NewBlockedBloomFilterPolicy(
+    const int* bits_per_level, int num_levels);
+
 }
 
 #endif  // STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
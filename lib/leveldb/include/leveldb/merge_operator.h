@@ -0,0 +1,50 @@
+// Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A database can be configured with a custom MergeOperator object.
+// DB::Merge() then records an operand for a key without reading its
+// current value; the operands are applied to the value when the key is
+// read, and folded into it when compactions meet them together.  This
+// turns a read-modify-write into a single blind write.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+#define STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+
+#include <string>
+#include <vector>
+
+namespace leveldb {
+
+class Slice;
+
+class MergeOperator {
+ public:
+  virtual ~MergeOperator();
+
+  // Return the name of this operator.  If the encoding of operands
+  // changes in an incompatible way, the name must change too.
+  virtual const char* Name() const = 0;
+
+  // Apply "operands", oldest first, to "existing_value" and store the
+  // result in *new_value.  "existing_value" is NULL if the key has no
+  // value underneath the operands.
+  //
+  // Return false if the operands cannot be applied.  Reads of the key
+  // then fail with a corruption error, and compactions keep the
+  // operands as they are.
+  virtual bool FullMerge(const Slice& key,
+                         const Slice* existing_value,
+                         const std::vector<Slice>& operands,
+                         std::string* new_value) const = 0;
+
+  // Return true if operands with no value beneath them apply to a key
+  // that has been deleted.  FullMerge() is then never called without an
+  // existing value: reads find no value, iterators skip the key, and
+  // compactions drop the operands.  The default is false.
+  virtual bool DropsOperandsWithoutValue() const;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
@@ -0,0 +1,93 @@
+// Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Lock contention profiling.  In builds with LOCK_PROFILING defined,
+// every port::Mutex given a LockClass with Mutex::SetLockClass() counts
+// how long each Lock() waited and how long the mutex was then held
+// towards its class.  Wait and hold times are kept in log2 histograms
+// of nanoseconds, updated with atomic increments.
+//
+// Mutexes of a class may carry a tag, such as the id of the directory
+// they protect; the tags with the most wait time are kept with the
+// Space-Saving algorithm, so a tag out of the top ones may be reported
+// with the weight of the tag it replaced, but no tag with more wait
+// time than the smallest reported one is ever left out.
+
+#ifndef STORAGE_LEVELDB_PORT_LOCK_PROFILE_H_
+#define STORAGE_LEVELDB_PORT_LOCK_PROFILE_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace leveldb {
+namespace port {
+
+class LockClass {
+ public:
+  enum { kNumBuckets = 48 };   // Bucket i counts times in [2^(i-1), 2^i) ns
+  enum { kNumTopTags = 16 };
+
+  // Return the class named "name", creating it on first use.  Classes
+  // are never deleted.
+  static LockClass* Get(const char* name);
+
+  // Store all the classes created so far in *classes
+  static void GetAll(std::vector<LockClass*>* classes);
+
+  static uint64_t NowNanos();
+
+  const std::string& name() const { return name_; }
+
+  // Count one Lock() of a mutex tagged "tag" that waited wait_nanos and
+  // then held the mutex for hold_nanos.
+  void Record(uint64_t tag, uint64_t wait_nanos, uint64_t hold_nanos);
+
+  struct Stats {
+    uint64_t acquisitions;
+    uint64_t contended;        // Acquisitions that had to wait
+    uint64_t wait_nanos;
+    uint64_t hold_nanos;
+    uint64_t wait_buckets[kNumBuckets];
+    uint64_t hold_buckets[kNumBuckets];
+    // (wait nanos, tag) of the most waited for tags, largest first
+    std::vector<std::pair<uint64_t, uint64_t> > top_tags;
+
+    // Upper bound of the bucket holding the p'th fraction of the times
+    static uint64_t Percentile(const uint64_t* buckets, double p);
+  };
+
+  void GetStats(Stats* stats);
+
+ private:
+  explicit LockClass(const char* name);
+
+  const std::string name_;
+  LockClass* next_;            // Next in the list of all classes
+
+  uint64_t acquisitions_;
+  uint64_t contended_;
+  uint64_t wait_nanos_;
+  uint64_t hold_nanos_;
+  uint64_t wait_buckets_[kNumBuckets];
+  uint64_t hold_buckets_[kNumBuckets];
+
+  // Space-Saving counters of the wait time per tag.  A raw pthread
+  // mutex, so that it is not profiled itself; only taken on contention.
+  pthread_mutex_t tags_mu_;
+  int num_tags_;
+  uint64_t tags_[kNumTopTags * 4];
+  uint64_t tag_waits_[kNumTopTags * 4];
+
+  // No copying allowed
+  LockClass(const LockClass&);
+  void operator=(const LockClass&);
+};
+
+}  // namespace port
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_PORT_LOCK_PROFILE_H_
@@ -9,6 +9,7 @@
 #include <vector>
 #include <algorithm>
 #include "leveldb/comparator.h"
+#include "table/block_builder.h"
 #include "table/format.h"
 #include "util/coding.h"
 #include "util/logging.h"
@@ -23,9 +24,18 @@ inline uint32_t Block::NumRestarts() const {
 Block::Block(const BlockContents& contents)
     : data_(contents.data.data()),
       size_(contents.data.size()),
-      owned_(contents.heap_allocated) {
+      owned_(contents.heap_allocated),
+      fixed_(false),
+      delta_(false),
+      key_length_(0),
+      num_entries_(0),
+      reference_length_(0) {
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
+  } else if (NumRestarts() == kFixedKeyBlockMagic) {
+    InitFixedKeyLayout(false);
+  } else if (NumRestarts() == kFixedKeyDeltaBlockMagic) {
+    InitFixedKeyLayout(true);
   } else {
     restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
     if (restart_offset_ > size_ - sizeof(uint32_t)) {
@@ -36,6 +46,44 @@ Block::Block(const BlockContents& contents)
   }
 }
 
+void Block::InitFixedKeyLayout(bool delta) {
+  // Trailer: value_offsets[num_entries + 1], [reference_length,]
+  //          key_length, num_entries, magic
+  fixed_ = true;
+  delta_ = delta;
+  const uint64_t words = delta ? 5 : 4;
+  if (size_ < (words + 1) * sizeof(uint32_t)) {
+    size_ = 0;
+    return;
+  }
+  if (delta) {
+    reference_length_ = DecodeFixed32(data_ + size_ - 4 * sizeof(uint32_t));
+  }
+  key_length_ = DecodeFixed32(data_ + size_ - 3 * sizeof(uint32_t));
+  num_entries_ = DecodeFixed32(data_ + size_ - 2 * sizeof(uint32_t));
+  const uint64_t trailer = (num_entries_ + words) * sizeof(uint32_t);
+  const uint64_t prefix = static_cast<uint64_t>(num_entries_) * key_length_ +
+                          reference_length_;
+  if (num_entries_ == 0 || trailer + prefix > size_) {
+    size_ = 0;
+    return;
+  }
+  restart_offset_ = size_ - trailer;
+  // The value offsets must be non-decreasing and lie between the end of
+  // the keys (and reference value) and the start of the offset array, so
+  // that the iterator can trust them.
+  uint32_t prev = prefix;
+  for (uint32_t i = 0; i <= num_entries_; i++) {
+    const uint32_t offset =
+        DecodeFixed32(data_ + restart_offset_ + i * sizeof(uint32_t));
+    if (offset < prev || offset > restart_offset_) {
+      size_ = 0;
+      return;
+    }
+    prev = offset;
+  }
+}
+
 Block::~Block() {
   if (owned_) {
     delete[] data_;
@@ -256,7 +304,149 @@ class Block::Iter : public Iterator {
   }
 };
 
+// Decode into *dst the value patch stored in [p, limit) against "ref".
+// Returns false if the patch is malformed.  See block_builder.cc.
+static bool DecodeValueDelta(const Slice& ref, const char* p,
+                             const char* limit, std::string* dst) {
+  uint32_t length;
+  if ((p = GetVarint32Ptr(p, limit, &length)) == NULL) return false;
+  const size_t n = std::min<size_t>(ref.size(), length);
+  const size_t num_groups = (n + 7) / 8;
+  const char* bitmap = p;
+  p += (num_groups + 7) / 8;
+  if (p > limit) return false;
+  dst->assign(ref.data(), n);
+  for (size_t g = 0; g < num_groups; g++) {
+    if ((bitmap[g / 8] & (1 << (g % 8))) == 0) continue;
+    if (p >= limit) return false;
+    const unsigned char mask = static_cast<unsigned char>(*p++);
+    for (size_t i = 0; i < 8; i++) {
+      if (mask & (1 << i)) {
+        if (p >= limit || g * 8 + i >= n) return false;
+        (*dst)[g * 8 + i] = *p++;
+      }
+    }
+  }
+  if (static_cast<size_t>(limit - p) < length - n) return false;
+  dst->append(p, length - n);
+  return true;
+}
+
+// Iterator over a kFixedKeyBlock or kFixedKeyDeltaBlock block.  Entries
+// are addressed by index, so seeking is a plain binary search over the
+// key array and no key needs to be decoded or copied.
+class Block::FixedIter : public Iterator {
+ private:
+  const Comparator* const comparator_;
+  const char* const data_;        // underlying block contents
+  uint32_t const value_offsets_;  // Offset of value offset array
+  uint32_t const key_length_;
+  uint32_t const num_entries_;
+  Slice const reference_;         // Delta reference value, if any
+  bool const delta_;
+
+  // current_ is the index of the current entry.  == num_entries_ if !Valid
+  uint32_t current_;
+  uint32_t decoded_;              // Index of the entry held in value_
+  std::string value_;             // Decoded value of a delta block
+  Status status_;
+
+  inline uint32_t ValueOffset(uint32_t index) const {
+    return DecodeFixed32(data_ + value_offsets_ + index * sizeof(uint32_t));
+  }
+
+ public:
+  FixedIter(const Comparator* comparator,
+            const char* data,
+            uint32_t value_offsets,
+            uint32_t key_length,
+            uint32_t num_entries,
+            const Slice& reference,
+            bool delta)
+      : comparator_(comparator),
+        data_(data),
+        value_offsets_(value_offsets),
+        key_length_(key_length),
+        num_entries_(num_entries),
+        reference_(reference),
+        delta_(delta),
+        current_(num_entries),
+        decoded_(num_entries) {
+    assert(num_entries_ > 0);
+  }
+
+  virtual bool Valid() const { return current_ < num_entries_; }
+  virtual Status status() const { return status_; }
+  virtual Slice internalkey() const {
+    assert(Valid());
+    return key();
+  }
+  virtual Slice key() const {
+    assert(Valid());
+    return Slice(data_ + current_ * key_length_, key_length_);
+  }
+  virtual Slice value() {
+    assert(Valid());
+    const uint32_t offset = ValueOffset(current_);
+    const uint32_t limit = ValueOffset(current_ + 1);
+    if (!delta_) {
+      return Slice(data_ + offset, limit - offset);
+    }
+    if (decoded_ != current_) {
+      if (!DecodeValueDelta(reference_, data_ + offset, data_ + limit,
+                            &value_)) {
+        status_ = Status::Corruption("bad value in block");
+        value_.clear();
+      }
+      decoded_ = current_;
+    }
+    return value_;
+  }
+
+  virtual void Next() {
+    assert(Valid());
+    current_++;
+  }
+
+  virtual void Prev() {
+    assert(Valid());
+    current_ = (current_ == 0) ? num_entries_ : current_ - 1;
+  }
+
+  virtual void Seek(const Slice& target) {
+    // Binary search for the first key >= target
+    uint32_t left = 0;
+    uint32_t right = num_entries_;
+    while (left < right) {
+      uint32_t mid = left + (right - left) / 2;
+      Slice mid_key(data_ + mid * key_length_, key_length_);
+      if (comparator_->Compare(mid_key, target) < 0) {
+        left = mid + 1;
+      } else {
+        right = mid;
+      }
+    }
+    current_ = left;
+  }
+
+  virtual void SeekToFirst() {
+    current_ = 0;
+  }
+
+  virtual void SeekToLast() {
+    current_ = num_entries_ - 1;
+  }
+};
+
 Iterator* Block::NewIterator(const Comparator* cmp) {
+  if (fixed_) {
+    if (size_ == 0) {
+      return NewErrorIterator(Status::Corruption("bad block contents"));
+    }
+    Slice reference(data_ + num_entries_ * key_length_, reference_length_);
+    return new FixedIter(cmp, data_, restart_offset_, key_length_,
+                         num_entries_, reference, delta_);
+  }
   if (size_ < 2*sizeof(uint32_t)) {
     return NewErrorIterator(Status::Corruption("bad block contents"));
   }
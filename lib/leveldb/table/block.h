@@ -26,17 +26,28 @@ class Block {
 
  private:
   uint32_t NumRestarts() const;
+  void InitFixedKeyLayout(bool delta);
 
   const char* data_;
   size_t size_;
   uint32_t restart_offset_;     // Offset in data_ of restart array
   bool owned_;                  // Block owns data_[]
 
+  // Set for blocks in the kFixedKeyBlock layout, in which case
+  // restart_offset_ is the offset of the value offset array instead.
+  // delta_ is also set for the kFixedKeyDeltaBlock layout.
+  bool fixed_;
+  bool delta_;
+  uint32_t key_length_;
+  uint32_t num_entries_;
+  uint32_t reference_length_;   // Length of the delta reference value
+
   // No copying allowed
   Block(const Block&);
   void operator=(const Block&);
 
   class Iter;
+  class FixedIter;
 };
 
 }  // namespace leveldb
@@ -25,6 +25,41 @@
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+//
+// When options->block_format is kFixedKeyBlock and every key in the
+// block has the same length, the block is instead laid out as:
+//     keys: char[num_entries * key_length]
+//     values: char[]
+//     value_offsets: uint32[num_entries + 1]
+//     key_length: uint32
+//     num_entries: uint32
+//     magic: uint32 (kFixedKeyBlockMagic)
+// value_offsets[i] is the offset within the block of the ith value and
+// value_offsets[num_entries] is the end of the last one.  A block with
+// keys of different lengths is converted to the prefix-compressed form
+// as soon as the first mismatching key is added.
+//
+// kFixedKeyDeltaBlock blocks store the first value once, as a reference,
+// right after the keys, and every value as a patch against it:
+//     keys: char[num_entries * key_length]
+//     reference: char[reference_length]
+//     values: patch[]
+//     value_offsets: uint32[num_entries + 1]
+//     reference_length: uint32
+//     key_length: uint32
+//     num_entries: uint32
+//     magic: uint32 (kFixedKeyDeltaBlockMagic)
+// A patch has the form:
+//     value_length: varint32
+//     group_bitmap: char[(num_groups + 7) / 8]
+//     for each group set in group_bitmap:
+//         byte_mask: char
+//         bytes: char[number of bits set in byte_mask]
+//     tail: char[value_length - n]
+// where n = min(value_length, reference_length) and the n leading bytes
+// are split into num_groups = (n + 7) / 8 groups of 8 bytes.  A group is
+// present iff it differs from the reference, and byte_mask tells which
+// of its bytes do.
 
 #include "table/block_builder.h"
 
@@ -40,7 +75,10 @@ BlockBuilder::BlockBuilder(const Options* options)
     : options_(options),
       restarts_(),
       counter_(0),
-      finished_(false) {
+      finished_(false),
+      fixed_(options->block_format == kFixedKeyBlock ||
+             options->block_format == kFixedKeyDeltaBlock),
+      delta_(options->block_format == kFixedKeyDeltaBlock) {
   assert(options->block_restart_interval >= 1);
   restarts_.push_back(0);       // First restart point is at offset 0
 }
@@ -52,15 +90,93 @@ void BlockBuilder::Reset() {
   counter_ = 0;
   finished_ = false;
   last_key_.clear();
+  fixed_ = (options_->block_format == kFixedKeyBlock ||
+            options_->block_format == kFixedKeyDeltaBlock);
+  delta_ = (options_->block_format == kFixedKeyDeltaBlock);
+  keys_.clear();
+  value_offsets_.clear();
 }
 
 size_t BlockBuilder::CurrentSizeEstimate() const {
+  if (fixed_) {
+    return (keys_.size() +                                    // Keys
+            buffer_.size() +                                  // Values
+            (value_offsets_.size() + 1) * sizeof(uint32_t) +  // Offsets
+            3 * sizeof(uint32_t));                            // Trailer
+  }
   return (buffer_.size() +                        // Raw data buffer
           restarts_.size() * sizeof(uint32_t) +   // Restart array
           sizeof(uint32_t));                      // Restart array length
 }
 
+// Append to *dst the patch that turns "ref" into "value".
+static void EncodeValueDelta(const Slice& ref, const Slice& value,
+                             std::string* dst) {
+  PutVarint32(dst, value.size());
+  const size_t n = std::min(ref.size(), value.size());
+  const size_t num_groups = (n + 7) / 8;
+  const size_t bitmap = dst->size();
+  dst->resize(bitmap + (num_groups + 7) / 8, 0);
+  for (size_t g = 0; g < num_groups; g++) {
+    const size_t limit = std::min(n, g * 8 + 8);
+    unsigned char mask = 0;
+    for (size_t i = g * 8; i < limit; i++) {
+      if (value[i] != ref[i]) mask |= (1 << (i % 8));
+    }
+    if (mask != 0) {
+      (*dst)[bitmap + g / 8] |= static_cast<char>(1 << (g % 8));
+      dst->push_back(static_cast<char>(mask));
+      for (size_t i = g * 8; i < limit; i++) {
+        if (mask & (1 << (i % 8))) dst->push_back(value[i]);
+      }
+    }
+  }
+  dst->append(value.data() + n, value.size() - n);
+}
+
 Slice BlockBuilder::Finish() {
+  if (fixed_ && !value_offsets_.empty()) {
+    // Prepend the key array and append the value offsets.  Empty blocks
+    // keep the prefix-compressed form below.
+    const uint32_t num_entries = value_offsets_.size();
+    const uint32_t key_length = last_key_.size();
+    value_offsets_.push_back(buffer_.size());  // End of the last value
+    std::string block;
+    block.swap(keys_);
+    std::vector<uint32_t> offsets;
+    offsets.reserve(num_entries + 1);
+    const Slice ref(buffer_.data(), value_offsets_[1]);
+    if (delta_) {
+      block.append(ref.data(), ref.size());
+      for (uint32_t i = 0; i < num_entries; i++) {
+        offsets.push_back(block.size());
+        EncodeValueDelta(ref,
+                         Slice(buffer_.data() + value_offsets_[i],
+                               value_offsets_[i + 1] - value_offsets_[i]),
+                         &block);
+      }
+      offsets.push_back(block.size());
+    } else {
+      const uint32_t values_start = block.size();
+      block.append(buffer_);
+      for (uint32_t i = 0; i <= num_entries; i++) {
+        offsets.push_back(values_start + value_offsets_[i]);
+      }
+    }
+    for (size_t i = 0; i < offsets.size(); i++) {
+      PutFixed32(&block, offsets[i]);
+    }
+    if (delta_) {
+      PutFixed32(&block, ref.size());
+    }
+    PutFixed32(&block, key_length);
+    PutFixed32(&block, num_entries);
+    PutFixed32(&block, delta_ ? kFixedKeyDeltaBlockMagic : kFixedKeyBlockMagic);
+    buffer_.swap(block);
+    finished_ = true;
+    return Slice(buffer_);
+  }
+
   // Append restart array
   for (size_t i = 0; i < restarts_.size(); i++) {
     PutFixed32(&buffer_, restarts_[i]);
@@ -74,8 +190,19 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
   Slice last_key_piece(last_key_);
   assert(!finished_);
   assert(counter_ <= options_->block_restart_interval);
-  assert(buffer_.empty() // No values yet?
+  assert(empty() // No values yet?
          || options_->comparator->Compare(key, last_key_piece) > 0);
+  if (fixed_) {
+    if (value_offsets_.empty() || key.size() == last_key_.size()) {
+      keys_.append(key.data(), key.size());
+      value_offsets_.push_back(buffer_.size());
+      buffer_.append(value.data(), value.size());
+      last_key_.assign(key.data(), key.size());
+      return;
+    }
+    SwitchToPrefixCompressed();
+    last_key_piece = Slice(last_key_);
+  }
   size_t shared = 0;
   if (counter_ < options_->block_restart_interval) {
     // See how much sharing to do with previous string
@@ -106,4 +233,24 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
   counter_++;
 }
 
+void BlockBuilder::SwitchToPrefixCompressed() {
+  assert(fixed_);
+  std::string keys, values;
+  std::vector<uint32_t> value_offsets;
+  keys.swap(keys_);
+  values.swap(buffer_);
+  value_offsets.swap(value_offsets_);
+  const size_t key_length = last_key_.size();
+  last_key_.clear();
+  fixed_ = false;
+  delta_ = false;
+
+  value_offsets.push_back(values.size());
+  for (size_t i = 0; i + 1 < value_offsets.size(); i++) {
+    Add(Slice(keys.data() + i * key_length, key_length),
+        Slice(values.data() + value_offsets[i],
+              value_offsets[i + 1] - value_offsets[i]));
+  }
+}
+
 }  // namespace leveldb
@@ -14,6 +14,11 @@ namespace leveldb {
 
 struct Options;
 
+// Trailing word that marks a block in the fixed-key layout.  It can not
+// be mistaken for a restart count since the restart array would not fit.
+static const uint32_t kFixedKeyBlockMagic = 0xffffffffu;
+static const uint32_t kFixedKeyDeltaBlockMagic = 0xfffffffeu;
+
 class BlockBuilder {
  public:
   explicit BlockBuilder(const Options* options);
@@ -36,10 +41,14 @@ class BlockBuilder {
 
   // Return true iff no entries have been added since the last Reset()
   bool empty() const {
-    return buffer_.empty();
+    return buffer_.empty() && value_offsets_.empty();
   }
 
  private:
+  // Re-encode the entries added so far in the prefix-compressed format
+  // and use that format for the rest of the block.
+  void SwitchToPrefixCompressed();
+
   const Options*        options_;
   std::string           buffer_;      // Destination buffer
   std::vector<uint32_t> restarts_;    // Restart points
@@ -47,6 +56,12 @@ class BlockBuilder {
   bool                  finished_;    // Has Finish() been called?
   std::string           last_key_;
 
+  // State for the kFixedKeyBlock layout; buffer_ then holds the values.
+  bool                  fixed_;         // Still building a fixed-key block?
+  bool                  delta_;         // Delta-encode its values?
+  std::string           keys_;          // Fixed-stride key array
+  std::vector<uint32_t> value_offsets_; // Offset of each value in buffer_
+
   // No copying allowed
   BlockBuilder(const BlockBuilder&);
   void operator=(const BlockBuilder&);
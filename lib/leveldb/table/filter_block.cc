@@ -16,8 +16,8 @@ static const size_t kFilterBaseLg = 11;
 static const size_t kFilterBase = 1 << kFilterBaseLg;
 
 FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy,
-                                       bool lastLayer)
-    : policy_(policy), lastLayer_(lastLayer) {
+                                       int level)
+    : policy_(policy), level_(level) {
 }
 
 void FilterBlockBuilder::StartBlock(uint64_t block_offset) {
@@ -69,7 +69,7 @@ void FilterBlockBuilder::GenerateFilter() {
 
   // Generate filter for current set of keys and append to result_.
   filter_offsets_.push_back(result_.size());
-  policy_->CreateFilter(&tmp_keys_[0], num_keys, &result_, lastLayer_);
+  policy_->CreateFilter(&tmp_keys_[0], num_keys, &result_, level_);
 
   tmp_keys_.clear();
   keys_.clear();
@@ -4,6 +4,9 @@
 
 #include "leveldb/table.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
@@ -172,7 +175,8 @@ Iterator* Table::BlockReader(void* arg,
       EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
       EncodeFixed64(cache_key_buffer+8, handle.offset());
       Slice key(cache_key_buffer, sizeof(cache_key_buffer));
-      cache_handle = block_cache->Lookup(key);
+      cache_handle = options.scan_hint ? block_cache->LookupForScan(key)
+                                       : block_cache->Lookup(key);
       if (cache_handle != NULL) {
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
       } else {
@@ -207,19 +211,52 @@ Iterator* Table::BlockReader(void* arg,
   return iter;
 }
 
+// Called before a forward scan opens the data block of "index_value".
+// Data blocks are laid out one after the other, so ask the file for the
+// bytes of the next options.readahead_blocks blocks (estimated from the
+// size of this one) whenever less than half of that is still ahead of
+// *limit, the end of what the scan asked for last.
+void Table::Readahead(void* arg,
+                      const ReadOptions& options,
+                      const Slice& index_value,
+                      uint64_t* limit) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  BlockHandle handle;
+  Slice input = index_value;
+  if (!handle.DecodeFrom(&input).ok()) {
+    return;
+  }
+  const uint64_t block_size = handle.size() + kBlockTrailerSize;
+  const uint64_t next = handle.offset() + block_size;
+  const uint64_t window = block_size * options.readahead_blocks;
+  if (*limit >= next + window / 2) {
+    return;
+  }
+  const uint64_t start = std::max(next, *limit);
+  // The meta blocks follow the data blocks
+  const uint64_t end = std::min(next + window,
+                                table->rep_->metaindex_handle.offset());
+  if (start < end) {
+    const size_t size = end - start;
+    table->rep_->file->Prefetch(1, &start, &size);
+    *limit = end;
+  }
+}
+
 Iterator* Table::NewIterator(const ReadOptions& options) const {
   return NewTwoLevelIterator(
       rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+      &Table::BlockReader, const_cast<Table*>(this), options,
+      &Table::Readahead);
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k,
                           void* arg,
-                          void (*saver)(void*, const Slice&, const Slice&)) {
+                          bool (*saver)(void*, const Slice&, const Slice&)) {
   Status s;
   Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
-  iiter->Seek(k);
-  if (iiter->Valid()) {
+  bool more = true;
+  for (iiter->Seek(k); more && s.ok() && iiter->Valid(); iiter->Next()) {
     Slice handle_value = iiter->value();
     FilterBlockReader* filter = rep_->filter;
     BlockHandle handle;
@@ -227,17 +264,115 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k,
         handle.DecodeFrom(&handle_value).ok() &&
         !filter->KeyMayMatch(handle.offset(), k)) {
       // Not found
-    } else {
-      Slice handle = iiter->value();
-      Iterator* block_iter = BlockReader(this, options, iiter->value());
-      block_iter->Seek(k);
-      if (block_iter->Valid()) {
-        (*saver)(arg, block_iter->key(), block_iter->value());
+      break;
+    }
+    Iterator* block_iter = BlockReader(this, options, iiter->value());
+    for (block_iter->Seek(k); more && block_iter->Valid(); block_iter->Next()) {
+      more = (*saver)(arg, block_iter->key(), block_iter->value());
+    }
+    s = block_iter->status();
+    delete block_iter;
+  }
+  if (s.ok()) {
+    s = iiter->status();
+  }
+  delete iiter;
+  return s;
+}
+
+Status Table::InternalMultiGet(const ReadOptions& options,
+                               int n, const Slice* keys, void* const* args,
+                               bool (*saver)(void*, const Slice&,
+                                             const Slice&)) {
+  Status s;
+  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  FilterBlockReader* filter = rep_->filter;
+  Cache* block_cache = rep_->options.block_cache;
+
+  // First find the data block of every key.  The index values are
+  // copied out since delta-encoded index blocks decode them into the
+  // iterator.  An empty one means the filter ruled the key out.
+  std::vector<std::string> index_values(n);
+  int end = n;
+  std::vector<uint64_t> offsets;
+  std::vector<size_t> sizes;
+  uint64_t last_offset = ~static_cast<uint64_t>(0);
+  for (int i = 0; i < n; i++) {
+    iiter->Seek(keys[i]);
+    if (!iiter->Valid()) {
+      end = i;                // Later keys are past the table too
+      break;
+    }
+    Slice handle_value = iiter->value();
+    BlockHandle handle;
+    if (!handle.DecodeFrom(&handle_value).ok()) {
+      index_values[i] = iiter->value().ToString();   // BlockReader reports the error
+      continue;
+    }
+    if (filter != NULL && !filter->KeyMayMatch(handle.offset(), keys[i])) {
+      continue;               // Not found
+    }
+    index_values[i] = iiter->value().ToString();
+    if (handle.offset() == last_offset) {
+      continue;
+    }
+    last_offset = handle.offset();
+    if (block_cache != NULL) {
+      // Only a probe: BlockReader below makes the real lookup, so keep
+      // this one out of the hit stats and the protected segment
+      char cache_key_buffer[16];
+      EncodeFixed64(cache_key_buffer, rep_->cache_id);
+      EncodeFixed64(cache_key_buffer+8, handle.offset());
+      Cache::Handle* cache_handle = block_cache->LookupForScan(
+          Slice(cache_key_buffer, sizeof(cache_key_buffer)));
+      if (cache_handle != NULL) {
+        block_cache->Release(cache_handle);
+        continue;
       }
-      s = block_iter->status();
+    }
+    offsets.push_back(handle.offset());
+    sizes.push_back(handle.size() + kBlockTrailerSize);
+  }
+  // Let the file fetch all the missing blocks at once rather than one
+  // read at a time below
+  if (offsets.size() > 1) {
+    rep_->file->Prefetch(offsets.size(), &offsets[0], &sizes[0]);
+  }
+
+  Iterator* block_iter = NULL;
+  Slice block_handle;         // Handle of the block under block_iter
+  for (int i = 0; i < end && s.ok(); i++) {
+    const Slice& k = keys[i];
+    if (index_values[i].empty()) {
+      continue;
+    }
+    if (block_iter == NULL || Slice(index_values[i]) != block_handle) {
       delete block_iter;
+      block_iter = BlockReader(this, options, index_values[i]);
+      block_handle = index_values[i];
+    }
+    bool more = true;
+    for (block_iter->Seek(k); more && block_iter->Valid();
+         block_iter->Next()) {
+      more = (*saver)(args[i], block_iter->key(), block_iter->value());
+    }
+    s = block_iter->status();
+    if (!more || !s.ok()) {
+      continue;
+    }
+    // Merge operands may run on into the following blocks
+    iiter->Seek(k);
+    for (iiter->Next(); more && s.ok() && iiter->Valid(); iiter->Next()) {
+      Iterator* next_iter = BlockReader(this, options, iiter->value());
+      for (next_iter->SeekToFirst(); more && next_iter->Valid();
+           next_iter->Next()) {
+        more = (*saver)(args[i], next_iter->key(), next_iter->value());
+      }
+      s = next_iter->status();
+      delete next_iter;
     }
   }
+  delete block_iter;
   if (s.ok()) {
     s = iiter->status();
   }
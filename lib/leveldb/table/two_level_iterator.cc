@@ -14,6 +14,8 @@ namespace leveldb {
 namespace {
 
 typedef Iterator* (*BlockFunction)(void*, const ReadOptions&, const Slice&);
+typedef void (*ReadaheadFunction)(void*, const ReadOptions&, const Slice&,
+                                  uint64_t*);
 
 class TwoLevelIterator: public Iterator {
  public:
@@ -21,7 +23,8 @@ class TwoLevelIterator: public Iterator {
     Iterator* index_iter,
     BlockFunction block_function,
     void* arg,
-    const ReadOptions& options);
+    const ReadOptions& options,
+    ReadaheadFunction readahead_function);
 
   virtual ~TwoLevelIterator();
 
@@ -65,8 +68,11 @@ class TwoLevelIterator: public Iterator {
   void SkipEmptyDataBlocksBackward();
   void SetDataIterator(Iterator* data_iter);
   void InitDataBlock();
+  void Readahead();
 
   BlockFunction block_function_;
+  ReadaheadFunction readahead_function_;
+  uint64_t readahead_limit_;
   void* arg_;
   const ReadOptions options_;
   Status status_;
@@ -81,8 +87,11 @@ TwoLevelIterator::TwoLevelIterator(
     Iterator* index_iter,
     BlockFunction block_function,
     void* arg,
-    const ReadOptions& options)
+    const ReadOptions& options,
+    ReadaheadFunction readahead_function)
     : block_function_(block_function),
+      readahead_function_(readahead_function),
+      readahead_limit_(0),
       arg_(arg),
       options_(options),
       index_iter_(index_iter),
@@ -94,6 +103,8 @@ TwoLevelIterator::~TwoLevelIterator() {
 
 void TwoLevelIterator::Seek(const Slice& target) {
   index_iter_.Seek(target);
+  readahead_limit_ = 0;
+  Readahead();
   InitDataBlock();
   if (data_iter_.iter() != NULL) data_iter_.Seek(target);
   SkipEmptyDataBlocksForward();
@@ -101,6 +112,8 @@ void TwoLevelIterator::Seek(const Slice& target) {
 
 void TwoLevelIterator::SeekToFirst() {
   index_iter_.SeekToFirst();
+  readahead_limit_ = 0;
+  Readahead();
   InitDataBlock();
   if (data_iter_.iter() != NULL) data_iter_.SeekToFirst();
   SkipEmptyDataBlocksForward();
@@ -108,6 +121,7 @@ void TwoLevelIterator::SeekToFirst() {
 
 void TwoLevelIterator::SeekToLast() {
   index_iter_.SeekToLast();
+  readahead_limit_ = 0;
   InitDataBlock();
   if (data_iter_.iter() != NULL) data_iter_.SeekToLast();
   SkipEmptyDataBlocksBackward();
@@ -134,6 +148,7 @@ void TwoLevelIterator::SkipEmptyDataBlocksForward() {
       return;
     }
     index_iter_.Next();
+    Readahead();
     InitDataBlock();
     if (data_iter_.iter() != NULL) data_iter_.SeekToFirst();
   }
@@ -173,14 +188,24 @@ void TwoLevelIterator::InitDataBlock() {
   }
 }
 
+void TwoLevelIterator::Readahead() {
+  if (readahead_function_ != NULL && options_.readahead_blocks > 0 &&
+      index_iter_.Valid()) {
+    (*readahead_function_)(arg_, options_, index_iter_.value(),
+                           &readahead_limit_);
+  }
+}
+
 }  // namespace
 
 Iterator* NewTwoLevelIterator(
     Iterator* index_iter,
     BlockFunction block_function,
     void* arg,
-    const ReadOptions& options) {
-  return new TwoLevelIterator(index_iter, block_function, arg, options);
+    const ReadOptions& options,
+    ReadaheadFunction readahead_function) {
+  return new TwoLevelIterator(index_iter, block_function, arg, options,
+                              readahead_function);
 }
 
 }  // namespace leveldb
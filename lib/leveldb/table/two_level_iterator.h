@@ -5,6 +5,7 @@
 #ifndef STORAGE_LEVELDB_TABLE_TWO_LEVEL_ITERATOR_H_
 #define STORAGE_LEVELDB_TABLE_TWO_LEVEL_ITERATOR_H_
 
+#include <stdint.h>
 #include "leveldb/iterator.h"
 
 namespace leveldb {
@@ -20,6 +21,11 @@ struct ReadOptions;
 //
 // Uses a supplied function to convert an index_iter value into
 // an iterator over the contents of the corresponding block.
+//
+// If options.readahead_blocks is positive, "readahead_function" (if
+// any) is called with the index value of every block that a forward
+// move is about to open.  "*limit" belongs to the iterator: it starts
+// at 0 and may be used to remember how far ahead was already asked for.
 extern Iterator* NewTwoLevelIterator(
     Iterator* index_iter,
     Iterator* (*block_function)(
@@ -27,7 +33,12 @@ extern Iterator* NewTwoLevelIterator(
         const ReadOptions& options,
         const Slice& index_value),
     void* arg,
-    const ReadOptions& options);
+    const ReadOptions& options,
+    void (*readahead_function)(
+        void* arg,
+        const ReadOptions& options,
+        const Slice& index_value,
+        uint64_t* limit) = NULL);
 
 }  // namespace leveldb
 
@@ -33,8 +33,8 @@ class BloomFilterPolicy : public FilterPolicy {
   }
 
   virtual void CreateFilter(const Slice* keys, int n, std::string* dst,
-                            bool lastLayer) const {
-    (void) lastLayer;
+                            int level) const {
+    (void) level;
     // Compute bloom filter size (in both bits and bytes)
     size_t bits = n * bits_per_key_;
 
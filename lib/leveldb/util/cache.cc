@@ -7,6 +7,7 @@
 #include <stdlib.h>
 
 #include "leveldb/cache.h"
+#include "port/lock_profile.h"
 #include "port/port.h"
 #include "util/hash.h"
 #include "util/mutexlock.h"
@@ -16,12 +17,21 @@ namespace leveldb {
 Cache::~Cache() {
 }
 
+Cache::Handle* Cache::LookupForScan(const Slice& key) {
+  return Lookup(key);
+}
+
+void Cache::GetLookupStats(uint64_t* lookups, uint64_t* hits) {
+  *lookups = 0;
+  *hits = 0;
+}
+
 namespace {
 
 // LRU cache implementation
 
 // An entry is a variable length heap-allocated structure.  Entries
-// are kept in a circular doubly linked list ordered by access time.
+// are kept in circular doubly linked lists ordered by access time.
 struct LRUHandle {
   void* value;
   void (*deleter)(const Slice&, void* value);
@@ -32,6 +42,7 @@ struct LRUHandle {
   size_t key_length;
   uint32_t refs;
   uint32_t hash;      // Hash of key(); used for fast sharding and comparisons
+  bool in_protected;  // On the protected rather than probationary list?
   char key_data[1];   // Beginning of key
 
   Slice key() const {
@@ -133,6 +144,15 @@ class HandleTable {
 };
 
 // A single shard of sharded cache.
+//
+// Entries are kept in two LRU lists, as in a segmented LRU.  New entries
+// start out in the probationary segment and are moved to the protected
+// segment the first time they are looked up again.  When the protected
+// segment outgrows its share of the capacity its oldest entries are
+// moved back to the newest end of the probationary segment.  Eviction
+// takes the oldest probationary entries first, so a long run of entries
+// that are used only once (e.g., the blocks of a large scan) cycles
+// through the probationary segment without flushing the protected one.
 class LRUCache {
  public:
   LRUCache();
@@ -145,44 +165,62 @@ class LRUCache {
   Cache::Handle* Insert(const Slice& key, uint32_t hash,
                         void* value, size_t charge,
                         void (*deleter)(const Slice& key, void* value));
-  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash, bool scan);
   void Release(Cache::Handle* handle);
   void Erase(const Slice& key, uint32_t hash);
+  void AddLookupStats(uint64_t* lookups, uint64_t* hits);
 
  private:
   void LRU_Remove(LRUHandle* e);
-  void LRU_Append(LRUHandle* e);
+  void LRU_Append(LRUHandle* list, LRUHandle* e);
+  void Detach(LRUHandle* e);
   void Unref(LRUHandle* e);
 
+  // Fraction of the capacity the protected segment may use.
+  static const int kProtectedPercent = 80;
+
   // Initialized before use.
   size_t capacity_;
 
   // mutex_ protects the following state.
   port::Mutex mutex_;
   size_t usage_;
+  size_t protected_usage_;
   uint64_t last_id_;
+  uint64_t lookups_;              // Lookup() calls, excluding scans
+  uint64_t hits_;
 
-  // Dummy head of LRU list.
+  // Dummy heads of the probationary and protected LRU lists.
   // lru.prev is newest entry, lru.next is oldest entry.
   LRUHandle lru_;
+  LRUHandle protected_;
 
   HandleTable table_;
 };
 
 LRUCache::LRUCache()
     : usage_(0),
-      last_id_(0) {
-  // Make empty circular linked list
+      protected_usage_(0),
+      last_id_(0),
+      lookups_(0),
+      hits_(0) {
+  mutex_.SetLockClass(port::LockClass::Get("lru_cache"));
+  // Make empty circular linked lists
   lru_.next = &lru_;
   lru_.prev = &lru_;
+  protected_.next = &protected_;
+  protected_.prev = &protected_;
 }
 
 LRUCache::~LRUCache() {
-  for (LRUHandle* e = lru_.next; e != &lru_; ) {
-    LRUHandle* next = e->next;
-    assert(e->refs == 1);  // Error if caller has an unreleased handle
-    Unref(e);
-    e = next;
+  LRUHandle* lists[2] = { &lru_, &protected_ };
+  for (int i = 0; i < 2; i++) {
+    for (LRUHandle* e = lists[i]->next; e != lists[i]; ) {
+      LRUHandle* next = e->next;
+      assert(e->refs == 1);  // Error if caller has an unreleased handle
+      Unref(e);
+      e = next;
+    }
   }
 }
 
@@ -201,21 +239,52 @@ void LRUCache::LRU_Remove(LRUHandle* e) {
   e->prev->next = e->next;
 }
 
-void LRUCache::LRU_Append(LRUHandle* e) {
-  // Make "e" newest entry by inserting just before lru_
-  e->next = &lru_;
-  e->prev = lru_.prev;
+void LRUCache::LRU_Append(LRUHandle* list, LRUHandle* e) {
+  // Make "e" newest entry by inserting just before *list
+  e->next = list;
+  e->prev = list->prev;
   e->prev->next = e;
   e->next->prev = e;
 }
 
-Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
+// Remove "e" from whichever list it is on.
+void LRUCache::Detach(LRUHandle* e) {
+  LRU_Remove(e);
+  if (e->in_protected) {
+    protected_usage_ -= e->charge;
+    e->in_protected = false;
+  }
+}
+
+Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash,
+                                bool scan) {
   MutexLock l(&mutex_);
   LRUHandle* e = table_.Lookup(key, hash);
+  if (!scan) {
+    lookups_++;
+    hits_ += (e != NULL);
+  }
   if (e != NULL) {
     e->refs++;
-    LRU_Remove(e);
-    LRU_Append(e);
+    if (scan) {
+      // A scan does not count as reuse: keep probationary entries
+      // probationary and leave protected ones where they are.
+      if (!e->in_protected) {
+        LRU_Remove(e);
+        LRU_Append(&lru_, e);
+      }
+    } else {
+      Detach(e);
+      LRU_Append(&protected_, e);
+      e->in_protected = true;
+      protected_usage_ += e->charge;
+      const size_t limit = capacity_ / 100 * kProtectedPercent;
+      while (protected_usage_ > limit && protected_.next != e) {
+        LRUHandle* old = protected_.next;
+        Detach(old);
+        LRU_Append(&lru_, old);
+      }
+    }
   }
   return reinterpret_cast<Cache::Handle*>(e);
 }
@@ -238,19 +307,27 @@ Cache::Handle* LRUCache::Insert(
   e->key_length = key.size();
   e->hash = hash;
   e->refs = 2;  // One from LRUCache, one for the returned handle
+  e->in_protected = false;
   memcpy(e->key_data, key.data(), key.size());
-  LRU_Append(e);
+  LRU_Append(&lru_, e);
   usage_ += charge;
 
   LRUHandle* old = table_.Insert(e);
   if (old != NULL) {
-    LRU_Remove(old);
+    Detach(old);
     Unref(old);
   }
 
-  while (usage_ > capacity_ && lru_.next != &lru_) {
-    LRUHandle* old = lru_.next;
-    LRU_Remove(old);
+  while (usage_ > capacity_) {
+    LRUHandle* old;
+    if (lru_.next != &lru_) {
+      old = lru_.next;
+    } else if (protected_.next != &protected_) {
+      old = protected_.next;
+    } else {
+      break;
+    }
+    Detach(old);
     table_.Remove(old->key(), old->hash);
     Unref(old);
   }
@@ -262,11 +339,17 @@ void LRUCache::Erase(const Slice& key, uint32_t hash) {
   MutexLock l(&mutex_);
   LRUHandle* e = table_.Remove(key, hash);
   if (e != NULL) {
-    LRU_Remove(e);
+    Detach(e);
     Unref(e);
   }
 }
 
+void LRUCache::AddLookupStats(uint64_t* lookups, uint64_t* hits) {
+  MutexLock l(&mutex_);
+  *lookups += lookups_;
+  *hits += hits_;
+}
+
 static const int kNumShardBits = 4;
 static const int kNumShards = 1 << kNumShardBits;
 
@@ -300,7 +383,11 @@ class ShardedLRUCache : public Cache {
   }
   virtual Handle* Lookup(const Slice& key) {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Lookup(key, hash);
+    return shard_[Shard(hash)].Lookup(key, hash, false);
+  }
+  virtual Handle* LookupForScan(const Slice& key) {
+    const uint32_t hash = HashSlice(key);
+    return shard_[Shard(hash)].Lookup(key, hash, true);
   }
   virtual void Release(Handle* handle) {
     LRUHandle* h = reinterpret_cast<LRUHandle*>(handle);
@@ -317,6 +404,13 @@ class ShardedLRUCache : public Cache {
     MutexLock l(&id_mutex_);
     return ++(last_id_);
   }
+  virtual void GetLookupStats(uint64_t* lookups, uint64_t* hits) {
+    *lookups = 0;
+    *hits = 0;
+    for (int s = 0; s < kNumShards; s++) {
+      shard_[s].AddLookupStats(lookups, hits);
+    }
+  }
 };
 
 }  // end anonymous namespace
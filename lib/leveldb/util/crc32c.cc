@@ -3,11 +3,19 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 //
 // A portable implementation of crc32c, optimized to handle
-// four bytes at a time.
+// four bytes at a time, and one that uses the SSE4.2 crc32 instruction
+// on three interleaved streams.  The latter is picked at run time if
+// the CPU has the instruction and it agrees with the former.
 
 #include "util/crc32c.h"
 
+#include <pthread.h>
 #include <stdint.h>
+#include <string.h>
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <cpuid.h>
+#define CRC32C_HAVE_SSE42_PATH
+#endif
 #include "util/coding.h"
 
 namespace leveldb {
@@ -283,7 +291,7 @@ static inline uint32_t LE_LOAD32(const uint8_t *p) {
   return DecodeFixed32(reinterpret_cast<const char*>(p));
 }
 
-uint32_t Extend(uint32_t crc, const char* buf, size_t size) {
+uint32_t ExtendPortable(uint32_t crc, const char* buf, size_t size) {
   const uint8_t *p = reinterpret_cast<const uint8_t *>(buf);
   const uint8_t *e = p + size;
   uint32_t l = crc ^ 0xffffffffu;
@@ -328,5 +336,207 @@ uint32_t Extend(uint32_t crc, const char* buf, size_t size) {
   return l ^ 0xffffffffu;
 }
 
+#if defined(CRC32C_HAVE_SSE42_PATH)
+
+// The crc32 instruction has a latency of three cycles but can start
+// one every cycle, so it is run on three streams of kLong (then kShort)
+// bytes at once.  The crcs of the streams are then combined by shifting
+// the first over the length of the next, which is a table lookup per
+// byte of crc using the tables built by InitZeros().
+static const size_t kLong = 8192;
+static const size_t kShort = 256;
+static uint32_t long_zeros_[4][256];
+static uint32_t short_zeros_[4][256];
+
+static inline uint64_t Crc32q(uint64_t crc, uint64_t v) {
+  __asm__("crc32q %1, %0" : "+r" (crc) : "rm" (v));
+  return crc;
+}
+
+static inline uint32_t Crc32b(uint32_t crc, uint8_t v) {
+  __asm__("crc32b %1, %0" : "+r" (crc) : "rm" (v));
+  return crc;
+}
+
+static inline uint64_t Load64(const uint8_t* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// Multiply the 32x32 GF(2) matrix "mat" by the vector "vec"
+static uint32_t MatrixTimes(const uint32_t* mat, uint32_t vec) {
+  uint32_t sum = 0;
+  while (vec) {
+    if (vec & 1) {
+      sum ^= *mat;
+    }
+    vec >>= 1;
+    mat++;
+  }
+  return sum;
+}
+
+static void MatrixSquare(uint32_t* square, const uint32_t* mat) {
+  for (int n = 0; n < 32; n++) {
+    square[n] = MatrixTimes(mat, mat[n]);
+  }
+}
+
+// Build the tables that advance a crc over "len" zero bytes, which is
+// how a crc is shifted past the stream that follows it.
+static void InitZeros(uint32_t zeros[][256], size_t len) {
+  // Operator for one zero bit, then square it up to one zero byte and
+  // on through the binary digits of len
+  uint32_t odd[32], even[32];
+  odd[0] = 0x82f63b78u;  // Reflected crc32c polynomial
+  uint32_t row = 1;
+  for (int n = 1; n < 32; n++) {
+    odd[n] = row;
+    row <<= 1;
+  }
+  MatrixSquare(even, odd);  // Two zero bits
+  MatrixSquare(odd, even);  // Four zero bits
+  uint32_t* op = odd;
+  do {
+    MatrixSquare(even, odd);
+    len >>= 1;
+    op = even;
+    if (len == 0) break;
+    MatrixSquare(odd, even);
+    len >>= 1;
+    op = odd;
+  } while (len);
+  for (uint32_t n = 0; n < 256; n++) {
+    zeros[0][n] = MatrixTimes(op, n);
+    zeros[1][n] = MatrixTimes(op, n << 8);
+    zeros[2][n] = MatrixTimes(op, n << 16);
+    zeros[3][n] = MatrixTimes(op, n << 24);
+  }
+}
+
+static inline uint32_t Shift(uint32_t zeros[][256], uint32_t crc) {
+  return zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff] ^
+         zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24];
+}
+
+static uint32_t ExtendSSE42(uint32_t crc, const char* buf, size_t size) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(buf);
+  uint64_t crc0 = crc ^ 0xffffffffu;
+
+  // Process bytes until p is 8-byte aligned
+  while (size > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0) {
+    crc0 = Crc32b(static_cast<uint32_t>(crc0), *p++);
+    size--;
+  }
+
+  // Process three streams of kLong, then of kShort, bytes at a time
+  while (size >= 3 * kLong) {
+    uint64_t crc1 = 0, crc2 = 0;
+    const uint8_t* end = p + kLong;
+    do {
+      crc0 = Crc32q(crc0, Load64(p));
+      crc1 = Crc32q(crc1, Load64(p + kLong));
+      crc2 = Crc32q(crc2, Load64(p + 2 * kLong));
+      p += 8;
+    } while (p < end);
+    crc0 = Shift(long_zeros_, static_cast<uint32_t>(crc0)) ^ crc1;
+    crc0 = Shift(long_zeros_, static_cast<uint32_t>(crc0)) ^ crc2;
+    p += 2 * kLong;
+    size -= 3 * kLong;
+  }
+  while (size >= 3 * kShort) {
+    uint64_t crc1 = 0, crc2 = 0;
+    const uint8_t* end = p + kShort;
+    do {
+      crc0 = Crc32q(crc0, Load64(p));
+      crc1 = Crc32q(crc1, Load64(p + kShort));
+      crc2 = Crc32q(crc2, Load64(p + 2 * kShort));
+      p += 8;
+    } while (p < end);
+    crc0 = Shift(short_zeros_, static_cast<uint32_t>(crc0)) ^ crc1;
+    crc0 = Shift(short_zeros_, static_cast<uint32_t>(crc0)) ^ crc2;
+    p += 2 * kShort;
+    size -= 3 * kShort;
+  }
+
+  // Process bytes 8 at a time, then the last few
+  while (size >= 8) {
+    crc0 = Crc32q(crc0, Load64(p));
+    p += 8;
+    size -= 8;
+  }
+  while (size > 0) {
+    crc0 = Crc32b(static_cast<uint32_t>(crc0), *p++);
+    size--;
+  }
+  return static_cast<uint32_t>(crc0) ^ 0xffffffffu;
+}
+
+static bool CPUHasSSE42() {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+  return (ecx & bit_SSE4_2) != 0;
+}
+
+// Check ExtendSSE42() against the portable code over every path it has:
+// unaligned heads, both stream lengths and short tails.
+static bool SSE42Agrees() {
+  const size_t n = 3 * kLong + 3 * kShort + 64;
+  char* buf = new char[n];
+  uint32_t seed = 301;
+  for (size_t i = 0; i < n; i++) {
+    seed = seed * 1103515245u + 12345u;
+    buf[i] = static_cast<char>(seed >> 16);
+  }
+  static const size_t kCases[][2] = {
+    { 0, 0 }, { 1, 7 }, { 3, 100 }, { 0, 3 * kShort },
+    { 5, 3 * kShort + 13 }, { 0, 3 * kLong }, { 7, n - 7 }, { 0, n }
+  };
+  bool ok = true;
+  for (size_t i = 0; i < sizeof(kCases) / sizeof(kCases[0]); i++) {
+    const char* data = buf + kCases[i][0];
+    const size_t len = kCases[i][1];
+    if (ExtendSSE42(0x12345678u, data, len) !=
+        ExtendPortable(0x12345678u, data, len)) {
+      ok = false;
+    }
+  }
+  delete [] buf;
+  return ok;
+}
+
+#endif  // CRC32C_HAVE_SSE42_PATH
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static bool accelerated = false;
+
+static void InitExtend() {
+#if defined(CRC32C_HAVE_SSE42_PATH)
+  if (CPUHasSSE42()) {
+    InitZeros(long_zeros_, kLong);
+    InitZeros(short_zeros_, kShort);
+    accelerated = SSE42Agrees();
+  }
+#endif
+}
+
+bool IsHardwareAccelerated() {
+  pthread_once(&once, InitExtend);
+  return accelerated;
+}
+
+uint32_t Extend(uint32_t crc, const char* buf, size_t size) {
+  pthread_once(&once, InitExtend);
+#if defined(CRC32C_HAVE_SSE42_PATH)
+  if (accelerated) {
+    return ExtendSSE42(crc, buf, size);
+  }
+#endif
+  return ExtendPortable(crc, buf, size);
+}
+
 }  // namespace crc32c
 }  // namespace leveldb
@@ -15,6 +15,10 @@ SequentialFile::~SequentialFile() {
 RandomAccessFile::~RandomAccessFile() {
 }
 
+void RandomAccessFile::Prefetch(int n, const uint64_t* offsets,
+                                const size_t* sizes) const {
+}
+
 WritableFile::~WritableFile() {
 }
 
@@ -2,6 +2,7 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
+#include <algorithm>
 #include <deque>
 #include <dirent.h>
 #include <errno.h>
@@ -88,6 +89,14 @@ class PosixRandomAccessFile: public RandomAccessFile {
     }
     return s;
   }
+
+  virtual void Prefetch(int n, const uint64_t* offsets,
+                        const size_t* sizes) const {
+    for (int i = 0; i < n; i++) {
+      posix_fadvise(fd_, static_cast<off_t>(offsets[i]),
+                    static_cast<off_t>(sizes[i]), POSIX_FADV_WILLNEED);
+    }
+  }
 };
 
 // mmap() based random-access
@@ -117,6 +126,20 @@ class PosixMmapReadableFile: public RandomAccessFile {
     }
     return s;
   }
+
+  virtual void Prefetch(int n, const uint64_t* offsets,
+                        const size_t* sizes) const {
+    const uintptr_t page_mask = getpagesize() - 1;
+    for (int i = 0; i < n; i++) {
+      if (offsets[i] >= length_) continue;
+      size_t size = std::min<uint64_t>(sizes[i], length_ - offsets[i]);
+      uintptr_t start = reinterpret_cast<uintptr_t>(mmapped_region_) +
+                        offsets[i];
+      uintptr_t aligned = start & ~page_mask;
+      madvise(reinterpret_cast<void*>(aligned), start + size - aligned,
+              MADV_WILLNEED);
+    }
+  }
 };
 
 // We preallocate up to an extra megabyte and use memcpy to append new
@@ -385,9 +408,8 @@ class PosixEnv : public Env {
     }
   }
 
-  /*
-  virtual Status NewRandomAccessFile(const std::string& fname,
-                                     RandomAccessFile** result) {
+  virtual Status NewUnmappedRandomAccessFile(const std::string& fname,
+                                             RandomAccessFile** result) {
     *result = NULL;
     Status s;
     int fd = open(fname.c_str(), O_RDONLY);
@@ -398,7 +420,6 @@ class PosixEnv : public Env {
     }
     return s;
   }
-  */
 
   virtual Status NewRandomAccessFile(const std::string& fname,
                                      RandomAccessFile** result) {
@@ -19,17 +19,24 @@ Options::Options()
       write_buffer_size(4<<20),
       max_open_files(1000),
       block_cache(NULL),
+      allow_mmap_reads(true),
       block_size(4096),
       block_restart_interval(16),
+      block_format(kPrefixCompressedBlock),
       compression(kSnappyCompression),
       filter_policy(NULL),
+      merge_operator(NULL),
       disable_write_ahead_log(false),
       server_id(0),
       max_sst_file_size(16<<20),
       level_zero_factor(10.0),
       level_factor(10.0),
       enable_monitor_thread(true),
-      disable_compaction(false) {
+      disable_compaction(false),
+      allow_concurrent_memtable_write(false),
+      value_gc_interval(0),
+      value_gc_garbage_percent(50),
+      value_gc_bytes_per_second(16<<20) {
 }
 
 
@@ -4,6 +4,7 @@
 
 #include "leveldb/filter_policy.h"
 
+#include "db/dbformat.h"
 #include "leveldb/slice.h"
 #include "util/hash.h"
 #include "util/coding.h"
@@ -83,7 +84,8 @@ class ZigzagFilterPolicy : public FilterPolicy {
   }
 
   virtual void CreateFilter(const Slice* keys, int n, std::string* dst,
-                            bool lastLayer) const {
+                            int level) const {
+      const bool lastLayer = level + 1 >= config::kNumLevels;
       if (!lastLayer) {
         CreateFullIndex(keys, n, dst);
         dst->push_back(static_cast<char>(kFullIndex));
@@ -0,0 +1,342 @@
+// Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Runs a whole IndexFS cluster within one process: a number of metadata
+// servers listening on consecutive loopback ports, each with its own
+// backend under a fresh temporary directory, and a number of client
+// threads talking to them over real RPCs.  The clients run a fixed
+// workload, exercising cross-server mkdir and splitting a shared
+// directory, and the harness reports the throughput of each phase along
+// with per-server counters.  Runs are reproducible: every run starts
+// from an empty file system and issues the same operations.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sstream>
+#include <gflags/gflags.h>
+
+#include "common/config.h"
+#include "common/logging.h"
+#include "server_instance.h"
+
+namespace indexfs {
+
+DEFINE_int32(servers, 4,
+    "Number of metadata servers to run");
+
+DEFINE_int32(port, 46000,
+    "Port of the first server; the others use the following ports");
+
+DEFINE_int32(clients, 4,
+    "Number of client threads");
+
+DEFINE_int32(dirs, 16,
+    "Number of directories each client creates");
+
+DEFINE_int32(files, 4000,
+    "Number of files each client creates in the shared directory");
+
+DEFINE_int32(split_threshold, 1000,
+    "Number of entries at which a directory partition splits");
+
+DEFINE_string(root, "/tmp",
+    "Directory under which to create the servers' storage");
+
+DEFINE_bool(keep, false,
+    "Keep the servers' storage after the run");
+
+DEFINE_string(logfn, "cluster_harness",
+    "Set the IndexFS log file name");
+
+DEFINE_string(configfn, "",
+    "Unused; the servers are configured by the harness");
+
+DEFINE_string(srvlstfn, "",
+    "Unused; the servers are configured by the harness");
+
+#ifdef HDFS
+DEFINE_string(hconfigfn, "",
+    "Unused; the servers are configured by the harness");
+#endif
+
+namespace {
+
+static const char* kLoopback = "127.0.0.1";
+static const char* kSharedDir = "/shared";
+static const int kServerStartSecs = 10;
+
+struct Worker {
+  int id;
+  MetadataClient* client;
+  int ops;
+  int errors;
+};
+
+typedef void (*PhaseFunc)(Worker* worker);
+
+struct PhaseArg {
+  PhaseFunc func;
+  Worker* worker;
+};
+
+void CheckErrors(const Status &status) {
+  CHECK(status.ok()) << status.ToString();
+}
+
+void Count(Worker* worker, const Status &status) {
+  worker->ops++;
+  if (!status.ok()) {
+    worker->errors++;
+  }
+}
+
+std::string FileName(int client, int file) {
+  std::stringstream ss;
+  ss << kSharedDir << "/f" << client << "_" << file;
+  return ss.str();
+}
+
+// Each client makes a directory of its own, and directories under it;
+// new directories are spread over all servers, so most of these need the
+// server of the parent to set up the zeroth partition on another server.
+void MkdirPhase(Worker* worker) {
+  std::stringstream base;
+  base << "/c" << worker->id;
+  Count(worker, worker->client->Mkdir(base.str(), S_IRWXU | S_IRWXG));
+  for (int i = 0; i < FLAGS_dirs; ++i) {
+    std::stringstream ss;
+    ss << base.str() << "/d" << i;
+    Count(worker, worker->client->Mkdir(ss.str(), S_IRWXU | S_IRWXG));
+  }
+}
+
+// All clients create files in the same directory, splitting it over the
+// servers as it grows.
+void CreatePhase(Worker* worker) {
+  for (int i = 0; i < FLAGS_files; ++i) {
+    Count(worker, worker->client->Mknod(FileName(worker->id, i),
+                                        S_IRUSR | S_IWUSR));
+  }
+}
+
+void GetattrPhase(Worker* worker) {
+  StatInfo info;
+  for (int i = 0; i < FLAGS_files; ++i) {
+    Count(worker, worker->client->Getattr(FileName(worker->id, i), &info));
+  }
+}
+
+void* RunWorker(void* arg) {
+  PhaseArg* phase = reinterpret_cast<PhaseArg*>(arg);
+  phase->func(phase->worker);
+  return NULL;
+}
+
+// Run a phase on all workers at once, and report its throughput.
+// Returns the number of failed operations.
+int RunPhase(const char* name, PhaseFunc func, std::vector<Worker>* workers) {
+  std::vector<PhaseArg> args(workers->size());
+  std::vector<pthread_t> threads(workers->size());
+  uint64_t start = Env::Default()->NowMicros();
+  for (size_t i = 0; i < workers->size(); ++i) {
+    (*workers)[i].ops = 0;
+    (*workers)[i].errors = 0;
+    args[i].func = func;
+    args[i].worker = &(*workers)[i];
+    int ret = pthread_create(&threads[i], NULL, &RunWorker, &args[i]);
+    CHECK(ret == 0) << "Fail to create client thread: " << strerror(ret);
+  }
+  int ops = 0, errors = 0;
+  for (size_t i = 0; i < workers->size(); ++i) {
+    pthread_join(threads[i], NULL);
+    ops += (*workers)[i].ops;
+    errors += (*workers)[i].errors;
+  }
+  double secs = (Env::Default()->NowMicros() - start) / 1000000.0;
+  printf("%-10s %10d ops %8.3f s %12.1f ops/s %8d errors\n",
+         name, ops, secs, secs > 0 ? ops / secs : 0.0, errors);
+  return errors;
+}
+
+// Wait for a server to accept connections, as clients do not retry
+bool WaitForServer(int port) {
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, kLoopback, &addr.sin_addr);
+  for (int i = 0; i < kServerStartSecs * 10; ++i) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+      return false;
+    }
+    int ret = connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+                      sizeof(addr));
+    close(fd);
+    if (ret == 0) {
+      return true;
+    }
+    Env::Default()->SleepForMicroseconds(100000);
+  }
+  return false;
+}
+
+void RemoveTree(Env* env, const std::string &path) {
+  struct stat buf;
+  if (lstat(path.c_str(), &buf) != 0) {
+    return;
+  }
+  if (S_ISDIR(buf.st_mode)) {
+    std::vector<std::string> children;
+    env->GetChildren(path, &children);
+    for (size_t i = 0; i < children.size(); ++i) {
+      if (children[i] != "." && children[i] != "..") {
+        RemoveTree(env, path + "/" + children[i]);
+      }
+    }
+    env->DeleteDir(path);
+  } else {
+    env->DeleteFile(path);
+  }
+}
+
+void PrintServerStats(std::vector<ServerInstance*> &instances) {
+  static const char* kOps[] = { "mkdir", "createzeroth", "mknod",
+                                "split", "insertsplit" };
+  static const int kNumOps = sizeof(kOps) / sizeof(kOps[0]);
+  printf("\n%-6s", "server");
+  for (int k = 0; k < kNumOps; ++k) {
+    printf(" %12s", kOps[k]);
+  }
+  printf("\n");
+  for (size_t i = 0; i < instances.size(); ++i) {
+    ServerStats stats;
+    instances[i]->handler()->GetStats(stats);
+    printf("%-6d", stats.server_id);
+    for (int k = 0; k < kNumOps; ++k) {
+      int64_t count = 0;
+      for (size_t j = 0; j < stats.ops.size(); ++j) {
+        if (stats.ops[j].name == kOps[k]) {
+          count = stats.ops[j].count;
+        }
+      }
+      printf(" %12lld", static_cast<long long>(count));
+    }
+    printf("\n");
+  }
+}
+
+int RunCluster() {
+  Env* env = Env::Default();
+
+  char root_template[PATH_MAX];
+  snprintf(root_template, sizeof(root_template), "%s/indexfs-XXXXXX",
+           FLAGS_root.c_str());
+  CHECK(mkdtemp(root_template) != NULL)
+    << "Fail to create temporary directory under " << FLAGS_root;
+  std::string root = root_template;
+
+  // Splits are triggered by the servers, which read the threshold from
+  // the environment like the other server options
+  std::stringstream threshold;
+  threshold << FLAGS_split_threshold;
+  setenv("FS_DIR_SPLIT_THR", threshold.str().c_str(), 1);
+
+  std::vector<std::pair<std::string, int> > servers;
+  for (int i = 0; i < FLAGS_servers; ++i) {
+    servers.push_back(std::make_pair(std::string(kLoopback), FLAGS_port + i));
+  }
+
+  std::vector<Config*> configs;
+  std::vector<ServerInstance*> instances;
+  for (int i = 0; i < FLAGS_servers; ++i) {
+    std::stringstream ss;
+    ss << root << "/s" << i;
+    std::string dir = ss.str();
+    CheckErrors(env->CreateDir(dir));
+    Config* config = Config::CreateServerConfig();
+    CheckErrors(config->SetServerID(i));
+    CheckErrors(config->SetServers(servers));
+    CheckErrors(config->SetStorageDirs(dir + "/files", dir + "/split/",
+                                       dir + "/leveldb"));
+    ServerInstance* instance = new ServerInstance(config, env);
+    instance->Open();
+    instance->Start();
+    configs.push_back(config);
+    instances.push_back(instance);
+  }
+  for (int i = 0; i < FLAGS_servers; ++i) {
+    CHECK(WaitForServer(FLAGS_port + i))
+      << "Server " << i << " did not start on port " << FLAGS_port + i;
+  }
+
+  Config* client_config = Config::CreateClientConfig();
+  CheckErrors(client_config->SetServers(servers));
+  std::vector<Worker> workers(FLAGS_clients);
+  for (int i = 0; i < FLAGS_clients; ++i) {
+    workers[i].id = i;
+    workers[i].client = new MetadataClient(client_config);
+    CheckErrors(workers[i].client->Init());
+  }
+
+  printf("%d servers, %d clients, storage at %s\n\n",
+         FLAGS_servers, FLAGS_clients, root.c_str());
+  int errors = 0;
+  Status s = workers[0].client->Mkdir(kSharedDir, S_IRWXU | S_IRWXG);
+  if (!s.ok()) {
+    fprintf(stderr, "Cannot create %s: %s\n", kSharedDir,
+            s.ToString().c_str());
+    errors++;
+  } else {
+    errors += RunPhase("mkdir", &MkdirPhase, &workers);
+    errors += RunPhase("create", &CreatePhase, &workers);
+    errors += RunPhase("getattr", &GetattrPhase, &workers);
+
+    std::vector<std::string> entries;
+    s = workers[0].client->Readdir(kSharedDir, &entries);
+    size_t expected = static_cast<size_t>(FLAGS_clients) * FLAGS_files;
+    if (!s.ok() || entries.size() != expected) {
+      fprintf(stderr, "Readdir of %s found %d entries, expected %d: %s\n",
+              kSharedDir, static_cast<int>(entries.size()),
+              static_cast<int>(expected), s.ToString().c_str());
+      errors++;
+    }
+    PrintServerStats(instances);
+  }
+
+  for (int i = 0; i < FLAGS_clients; ++i) {
+    workers[i].client->Dispose();
+    delete workers[i].client;
+  }
+  delete client_config;
+  for (int i = 0; i < FLAGS_servers; ++i) {
+    instances[i]->Stop();
+    delete instances[i];
+    delete configs[i];
+  }
+  if (!FLAGS_keep) {
+    RemoveTree(env, root);
+  }
+  return errors == 0 ? 0 : 1;
+}
+
+} // namespace
+
+} // namespace indexfs
+
+int main(int argc, char* argv[]) {
+  google::SetUsageMessage("IndexFS In-Process Cluster Harness");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  indexfs::OpenServerLog(indexfs::GetLogFileName());
+  int ret = indexfs::RunCluster();
+  indexfs::CloseFSLog();
+  return ret;
+}
@@ -5,6 +5,7 @@
 #include <sstream>
 #include <algorithm>
 #include <fcntl.h>
+#include <stdlib.h>
 #include <cmath>
 #include "common/config.h"
 #include "metadata_server.h"
@@ -16,19 +17,6 @@ using namespace apache::thrift::protocol;
 
 namespace indexfs {
 
-MetadataBackend* MetadataServer::mdb_ = NULL;
-DirCache* MetadataServer::dir_cache_ = NULL;
-DirMappingCache* MetadataServer::dmap_cache_ = NULL;
-DirEntryCache<ServerDirEntryValue>* MetadataServer::dent_cache_ = NULL;
-Config* MetadataServer::options_ = NULL;
-Measurement* MetadataServer::measure_ = NULL;
-SplitThread* MetadataServer::split_thread_ = NULL;
-MetadataClient* MetadataServer::proxy_= NULL;
-Env* MetadataServer::env_ = NULL;
-Mutex MetadataServer::split_mtx_;
-int MetadataServer::split_flag = 0;
-Mutex MetadataServer::insert_mtx_;
-
 static const bool kNoOverwrite = true; // FIXME: false for POSIX_ENV
 static const int kNumInstrumentPoints = 18;
 static const char* kMetadataServerOpsName[kNumInstrumentPoints] = {
@@ -38,24 +26,27 @@ static const char* kMetadataServerOpsName[kNumInstrumentPoints] = {
 };
 static const int kTimeEpsilon = 10000;
 
-void MetadataServer::Init(Config* options,
-                          MetadataBackend* mdb,
-                          Env* env,
-                          DirEntryCache<ServerDirEntryValue>* dent_cache,
-                          DirMappingCache* dmap_cache,
-                          DirCache* dir_cache,
-                          Measurement* measure,
-                          SplitThread* split_thread) {
-  options_ = options;
-  mdb_ = mdb;
-  env_ = env;
-  dent_cache_ = dent_cache;
-  dmap_cache_ = dmap_cache;
-  dir_cache_ = dir_cache;
-  DirHandle::dmap_cache_ = dmap_cache;
-  DirHandle::dir_cache_ = dir_cache;
-  measure_ = measure;
-  split_thread_ = split_thread;
+MetadataServer::MetadataServer(Config* options,
+                               MetadataBackend* mdb,
+                               Env* env,
+                               DirEntryCache<ServerDirEntryValue>* dent_cache,
+                               DirMappingCache* dmap_cache,
+                               DirCache* dir_cache,
+                               Measurement* measure) :
+  mdb_(mdb), dent_cache_(dent_cache), dmap_cache_(dmap_cache),
+  dir_cache_(dir_cache), options_(options), env_(env),
+  hot_keys_(NULL), measure_(measure) {
+  split_mtx_.SetLockClass(LockClass::Get("split_mtx"));
+  split_thread_ = new SplitThread(this, measure);
+  if (options->GetHotKeysCapacity() > 0) {
+    hot_keys_ = new HotKeys(NumMetadataOps, options->GetHotKeysCapacity(),
+                            options->GetHotKeysHalfLife());
+  }
+}
+
+MetadataServer::~MetadataServer() {
+  delete split_thread_;
+  delete hot_keys_;
 }
 
 void MetadataServer::GetInstrumentPoints(std::vector<std::string> &points) {
@@ -72,6 +63,115 @@ bool MetadataServer::InitRPC() {
   return true;
 }
 
+void MetadataServer::SetTrace(const int64_t trace_id) {
+  Tracer::SetPending(trace_id);
+}
+
+static void AddCacheStats(ServerStats& _return, const char* name,
+                          uint64_t lookups, uint64_t hits) {
+  CacheStats cache;
+  cache.name = name;
+  cache.lookups = lookups;
+  cache.hits = hits;
+  _return.caches.push_back(cache);
+}
+
+// Parse the "name value" lines of the leveldb.counters property
+static int64_t GetCounter(const std::string& counters, const char* name) {
+  std::istringstream in(counters);
+  std::string key;
+  int64_t value;
+  while (in >> key >> value) {
+    if (key == name)
+      return value;
+  }
+  return 0;
+}
+
+static void AddHotKeys(std::vector<HotKey>* keys,
+                       const std::vector<HotKeys::Entry>& entries) {
+  for (size_t i = 0; i < entries.size(); ++i) {
+    HotKey key;
+    key.dir_id = entries[i].dir_id;
+    key.name = entries[i].name;
+    key.rate = entries[i].rate;
+    key.error = entries[i].error;
+    keys->push_back(key);
+  }
+}
+
+void MetadataServer::GetStats(ServerStats& _return) {
+  _return.server_id = options_->GetSrvID();
+  _return.timestamp = env_->NowMicros();
+
+  // Counts since start, latencies over the measurement window
+  std::vector<LatencySummary> current, window;
+  measure_->GetWindowSummaries(&current, &window);
+  for (int i = 0; i < measure_->NumMetrics(); ++i) {
+    OpStats op;
+    op.name = measure_->MetricName(i);
+    op.count = current[i].Count();
+    op.avg_lat = window[i].Average();
+    op.p50_lat = window[i].Percentile(0.5);
+    op.p90_lat = window[i].Percentile(0.9);
+    op.p99_lat = window[i].Percentile(0.99);
+    op.p999_lat = window[i].Percentile(0.999);
+    op.max_lat = window[i].Max();
+    _return.ops.push_back(op);
+  }
+
+  uint64_t lookups, hits;
+  dent_cache_->GetLookupStats(&lookups, &hits);
+  AddCacheStats(_return, "dent", lookups, hits);
+  dmap_cache_->GetLookupStats(&lookups, &hits);
+  AddCacheStats(_return, "dmap", lookups, hits);
+  dir_cache_->GetLookupStats(&lookups, &hits);
+  AddCacheStats(_return, "dir", lookups, hits);
+  mdb_->GetBlockCacheStats(&lookups, &hits);
+  AddCacheStats(_return, "block", lookups, hits);
+
+  for (int level = 0; ; ++level) {
+    std::stringstream files, bytes;
+    files << "leveldb.num-files-at-level" << level;
+    bytes << "leveldb.bytes-at-level" << level;
+    std::string num_files, num_bytes;
+    if (!mdb_->GetProperty(files.str(), &num_files) ||
+        !mdb_->GetProperty(bytes.str(), &num_bytes))
+      break;
+    LevelStats stats;
+    stats.num_files = atoi(num_files.c_str());
+    stats.num_bytes = atoll(num_bytes.c_str());
+    _return.levels.push_back(stats);
+  }
+
+  std::string counters;
+  mdb_->GetProperty("leveldb.counters", &counters);
+  _return.compaction_bytes_read =
+      GetCounter(counters, "compaction-bytes-read");
+  _return.compaction_bytes_written =
+      GetCounter(counters, "compaction-bytes-written");
+  _return.write_stalls = GetCounter(counters, "write-stalls");
+  _return.write_stall_micros = GetCounter(counters, "write-stall-micros");
+
+  _return.split_queue_depth = split_thread_->QueueDepth();
+  _return.active_leases = lease_counter_.Active(env_->NowMicros());
+
+  if (hot_keys_ != NULL) {
+    std::vector<HotKeys::Entry> dirs, entries;
+    for (int op = 0; op < NumMetadataOps; ++op) {
+      hot_keys_->GetTopDirs(op, &dirs);
+      hot_keys_->GetTopEntries(op, &entries);
+      if (dirs.empty() && entries.empty())
+        continue;
+      HotKeyStats stats;
+      stats.op = kMetadataServerOpsName[op];
+      AddHotKeys(&stats.dirs, dirs);
+      AddHotKeys(&stats.entries, entries);
+      _return.hot_keys.push_back(stats);
+    }
+  }
+}
+
 DirHandle MetadataServer::FetchDir(const TInodeID dir_id) {
   Directory* dir;
   dir_cache_->Get(dir_id, &dir);
@@ -84,13 +184,13 @@ DirHandle MetadataServer::FetchDir(const TInodeID dir_id) {
       giga_mapping_t mapping;
       if (mdb_->ReadBitmap(dir_id, &mapping) != 0) {
         LOG(ERROR) << "Error: Directory (" << dir_id << ") cannot be found";
-        return DirHandle(NULL, NULL);
+        return DirHandle();
       }
       handle = dmap_cache_->Put(dir_id, mapping);
     }
   }
 
-  return DirHandle(dir, handle);
+  return DirHandle(dmap_cache_, dir_cache_, dir, handle);
 }
 
 int MetadataServer::CheckAddressing(giga_mapping_t *mapping,
@@ -104,6 +204,18 @@ int MetadataServer::CheckAddressing(giga_mapping_t *mapping,
   return index;
 }
 
+// REQUIRES: hdir.dir->partition_mtx held.  Waits out a split that is
+// moving the entry away, then addresses it with the updated mapping.
+int MetadataServer::CheckAddressing(DirHandle &hdir,
+                                    const std::string &path) {
+  while (hdir.dir->split_index >= 0 &&
+         giga_file_migration_status(path.c_str(),
+                                    hdir.dir->split_index) == 1) {
+    hdir.dir->partition_cv.Wait();
+  }
+  return CheckAddressing(hdir.mapping, path);
+}
+
 inline GigaBitmap CopyGigaMap(const giga_mapping_t *mapping) {
   GigaBitmap bitmap;
   bitmap.id = mapping->id;
@@ -159,16 +271,21 @@ void MetadataServer::WriteLockDirEntry(const TInodeID dir_id,
     ServerDirEntryValue* value = reinterpret_cast<ServerDirEntryValue*>(
                                           dent_cache_->Value(*handle));
     value->write_rate.AddRequest(now);
+    TraceSpan lease_wait("lease_wait");
     while (value->status == LEASE_WRITE_STATUS) {
       hdir.dir->partition_cv.Wait();
     }
     if (now < value->expire_time + kTimeEpsilon) {
       value->status = LEASE_WRITE_STATUS;
       uint64_t micros = value->expire_time - now + kTimeEpsilon;
+      hdir.dir->lease_sleepers++;
       hdir.dir->partition_mtx.Unlock();
       env_->SleepForMicroseconds(micros);
       hdir.dir->partition_mtx.Lock();
+      hdir.dir->lease_sleepers--;
+      hdir.dir->partition_cv.SignalAll();
     }
+    lease_wait.End();
   } else {
     ServerDirEntryValue* value = new ServerDirEntryValue();
     value->status = LEASE_WRITE_STATUS;
@@ -193,6 +310,8 @@ void MetadataServer::UnlockDirEntry(DirHandle &hdir,
 void MetadataServer::Getattr(StatInfo& _return, const TInodeID dir_id,
                              const std::string& objname, int lease_time) {
   MeasurementHelper helper(oGetattr, measure_);
+  TraceScope trace(kMetadataServerOpsName[oGetattr]);
+  CountHotKeys(oGetattr, dir_id, objname);
 
   DirHandle hdir = FetchDir(dir_id);
 
@@ -201,10 +320,12 @@ void MetadataServer::Getattr(StatInfo& _return, const TInodeID dir_id,
     throw FileNotFoundException();
   }
 
+  TraceSpan lock_wait("partition_mtx");
   MutexLock l(&(hdir.dir->partition_mtx));
+  lock_wait.End();
 
   int index = 0;
-  if ((index = CheckAddressing(hdir.mapping, objname)) < 0) {
+  if ((index = CheckAddressing(hdir, objname)) < 0) {
      ServerRedirectionException se;
      se.redirect = CopyGigaMap(hdir.mapping);
      throw se;
@@ -260,6 +381,8 @@ uint64_t GetLeaseTime(const ServerDirEntryValue *value, const int depth_time) {
 void MetadataServer::Access(AccessInfo& _return, const TInodeID dir_id,
                             const std::string& objname, int lease_time) {
   MeasurementHelper helper(oAccess, measure_);
+  TraceScope trace(kMetadataServerOpsName[oAccess]);
+  CountHotKeys(oAccess, dir_id, objname);
 
   DirHandle hdir = FetchDir(dir_id);
 
@@ -268,10 +391,12 @@ void MetadataServer::Access(AccessInfo& _return, const TInodeID dir_id,
     throw FileNotFoundException();
   }
 
+  TraceSpan lock_wait("partition_mtx");
   MutexLock l(&(hdir.dir->partition_mtx));
+  lock_wait.End();
 
   int index = 0;
-  if ((index = CheckAddressing(hdir.mapping, objname)) < 0) {
+  if ((index = CheckAddressing(hdir, objname)) < 0) {
      ServerRedirectionException se;
      se.redirect = CopyGigaMap(hdir.mapping);
      throw se;
@@ -322,6 +447,7 @@ void MetadataServer::Access(AccessInfo& _return, const TInodeID dir_id,
   }
   uint64_t new_expire_time = now + srv_lease_time;
   if (new_expire_time > value->expire_time) {
+    lease_counter_.Extend(value->expire_time, new_expire_time, now);
     value->expire_time = new_expire_time;
   }
   _return.lease_time = new_expire_time;
@@ -333,6 +459,8 @@ void MetadataServer::Access(AccessInfo& _return, const TInodeID dir_id,
 void MetadataServer::Mknod(const TInodeID dir_id, const std::string& objname,
                            const int16_t permission) {
   MeasurementHelper helper(oMknod, measure_);
+  TraceScope trace(kMetadataServerOpsName[oMknod]);
+  CountHotKeys(oMknod, dir_id, objname);
 
   DirHandle hdir = FetchDir(dir_id);
 
@@ -341,10 +469,12 @@ void MetadataServer::Mknod(const TInodeID dir_id, const std::string& objname,
     throw FileNotFoundException();
   }
 
+  TraceSpan lock_wait("partition_mtx");
   MutexLock l(&(hdir.dir->partition_mtx));
+  lock_wait.End();
 
   int index = 0;
-  if ((index = CheckAddressing(hdir.mapping, objname)) < 0) {
+  if ((index = CheckAddressing(hdir, objname)) < 0) {
      ServerRedirectionException se;
      se.redirect = CopyGigaMap(hdir.mapping);
      throw se;
@@ -373,6 +503,8 @@ bool MetadataServer::CreateZerothRemote(int zeroth_server,
 
   try {
     transport->open();
+    if (Tracer::Current() != 0)
+      client.SetTrace(Tracer::Current());
     client.CreateZeroth(dir_id);
     transport->close();
   } catch (TException &tx) {
@@ -385,14 +517,18 @@ bool MetadataServer::CreateZerothRemote(int zeroth_server,
 void MetadataServer::Mkdir(const TInodeID dir_id, const std::string& objname,
                        const int16_t permission, const int16_t hint_server) {
   MeasurementHelper helper(oMkdir, measure_);
+  TraceScope trace(kMetadataServerOpsName[oMkdir]);
+  CountHotKeys(oMkdir, dir_id, objname);
 
   DirHandle hdir = FetchDir(dir_id);
   SanityCheck(hdir.mapping == NULL, FileNotFoundException());
 
+  TraceSpan lock_wait("partition_mtx");
   MutexLock l(&(hdir.dir->partition_mtx));
+  lock_wait.End();
 
   int index = 0;
-  if ((index = CheckAddressing(hdir.mapping, objname)) < 0) {
+  if ((index = CheckAddressing(hdir, objname)) < 0) {
      ServerRedirectionException se;
      se.redirect = CopyGigaMap(hdir.mapping);
      throw se;
@@ -419,14 +555,18 @@ void MetadataServer::CreateEntry(const TInodeID dir_id,
                                  const std::string& link,
                                  const std::string& data) {
   MeasurementHelper helper(oCreateEntry, measure_);
+  TraceScope trace(kMetadataServerOpsName[oCreateEntry]);
+  CountHotKeys(oCreateEntry, dir_id, objname);
 
   DirHandle hdir = FetchDir(dir_id);
   SanityCheck(hdir.mapping == NULL, FileNotFoundException());
 
+  TraceSpan lock_wait("partition_mtx");
   MutexLock l(&(hdir.dir->partition_mtx));
+  lock_wait.End();
 
   int index = 0;
-  if ((index = CheckAddressing(hdir.mapping, objname)) < 0) {
+  if ((index = CheckAddressing(hdir, objname)) < 0) {
      ServerRedirectionException se;
      se.redirect = CopyGigaMap(hdir.mapping);
      throw se;
@@ -443,10 +583,12 @@ void MetadataServer::CreateNamespace(LeaseInfo& _return, const TInodeID dir_id,
   DirHandle hdir = FetchDir(dir_id);
   SanityCheck(hdir.mapping == NULL, FileNotFoundException());
 
+  TraceSpan lock_wait("partition_mtx");
   MutexLock l(&(hdir.dir->partition_mtx));
+  lock_wait.End();
 
   int index = 0;
-  if ((index = CheckAddressing(hdir.mapping, objname)) < 0) {
+  if ((index = CheckAddressing(hdir, objname)) < 0) {
      ServerRedirectionException se;
      se.redirect = CopyGigaMap(hdir.mapping);
      throw se;
@@ -477,6 +619,7 @@ void MetadataServer::CloseNamespace(const TInodeID dir_id) {
 
 void MetadataServer::CreateZeroth(const TInodeID dir_id) {
   MeasurementHelper helper(oCreateZeroth, measure_);
+  TraceScope trace(kMetadataServerOpsName[oCreateZeroth]);
 
   Directory* dir;
   dir_cache_->Get(dir_id, &dir);
@@ -493,14 +636,18 @@ void MetadataServer::CreateZeroth(const TInodeID dir_id) {
 void MetadataServer::Chmod(const TInodeID dir_id, const std::string& objname,
                            const int16_t permission) {
   MeasurementHelper helper(oChmod, measure_);
+  TraceScope trace(kMetadataServerOpsName[oChmod]);
+  CountHotKeys(oChmod, dir_id, objname);
 
   DirHandle hdir = FetchDir(dir_id);
   SanityCheck(hdir.mapping == NULL, FileNotFoundException());
 
+  TraceSpan lock_wait("partition_mtx");
   MutexLock l(&(hdir.dir->partition_mtx));
+  lock_wait.End();
 
   int index = 0;
-  if ((index = CheckAddressing(hdir.mapping, objname)) < 0) {
+  if ((index = CheckAddressing(hdir, objname)) < 0) {
      ServerRedirectionException se;
      se.redirect = CopyGigaMap(hdir.mapping);
      throw se;
@@ -523,14 +670,18 @@ void MetadataServer::Chmod(const TInodeID dir_id, const std::string& objname,
 void MetadataServer::Remove(const TInodeID dir_id,
                             const std::string& objname) {
   MeasurementHelper helper(oRemove, measure_);
+  TraceScope trace(kMetadataServerOpsName[oRemove]);
+  CountHotKeys(oRemove, dir_id, objname);
 
   DirHandle hdir = FetchDir(dir_id);
   SanityCheck(hdir.mapping == NULL, FileNotFoundException());
 
+  TraceSpan lock_wait("partition_mtx");
   MutexLock l(&(hdir.dir->partition_mtx));
+  lock_wait.End();
 
   int index = 0;
-  if ((index = CheckAddressing(hdir.mapping, objname)) < 0) {
+  if ((index = CheckAddressing(hdir, objname)) < 0) {
      ServerRedirectionException se;
      se.redirect = CopyGigaMap(hdir.mapping);
      throw se;
@@ -555,16 +706,20 @@ void MetadataServer::Rename(const TInodeID src_id, const std::string& src_path,
                             const TInodeID dst_id, const std::string& dst_path)
 {
   MeasurementHelper helper(oRename, measure_);
+  TraceScope trace(kMetadataServerOpsName[oRename]);
+  CountHotKeys(oRename, src_id, src_path);
 
   SanityCheck(dst_id == src_id, FileNotInSameServer());
 
   DirHandle sdir = FetchDir(src_id);
   SanityCheck(sdir.mapping == NULL, FileNotFoundException());
 
+  TraceSpan lock_wait("partition_mtx");
   MutexLock l(&(sdir.dir->partition_mtx));
+  lock_wait.End();
 
   int index = 0;
-  if ((index = CheckAddressing(sdir.mapping, src_path)) < 0) {
+  if ((index = CheckAddressing(sdir, src_path)) < 0) {
      ServerRedirectionException se;
      se.redirect = CopyGigaMap(sdir.mapping);
      throw se;
@@ -576,14 +731,14 @@ void MetadataServer::Rename(const TInodeID src_id, const std::string& src_path,
 
   if (S_ISDIR(info.mode)) {
     DirEntryLockHandler dent_lock(this, src_id, src_path, sdir);
-    int dst_index = CheckAddressing(sdir.mapping, dst_path);
+    int dst_index = CheckAddressing(sdir, dst_path);
     SanityCheck(dst_index >= 0, FileNotInSameServer());
     SanityCheck((mdb_->CreateEntry(dst_id, dst_index, dst_path, info,"", "")!=0),
                 FileAlreadyExistException());
     SanityCheck(mdb_->Remove(src_id, index, src_path)!=0,
                 FileNotFoundException());
   } else {
-    int dst_index = CheckAddressing(sdir.mapping, dst_path);
+    int dst_index = CheckAddressing(sdir, dst_path);
     SanityCheck(dst_index >= 0, FileNotInSameServer());
     SanityCheck((mdb_->CreateEntry(dst_id, dst_index, dst_path, info,"", "")!=0),
                 FileAlreadyExistException());
@@ -598,6 +753,8 @@ void MetadataServer::Readdir(ScanResult& _return,
                              const std::string& start_key,
                              const int16_t max_num_entries) {
   MeasurementHelper helper(oReaddir, measure_);
+  TraceScope trace(kMetadataServerOpsName[oReaddir]);
+  CountHotKeys(oReaddir, dir_id, std::string());
 
   DirHandle hdir = FetchDir(dir_id);
   SanityCheck(hdir.mapping == NULL, FileNotFoundException());
@@ -617,6 +774,8 @@ void MetadataServer::ReaddirPlus(ScanPlusResult& _return,
                                  const int16_t max_num_entries) {
 
   MeasurementHelper helper(oReaddir, measure_);
+  TraceScope trace(kMetadataServerOpsName[oReaddir]);
+  CountHotKeys(oReaddir, dir_id, std::string());
   DirHandle hdir = FetchDir(dir_id);
   SanityCheck(hdir.mapping == NULL, FileNotFoundException());
   _return.mapping = CopyGigaMap(hdir.mapping);
@@ -632,6 +791,8 @@ void MetadataServer::ReaddirPlus(ScanPlusResult& _return,
 
 void MetadataServer::ReadBitmap(GigaBitmap& _return, const TInodeID dir_id) {
   MeasurementHelper helper(oReadBitmap, measure_);
+  TraceScope trace(kMetadataServerOpsName[oReadBitmap]);
+  CountHotKeys(oReadBitmap, dir_id, std::string());
 
   DirHandle hdir = FetchDir(dir_id);
   SanityCheck(hdir.mapping == NULL, FileNotFoundException());
@@ -641,6 +802,8 @@ void MetadataServer::ReadBitmap(GigaBitmap& _return, const TInodeID dir_id) {
 void MetadataServer::UpdateBitmap(const TInodeID dir_id,
                                   const GigaBitmap &mapping) {
   MeasurementHelper helper(oUpdateBitmap, measure_);
+  TraceScope trace(kMetadataServerOpsName[oUpdateBitmap]);
+  CountHotKeys(oUpdateBitmap, dir_id, std::string());
 
   DirHandle hdir = FetchDir(dir_id);
   SanityCheck(hdir.mapping == NULL, FileNotFoundException());
@@ -686,6 +849,8 @@ bool MetadataServer::UpdateBitmapRemote(int zeroth_server,
   try {
     transport->open();
     GigaBitmap mapping = CopyGigaMap(hdir.mapping);
+    if (Tracer::Current() != 0)
+      client.SetTrace(Tracer::Current());
     client.UpdateBitmap(dir_id, mapping);
     transport->close();
   } catch (TException &tx) {
@@ -700,9 +865,12 @@ void MetadataServer::Split(const TInodeID dir_id,
                            DirHandle &hdir) {
   //TODO: fault tolerance order?
   MeasurementHelper helper(oSplit, measure_);
+  TraceScope trace(kMetadataServerOpsName[oSplit]);
 
   MutexLock split_mtx_lock(&split_mtx_);
-  MutexLock mutexlock(&hdir.dir->partition_mtx);
+  TraceSpan lock_wait("partition_mtx");
+  hdir.dir->partition_mtx.Lock();
+  lock_wait.End();
 
   int parent_srv = options_->GetSrvID();
   int child = giga_index_for_splitting(hdir.mapping, parent);
@@ -720,14 +888,31 @@ void MetadataServer::Split(const TInodeID dir_id,
              parent, child, parent_srv, child_srv);
     std::string split_dir_path(split_dir_path_buf);
 
+    // Extract and ship the moving half without partition_mtx, so that
+    // operations on the entries that stay are not held up by the copy.
+    // Operations on moving entries wait in CheckAddressing, as do writers
+    // that already addressed one and sleep on a lease, so the moving half
+    // takes no writes and the snapshot the backend extracts is complete.
+    hdir.dir->split_index = child;
+    while (hdir.dir->lease_sleepers > 0) {
+      hdir.dir->partition_cv.Wait();
+    }
+    giga_mapping_t mapping = *hdir.mapping;
+    hdir.dir->partition_mtx.Unlock();
+
     uint64_t min_seq, max_seq;
+    TraceSpan extract("split_extract");
     ret = mdb_->Extract(dir_id, parent, child, split_dir_path,
                         &min_seq, &max_seq);
+    extract.End();
 
-    if (ret > 0)
+    if (ret > 0) {
+       TraceSpan insert("split_insert_remote");
        InsertSplitRemote(dir_id, child_srv, parent, child,
-                         split_dir_path, hdir.mapping,
+                         split_dir_path, &mapping,
                          min_seq, max_seq, ret);
+    }
+    hdir.dir->partition_mtx.Lock();
   }
 
   if (ret >= 0) {
@@ -742,7 +927,10 @@ void MetadataServer::Split(const TInodeID dir_id,
     }
   }
 
+  hdir.dir->split_index = -1;
   hdir.dir->split_flag = 0;
+  hdir.dir->partition_cv.SignalAll();
+  hdir.dir->partition_mtx.Unlock();
 }
 
 void MetadataServer::InsertSplitRemote(const TInodeID dir_id,
@@ -765,6 +953,8 @@ void MetadataServer::InsertSplitRemote(const TInodeID dir_id,
 
   try {
     transport->open();
+    if (Tracer::Current() != 0)
+      client.SetTrace(Tracer::Current());
     client.InsertSplit(dir_id, parent_index, child_index, path_split_files,
                        CopyGigaMap(bitmap), min_seq, max_seq, num_entries);
     transport->close();
@@ -782,6 +972,7 @@ void MetadataServer::InsertSplit(const TInodeID dir_id,
                                  const int64_t max_seq,
                                  const int64_t num_entries) {
   MeasurementHelper helper(oInsertSplit, measure_);
+  TraceScope trace(kMetadataServerOpsName[oInsertSplit]);
 
   LOG(INFO) << "InsertSplit[" << dir_id << "]: " << path_split_files;
 
@@ -854,14 +1045,18 @@ void MetadataServer::OpenFile(OpenResult& _return, const TInodeID dir_id,
                               const std::string& objname, const int16_t mode,
                               const int16_t auth) {
   MeasurementHelper helper(oOpen, measure_);
+  TraceScope trace(kMetadataServerOpsName[oOpen]);
+  CountHotKeys(oOpen, dir_id, objname);
 
   DirHandle hdir = FetchDir(dir_id);
   SanityCheck(hdir.mapping == NULL, FileNotFoundException());
 
+  TraceSpan lock_wait("partition_mtx");
   MutexLock l(&(hdir.dir->partition_mtx));
+  lock_wait.End();
 
   int index = 0;
-  if ((index = CheckAddressing(hdir.mapping, objname)) < 0) {
+  if ((index = CheckAddressing(hdir, objname)) < 0) {
      ServerRedirectionException se;
      se.redirect = CopyGigaMap(hdir.mapping);
      throw se;
@@ -894,14 +1089,18 @@ void MetadataServer::Read(ReadResult& _return, const TInodeID dir_id,
                           const std::string& objname, const int32_t offset,
                           const int32_t size) {
   MeasurementHelper helper(oRead, measure_);
+  TraceScope trace(kMetadataServerOpsName[oRead]);
+  CountHotKeys(oRead, dir_id, objname);
 
   DirHandle hdir = FetchDir(dir_id);
   SanityCheck(hdir.mapping == NULL, FileNotFoundException());
 
+  TraceSpan lock_wait("partition_mtx");
   MutexLock l(&(hdir.dir->partition_mtx));
+  lock_wait.End();
 
   int index = 0;
-  if ((index = CheckAddressing(hdir.mapping, objname)) < 0) {
+  if ((index = CheckAddressing(hdir, objname)) < 0) {
      ServerRedirectionException se;
      se.redirect = CopyGigaMap(hdir.mapping);
      throw se;
@@ -931,14 +1130,18 @@ void MetadataServer::Write(WriteResult& _return,
                            const TInodeID dir_id, const std::string& objname,
                            const std::string& data, const int32_t offset) {
   MeasurementHelper helper(oWrite, measure_);
+  TraceScope trace(kMetadataServerOpsName[oWrite]);
+  CountHotKeys(oWrite, dir_id, objname);
 
   DirHandle hdir = FetchDir(dir_id);
   SanityCheck(hdir.mapping == NULL, FileNotFoundException());
 
+  TraceSpan lock_wait("partition_mtx");
   MutexLock l(&(hdir.dir->partition_mtx));
+  lock_wait.End();
 
   int index = 0;
-  if ((index = CheckAddressing(hdir.mapping, objname)) < 0) {
+  if ((index = CheckAddressing(hdir, objname)) < 0) {
      ServerRedirectionException se;
      se.redirect = CopyGigaMap(hdir.mapping);
      throw se;
@@ -988,14 +1191,18 @@ void MetadataServer::Write(WriteResult& _return,
 void MetadataServer::CloseFile(const TInodeID dir_id, const std::string& objname,
                                const int16_t mode) {
   MeasurementHelper helper(oClose, measure_);
+  TraceScope trace(kMetadataServerOpsName[oClose]);
+  CountHotKeys(oClose, dir_id, objname);
 
   DirHandle hdir = FetchDir(dir_id);
   SanityCheck(hdir.mapping == NULL, FileNotFoundException());
 
+  TraceSpan lock_wait("partition_mtx");
   MutexLock l(&(hdir.dir->partition_mtx));
+  lock_wait.End();
 
   int index = 0;
-  if ((index = CheckAddressing(hdir.mapping, objname)) < 0) {
+  if ((index = CheckAddressing(hdir, objname)) < 0) {
      ServerRedirectionException se;
      se.redirect = CopyGigaMap(hdir.mapping);
      throw se;
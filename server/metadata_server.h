@@ -17,10 +17,13 @@
 #include "common/dentcache.h"
 #include "common/dmapcache.h"
 #include "common/dirhandle.h"
+#include "common/counter.h"
 extern "C" {
   #include "common/options.h"
 }
 #include "util/measurement.h"
+#include "util/trace.h"
+#include "util/hot_keys.h"
 #include "client/metadata_client.h"
 
 namespace indexfs {
@@ -28,27 +31,29 @@ namespace indexfs {
 class DirHandle;
 class SplitThread;
 
+// One metadata server's RPC handler.  All of a server's state hangs off
+// its handler, so several servers can run within the same process, each
+// with its own backend, caches and split thread.
 class MetadataServer : virtual public MetadataServiceIf {
 public:
-  MetadataServer() {
-  }
-
-  ~MetadataServer() {
-  }
+  MetadataServer(Config* options,
+                 MetadataBackend* mdb,
+                 Env* env,
+                 DirEntryCache<ServerDirEntryValue>* dent_cache,
+                 DirMappingCache* dmap_cache,
+                 DirCache* dir_cache,
+                 Measurement* measure);
 
-  static void Init(Config* options,
-                   MetadataBackend* mdb,
-                   Env* env,
-                   DirEntryCache<ServerDirEntryValue>* dent_cache,
-                   DirMappingCache* dmap_cache,
-                   DirCache* dir_cache,
-                   Measurement* measure,
-                   SplitThread* split_thread);
+  ~MetadataServer();
 
   static void GetInstrumentPoints(std::vector<std::string> &points);
 
   bool InitRPC();
 
+  void GetStats(ServerStats& _return);
+
+  void SetTrace(const int64_t trace_id);
+
   void Getattr(StatInfo& _return, const TInodeID dir_id,
                const std::string& path, int lease_time);
 
@@ -127,28 +132,37 @@ public:
                    const int64_t min_seq, const int64_t max_seq,
                    const int64_t num_entries);
 
-  static MetadataBackend* mdb_;
-  static DirEntryCache<ServerDirEntryValue>* dent_cache_;
-  static DirMappingCache* dmap_cache_;
-  static DirCache* dir_cache_;
-  static Config* options_;
-  static Mutex split_mtx_;
-  static int split_flag;
-  static Mutex insert_mtx_;
-  static SplitThread* split_thread_;
-  static Env* env_;
-  static bool no_overwrite_;
-  static MetadataClient* proxy_;
+  MetadataBackend* mdb_;
+  DirEntryCache<ServerDirEntryValue>* dent_cache_;
+  DirMappingCache* dmap_cache_;
+  DirCache* dir_cache_;
+  Config* options_;
+  Mutex split_mtx_;
+  SplitThread* split_thread_;
+  Env* env_;
+  LeaseCounter lease_counter_;
+  HotKeys* hot_keys_;
 
   enum MetadataServerOps {
     oGetattr, oMknod, oMkdir, oCreateEntry, oCreateZeroth, oChmod,
     oRemove, oRename, oReaddir, oReadBitmap, oUpdateBitmap, oInsertSplit,
     oOpen, oRead, oWrite, oClose, oSplit, oAccess, NumMetadataOps
   };
-  static Measurement* measure_;
+  Measurement* measure_;
 
 private:
 
+  // Count an operation on entry objname of directory dir_id, or on the
+  // directory itself if objname is empty, towards the hot keys.
+  void CountHotKeys(int op, const TInodeID dir_id,
+                    const std::string& objname) {
+    if (hot_keys_ != NULL) {
+      hot_keys_->AddDir(op, dir_id);
+      if (!objname.empty())
+        hot_keys_->AddEntry(op, dir_id, objname);
+    }
+  }
+
   bool CheckSplit(const DirHandle &hdir, int index);
 
   void ScheduleSplit(const TInodeID dir_id,
@@ -172,6 +186,8 @@ private:
   int CheckAddressing(giga_mapping_t *mapping,
                       const std::string &path);
 
+  int CheckAddressing(DirHandle &hdir, const std::string &path);
+
   int AssignServerForNewInode();
 
   DirHandle FetchDir(const TInodeID dir_id);
@@ -208,6 +224,10 @@ private:
 
   friend class SplitThread;
   friend class DirEntryLockHandler;
+
+  // No copying allowed
+  MetadataServer(const MetadataServer&);
+  void operator=(const MetadataServer&);
 };
 
 } // namespace indexfs
@@ -0,0 +1,122 @@
+// Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <stdlib.h>
+#include <string.h>
+#include <sstream>
+
+#include "common/config.h"
+#include "server/server_instance.h"
+
+namespace indexfs {
+
+ServerInstance::ServerInstance(Config* config, Env* env) :
+  config_(config), env_(env), mdb_open_(false), measure_(NULL),
+  handler_(NULL), server_(NULL), thread_(0), started_thread_(false) {
+  dir_cache_ = new DirCache(config_->GetDirCacheSize());
+  dmap_cache_ = new DirMappingCache(config_->GetDirMappingCacheSize());
+  dent_cache_ = new DirEntryCache<ServerDirEntryValue>(
+      config_->GetDirMappingCacheSize());
+}
+
+ServerInstance::~ServerInstance() {
+  Stop();
+  delete server_;   // Deletes the handler, and stops its split thread
+  if (mdb_open_) {
+    mdb_.Close();
+  }
+  delete measure_;
+  delete dent_cache_;
+  delete dmap_cache_;
+  delete dir_cache_;
+}
+
+void ServerInstance::PrepareStorageDirectory(const std::string &dirname) {
+  Status s = env_->CreateDir(dirname);
+  CHECK(s.ok() || env_->FileExists(dirname))
+    << "Fail to create storage directory: " << dirname;
+}
+
+void ServerInstance::InitRootPartition() {
+  PrepareStorageDirectory(config_->GetFileDir());
+  PrepareStorageDirectory(config_->GetLevelDBDir());
+  PrepareStorageDirectory(config_->GetSplitDir());
+
+  srand(config_->GetSrvID());
+
+  std::stringstream ss;
+  ss << config_->GetLevelDBDir() << "/l" << config_->GetSrvID();
+  std::string leveldb_path = ss.str();
+
+  int mdb_setup = mdb_.Init(leveldb_path, config_->GetHDFSIP(),
+                            config_->GetHDFSPort(), config_->GetSrvID());
+  CHECK(mdb_setup >= 0) << "Fail to initialize leveldb";
+  mdb_open_ = true;
+
+  int dir_id = ROOT_DIR_ID;
+  struct giga_mapping_t mapping;
+
+  int ret;
+  switch (mdb_setup) {
+    case 1:
+    LOG(INFO) << "Creating new file system at " << leveldb_path;
+    giga_init_mapping(&mapping, 0, dir_id, 0, config_->GetSrvNum());
+    dmap_cache_->Insert(dir_id, mapping);
+    ret = mdb_.Mkdir(dir_id, -1, "", dir_id, config_->GetSrvID(),
+                     config_->GetSrvNum());
+    CHECK(ret == 0) << "Error creating root mapping structure";
+    break;
+
+    case 0:
+    LOG(INFO) << "Reading old file system from " << leveldb_path;
+    ret = mdb_.ReadBitmap(dir_id, &mapping);
+    if (ret != 0) {
+      giga_init_mapping(&mapping, 0, dir_id, 0, config_->GetSrvNum());
+      ret = mdb_.Mkdir(dir_id, -1, "", dir_id, config_->GetSrvID(),
+                       config_->GetSrvNum());
+      CHECK(ret == 0) << "Error creating root mapping structure";
+    }
+    dmap_cache_->Insert(dir_id, mapping);
+    break;
+  }
+}
+
+void ServerInstance::Open() {
+  InitRootPartition();
+  std::vector<std::string> metrics;
+  MetadataServer::GetInstrumentPoints(metrics);
+  measure_ = new Measurement(metrics, config_->GetSrvID());
+  handler_ = new MetadataServer(config_, &mdb_, env_,
+                                dent_cache_, dmap_cache_, dir_cache_,
+                                measure_);
+  server_ = RPC_Server::CreateRPCServer(config_, handler_);
+}
+
+void ServerInstance::RunForever() {
+  LOG(INFO) << "Starting metadata server " << config_->GetSrvID() << "...";
+  server_->RunForever();
+}
+
+void* ServerInstance::Run(void* arg) {
+  reinterpret_cast<ServerInstance*>(arg)->RunForever();
+  return NULL;
+}
+
+void ServerInstance::Start() {
+  int ret = pthread_create(&thread_, NULL, &Run, this);
+  CHECK(ret == 0) << "Fail to create server thread: " << strerror(ret);
+  started_thread_ = true;
+}
+
+void ServerInstance::Stop() {
+  if (server_ != NULL) {
+    server_->Stop();
+  }
+  if (started_thread_) {
+    pthread_join(thread_, NULL);
+    started_thread_ = false;
+  }
+}
+
+} // namespace indexfs
@@ -0,0 +1,69 @@
+// Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef _INDEXFS_SERVER_INSTANCE_H_
+#define _INDEXFS_SERVER_INSTANCE_H_
+
+#include <pthread.h>
+#include "communication/rpc.h"
+#include "metadata_server.h"
+
+namespace indexfs {
+
+// Everything a metadata server is made of: its backend, caches, RPC handler
+// and RPC service.  The stand-alone server runs one, and a test harness may
+// run several within the same process on different ports.
+//
+class ServerInstance {
+ public:
+  // The instance uses config and env, which must outlive it
+  ServerInstance(Config* config, Env* env);
+
+  ~ServerInstance();
+
+  // Prepare the storage directories, open the backend, creating the root
+  // directory if it is a new file system, and set up the RPC service.
+  void Open();
+
+  // Serve requests until Stop() is called.
+  void RunForever();
+
+  // Serve requests from a background thread until Stop() is called.
+  void Start();
+
+  // Stop serving requests, waiting for the background thread if any.
+  void Stop();
+
+  MetadataServer* handler() { return handler_; }
+
+  Measurement* measure() { return measure_; }
+
+ private:
+  static void* Run(void* arg);
+
+  void PrepareStorageDirectory(const std::string &dirname);
+
+  void InitRootPartition();
+
+  Config* config_;
+  Env* env_;
+  DirCache* dir_cache_;
+  DirMappingCache* dmap_cache_;
+  DirEntryCache<ServerDirEntryValue>* dent_cache_;
+  MetadataBackend mdb_;
+  bool mdb_open_;
+  Measurement* measure_;
+  MetadataServer* handler_;   // Owned by server_
+  RPC_Server* server_;
+  pthread_t thread_;
+  bool started_thread_;
+
+  // No copying allowed
+  ServerInstance(const ServerInstance&);
+  void operator=(const ServerInstance&);
+};
+
+} // namespace indexfs
+
+#endif /* _INDEXFS_SERVER_INSTANCE_H_ */
@@ -9,8 +9,7 @@
 
 #include "common/config.h"
 #include "common/logging.h"
-#include "metadata_server.h"
-#include "split_thread.h"
+#include "server_instance.h"
 #include "util/monitor_thread.h"
 
 namespace indexfs {
@@ -34,27 +33,26 @@ DEFINE_string(hconfigfn, GetDefaultHDFSConfigFileName(),
 
 static Env* env;
 static Config* config;
-static DirCache* dir_cache;
-static DirMappingCache* dmap_cache;
-static DirEntryCache<ServerDirEntryValue>* dent_cache;
 
 namespace {
 
-static RPC_Server* server;
-static MetadataBackend mdb;
-static Measurement* measure;
+static ServerInstance* instance;
 static MonitorThread* monitor;
-static SplitThread* split_thread;
 
 void SignalHandler(const int sig) {
   DLOG(INFO) << "SIGINT=" << sig << " handled";
   LOG(INFO) << "Stopping metadata server ...";
-  server->Stop();
+  instance->Stop();
+}
+
+void DumpSignalHandler(const int sig) {
+  MonitorThread::RequestDump();
 }
 
 void SetupSignalHandler() {
   signal(SIGINT, SignalHandler);     // handling SIGINT
   signal(SIGTERM, SignalHandler);    // handling SIGTERM
+  signal(SIGUSR1, DumpSignalHandler); // dump latencies and lock profile
 }
 
 void InitEnvironment() {
@@ -67,88 +65,25 @@ void InitEnvironment() {
     env = Env::Default();
 #endif
 #endif
-  dir_cache = new DirCache(config->GetDirCacheSize());
-  dmap_cache = new DirMappingCache(config->GetDirMappingCacheSize());
-  dent_cache = new DirEntryCache<ServerDirEntryValue>(config->GetDirMappingCacheSize());
-}
-
-static
-void PrepareStorageDirectory(const std::string &dirname) {
-  Status s = env->CreateDir(dirname);
-  CHECK(s.ok() || env->FileExists(dirname))
-    << "Fail to create storage directory: " << dirname;
-}
-
-void InitRootPartition() {
-  PrepareStorageDirectory(config->GetFileDir());
-  PrepareStorageDirectory(config->GetLevelDBDir());
-  PrepareStorageDirectory(config->GetSplitDir());
-
-  srand(config->GetSrvID());
-
-  std::stringstream ss;
-  ss << config->GetLevelDBDir() << "/l" << config->GetSrvID();
-  std::string leveldb_path = ss.str();
-
-  int mdb_setup = mdb.Init(leveldb_path, config->GetHDFSIP(),
-                           config->GetHDFSPort(), config->GetSrvID());
-  CHECK(mdb_setup >= 0) << "Fail to initialize leveldb";
-
-  int dir_id = ROOT_DIR_ID;
-  struct giga_mapping_t mapping;
-
-  int ret;
-  switch (mdb_setup) {
-    case 1:
-    LOG(INFO) << "Creating new file system at " << leveldb_path;
-    giga_init_mapping(&mapping, 0, dir_id, 0, config->GetSrvNum());
-    dmap_cache->Insert(dir_id, mapping);
-    ret = mdb.Mkdir(dir_id, -1, "", dir_id, config->GetSrvID(), config->GetSrvNum());
-    CHECK(ret == 0) << "Error creating root mapping structure";
-    break;
-
-    case 0:
-    LOG(INFO) << "Reading old file system from " << leveldb_path;
-    ret = mdb.ReadBitmap(dir_id, &mapping);
-    if (ret != 0) {
-      giga_init_mapping(&mapping, 0, dir_id, 0, config->GetSrvNum());
-      ret = mdb.Mkdir(dir_id, -1, "", dir_id, config->GetSrvID(), config->GetSrvNum());
-      CHECK(ret == 0) << "Error creating root mapping structure";
-    }
-    dmap_cache->Insert(dir_id, mapping);
-    break;
-  }
+  instance = new ServerInstance(config, env);
+  instance->Open();
 }
 
 void InitMonitor() {
-  std::vector<std::string> metrics;
-  MetadataServer::GetInstrumentPoints(metrics);
-  measure = new Measurement(metrics, config->GetSrvID());
-  monitor = new MonitorThread(measure);
-}
-
-void CleanMonitor() {
-  delete monitor;
-  delete measure;
+  monitor = new MonitorThread(instance->measure());
+  Tracer::Configure(config->GetTraceSampleRate(),
+                    config->GetTraceSlowMicros(), stderr);
 }
 
 void LaunchMetadataServer() {
-  split_thread = new SplitThread(measure);
-  MetadataServer::Init(config, &mdb,
-                       env, dent_cache, dmap_cache, dir_cache,
-                       measure, split_thread);
-  MetadataServer* handler = new MetadataServer();
-  server = RPC_Server::CreateRPCServer(config, handler);
-  LOG(INFO)<< "Starting metadata server...";
   monitor->Start();
-  server->RunForever();
+  instance->RunForever();
 }
 
 void Cleanup() {
-  mdb.Close();
-  CleanMonitor();
+  delete monitor;
+  delete instance;
   CloseFSLog();
-  delete split_thread;
 }
 
 } //namespace
@@ -165,7 +100,6 @@ int main(int argc, char* argv[]) {
   indexfs::OpenServerLog(log_filename);
   indexfs::config = indexfs::LoadServerConfig(indexfs::FLAGS_srvid);
   indexfs::InitEnvironment();
-  indexfs::InitRootPartition();
   indexfs::InitMonitor();
   indexfs::SetupSignalHandler();
   indexfs::LaunchMetadataServer();
@@ -29,10 +29,9 @@ void PthreadCall(const char* label, int result) {
   }
 }
 
-SplitThread::SplitThread(Measurement* measure) :
-              measure_(measure), thread_(0),
+SplitThread::SplitThread(MetadataServer* server, Measurement* measure) :
+              server_(server), measure_(measure), thread_(0),
               started_thread_(false), done_(false) {
-  server_ = new MetadataServer();
   PthreadCall("mutex_init", pthread_mutex_init(&mu_, NULL));
   PthreadCall("cvar_init", pthread_cond_init(&signal_, NULL));
 }
@@ -41,7 +40,8 @@ SplitThread::~SplitThread() {
   if (!done_) {
     Stop();
   }
-  delete server_;
+  PthreadCall("cvar_destroy", pthread_cond_destroy(&signal_));
+  PthreadCall("mutex_destroy", pthread_mutex_destroy(&mu_));
 }
 
 void SplitThread::Start() {
@@ -54,6 +54,7 @@ void SplitThread::AddSplitTask(int dir_id, int index) {
 
   // Start background thread if necessary
   if (!started_thread_) {
+    started_thread_ = true;
     Start();
   }
 
@@ -62,7 +63,7 @@ void SplitThread::AddSplitTask(int dir_id, int index) {
   bool wakeup = queue_.empty();
 
   // Add to priority queue
-  queue_.push_back(SplitItem(dir_id, index));
+  queue_.push_back(SplitItem(dir_id, index, Tracer::Current()));
 
   if (wakeup)
     PthreadCall("signal", pthread_cond_signal(&signal_));
@@ -70,22 +71,34 @@ void SplitThread::AddSplitTask(int dir_id, int index) {
   PthreadCall("unlock", pthread_mutex_unlock(&mu_));
 }
 
-void SplitThread::ExecuteThread() {
-  started_thread_ = true;
+int SplitThread::QueueDepth() {
+  PthreadCall("lock", pthread_mutex_lock(&mu_));
+  int depth = queue_.size();
+  PthreadCall("unlock", pthread_mutex_unlock(&mu_));
+  return depth;
+}
 
-  while (!done_) {
+void SplitThread::ExecuteThread() {
+  while (true) {
     // Wait until there is an item that is ready to run
     PthreadCall("lock", pthread_mutex_lock(&mu_));
-    while (queue_.empty()) {
+    while (queue_.empty() && !done_) {
       PthreadCall("wait", pthread_cond_wait(&signal_, &mu_));
     }
+    if (done_) {
+      PthreadCall("unlock", pthread_mutex_unlock(&mu_));
+      break;
+    }
 
     int dir_id = queue_.front().dir_id;
     int index = queue_.front().index;
+    uint64_t trace_id = queue_.front().trace_id;
     queue_.pop_front();
 
     PthreadCall("unlock", pthread_mutex_unlock(&mu_));
 
+    if (trace_id != 0)
+      Tracer::SetPending(trace_id);
     DirHandle hdir = server_->FetchDir(dir_id);
     server_->Split(dir_id, index, hdir);
   }
@@ -97,9 +110,17 @@ void* SplitThread::Run(void* arg) {
   return NULL;
 }
 
+// Pending splits are dropped; a split in progress is finished first.
+//
 void SplitThread::Stop() {
+  PthreadCall("lock", pthread_mutex_lock(&mu_));
   done_ = true;
-  JoinThread(thread_);
+  bool started = started_thread_;
+  PthreadCall("broadcast", pthread_cond_broadcast(&signal_));
+  PthreadCall("unlock", pthread_mutex_unlock(&mu_));
+  if (started) {
+    JoinThread(thread_);
+  }
 }
 
 } // namespace indexfs
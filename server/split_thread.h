@@ -13,7 +13,8 @@ namespace indexfs {
 
 class SplitThread {
 public:
-  SplitThread(Measurement* measure);
+  // Execute the splits of server "server", which outlives the thread
+  SplitThread(MetadataServer* server, Measurement* measure);
 
   virtual ~SplitThread();
 
@@ -21,6 +22,9 @@ public:
 
   void AddSplitTask(int dir_id, int index);
 
+  // Number of splits waiting to be executed
+  int QueueDepth();
+
   void Stop();
 
 private:
@@ -38,8 +42,10 @@ private:
   bool done_;
 
   struct SplitItem {
-    SplitItem(int did, int dindex) : dir_id(did), index(dindex) {}
+    SplitItem(int did, int dindex, uint64_t tid) :
+      dir_id(did), index(dindex), trace_id(tid) {}
     int dir_id, index;
+    uint64_t trace_id;  // Trace of the operation that asked for it
   };
   typedef std::deque<SplitItem> SplitQueue;
   SplitQueue queue_;
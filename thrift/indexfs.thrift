@@ -71,6 +71,56 @@ struct LeaseInfo {
   4: i32 max_dirs
 }
 
+struct OpStats {
+  1: required string name
+  2: required i64 count
+  3: required double avg_lat
+  4: required double p50_lat
+  5: required double p99_lat
+  6: required double max_lat
+  7: required double p90_lat
+  8: required double p999_lat
+}
+
+struct CacheStats {
+  1: required string name
+  2: required i64 lookups
+  3: required i64 hits
+}
+
+struct LevelStats {
+  1: required i32 num_files
+  2: required i64 num_bytes
+}
+
+struct HotKey {
+  1: required i64 dir_id
+  2: required string name
+  3: required double rate
+  4: required double error
+}
+
+struct HotKeyStats {
+  1: required string op
+  2: required list<HotKey> dirs
+  3: required list<HotKey> entries
+}
+
+struct ServerStats {
+  1: required i32 server_id
+  2: required i64 timestamp
+  3: required list<OpStats> ops
+  4: required list<CacheStats> caches
+  5: required list<LevelStats> levels
+  6: required i64 compaction_bytes_read
+  7: required i64 compaction_bytes_written
+  8: required i64 write_stalls
+  9: required i64 write_stall_micros
+  10: required i32 split_queue_depth
+  11: required i64 active_leases
+  12: required list<HotKeyStats> hot_keys
+}
+
 exception ServerRedirectionException {
   1: required GigaBitmap redirect
 }
@@ -129,6 +179,11 @@ service MetadataService {
   bool InitRPC()
     throws (1: ServerNotFound e)
 
+  ServerStats GetStats()
+
+  // Makes the next call on this connection part of trace "trace_id"
+  oneway void SetTrace(1: i64 trace_id)
+
   StatInfo Getattr(1: TInodeID dir_id, 2: string path, 3: i32 lease_time)
     throws (1: ServerRedirectionException r, 2: ServerNotFound eS,
             3: FileNotFoundException eF)
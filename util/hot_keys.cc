@@ -0,0 +1,180 @@
+// Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "hot_keys.h"
+#include "str_hash.h"
+#include <math.h>
+#include <algorithm>
+
+namespace indexfs {
+
+namespace {
+
+// Rescale once weights pass 2^32, well within the precision of a double
+const double kMaxWeight = 4294967296.0;
+
+struct HotterFirst {
+  bool operator()(const HotKeys::Entry& a, const HotKeys::Entry& b) const {
+    return a.rate > b.rate;
+  }
+};
+
+} // namespace
+
+HotKeys::HotKeys(int num_types, int capacity, int half_life) :
+  num_types_(num_types), capacity_(capacity),
+  half_life_(half_life > 0 ? half_life : 1) {
+  time_t now = time(NULL);
+  sketches_ = new Sketch[num_types_ * kNumKinds * kNumShards];
+  for (int i = 0; i < num_types_ * kNumKinds * kNumShards; ++i) {
+    pthread_mutex_init(&sketches_[i].mu, NULL);
+    sketches_[i].epoch = now;
+    sketches_[i].now = now;
+    sketches_[i].weight = 1;
+  }
+}
+
+HotKeys::~HotKeys() {
+  for (int i = 0; i < num_types_ * kNumKinds * kNumShards; ++i)
+    pthread_mutex_destroy(&sketches_[i].mu);
+  delete [] sketches_;
+}
+
+int HotKeys::ShardIndex() {
+  static int next_shard = 0;
+  static __thread int shard = -1;
+  if (shard < 0)
+    shard = __sync_fetch_and_add(&next_shard, 1) % kNumShards;
+  return shard;
+}
+
+double HotKeys::Weight(Sketch* sketch, time_t now) {
+  if (now == sketch->now)
+    return sketch->weight;
+  sketch->now = now;
+  sketch->weight = exp2(static_cast<double>(now - sketch->epoch) / half_life_);
+  if (sketch->weight > kMaxWeight) {
+    for (size_t i = 0; i < sketch->counters.size(); ++i) {
+      sketch->counters[i].count /= sketch->weight;
+      sketch->counters[i].error /= sketch->weight;
+    }
+    sketch->epoch = now;
+    sketch->weight = 1;
+  }
+  return sketch->weight;
+}
+
+void HotKeys::AddDir(int type, uint64_t dir_id) {
+  Add(type, kDirs, dir_id, dir_id, NULL);
+}
+
+void HotKeys::AddEntry(int type, uint64_t dir_id, const std::string& name) {
+  uint64_t key = (dir_id * 0x9E3779B97F4A7C15ull) ^
+                 GetStrHash(name.data(), name.size(), 0);
+  Add(type, kEntries, key, dir_id, &name);
+}
+
+void HotKeys::Add(int type, Kind kind, uint64_t key, uint64_t dir_id,
+                  const std::string* name) {
+  if (type < 0 || type >= num_types_ || capacity_ == 0)
+    return;
+  Sketch* sketch = GetSketch(type, kind, ShardIndex());
+  pthread_mutex_lock(&sketch->mu);
+  double weight = Weight(sketch, time(NULL));
+  std::map<uint64_t, size_t>::iterator it = sketch->index.find(key);
+  if (it != sketch->index.end()) {
+    sketch->counters[it->second].count += weight;
+  } else {
+    size_t pos;
+    double base = 0;
+    if (sketch->counters.size() < capacity_) {
+      pos = sketch->counters.size();
+      sketch->counters.push_back(Counter());
+    } else {
+      pos = 0;
+      for (size_t i = 1; i < sketch->counters.size(); ++i) {
+        if (sketch->counters[i].count < sketch->counters[pos].count)
+          pos = i;
+      }
+      base = sketch->counters[pos].count;
+      sketch->index.erase(sketch->counters[pos].key);
+    }
+    Counter* counter = &sketch->counters[pos];
+    counter->key = key;
+    counter->dir_id = dir_id;
+    if (name != NULL)
+      counter->name.assign(*name);  // Reuses the replaced name's buffer
+    counter->count = base + weight;
+    counter->error = base;
+    sketch->index[key] = pos;
+  }
+  pthread_mutex_unlock(&sketch->mu);
+}
+
+void HotKeys::GetTop(int type, Kind kind, std::vector<Entry>* result) {
+  result->clear();
+  if (type < 0 || type >= num_types_)
+    return;
+  // A decayed count of c at a steady rate r is r * half_life / ln 2
+  const double to_rate = M_LN2 / half_life_;
+  time_t now = time(NULL);
+  std::map<uint64_t, Entry> merged;
+  for (int shard = 0; shard < kNumShards; ++shard) {
+    Sketch* sketch = GetSketch(type, kind, shard);
+    pthread_mutex_lock(&sketch->mu);
+    double scale = to_rate /
+        exp2(static_cast<double>(now - sketch->epoch) / half_life_);
+    for (size_t i = 0; i < sketch->counters.size(); ++i) {
+      const Counter& counter = sketch->counters[i];
+      std::map<uint64_t, Entry>::iterator it = merged.find(counter.key);
+      if (it == merged.end()) {
+        Entry entry;
+        entry.dir_id = counter.dir_id;
+        entry.name = counter.name;
+        entry.rate = 0;
+        entry.error = 0;
+        it = merged.insert(std::make_pair(counter.key, entry)).first;
+      }
+      it->second.rate += counter.count * scale;
+      it->second.error += counter.error * scale;
+    }
+    pthread_mutex_unlock(&sketch->mu);
+  }
+  for (std::map<uint64_t, Entry>::iterator it = merged.begin();
+       it != merged.end(); ++it) {
+    result->push_back(it->second);
+  }
+  std::sort(result->begin(), result->end(), HotterFirst());
+  if (result->size() > capacity_)
+    result->resize(capacity_);
+}
+
+void HotKeys::GetTopDirs(int type, std::vector<Entry>* result) {
+  GetTop(type, kDirs, result);
+}
+
+void HotKeys::GetTopEntries(int type, std::vector<Entry>* result) {
+  GetTop(type, kEntries, result);
+}
+
+double HotKeys::DirRate(uint64_t dir_id) {
+  const double to_rate = M_LN2 / half_life_;
+  time_t now = time(NULL);
+  double rate = 0;
+  for (int type = 0; type < num_types_; ++type) {
+    for (int shard = 0; shard < kNumShards; ++shard) {
+      Sketch* sketch = GetSketch(type, kDirs, shard);
+      pthread_mutex_lock(&sketch->mu);
+      std::map<uint64_t, size_t>::iterator it = sketch->index.find(dir_id);
+      if (it != sketch->index.end()) {
+        rate += sketch->counters[it->second].count * to_rate /
+            exp2(static_cast<double>(now - sketch->epoch) / half_life_);
+      }
+      pthread_mutex_unlock(&sketch->mu);
+    }
+  }
+  return rate;
+}
+
+} // namespace indexfs
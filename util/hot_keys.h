@@ -0,0 +1,116 @@
+// Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Streaming top-K of the directories and the directory entries a server
+// is busiest with, kept per operation type.
+//
+// Each (operation type, directories or entries) pair has a Space-Saving
+// sketch of "capacity" counters: a key already counted gets its counter
+// bumped, and a new key takes over the smallest counter, inheriting its
+// count as the error bound.  Any key with more weight than the smallest
+// counter is thus guaranteed to be counted, overestimated by at most its
+// error.
+//
+// Counts decay with a half life of "half_life" seconds, so the sketch
+// follows the current load rather than the load since start.  Decay is
+// applied forward: newer operations weigh 2^(t/half_life) times more,
+// and weights are rescaled once in a while, so no counter is touched
+// on the recording path besides the one being bumped.
+//
+// Like Measurement, every thread records into one of kNumShards shards,
+// merged at report time, so threads rarely contend on a shard lock.
+
+#ifndef HOT_KEYS_H_
+#define HOT_KEYS_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace indexfs {
+
+class HotKeys {
+public:
+  enum { kNumShards = 8 };
+
+  struct Entry {
+    uint64_t dir_id;
+    std::string name;   // Empty for directories
+    double rate;        // Operations per second, decayed
+    double error;       // rate is overestimated by at most this much
+  };
+
+  HotKeys(int num_types, int capacity, int half_life);
+
+  ~HotKeys();
+
+  // Count an operation of type "type" on directory dir_id
+  void AddDir(int type, uint64_t dir_id);
+
+  // Count an operation of type "type" on entry "name" of directory dir_id
+  void AddEntry(int type, uint64_t dir_id, const std::string& name);
+
+  // Store the hottest directories or entries for operations of type
+  // "type", hottest first, in *result.
+  void GetTopDirs(int type, std::vector<Entry>* result);
+  void GetTopEntries(int type, std::vector<Entry>* result);
+
+  // Decayed rate of operations of any type on directory dir_id, if it is
+  // among the hottest ones, or 0.  Meant for load-aware split and
+  // placement decisions.
+  double DirRate(uint64_t dir_id);
+
+  int NumTypes() const { return num_types_; }
+
+private:
+  enum Kind { kDirs, kEntries, kNumKinds };
+
+  struct Counter {
+    uint64_t key;
+    uint64_t dir_id;
+    std::string name;
+    double count;       // Scaled by the weight of the sketch's epoch
+    double error;
+  };
+
+  struct Sketch {
+    pthread_mutex_t mu;
+    time_t epoch;       // Operations at the epoch weigh 1
+    time_t now;         // Time of the last operation, and its weight
+    double weight;
+    std::vector<Counter> counters;
+    std::map<uint64_t, size_t> index;   // key -> counters_ position
+  };
+
+  int num_types_;
+  size_t capacity_;
+  int half_life_;
+  Sketch* sketches_;    // [num_types_][kNumKinds][kNumShards]
+
+  Sketch* GetSketch(int type, Kind kind, int shard) {
+    return &sketches_[(type * kNumKinds + kind) * kNumShards + shard];
+  }
+
+  void Add(int type, Kind kind, uint64_t key, uint64_t dir_id,
+           const std::string* name);
+
+  // Weight of an operation at time "now", rescaling the sketch if the
+  // weight grows too large; requires sketch->mu.
+  double Weight(Sketch* sketch, time_t now);
+
+  void GetTop(int type, Kind kind, std::vector<Entry>* result);
+
+  static int ShardIndex();
+
+  // No copying allowed
+  HotKeys(const HotKeys&);
+  void operator=(const HotKeys&);
+};
+
+} // namespace indexfs
+
+#endif /* HOT_KEYS_H_ */
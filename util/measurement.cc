@@ -0,0 +1,310 @@
+// Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "measurement.h"
+#include <string.h>
+#include "port/lock_profile.h"
+
+namespace indexfs {
+
+LatencySummary::LatencySummary() :
+  buckets_(Measurement::kNumBuckets, 0), count_(0), sum_(0) {
+}
+
+double LatencySummary::Average() const {
+  return count_ == 0 ? 0 : static_cast<double>(sum_) / count_;
+}
+
+double LatencySummary::Max() const {
+  for (int i = Measurement::kNumBuckets - 1; i >= 0; --i) {
+    if (buckets_[i] != 0)
+      return static_cast<double>(Measurement::BucketHigh(i) - 1);
+  }
+  return 0;
+}
+
+double LatencySummary::Percentile(double p) const {
+  if (count_ == 0)
+    return 0;
+  double threshold = count_ * p;
+  uint64_t sum = 0;
+  for (int i = 0; i < Measurement::kNumBuckets; ++i) {
+    if (buckets_[i] == 0)
+      continue;
+    if (sum + buckets_[i] >= threshold) {
+      // Scale linearly within the bucket, whose values are integers
+      double low = static_cast<double>(Measurement::BucketLow(i));
+      double high = static_cast<double>(Measurement::BucketHigh(i) - 1);
+      double pos = (threshold - sum) / buckets_[i];
+      return low + (high - low) * pos;
+    }
+    sum += buckets_[i];
+  }
+  return Max();
+}
+
+void LatencySummary::Add(const uint64_t* buckets, uint64_t sum) {
+  for (int i = 0; i < Measurement::kNumBuckets; ++i) {
+    buckets_[i] += buckets[i];
+    count_ += buckets[i];
+  }
+  sum_ += sum;
+}
+
+void LatencySummary::Merge(const LatencySummary& other) {
+  Add(&other.buckets_[0], other.sum_);
+}
+
+void LatencySummary::Subtract(const LatencySummary& earlier) {
+  for (int i = 0; i < Measurement::kNumBuckets; ++i)
+    buckets_[i] -= earlier.buckets_[i];
+  count_ -= earlier.count_;
+  sum_ -= earlier.sum_;
+}
+
+Measurement::Measurement(const std::vector<std::string> &metrics,
+                         int server_id, int window_size) :
+                         server_id_(server_id), metrics_(metrics),
+                         window_size_(window_size) {
+  num_metrics_ = metrics.size() + 1;
+  metrics_.push_back(std::string("total"));
+  for (int i = 0; i < kNumShards; ++i) {
+    shards_[i].buckets = new uint64_t[num_metrics_ * kNumBuckets];
+    memset(shards_[i].buckets, 0,
+           sizeof(uint64_t) * num_metrics_ * kNumBuckets);
+    shards_[i].sums = new uint64_t[num_metrics_];
+    memset(shards_[i].sums, 0, sizeof(uint64_t) * num_metrics_);
+  }
+  pthread_mutex_init(&report_mu_, NULL);
+}
+
+Measurement::~Measurement() {
+  pthread_mutex_destroy(&report_mu_);
+  for (int i = 0; i < kNumShards; ++i) {
+    delete [] shards_[i].buckets;
+    delete [] shards_[i].sums;
+  }
+}
+
+int Measurement::ShardIndex() {
+  static int next_shard = 0;
+  static __thread int shard = -1;
+  if (shard < 0)
+    shard = __sync_fetch_and_add(&next_shard, 1) % kNumShards;
+  return shard;
+}
+
+uint64_t Measurement::BucketLow(int index) {
+  if (index < kSubBuckets)
+    return index;
+  int exponent = index / kSubBuckets + kSubBits - 1;
+  uint64_t sub = index % kSubBuckets + kSubBuckets;
+  return sub << (exponent - kSubBits);
+}
+
+uint64_t Measurement::BucketHigh(int index) {
+  if (index < kSubBuckets)
+    return index + 1;
+  int exponent = index / kSubBuckets + kSubBits - 1;
+  return BucketLow(index) + (1ull << (exponent - kSubBits));
+}
+
+void Measurement::GetSummaries(std::vector<LatencySummary>* summaries) {
+  summaries->assign(num_metrics_, LatencySummary());
+  // Plain reads of counters being incremented are fine here: each is
+  // read whole, and a report may miss the operations still in flight.
+  for (int s = 0; s < kNumShards; ++s) {
+    for (int i = 0; i < num_metrics_; ++i) {
+      (*summaries)[i].Add(shards_[s].buckets + i * kNumBuckets,
+                          shards_[s].sums[i]);
+    }
+  }
+  // The total also has the operations of every type
+  for (int i = 0; i < num_metrics_ - 1; ++i)
+    (*summaries)[num_metrics_ - 1].Merge((*summaries)[i]);
+}
+
+void Measurement::ReadWindow(time_t now,
+                             const std::vector<LatencySummary>& current,
+                             std::vector<LatencySummary>* window) const {
+  *window = current;
+  for (size_t i = snapshots_.size(); i-- > 0; ) {
+    if (now - snapshots_[i].time >= window_size_) {
+      for (int j = 0; j < num_metrics_; ++j)
+        (*window)[j].Subtract(snapshots_[i].summaries[j]);
+      break;
+    }
+  }
+}
+
+void Measurement::AddSnapshot(time_t now,
+                              const std::vector<LatencySummary>& current) {
+  // Drop the snapshots older than the newest one usable as the start
+  size_t start = 0;
+  for (size_t i = 0; i < snapshots_.size(); ++i) {
+    if (now - snapshots_[i].time >= window_size_)
+      start = i;
+  }
+  snapshots_.erase(snapshots_.begin(), snapshots_.begin() + start);
+  Snapshot snapshot;
+  snapshot.time = now;
+  snapshot.summaries = current;
+  snapshots_.push_back(snapshot);
+}
+
+void Measurement::GetWindow(time_t now,
+                            const std::vector<LatencySummary>& current,
+                            std::vector<LatencySummary>* window) {
+  ReadWindow(now, current, window);
+  AddSnapshot(now, current);
+}
+
+void Measurement::GetWindowSummaries(std::vector<LatencySummary>* current,
+                                     std::vector<LatencySummary>* window) {
+  GetSummaries(current);
+  pthread_mutex_lock(&report_mu_);
+  ReadWindow(time(NULL), *current, window);
+  pthread_mutex_unlock(&report_mu_);
+}
+
+void Measurement::AdvanceWindow() {
+  std::vector<LatencySummary> current;
+  GetSummaries(&current);
+  pthread_mutex_lock(&report_mu_);
+  AddSnapshot(time(NULL), current);
+  pthread_mutex_unlock(&report_mu_);
+}
+
+void Measurement::GetStatus(std::stringstream &report) {
+  static const struct {
+    const char* name;
+    double p;
+  } kPercentiles[] = {
+    { "p50", 0.5 }, { "p90", 0.9 }, { "p99", 0.99 }, { "p999", 0.999 }
+  };
+  std::vector<LatencySummary> current, window;
+  GetSummaries(&current);
+  time_t now = time(NULL);
+  pthread_mutex_lock(&report_mu_);
+  GetWindow(now, current, &window);
+  pthread_mutex_unlock(&report_mu_);
+  for (int i = 0; i < num_metrics_; ++i) {
+    report << metrics_[i] << "_num" << " ";
+    report << now << " ";
+    report << current[i].Count();
+    report << " rank=" << server_id_  << '\n';
+    report << metrics_[i] << "_max_lat" << " ";
+    report << now << " ";
+    report << window[i].Max();
+    report << " rank=" << server_id_  << '\n';
+    report << metrics_[i] << "_avg_lat" << " ";
+    report << now << " ";
+    report << window[i].Average();
+    report << " rank=" << server_id_  << '\n';
+    for (size_t j = 0; j < sizeof(kPercentiles) / sizeof(kPercentiles[0]);
+         ++j) {
+      report << metrics_[i] << "_" << kPercentiles[j].name << "_lat" << " ";
+      report << now << " ";
+      report << window[i].Percentile(kPercentiles[j].p);
+      report << " rank=" << server_id_  << '\n';
+    }
+  }
+  GetLockStatus(now, report);
+}
+
+void Measurement::GetLockStatus(time_t now, std::stringstream &report) {
+  using leveldb::port::LockClass;
+  std::vector<LockClass*> classes;
+  LockClass::GetAll(&classes);
+  LockClass::Stats stats;
+  for (size_t i = 0; i < classes.size(); ++i) {
+    classes[i]->GetStats(&stats);
+    const std::string& name = classes[i]->name();
+    const struct {
+      const char* suffix;
+      uint64_t value;
+    } lines[] = {
+      { "_lock_num", stats.acquisitions },
+      { "_lock_contended", stats.contended },
+      { "_lock_wait_p50_ns", LockClass::Stats::Percentile(stats.wait_buckets,
+                                                          0.5) },
+      { "_lock_wait_p99_ns", LockClass::Stats::Percentile(stats.wait_buckets,
+                                                          0.99) },
+      { "_lock_hold_p50_ns", LockClass::Stats::Percentile(stats.hold_buckets,
+                                                          0.5) },
+      { "_lock_hold_p99_ns", LockClass::Stats::Percentile(stats.hold_buckets,
+                                                          0.99) },
+    };
+    for (size_t j = 0; j < sizeof(lines) / sizeof(lines[0]); ++j) {
+      report << name << lines[j].suffix << " ";
+      report << now << " ";
+      report << lines[j].value;
+      report << " rank=" << server_id_  << '\n';
+    }
+  }
+}
+
+static void PrintSummary(FILE* output, const char* view,
+                         const LatencySummary& summary) {
+  fprintf(output, "%-10s: %llu ops, avg %.1f, p50 %.1f, p90 %.1f,"
+          " p99 %.1f, p99.9 %.1f, max %.0f us\n", view,
+          static_cast<unsigned long long>(summary.Count()),
+          summary.Average(), summary.Percentile(0.5),
+          summary.Percentile(0.9), summary.Percentile(0.99),
+          summary.Percentile(0.999), summary.Max());
+}
+
+void Measurement::Print(FILE* output) {
+  std::vector<LatencySummary> current, window;
+  GetSummaries(&current);
+  if (window_size_ > 0) {
+    pthread_mutex_lock(&report_mu_);
+    GetWindow(time(NULL), current, &window);
+    pthread_mutex_unlock(&report_mu_);
+  }
+  for (int i = 0; i < num_metrics_; ++i) {
+    if (current[i].Count() == 0)
+      continue;
+    fprintf(output, "== Latencies for %s ops:\n", metrics_[i].c_str());
+    PrintSummary(output, "cumulative", current[i]);
+    if (window_size_ > 0)
+      PrintSummary(output, "window", window[i]);
+  }
+  PrintLocks(output);
+}
+
+void Measurement::PrintLocks(FILE* output) {
+  using leveldb::port::LockClass;
+  std::vector<LockClass*> classes;
+  LockClass::GetAll(&classes);
+  LockClass::Stats stats;
+  for (size_t i = 0; i < classes.size(); ++i) {
+    classes[i]->GetStats(&stats);
+    if (stats.acquisitions == 0)
+      continue;
+    fprintf(output, "== Lock %s: %llu acquisitions, %llu contended,"
+            " wait total %llu us, p50 %llu, p99 %llu ns,"
+            " hold total %llu us, p50 %llu, p99 %llu ns\n",
+            classes[i]->name().c_str(),
+            static_cast<unsigned long long>(stats.acquisitions),
+            static_cast<unsigned long long>(stats.contended),
+            static_cast<unsigned long long>(stats.wait_nanos / 1000),
+            static_cast<unsigned long long>(
+                LockClass::Stats::Percentile(stats.wait_buckets, 0.5)),
+            static_cast<unsigned long long>(
+                LockClass::Stats::Percentile(stats.wait_buckets, 0.99)),
+            static_cast<unsigned long long>(stats.hold_nanos / 1000),
+            static_cast<unsigned long long>(
+                LockClass::Stats::Percentile(stats.hold_buckets, 0.5)),
+            static_cast<unsigned long long>(
+                LockClass::Stats::Percentile(stats.hold_buckets, 0.99)));
+    for (size_t j = 0; j < stats.top_tags.size(); ++j) {
+      fprintf(output, "  tag %-20llu waited %llu us\n",
+              static_cast<unsigned long long>(stats.top_tags[j].second),
+              static_cast<unsigned long long>(stats.top_tags[j].first / 1000));
+    }
+  }
+}
+
+} // namespace indexfs
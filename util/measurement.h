@@ -1,106 +1,181 @@
 // Copyright (c) 2014 The IndexFS Authors. All rights reserved.
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Latency measurements of the operations a server or client serves,
+// kept per operation type.
+//
+// AddMetric() is called from every RPC thread at once.  Each thread
+// records into one of kNumShards shards, picked once per thread, with
+// atomic increments only: recording takes no lock, and threads of
+// different shards touch different counters.  Latencies are counted in
+// log-linear buckets, kSubBuckets per power of two microseconds, so a
+// percentile read off the buckets is within 1/kSubBuckets of the truth.
+//
+// Reports merge the shards and give two views of every operation type:
+// the cumulative one, since start, and a sliding window over the last
+// window_size seconds or more.  The window is the difference between
+// the current counts and a snapshot taken at least window_size seconds
+// before, so nothing is ever cleared on the recording path.
 
 #ifndef MEASUREMENT_H_
 #define MEASUREMENT_H_
 
+#include <pthread.h>
+#include <stdint.h>
 #include <sstream>
-#include <iostream>
 #include <string>
 #include <vector>
 #include <cstdio>
-#include "leveldb/util/histogram.h"
+#include <ctime>
 #include "leveldb/env.h"
 
 namespace indexfs {
 
+// Merged latency counts of one operation type.
+class LatencySummary {
+public:
+  LatencySummary();
+
+  uint64_t Count() const { return count_; }
+  double Average() const;
+  double Max() const;
+  // Latency below which a fraction p (0 < p <= 1) of the operations fall
+  double Percentile(double p) const;
+
+  void Add(const uint64_t* buckets, uint64_t sum);
+  void Merge(const LatencySummary& other);
+  // Subtract "earlier" counts of the same operations
+  void Subtract(const LatencySummary& earlier);
+
+private:
+  std::vector<uint64_t> buckets_;
+  uint64_t count_;
+  uint64_t sum_;
+};
+
 class Measurement {
 public:
+  enum { kSubBits = 5 };
+  enum { kSubBuckets = 1 << kSubBits };
+  enum { kMaxExponent = 40 };  // Latencies over 2^41 us are clamped
+  enum { kNumBuckets = (kMaxExponent - kSubBits + 2) * kSubBuckets };
+  enum { kNumShards = 16 };
+
   Measurement(const std::vector<std::string> &metrics,
-              int server_id, int window_size = 5) :
-              server_id_(server_id), metrics_(metrics),
-              window_size_(window_size)  {
-    num_metrics_ = metrics.size() + 1;
-    metrics_.push_back(std::string("total"));
-    hists_ = new leveldb::Histogram[num_metrics_];
-    for (int i = 0; i < num_metrics_; ++i)
-      hists_[i].Clear();
-    count_ = new int[num_metrics_];
-    memset(count_, 0, sizeof(int) * num_metrics_);
-    window_start_ = 0;
-  }
+              int server_id, int window_size = 5);
+
+  virtual ~Measurement();
 
+  // Record an operation of type no_metric that took "latency" micros.
+  // Types out of range only count towards the total.
   void AddMetric(int no_metric, double latency) {
-    Check(no_metric);
-    if (no_metric >= 0 && no_metric < num_metrics_) {
-      hists_[no_metric].Add(latency);
-      count_[no_metric]++;
-    }
-    hists_[num_metrics_ - 1].Add(latency);
-    count_[num_metrics_ - 1]++;
+    if (no_metric < 0 || no_metric >= num_metrics_ - 1)
+      no_metric = num_metrics_ - 1;
+    uint64_t micros = latency > 0 ? static_cast<uint64_t>(latency) : 0;
+    Shard* shard = &shards_[ShardIndex()];
+    __sync_fetch_and_add(&shard->buckets[no_metric * kNumBuckets +
+                                         BucketIndex(micros)], 1);
+    __sync_fetch_and_add(&shard->sums[no_metric], micros);
   }
 
   void AddMetricNoCheck(int no_metric, double latency) {
-    if (no_metric >= 0 && no_metric < num_metrics_)
-      hists_[no_metric].Add(latency);
-    hists_[num_metrics_ - 1].Add(latency);
+    AddMetric(no_metric, latency);
   }
 
-  void GetStatus(std::stringstream &report) {
-    Check(-1);
-    time_t now = time(NULL);
-    for (int i = 0; i < num_metrics_; ++i) {
-      report << metrics_[i] << "_num" << " ";
-      report << now << " ";
-      report << count_[i];
-      report << " rank=" << server_id_  << '\n';
-      report << metrics_[i] << "_max_lat" << " ";
-      report << now << " ";
-      report << hists_[i].Max();
-      report << " rank=" << server_id_  << '\n';
-      report << metrics_[i] << "_avg_lat" << " ";
-      report << now << " ";
-      report << hists_[i].Average();
-      report << " rank=" << server_id_  << '\n';
-    }
+  // Append the cumulative count and the windowed latencies of every
+  // operation type to "report", one OpenTSDB put line each, followed by
+  // the lock profile.
+  void GetStatus(std::stringstream &report);
+
+  // Print the cumulative latencies, and the windowed ones if there is a
+  // window, of every operation type seen so far, followed by the lock
+  // profile.
+  void Print(FILE* output);
+
+  // Print the wait and hold times of every lock class, and the tags
+  // waited for the most.  Prints nothing unless built with
+  // LOCK_PROFILING; see port/lock_profile.h.
+  static void PrintLocks(FILE* output);
+
+  // Merged counts since start of every operation type; the last one
+  // is the total.
+  void GetSummaries(std::vector<LatencySummary>* summaries);
+
+  // Same as GetSummaries(), plus the window view of every type in
+  // "window".  Only reads the window: it moves on with the periodic
+  // reports and AdvanceWindow().
+  void GetWindowSummaries(std::vector<LatencySummary>* current,
+                          std::vector<LatencySummary>* window);
+
+  // Take a window snapshot of the current counts, as a report does.
+  void AdvanceWindow();
+
+  // Number of operation types, including the total, and their names
+  int NumMetrics() const { return num_metrics_; }
+  const std::string& MetricName(int no_metric) const {
+    return metrics_[no_metric];
   }
 
-  void Print(FILE* output) {
-    for (int i = 0; i < num_metrics_; ++i) {
-      fprintf(output, "== Latencies for %s ops:\n", metrics_[i].c_str());
-      fprintf(output, "%s\n", hists_[i].ToString().c_str());
+  static int BucketIndex(uint64_t micros) {
+    if (micros < kSubBuckets)
+      return static_cast<int>(micros);
+    int exponent = 63 - __builtin_clzll(micros);
+    if (exponent > kMaxExponent) {
+      exponent = kMaxExponent;
+      micros = (2ull << kMaxExponent) - 1;
     }
+    return (exponent - kSubBits + 1) * kSubBuckets +
+           static_cast<int>((micros >> (exponent - kSubBits)) - kSubBuckets);
   }
 
-  virtual ~Measurement() {
-    delete [] hists_;
-    delete [] count_;
-  }
+  // Smallest latency counted in bucket "index", and the one past it.
+  static uint64_t BucketLow(int index);
+  static uint64_t BucketHigh(int index);
 
 private:
+  struct Shard {
+    uint64_t* buckets;  // [num_metrics_][kNumBuckets]
+    uint64_t* sums;     // [num_metrics_]
+  };
+
+  struct Snapshot {
+    time_t time;
+    std::vector<LatencySummary> summaries;
+  };
+
   int num_metrics_;
-  int* count_;
   int server_id_;
-
-  leveldb::Histogram* hists_;
   std::vector<std::string> metrics_;
   int window_size_;
-  int window_start_;
-
-  void Check(int no_metric) {
-    if (window_size_ <= 0) return;
-    int now_time = time(NULL);
-    if (now_time - window_start_ > window_size_) {
-      if (no_metric < 0) {
-        for (int i = 0; i < num_metrics_; ++i)
-          hists_[i].Clear();
-      } else {
-        hists_[no_metric].Clear();
-      }
-      window_start_ = now_time;
-    }
-  }
+  Shard shards_[kNumShards];
+
+  // Reports are serialized; snapshots_ is ordered oldest first
+  pthread_mutex_t report_mu_;
+  std::vector<Snapshot> snapshots_;
+
+  static int ShardIndex();
+
+  // Append the acquisitions and the wait and hold time percentiles of
+  // every lock class to "report".
+  void GetLockStatus(time_t now, std::stringstream &report);
+
+  // Compute the window view out of the newest snapshot at least
+  // window_size_ seconds old, or the cumulative one if there is none.
+  void ReadWindow(time_t now, const std::vector<LatencySummary>& current,
+                  std::vector<LatencySummary>* window) const;
+
+  // Take a snapshot of "now", dropping those no longer usable as the
+  // start of a window.
+  void AddSnapshot(time_t now, const std::vector<LatencySummary>& current);
+
+  // ReadWindow() then AddSnapshot()
+  void GetWindow(time_t now, const std::vector<LatencySummary>& current,
+                 std::vector<LatencySummary>* window);
+
+  // No copying allowed
+  Measurement(const Measurement&);
+  void operator=(const Measurement&);
 };
 
 struct MeasurementHelper {
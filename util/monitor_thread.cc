@@ -12,6 +12,8 @@
 
 namespace indexfs {
 
+volatile sig_atomic_t MonitorThread::dump_requested_ = 0;
+
 static pthread_t CreateThread
     (void*(*func)(void*), void* arg) {
   pthread_t tid;
@@ -59,13 +61,24 @@ void MonitorThread::SendMetrics() {
                      std::string("127.0.0.1"), 10600);
     } catch (leveldb::SocketException &e) {
     }
+  } else {
+    // GetStatus() moves the window on; keep it moving for GetStats()
+    measure_->AdvanceWindow();
   }
 }
 
 void* MonitorThread::Run(void* arg) {
   MonitorThread* mon = reinterpret_cast<MonitorThread*>(arg);
   while (!mon->done_) {
-    leveldb::Env::Default()->SleepForMicroseconds(mon->frequency_*1000000);
+    // Sleep in short steps so that dumps are not held up for a whole period
+    for (int i = 0; i < mon->frequency_ * 10 && !mon->done_; ++i) {
+      leveldb::Env::Default()->SleepForMicroseconds(100000);
+      if (dump_requested_) {
+        dump_requested_ = 0;
+        mon->measure_->Print(stderr);
+        fflush(stderr);
+      }
+    }
     mon->SendMetrics();
   };
   return 0;
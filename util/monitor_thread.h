@@ -5,6 +5,7 @@
 #ifndef MONITORTHREAD_H_
 #define MONITORTHREAD_H_
 
+#include <signal.h>
 #include "measurement.h"
 #include "leveldb/util/socket.h"
 
@@ -25,6 +26,10 @@ public:
 
   void Stop();
 
+  // Make the monitor thread print the measurement to stderr on its next
+  // wake-up.  Safe to call from a signal handler.
+  static void RequestDump() { dump_requested_ = 1; }
+
 private:
   bool IsDone() { return done_; }
 
@@ -33,6 +38,8 @@ private:
   void SendMetrics();
 
   static void* Run(void* arg);
+
+  static volatile sig_atomic_t dump_requested_;
   // the followsings are used only by the main thread
   //
   Measurement* measure_;
@@ -0,0 +1,171 @@
+// Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "trace.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+namespace indexfs {
+
+namespace {
+
+int sample_every = 0;
+uint64_t slow_micros = 0;
+FILE* slow_log = NULL;
+uint64_t next_trace_id = 0;
+pthread_mutex_t log_mu = PTHREAD_MUTEX_INITIALIZER;
+
+pthread_once_t key_once = PTHREAD_ONCE_INIT;
+pthread_key_t state_key;
+
+void FreeThreadState(void* state) {
+  free(state);
+}
+
+void InitStateKey() {
+  pthread_key_create(&state_key, &FreeThreadState);
+}
+
+struct SpanStartOrder {
+  template <typename T>
+  bool operator()(const T& a, const T& b) const { return a.start < b.start; }
+};
+
+} // namespace
+
+__thread uint64_t Tracer::current_ = 0;
+__thread uint64_t Tracer::pending_ = 0;
+
+void Tracer::Configure(int every, uint64_t micros, FILE* log) {
+  // Trace IDs of different processes should not collide
+  next_trace_id = (static_cast<uint64_t>(getpid()) << 40) ^
+                  (NowMicros() << 8);
+  slow_micros = micros;
+  slow_log = log;
+  sample_every = every;
+}
+
+uint64_t Tracer::NowMicros() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+Tracer::ThreadState* Tracer::GetThreadState() {
+  static __thread ThreadState* state = NULL;
+  if (state == NULL) {
+    pthread_once(&key_once, &InitStateKey);
+    // Allocated with calloc so that the ring does not cost memory until
+    // it is used
+    state = static_cast<ThreadState*>(calloc(1, sizeof(ThreadState)));
+    state->countdown = sample_every > 0 ? 1 + rand() % sample_every : 0;
+    pthread_setspecific(state_key, state);
+  }
+  return state;
+}
+
+void Tracer::SetPending(uint64_t trace_id) {
+  // A thread already tracing is calling its own server locally
+  if (current_ == 0)
+    pending_ = trace_id;
+}
+
+uint64_t Tracer::Begin() {
+  ThreadState* state = GetThreadState();
+  uint64_t trace_id = pending_;
+  pending_ = 0;
+  if (trace_id == 0 && sample_every > 0 && --state->countdown <= 0) {
+    state->countdown = sample_every;
+    trace_id = __sync_add_and_fetch(&next_trace_id, 1);
+  }
+  return trace_id;
+}
+
+void Tracer::Record(const char* name, uint64_t start, uint64_t end) {
+  if (current_ == 0)
+    return;
+  ThreadState* state = GetThreadState();
+  Span* span = &state->ring[state->num_spans % kRingSize];
+  span->trace_id = current_;
+  span->name = name;
+  span->start = start;
+  span->end = end;
+  state->num_spans++;
+}
+
+void Tracer::LogSlow(const char* op, uint64_t trace_id, uint64_t num_spans,
+                     uint64_t start, uint64_t end) {
+  if (slow_log == NULL)
+    return;
+  ThreadState* state = GetThreadState();
+  if (state->num_spans - num_spans > kRingSize)
+    num_spans = state->num_spans - kRingSize;
+  std::vector<Span> spans;
+  for (uint64_t i = num_spans; i < state->num_spans; ++i) {
+    const Span& span = state->ring[i % kRingSize];
+    if (span.trace_id == trace_id)
+      spans.push_back(span);
+  }
+  std::stable_sort(spans.begin(), spans.end(), SpanStartOrder());
+
+  pthread_mutex_lock(&log_mu);
+  fprintf(slow_log, "slow op %s: trace %016llx, %llu us\n", op,
+          static_cast<unsigned long long>(trace_id),
+          static_cast<unsigned long long>(end - start));
+  for (size_t i = 0; i < spans.size(); ++i) {
+    fprintf(slow_log, "  +%-8llu %-20s %llu us\n",
+            static_cast<unsigned long long>(spans[i].start - start),
+            spans[i].name,
+            static_cast<unsigned long long>(spans[i].end - spans[i].start));
+  }
+  fflush(slow_log);
+  pthread_mutex_unlock(&log_mu);
+}
+
+TraceScope::TraceScope(const char* op) :
+  op_(op), trace_id_(Tracer::Current()), outermost_(false),
+  first_span_(0), start_(0) {
+  if (trace_id_ == 0) {
+    trace_id_ = Tracer::Begin();
+    outermost_ = true;
+  }
+  if (trace_id_ != 0) {
+    Tracer::current_ = trace_id_;
+    first_span_ = Tracer::GetThreadState()->num_spans;
+    start_ = Tracer::NowMicros();
+  }
+}
+
+TraceScope::~TraceScope() {
+  if (trace_id_ == 0)
+    return;
+  uint64_t end = Tracer::NowMicros();
+  if (outermost_) {
+    if (end - start_ >= slow_micros)
+      Tracer::LogSlow(op_, trace_id_, first_span_, start_, end);
+    Tracer::current_ = 0;
+  } else {
+    Tracer::Record(op_, start_, end);
+  }
+}
+
+} // namespace indexfs
+
+extern "C" {
+
+uint64_t trace_start(void) {
+  return indexfs::Tracer::Current() != 0 ? indexfs::Tracer::NowMicros() : 0;
+}
+
+void trace_record(const char* name, uint64_t start) {
+  if (start != 0)
+    indexfs::Tracer::Record(name, start, indexfs::Tracer::NowMicros());
+}
+
+}  // extern "C"
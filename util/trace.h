@@ -0,0 +1,133 @@
+// Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Sampled tracing of single operations across client and servers.
+//
+// A TraceScope marks one operation.  One in every "sample_every" of the
+// outermost scopes of a thread starts a trace, identified by a random
+// trace ID; while it lasts, TraceSpans record how long the steps of the
+// operation took into a ring buffer owned by the thread.  Spans cost a
+// thread-local read when the thread is not tracing.
+//
+// The trace ID goes along with the RPCs made by a traced operation:
+// the caller sends it with SetTrace() right before the RPC, and the
+// scope of the handler serving the RPC joins the trace instead of
+// sampling on its own.  Operations slower than "slow_micros" print their
+// spans to the slow op log, so the client and server parts of a slow
+// operation can be matched up by trace ID.
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+#include <cstdio>
+#include "trace_c.h"
+
+namespace indexfs {
+
+class Tracer {
+public:
+  enum { kRingSize = 1024 };
+
+  // Trace one in every sample_every operations, or none if it is not
+  // positive, and print the spans of traced operations that take
+  // slow_micros or more to slow_log.
+  static void Configure(int sample_every, uint64_t slow_micros,
+                        FILE* slow_log);
+
+  // ID of the trace the current thread is in, or 0
+  static uint64_t Current() { return current_; }
+
+  // Make the next outermost TraceScope of the current thread join trace
+  // "trace_id" instead of sampling on its own.
+  static void SetPending(uint64_t trace_id);
+
+  // Drop the ID set by SetPending() if no TraceScope has taken it, as
+  // when the call it came with failed or does not trace.
+  static void ClearPending() { pending_ = 0; }
+
+  // Record a span of the current trace
+  static void Record(const char* name, uint64_t start, uint64_t end);
+
+  static uint64_t NowMicros();
+
+private:
+  friend class TraceScope;
+
+  struct Span {
+    uint64_t trace_id;
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+  };
+
+  struct ThreadState {
+    int countdown;        // Operations to go before the next sample
+    uint64_t num_spans;   // Spans recorded so far; the ring has the last ones
+    Span ring[kRingSize];
+  };
+
+  static __thread uint64_t current_;
+  static __thread uint64_t pending_;
+
+  static ThreadState* GetThreadState();
+
+  // Start a trace if the current operation is due for a sample or has a
+  // pending ID; returns the trace ID, or 0.
+  static uint64_t Begin();
+
+  // Print the spans of trace_id recorded since the num_spans'th one
+  static void LogSlow(const char* op, uint64_t trace_id, uint64_t num_spans,
+                      uint64_t start, uint64_t end);
+
+  Tracer();
+};
+
+// Marks one operation; see above.  Scopes inside a traced operation
+// record a span and nothing more.
+class TraceScope {
+public:
+  explicit TraceScope(const char* op);
+  ~TraceScope();
+
+private:
+  const char* op_;
+  uint64_t trace_id_;    // 0 if not traced
+  bool outermost_;
+  uint64_t first_span_;
+  uint64_t start_;
+
+  TraceScope(const TraceScope&);
+  void operator=(const TraceScope&);
+};
+
+// Records the time from its construction up to End(), or to its
+// destruction, as a span of the current trace.
+class TraceSpan {
+public:
+  explicit TraceSpan(const char* name) : name_(name), start_(0) {
+    if (Tracer::Current() != 0)
+      start_ = Tracer::NowMicros();
+  }
+
+  ~TraceSpan() { End(); }
+
+  void End() {
+    if (start_ != 0) {
+      Tracer::Record(name_, start_, Tracer::NowMicros());
+      start_ = 0;
+    }
+  }
+
+private:
+  const char* name_;
+  uint64_t start_;
+
+  TraceSpan(const TraceSpan&);
+  void operator=(const TraceSpan&);
+};
+
+} // namespace indexfs
+
+#endif /* TRACE_H_ */
@@ -0,0 +1,32 @@
+/* Copyright (c) 2014 The IndexFS Authors. All rights reserved.
+   Use of this source code is governed by a BSD-style license that can be
+   found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+   C interface to the spans of util/trace.h, for the metadb backend.
+   Typical use:
+
+     uint64_t start = trace_start();
+     ...
+     trace_record("leveldb_put", start);
+
+   trace_start() returns 0 when the calling thread is not tracing, in
+   which case trace_record() does nothing.
+*/
+
+#ifndef TRACE_C_H_
+#define TRACE_C_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern uint64_t trace_start(void);
+extern void trace_record(const char* name, uint64_t start);
+
+#ifdef __cplusplus
+}  /* end extern "C" */
+#endif
+
+#endif /* TRACE_C_H_ */